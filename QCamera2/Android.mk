@@ -10,8 +10,13 @@ LOCAL_COPY_HEADERS := QCameraFormat.h
 LOCAL_SRC_FILES := \
         util/QCameraCmdThread.cpp \
         util/QCameraQueue.cpp \
+        util/QCameraExecutor.cpp \
         util/QCameraBufferMaps.cpp \
+        util/QCameraBufferAllocator.cpp \
+        util/QCameraMemBudget.cpp \
         util/QCameraFlash.cpp \
+        util/QCameraStreamStats.cpp \
+        util/QCameraRowCopy.cpp \
         QCamera2Hal.cpp \
         QCamera2Factory.cpp
 
@@ -46,6 +46,7 @@
 #include "QCamera2HWI.h"
 #include "QCameraBufferMaps.h"
 #include "QCameraMem.h"
+#include "QCameraMemBudget.h"
 
 #define MAP_TO_DRIVER_COORDINATE(val, base, scale, offset) \
   ((int32_t)val * (int32_t)scale / (int32_t)base + (int32_t)offset)
@@ -360,6 +361,7 @@ int QCamera2HardwareInterface::start_preview(struct camera_device *device)
     ALOGI("[KPI Perf] %s: E PROFILE_START_PREVIEW camera id %d",
             __func__, hw->getCameraId());
     hw->lockAPI();
+    hw->mPreviewStartTime = systemTime();
     qcamera_api_result_t apiResult;
     qcamera_sm_evt_enum_t evt = QCAMERA_SM_EVT_START_PREVIEW;
     if (hw->isNoDisplayMode()) {
@@ -370,9 +372,14 @@ int QCamera2HardwareInterface::start_preview(struct camera_device *device)
         hw->waitAPIResult(evt, &apiResult);
         ret = apiResult.status;
     }
+    hw->mStartPreviewLatency = systemTime() - hw->mPreviewStartTime;
     hw->unlockAPI();
     hw->m_bPreviewStarted = true;
-    ALOGI("[KPI Perf] %s: X", __func__);
+    cam_dimension_t dim;
+    hw->mParameters.getStreamDimension(CAM_STREAM_TYPE_PREVIEW, dim);
+    ALOGI("[KPI Perf] %s: X preview %dx%d in %lld us", __func__,
+            dim.width, dim.height,
+            (long long)(hw->mStartPreviewLatency / 1000));
     return ret;
 }
 
@@ -1567,7 +1574,11 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
       m_postprocessor(this),
       m_thermalAdapter(QCameraThermalAdapter::getInstance()),
       m_cbNotifier(this),
+      m_memoryPool(cameraId),
       m_bPreviewStarted(false),
+      mPreviewStartTime(0),
+      mStartPreviewLatency(0),
+      mFirstFrameLatency(0),
       m_bRecordStarted(false),
       m_currentFocusState(CAM_AF_STATE_INACTIVE),
       m_pPowerModule(NULL),
@@ -1615,6 +1626,7 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
       mNumPreviewFaces(-1),
       mJpegClientHandle(0),
       mJpegHandleOwner(false),
+      mJpegWorkBufSize(0),
       mCACDoneReceived(false),
       mMetadataMem(NULL),
       mBootToMonoTimestampOffset(0)
@@ -1680,6 +1692,12 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
 
     pthread_mutex_init(&mGrallocLock, NULL);
     mEnqueuedBuffers = 0;
+    char value[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.display.async", value, "1");
+    mAsyncDisplay = (atoi(value) > 0);
+
+    pthread_mutex_init(&mPreviewCbLock, NULL);
+    mPreviewCbPool = NULL;
 }
 
 /*===========================================================================
@@ -1707,6 +1725,8 @@ QCamera2HardwareInterface::~QCamera2HardwareInterface()
     unlockAPI();
     m_stateMachine.releaseThread();
     closeCamera();
+    retirePreviewCbPool();
+    pthread_mutex_destroy(&mPreviewCbLock);
     pthread_mutex_destroy(&m_lock);
     pthread_cond_destroy(&m_cond);
     pthread_mutex_destroy(&m_evtLock);
@@ -1877,6 +1897,21 @@ int QCamera2HardwareInterface::openCamera()
     memset(&args, 0, sizeof(args));
     mParamInitJob = queueDeferredWork(CMD_DEF_PARAM_INIT, args);
 
+    // Refill the buffer pool with what the previous session of this
+    // camera used, so the first preview/snapshot/video switch can skip
+    // the allocator
+    property_get("persist.camera.mem.usepool", value, "1");
+    if (atoi(value) == 1) {
+        property_get("persist.camera.mem.prewarm", value, "1");
+        if (atoi(value) == 1) {
+            m_memoryPool.prewarm();
+        }
+    }
+
+    // idle pool and cache buffers are the first thing given back when
+    // the HAL goes over its memory budget
+    QCameraMemBudget::getInstance().addSession(reclaimIdleMemory, this);
+
     mCameraOpened = true;
 
     //Notify display HAL that a camera session is active.
@@ -2162,6 +2197,10 @@ int QCamera2HardwareInterface::closeCamera()
         }
     }
 
+    // buffer sets kept for restarts die with the session
+    m_bufCache.clear();
+    QCameraMemBudget::getInstance().removeSession(this);
+
     //free all pending api results here
     if(m_apiResultList != NULL) {
         api_result_list *apiResultList = m_apiResultList;
@@ -2511,7 +2550,8 @@ uint8_t QCamera2HardwareInterface::getBufNumRequired(cam_stream_type_t stream_ty
             //if its 4K encoding usecase, then add extra buffer
             cam_dimension_t dim;
             mParameters.getStreamDimension(CAM_STREAM_TYPE_VIDEO, dim);
-            if (is4k2kResolution(&dim)) {
+            if (is4k2kResolution(&dim) && (mParameters.getMemPressure() ==
+                    QCAMERA_MEM_PRESSURE_NORMAL)) {
                  //get additional buffer count
                  property_get("vidc.enc.dcvs.extra-buff-count", value, "0");
                  bufferCnt += atoi(value);
@@ -2752,15 +2792,33 @@ QCameraMemory *QCamera2HardwareInterface::allocateStreamBuf(
         return NULL;
     }
 
+    uint32_t secureMode = NON_SECURE;
+    if (mParameters.isSecureMode() &&
+        (stream_type == CAM_STREAM_TYPE_RAW) &&
+        (mParameters.isRdiMode())) {
+        secureMode = SECURE;
+    }
+
+    // A set left behind by an earlier stream with the same layout is
+    // already allocated, mapped and registered with the framework.
+    // The cache only holds non secure sets.
+    qcamera_buf_cache_key_t key;
+    if ((bufferCnt > 0) && (NON_SECURE == secureMode) &&
+            getBufCacheKey(stream_type, mem, size, stride,
+            scanline, bufferCnt, key)) {
+        QCameraMemory *cachedMem = m_bufCache.acquire(key);
+        if (cachedMem != NULL) {
+            delete mem;
+            bufferCnt = cachedMem->getCnt();
+            return cachedMem;
+        }
+    }
+
     if (bufferCnt > 0) {
-        if (mParameters.isSecureMode() &&
-            (stream_type == CAM_STREAM_TYPE_RAW) &&
-            (mParameters.isRdiMode())) {
+        if (SECURE == secureMode) {
             ALOGD("%s: Allocating %d secure buffers of size %d ", __func__, bufferCnt, size);
-            rc = mem->allocate(bufferCnt, size, SECURE);
-        } else {
-            rc = mem->allocate(bufferCnt, size, NON_SECURE);
         }
+        rc = mem->allocate(bufferCnt, size, secureMode);
         if (rc < 0) {
             delete mem;
             return NULL;
@@ -2770,6 +2828,105 @@ QCameraMemory *QCamera2HardwareInterface::allocateStreamBuf(
     return mem;
 }
 
+/*===========================================================================
+ * FUNCTION   : getBufCacheKey
+ *
+ * DESCRIPTION: describe a stream buffer set for the stream buffer cache
+ *
+ * PARAMETERS :
+ *   @stream_type  : type of stream
+ *   @mem          : memory object of the set
+ *   @size         : size of buffer
+ *   @stride       : stride of buffer
+ *   @scanline     : scanline of buffer
+ *   @bufferCnt    : number of buffers in the set
+ *   @key          : [output] cache key
+ *
+ * RETURN     : true if the set can be kept in the cache
+ *==========================================================================*/
+bool QCamera2HardwareInterface::getBufCacheKey(cam_stream_type_t stream_type,
+        QCameraMemory *mem, size_t size, int stride, int scanline,
+        uint8_t bufferCnt, qcamera_buf_cache_key_t &key)
+{
+    // gralloc and metadata buffers have their own life cycle, secure
+    // buffers must never outlive the secure session. Judge by how the set
+    // was allocated, the app may have left secure mode since.
+    if (!mem->isReusable() || (CAM_STREAM_TYPE_METADATA == stream_type) ||
+            mem->isSecure()) {
+        return false;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.streamType = stream_type;
+    mParameters.getStreamFormat(stream_type, key.format);
+    key.size = size;
+    key.stride = stride;
+    key.scanline = scanline;
+    key.bufferCnt = bufferCnt;
+    key.cached = mem->isCached();
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : reclaimIdleMemory
+ *
+ * DESCRIPTION: memory budget callback, frees buffers this session keeps
+ *              around without using them: the stream buffer cache and the
+ *              idle part of the memory pool
+ *
+ * PARAMETERS :
+ *   @data    : ptr to QCamera2HardwareInterface
+ *
+ * RETURN     : bytes freed
+ *==========================================================================*/
+size_t QCamera2HardwareInterface::reclaimIdleMemory(void *data)
+{
+    QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)data;
+    size_t freed = 0;
+
+    if (pme != NULL) {
+        freed += pme->m_bufCache.clear();
+        freed += pme->m_memoryPool.reclaim();
+        CDBG_HIGH("%s: camera %d freed %zu bytes", __func__,
+                pme->mCameraId, freed);
+    }
+    return freed;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseStreamBuf
+ *
+ * DESCRIPTION: return stream buffers of a stream being torn down. Compatible
+ *              sets are kept in the session buffer cache for the next
+ *              stream, everything else is freed.
+ *
+ * PARAMETERS :
+ *   @stream_type  : type of stream
+ *   @mem_obj      : memory object ptr
+ *   @size         : size of buffer
+ *   @stride       : stride of buffer
+ *   @scanline     : scanline of buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::releaseStreamBuf(cam_stream_type_t stream_type,
+        QCameraMemory *mem_obj, size_t size, int stride, int scanline)
+{
+    qcamera_buf_cache_key_t key;
+
+    if (mem_obj == NULL) {
+        return;
+    }
+
+    if (getBufCacheKey(stream_type, mem_obj, size, stride, scanline,
+            mem_obj->getCnt(), key) && m_bufCache.release(key, mem_obj)) {
+        return;
+    }
+
+    mem_obj->deallocate();
+    delete mem_obj;
+}
+
 /*===========================================================================
  * FUNCTION   : allocateMoreStreamBuf
  *
@@ -3329,6 +3486,7 @@ int QCamera2HardwareInterface::startPreview()
     }
 
     updatePostPreviewParameters();
+    updatePreviewFrameLayout();
 
     // if job id is non-zero, that means the postproc init job is already
     // pending or complete
@@ -3377,7 +3535,15 @@ int QCamera2HardwareInterface::stopPreview()
     stopChannel(QCAMERA_CH_TYPE_ZSL);
     stopChannel(QCAMERA_CH_TYPE_PREVIEW);
 
+    // no frame reaches the display thread any more, stop it before
+    // the preview buffers are unmapped
+    QCameraGrallocMemory *displayMem = getPreviewDisplayMem();
+    if (displayMem != NULL) {
+        displayMem->stopDisplay();
+    }
+
     m_cbNotifier.flushPreviewNotifications();
+    retirePreviewCbPool();
     //add for ts makeup
 #ifdef TARGET_TS_MAKEUP
     ts_makeup_finish();
@@ -5551,8 +5717,52 @@ int QCamera2HardwareInterface::dump(int fd)
     dprintf(fd, "StoreMetaDataInFrame: %d \n", mStoreMetaDataInFrame);
     dprintf(fd, "\n Configuration: %s", mParameters.dump().string());
     dprintf(fd, "\n State Information: %s", m_stateMachine.dump().string());
+
+    dprintf(fd, "\n Stream latency stats:");
+    for (int i = 0; i < QCAMERA_CH_TYPE_MAX; i++) {
+        if (m_channels[i] == NULL) {
+            continue;
+        }
+        for (uint32_t j = 0; j < m_channels[i]->getNumOfStreams(); j++) {
+            QCameraStream *stream = m_channels[i]->getStreamByIndex(j);
+            if (stream != NULL) {
+                stream->dumpStats(fd);
+            }
+        }
+    }
+    m_memoryPool.dump(fd);
+    m_bufCache.dump(fd);
+    QCameraMemBudget::getInstance().dump(fd);
+    QCameraBufferAllocator::getInstance().dumpCacheStats(fd);
+    dprintf(fd, "\n Last startPreview: %lld us, first frame after %lld us\n",
+            (long long)(mStartPreviewLatency / 1000),
+            (long long)(mFirstFrameLatency / 1000));
+    QCameraGrallocMemory *displayMem = getPreviewDisplayMem();
+    if (displayMem != NULL) {
+        qcamera_display_stats_t stats;
+        displayMem->getDisplayStats(stats);
+        dprintf(fd, " Display: queued %u displayed %u dropped %u returned %u\n",
+                stats.queued, stats.displayed, stats.dropped, stats.returned);
+        dprintf(fd, " Display stalls: enqueue %u dequeue %u total %lld us "
+                "max %lld us, dequeue misses %u\n",
+                stats.enqueueStalls, stats.dequeueStalls,
+                (long long)(stats.stallTime / 1000),
+                (long long)(stats.maxStall / 1000), stats.dequeueMisses);
+    }
+    pthread_mutex_lock(&mPreviewCbLock);
+    if (mPreviewCbPool != NULL) {
+        mPreviewCbPool->dump(fd);
+    }
+    pthread_mutex_unlock(&mPreviewCbLock);
     dprintf(fd, "\n Camera HAL information End \n");
 
+    if (gMmCameraTraceLevel > 0) {
+        // chrome trace JSON of the recorded frame lifecycle events
+        dprintf(fd, "\n Camera trace Begin \n");
+        mm_camera_trace_dump(fd);
+        dprintf(fd, " Camera trace End \n");
+    }
+
     /* send UPDATE_DEBUG_LEVEL to the backend so that they can read the
        debug level property */
     pthread_mutex_lock(&m_parm_lock);
@@ -6608,6 +6818,10 @@ int32_t QCamera2HardwareInterface::addPreviewChannel()
                                     preview_stream_cb_routine, this);
             pChannel->setStreamSyncCB(CAM_STREAM_TYPE_PREVIEW,
                     synchronous_stream_cb_routine);
+            if (!mAsyncDisplay) {
+                // preview_stream_cb_routine dequeues from the window
+                pChannel->setStreamBlockingCB(CAM_STREAM_TYPE_PREVIEW);
+            }
         }
     }
 
@@ -6860,6 +7074,12 @@ int32_t QCamera2HardwareInterface::addZSLChannel()
         CDBG_HIGH("%s: Enabling frame sync for dual camera, camera Id: %d",
                 __func__, mCameraId);
         attr.enable_frame_sync = 1;
+        // Both related sessions pick the lower session id as sync group
+        uint32_t sessionId = 0;
+        uint32_t relatedId = getRelatedCamSyncInfo()->related_sensor_session_id;
+        if (getCameraSessionId(&sessionId) == NO_ERROR) {
+            attr.frame_sync_id = (sessionId < relatedId) ? sessionId : relatedId;
+        }
     }
     rc = pChannel->init(&attr,
                         zsl_channel_cb,
@@ -6887,6 +7107,10 @@ int32_t QCamera2HardwareInterface::addZSLChannel()
                                 preview_stream_cb_routine, this);
         pChannel->setStreamSyncCB(CAM_STREAM_TYPE_PREVIEW,
                 synchronous_stream_cb_routine);
+        if (!mAsyncDisplay) {
+            // preview_stream_cb_routine dequeues from the window
+            pChannel->setStreamBlockingCB(CAM_STREAM_TYPE_PREVIEW);
+        }
     }
     if (rc != NO_ERROR) {
         ALOGE("%s: add preview stream failed, ret = %d", __func__, rc);
@@ -7010,6 +7234,10 @@ int32_t QCamera2HardwareInterface::addCaptureChannel()
         }
         pChannel->setStreamSyncCB(CAM_STREAM_TYPE_PREVIEW,
                 synchronous_stream_cb_routine);
+        if (!mAsyncDisplay) {
+            // preview_stream_cb_routine dequeues from the window
+            pChannel->setStreamBlockingCB(CAM_STREAM_TYPE_PREVIEW);
+        }
     }
 
     if (!mParameters.getofflineRAW()) {
@@ -7698,6 +7926,152 @@ int32_t QCamera2HardwareInterface::stopChannel(qcamera_ch_type_enum_t ch_type)
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : getPreviewDisplayMem
+ *
+ * DESCRIPTION: get the gralloc memory of the running preview stream
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : ptr to the gralloc memory, NULL if there is none
+ *==========================================================================*/
+QCameraGrallocMemory *QCamera2HardwareInterface::getPreviewDisplayMem()
+{
+    qcamera_ch_type_enum_t chTypes[] = {QCAMERA_CH_TYPE_ZSL,
+            QCAMERA_CH_TYPE_PREVIEW};
+
+    if (isNoDisplayMode()) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sizeof(chTypes) / sizeof(chTypes[0]); i++) {
+        QCameraChannel *pChannel = m_channels[chTypes[i]];
+        if (pChannel == NULL) {
+            continue;
+        }
+        for (uint32_t j = 0; j < pChannel->getNumOfStreams(); j++) {
+            QCameraStream *pStream = pChannel->getStreamByIndex(j);
+            if ((pStream != NULL) &&
+                    pStream->isTypeOf(CAM_STREAM_TYPE_PREVIEW)) {
+                return (QCameraGrallocMemory *)pStream->getStreamBufs();
+            }
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : getPreviewCbBuffer
+ *
+ * DESCRIPTION: get a buffer for a preview data callback from the pool of
+ *              the current preview session, created on first use
+ *
+ * PARAMETERS :
+ *   @size    : size of the frame the app sees
+ *   @fd      : stream buffer fd to map the frame in place,
+ *              -1 for a buffer to compact the frame into
+ *   @idx     : stream buffer index, used with fd only
+ *   @token   : returns the user data for QCameraCallbackBufPool::releaseBuffer
+ *
+ * RETURN     : camera memory, NULL if the pool can't serve the frame and
+ *              the caller needs to fall back to mGetMemory
+ *==========================================================================*/
+camera_memory_t *QCamera2HardwareInterface::getPreviewCbBuffer(size_t size,
+        int fd, uint32_t idx, void **token)
+{
+    camera_memory_t *mem = NULL;
+
+    pthread_mutex_lock(&mPreviewCbLock);
+    if ((mPreviewCbPool != NULL) && (fd < 0) &&
+            (mPreviewCbPool->getSize() != size)) {
+        // compacted size changed, callbacks in flight keep the old pool
+        mPreviewCbPool->retire();
+        mPreviewCbPool = NULL;
+    }
+    if (mPreviewCbPool == NULL) {
+        char value[PROPERTY_VALUE_MAX];
+        property_get("persist.camera.preview.cb.bufs", value, "4");
+        uint32_t count = (uint32_t)atoi(value);
+        mPreviewCbPool = new QCameraCallbackBufPool(mGetMemory,
+                mCallbackCookie, (fd < 0) ? size : 0, count);
+    }
+    if (mPreviewCbPool != NULL) {
+        if (fd < 0) {
+            mem = mPreviewCbPool->getBuffer(token);
+        } else {
+            mem = mPreviewCbPool->getMapping(fd, idx, size, token);
+        }
+    }
+    pthread_mutex_unlock(&mPreviewCbLock);
+
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : retirePreviewCbPool
+ *
+ * DESCRIPTION: end the preview callback buffer pool of a preview session.
+ *              Buffers still with the app are freed on their release.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::retirePreviewCbPool()
+{
+    pthread_mutex_lock(&mPreviewCbLock);
+    if (mPreviewCbPool != NULL) {
+        mPreviewCbPool->retire();
+        mPreviewCbPool = NULL;
+    }
+    pthread_mutex_unlock(&mPreviewCbLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : updatePreviewFrameLayout
+ *
+ * DESCRIPTION: publish stride and scanline of the stream feeding preview
+ *              callbacks, for apps that take strided preview frames
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::updatePreviewFrameLayout()
+{
+    qcamera_ch_type_enum_t chTypes[] = {QCAMERA_CH_TYPE_CALLBACK,
+            QCAMERA_CH_TYPE_ZSL, QCAMERA_CH_TYPE_PREVIEW};
+
+    if (!mParameters.isStridedPreviewFrames()) {
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(chTypes) / sizeof(chTypes[0]); i++) {
+        QCameraChannel *pChannel = m_channels[chTypes[i]];
+        if (pChannel == NULL) {
+            continue;
+        }
+        for (uint32_t j = 0; j < pChannel->getNumOfStreams(); j++) {
+            QCameraStream *pStream = pChannel->getStreamByIndex(j);
+            if ((pStream == NULL) ||
+                    !(pStream->isTypeOf(CAM_STREAM_TYPE_CALLBACK) ||
+                    pStream->isTypeOf(CAM_STREAM_TYPE_PREVIEW))) {
+                continue;
+            }
+            cam_stream_info_t *streamInfo = reinterpret_cast<cam_stream_info_t *>
+                    (pStream->getStreamInfoBuf()->getPtr(0));
+            if (streamInfo != NULL) {
+                pthread_mutex_lock(&m_parm_lock);
+                mParameters.setPreviewFrameLayout(
+                        streamInfo->buf_planes.plane_info.mp[0].stride,
+                        streamInfo->buf_planes.plane_info.mp[0].scanline);
+                pthread_mutex_unlock(&m_parm_lock);
+            }
+            return;
+        }
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : preparePreview
  *
@@ -7715,6 +8089,9 @@ int32_t QCamera2HardwareInterface::preparePreview()
     int32_t rc = NO_ERROR;
 
     pthread_mutex_lock(&m_parm_lock);
+    // buffer counts of the streams below follow the memory pressure
+    // sampled here
+    mParameters.updateMemPressure();
     rc = mParameters.setStreamConfigure(false, false, false);
     if (rc != NO_ERROR) {
         ALOGE("%s: setStreamConfigure failed %d", __func__, rc);
@@ -9091,9 +9468,9 @@ void *QCamera2HardwareInterface::deferredWorkRoutine(void *obj)
 
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
+                ALOGE("%s: waitCmd error (%s)",
                         __func__, strerror(errno));
                 return NULL;
             }
@@ -9110,7 +9487,7 @@ void *QCamera2HardwareInterface::deferredWorkRoutine(void *obj)
             CDBG_HIGH("%s: stop data proc", __func__);
             is_active = FALSE;
             // signal cmd is completed
-            cam_sem_post(&cmdThread->sync_sem);
+            cmdThread->sync_sem.post();
             break;
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
             {
@@ -9444,6 +9821,14 @@ int32_t QCamera2HardwareInterface::initJpegHandle() {
         // Set JPEG initialized as true to signify that this camera
         // has initialized the handle
         mJpegHandleOwner = true;
+        // With MPO ops the jpeg library allocates its own work buffer
+        // for the max picture size, account for it in the budget
+        if (getRelatedCamSyncInfo()->sync_control == CAM_SYNC_RELATED_SENSORS_ON) {
+            mJpegWorkBufSize = (size_t)CEILING64(max_size.w) *
+                    (size_t)CEILING64(max_size.h) * 3 / 2;
+            QCameraMemBudget::getInstance().charge(
+                    QCAMERA_MEM_CLASS_JPEG_WORK, mJpegWorkBufSize);
+        }
     }
     CDBG_HIGH("%s: X mJpegHandleOwner: %d, mJpegClientHandle: %d camera id: %d",
             __func__, mJpegHandleOwner, mJpegClientHandle, mCameraId);
@@ -9472,6 +9857,11 @@ int32_t QCamera2HardwareInterface::deinitJpegHandle() {
         memset(&mJpegHandle, 0, sizeof(mJpegHandle));
         memset(&mJpegMpoHandle, 0, sizeof(mJpegMpoHandle));
         mJpegHandleOwner = false;
+        if (mJpegWorkBufSize > 0) {
+            QCameraMemBudget::getInstance().uncharge(
+                    QCAMERA_MEM_CLASS_JPEG_WORK, mJpegWorkBufSize);
+            mJpegWorkBufSize = 0;
+        }
     }
     mJpegClientHandle = 0;
     CDBG_HIGH("%s: X rc = %d", __func__, rc);
@@ -9747,6 +10137,7 @@ void QCamera2HardwareInterface::getLogLevel()
 
     property_get("persist.camera.kpi.debug", prop, "1");
     gKpiDebugLevel = atoi(prop);
+    mm_camera_trace_update_level();
 
     /* Highest log level among hal.logs and global.logs is selected */
     if (gCamHalLogLevel < globalLogLevel)
@@ -308,6 +308,8 @@ public:
             size_t size, int stride, int scanline, uint8_t &bufferCnt);
     virtual int32_t allocateMoreStreamBuf(QCameraMemory *mem_obj,
             size_t size, uint8_t &bufferCnt);
+    virtual void releaseStreamBuf(cam_stream_type_t stream_type,
+            QCameraMemory *mem_obj, size_t size, int stride, int scanline);
 
     virtual QCameraHeapMemory *allocateStreamInfoBuf(cam_stream_type_t stream_type);
     virtual QCameraHeapMemory *allocateMiscBuf(cam_stream_info_t *streamInfo);
@@ -403,6 +405,10 @@ private:
     bool isCACEnabled();
     bool is4k2kResolution(cam_dimension_t* resolution);
     bool isPreviewRestartEnabled();
+    bool getBufCacheKey(cam_stream_type_t stream_type, QCameraMemory *mem,
+            size_t size, int stride, int scanline, uint8_t bufferCnt,
+            qcamera_buf_cache_key_t &key);
+    static size_t reclaimIdleMemory(void *data);
     bool needReprocess();
     bool needRotationReprocess();
     void debugShowVideoFPS();
@@ -443,6 +449,10 @@ private:
 
     int32_t sendPreviewCallback(QCameraStream *stream,
             QCameraMemory *memory, uint32_t idx);
+    camera_memory_t *getPreviewCbBuffer(size_t size, int fd,
+            uint32_t idx, void **token);
+    void retirePreviewCbPool();
+    void updatePreviewFrameLayout();
     int32_t selectScene(QCameraChannel *pChannel,
             mm_camera_super_buf_t *recvd_frame);
 
@@ -472,6 +482,7 @@ private:
                                void *userData);
     int32_t preparePreview();
     void unpreparePreview();
+    QCameraGrallocMemory *getPreviewDisplayMem();
     int32_t prepareRawStream(QCameraChannel *pChannel);
     QCameraChannel *getChannelByHandle(uint32_t channelHandle);
     mm_camera_buf_def_t *getSnapshotFrame(mm_camera_super_buf_t *recvd_frame);
@@ -547,6 +558,8 @@ private:
                                           void *userdata);
     static void synchronous_stream_cb_routine(mm_camera_super_buf_t *frame,
             QCameraStream *stream, void *userdata);
+    static void display_buf_ret_routine(uint32_t index, bool mapNeeded,
+            void *userdata);
     static void postview_stream_cb_routine(mm_camera_super_buf_t *frame,
                                            QCameraStream *stream,
                                            void *userdata);
@@ -613,6 +626,7 @@ private:
     pthread_cond_t m_cond;
     api_result_list *m_apiResultList;
     QCameraMemoryPool m_memoryPool;
+    QCameraStreamBufCache m_bufCache;     // stream buffer sets kept for restarts
 
     pthread_mutex_t m_evtLock;
     pthread_cond_t m_evtCond;
@@ -623,6 +637,9 @@ private:
     QCameraChannel *m_channels[QCAMERA_CH_TYPE_MAX]; // array holding channel ptr
 
     bool m_bPreviewStarted;             //flag indicates first preview frame callback is received
+    nsecs_t mPreviewStartTime;          //start_preview entry time
+    nsecs_t mStartPreviewLatency;       //duration of the last start_preview
+    nsecs_t mFirstFrameLatency;         //start_preview entry to first preview frame
     bool m_bRecordStarted;             //flag indicates Recording is started for first time
 
     // Signifies if ZSL Retro Snapshots are enabled
@@ -758,6 +775,7 @@ private:
     mm_jpeg_mpo_ops_t     mJpegMpoHandle;
     uint32_t              mJpegClientHandle;
     bool                  mJpegHandleOwner;
+    size_t                mJpegWorkBufSize; // charged to the memory budget
 
    //ts add for makeup
 #ifdef TARGET_TS_MAKEUP
@@ -780,6 +798,11 @@ private:
     //Gralloc memory details
     pthread_mutex_t mGrallocLock;
     uint8_t mEnqueuedBuffers;
+    bool mAsyncDisplay; // preview frames go through the display thread
+
+    //Buffers for preview data callbacks, lives for one preview session
+    pthread_mutex_t mPreviewCbLock;
+    QCameraCallbackBufPool *mPreviewCbPool;
 
     //The offset between BOOTTIME and MONOTONIC timestamps
     nsecs_t mBootToMonoTimestampOffset;
@@ -40,6 +40,7 @@
 #endif
 
 #include "QCamera2HWI.h"
+#include "QCameraRowCopy.h"
 
 namespace qcamera {
 
@@ -620,7 +621,8 @@ bool QCamera2HardwareInterface::TsMakeupProcess(mm_camera_buf_def_t *pFrame,
         ts_makeup_skin_beautyEx(&inMakeupData, &outMakeupData, &(faceRect),cleanLevel,whiteLevel);
         memcpy((unsigned char*)pFrame->buffer, tmpBuf, offset.frame_len);
         QCameraMemory *memory = (QCameraMemory *)pFrame->mem_info;
-        memory->cleanCache(pFrame->buf_idx);
+        memory->markCpuWrite(pFrame->buf_idx, 0, offset.frame_len);
+        memory->cleanCache(pFrame->buf_idx, 0, offset.frame_len);
         if (tmpBuf != NULL) {
             delete[] tmpBuf;
             tmpBuf = NULL;
@@ -734,7 +736,10 @@ void QCamera2HardwareInterface::synchronous_stream_cb_routine(
     if(pme->m_bPreviewStarted) {
         cam_fps_range_t fpsRange = pme->mParameters.getFpsRange();
         nsecs_t previewRate = 0;
-        ALOGI("[KPI Perf] %s : PROFILE_FIRST_PREVIEW_FRAME fps = %d", __func__, fpsRange.min_fps);
+        pme->mFirstFrameLatency = systemTime() - pme->mPreviewStartTime;
+        ALOGI("[KPI Perf] %s : PROFILE_FIRST_PREVIEW_FRAME fps = %d after %lld us",
+                __func__, fpsRange.min_fps,
+                (long long)(pme->mFirstFrameLatency / 1000));
         pme->m_bPreviewStarted = false ;
         if (fpsRange.min_fps != 0) {
             previewRate = (nsecs_t)(((int)(1000/fpsRange.min_fps) * 1000) * 1000000LL);
@@ -764,12 +769,21 @@ void QCamera2HardwareInterface::synchronous_stream_cb_routine(
     uint32_t idx = frame->buf_idx;
     CDBG("%p Enqueue Buffer to display %d frame Time = %lld Display Time = %lld",
             pme, idx, frameTime, mPreviewTimestamp);
-    err = memory->enqueueBuffer(idx, mPreviewTimestamp);
+    if (pme->mAsyncDisplay) {
+        // the display thread enqueues it and returns dequeued buffers
+        err = memory->displayBufferAsync(idx, mPreviewTimestamp,
+                display_buf_ret_routine, stream);
+    } else {
+        err = memory->enqueueBuffer(idx, mPreviewTimestamp);
+    }
 
     if (err == NO_ERROR) {
-        pthread_mutex_lock(&pme->mGrallocLock);
-        pme->mEnqueuedBuffers++;
-        pthread_mutex_unlock(&pme->mGrallocLock);
+        frame->consume_time = systemTime(SYSTEM_TIME_BOOTTIME);
+        if (!pme->mAsyncDisplay) {
+            pthread_mutex_lock(&pme->mGrallocLock);
+            pme->mEnqueuedBuffers++;
+            pthread_mutex_unlock(&pme->mGrallocLock);
+        }
     } else {
         ALOGE ("%s: Enqueue Buffer failed", __func__);
     }
@@ -778,6 +792,51 @@ void QCamera2HardwareInterface::synchronous_stream_cb_routine(
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : display_buf_ret_routine
+ *
+ * DESCRIPTION: helper function to return a buffer the display thread is
+ *              done with back to the preview stream
+ *
+ * PARAMETERS :
+ *   @index     : buffer index
+ *   @mapNeeded : buffer is new to the backend and has to be mapped first
+ *   @userdata  : preview stream
+ *
+ * RETURN    : None
+ *
+ * NOTE      : This Function is excecuted in display thread context, in
+ *             mm-interface context for dropped frames, or in the preview
+ *             stream's data context for buffers returned while the data
+ *             path still held them.
+ *==========================================================================*/
+void QCamera2HardwareInterface::display_buf_ret_routine(uint32_t index,
+        bool mapNeeded, void *userdata)
+{
+    QCameraStream *stream = (QCameraStream *)userdata;
+    int32_t err = NO_ERROR;
+
+    if (stream == NULL) {
+        ALOGE("%s: Invalid stream", __func__);
+        return;
+    }
+
+    if (mapNeeded) {
+        // This buffer has not yet been mapped to the backend
+        err = stream->mapNewBuffer(index);
+    }
+
+    if (err < 0) {
+        ALOGE("buffer mapping failed %d", err);
+    } else {
+        // Return dequeued buffer back to driver
+        err = stream->bufDone(index);
+        if ( err < 0) {
+            ALOGE("stream bufDone failed %d", err);
+        }
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : preview_stream_cb_routine
  *
@@ -835,7 +894,9 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
 
     if (!pme->needProcessPreviewFrame()) {
         ALOGE("%s: preview is not running, no need to process", __func__);
-        stream->bufDone(frame->buf_idx);
+        if (!pme->mAsyncDisplay || !memory->releaseDataHold(frame->buf_idx)) {
+            stream->bufDone(frame->buf_idx);
+        }
         free(super_frame);
         return;
     }
@@ -849,13 +910,19 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
     pme->dumpFrameToFile(stream, frame, QCAMERA_DUMP_FRM_PREVIEW);
 
     if(pme->m_bPreviewStarted) {
-       ALOGI("[KPI Perf] %s : PROFILE_FIRST_PREVIEW_FRAME", __func__);
+       pme->mFirstFrameLatency = systemTime() - pme->mPreviewStartTime;
+       ALOGI("[KPI Perf] %s : PROFILE_FIRST_PREVIEW_FRAME after %lld us",
+               __func__, (long long)(pme->mFirstFrameLatency / 1000));
        pme->m_bPreviewStarted = false ;
     }
 
-    pthread_mutex_lock(&pme->mGrallocLock);
-    dequeueCnt = pme->mEnqueuedBuffers;
-    pthread_mutex_unlock(&pme->mGrallocLock);
+    // with the display thread, buffers come back through
+    // display_buf_ret_routine instead
+    if (!pme->mAsyncDisplay) {
+        pthread_mutex_lock(&pme->mGrallocLock);
+        dequeueCnt = pme->mEnqueuedBuffers;
+        pthread_mutex_unlock(&pme->mGrallocLock);
+    }
 
     // Display the buffer.
     CDBG("%p displayBuffer %d E", pme, idx);
@@ -899,6 +966,12 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
         }
     }
 
+    // done reading the frame, the display thread may return it now. If
+    // it never reached the display thread it is ours to return
+    if (pme->mAsyncDisplay && !memory->releaseDataHold(idx)) {
+        stream->bufDone(idx);
+    }
+
     free(super_frame);
     CDBG_HIGH("[KPI Perf] %s : END", __func__);
     return;
@@ -924,6 +997,7 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     camera_memory_t *previewMem = NULL;
     camera_memory_t *data = NULL;
     camera_memory_t *dataToApp = NULL;
+    void *cbToken = NULL;
     size_t previewBufSize = 0;
     size_t previewBufSizeFromCallback = 0;
     cam_dimension_t preview_dim;
@@ -941,11 +1015,8 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     int32_t uvStrideToApp = 0;
     int32_t yScanlineToApp = 0;
     int32_t uvScanlineToApp = 0;
-    int32_t srcOffset = 0;
-    int32_t dstOffset = 0;
     int32_t srcBaseOffset = 0;
     int32_t dstBaseOffset = 0;
-    int i;
 
     if ((NULL == stream) || (NULL == memory)) {
         ALOGE("%s: Invalid preview callback input", __func__);
@@ -999,10 +1070,21 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
 
             previewBufSizeFromCallback = (size_t)
                     ((yStride * yScanline) + (uvStride * uvScanline));
+
+            // The app takes the padded layout published at preview start,
+            // send the frame in place
+            if ((previewBufSize != previewBufSizeFromCallback) &&
+                    (yStride == uvStride) &&
+                    mParameters.isStridedPreviewFrames()) {
+                previewBufSize = previewBufSizeFromCallback;
+            }
         }
         if(previewBufSize == previewBufSizeFromCallback) {
-            previewMem = mGetMemory(memory->getFd(idx),
-                       previewBufSize, 1, mCallbackCookie);
+            int fd = memory->getFd(idx);
+            previewMem = getPreviewCbBuffer(previewBufSize, fd, idx, &cbToken);
+            if (previewMem == NULL) {
+                previewMem = mGetMemory(fd, previewBufSize, 1, mCallbackCookie);
+            }
             if (!previewMem || !previewMem->data) {
                 ALOGE("%s: mGetMemory failed.\n", __func__);
                 return NO_MEMORY;
@@ -1011,32 +1093,27 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
             }
         } else {
             data = memory->getMemory(idx, false);
-            dataToApp = mGetMemory(-1, previewBufSize, 1, mCallbackCookie);
+            dataToApp = getPreviewCbBuffer(previewBufSize, -1, 0, &cbToken);
+            if (dataToApp == NULL) {
+                dataToApp = mGetMemory(-1, previewBufSize, 1, mCallbackCookie);
+            }
             if (!dataToApp || !dataToApp->data) {
                 ALOGE("%s: mGetMemory failed.\n", __func__);
                 return NO_MEMORY;
             }
 
-            for (i = 0; i < preview_dim.height; i++) {
-                srcOffset = i * yStride;
-                dstOffset = i * yStrideToApp;
-
-                memcpy((unsigned char *) dataToApp->data + dstOffset,
-                        (unsigned char *) data->data + srcOffset,
-                        (size_t)yStrideToApp);
-            }
+            copyRows((uint8_t *)dataToApp->data, (size_t)yStrideToApp,
+                    (const uint8_t *)data->data, (size_t)yStride,
+                    (size_t)yStrideToApp, (size_t)preview_dim.height);
 
             srcBaseOffset = yStride * yScanline;
             dstBaseOffset = yStrideToApp * yScanlineToApp;
 
-            for (i = 0; i < preview_dim.height/2; i++) {
-                srcOffset = i * uvStride + srcBaseOffset;
-                dstOffset = i * uvStrideToApp + dstBaseOffset;
-
-                memcpy((unsigned char *) dataToApp->data + dstOffset,
-                        (unsigned char *) data->data + srcOffset,
-                        (size_t)yStrideToApp);
-            }
+            copyRows((uint8_t *)dataToApp->data + dstBaseOffset,
+                    (size_t)uvStrideToApp,
+                    (const uint8_t *)data->data + srcBaseOffset,
+                    (size_t)uvStride,
+                    (size_t)yStrideToApp, (size_t)(preview_dim.height / 2));
         }
     } else {
         data = memory->getMemory(idx, false);
@@ -1053,7 +1130,10 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     } else {
         cbArg.data = dataToApp;
     }
-    if ( previewMem ) {
+    if (cbToken) {
+        cbArg.user_data = cbToken;
+        cbArg.release_cb = QCameraCallbackBufPool::releaseBuffer;
+    } else if ( previewMem ) {
         cbArg.user_data = previewMem;
         cbArg.release_cb = releaseCameraMemory;
     } else if (dataToApp) {
@@ -1064,7 +1144,9 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     rc = m_cbNotifier.notifyCallback(cbArg);
     if (rc != NO_ERROR) {
         ALOGE("%s: fail sending notification", __func__);
-        if (previewMem) {
+        if (cbToken) {
+            QCameraCallbackBufPool::releaseBuffer(cbToken, this, rc);
+        } else if (previewMem) {
             previewMem->release(previewMem);
         } else if (dataToApp) {
             dataToApp->release(dataToApp);
@@ -1423,6 +1505,7 @@ void QCamera2HardwareInterface::video_stream_cb_routine(mm_camera_super_buf_t *s
                 cbArg.msg_type = CAMERA_MSG_VIDEO_FRAME;
                 cbArg.data = video_mem;
                 cbArg.timestamp = timeStamp;
+                frame->consume_time = systemTime(SYSTEM_TIME_BOOTTIME);
                 int32_t rc = pme->m_cbNotifier.notifyCallback(cbArg);
                 if (rc != NO_ERROR) {
                     ALOGE("%s: fail sending data notify", __func__);
@@ -1504,6 +1587,7 @@ void QCamera2HardwareInterface::video_stream_cb_routine(mm_camera_super_buf_t *s
                 }
                 CDBG("Final video buffer TimeStamp : %lld ", timeStamp);
                 cbArg.timestamp = timeStamp;
+                frame->consume_time = systemTime(SYSTEM_TIME_BOOTTIME);
                 int32_t rc = pme->m_cbNotifier.notifyCallback(cbArg);
                 if (rc != NO_ERROR) {
                     ALOGE("%s: fail sending data notify", __func__);
@@ -2866,9 +2950,9 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
     CDBG("%s: E", __func__);
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
-                CDBG("%s: cam_sem_wait error (%s)",
+                CDBG("%s: waitCmd error (%s)",
                            __func__, strerror(errno));
                 return NULL;
             }
@@ -58,6 +58,8 @@ QCameraChannel::QCameraChannel(uint32_t cam_handle,
     m_bAllowDynBufAlloc = false;
 
     m_handle = 0;
+    mDataCB = NULL;
+    mUserData = NULL;
 }
 
 /*===========================================================================
@@ -76,6 +78,8 @@ QCameraChannel::QCameraChannel()
     m_bIsActive = false;
 
     m_handle = 0;
+    mDataCB = NULL;
+    mUserData = NULL;
 }
 
 /*===========================================================================
@@ -152,6 +156,31 @@ int32_t QCameraChannel::setStreamSyncCB (cam_stream_type_t stream_type,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : setStreamBlockingCB
+ *
+ * DESCRIPTION: mark the data callback of the stream of stream type as one
+ *              that may block
+ *
+ * PARAMETERS :
+ *    @stream_type : Stream type whose callback may block.
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              non-zero failure code
+ *==========================================================================*/
+int32_t QCameraChannel::setStreamBlockingCB(cam_stream_type_t stream_type)
+{
+    int32_t rc = UNKNOWN_ERROR;
+    for (size_t i = 0; i < mStreams.size(); i++) {
+        if ((mStreams[i] != NULL) && (stream_type == mStreams[i]->getMyType())) {
+            rc = mStreams[i]->setBlockingDataCB();
+            break;
+        }
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : init
  *
@@ -170,10 +199,12 @@ int32_t QCameraChannel::init(mm_camera_channel_attr_t *attr,
                              mm_camera_buf_notify_t dataCB,
                              void *userData)
 {
+    mDataCB = dataCB;
+    mUserData = userData;
     m_handle = m_camOps->add_channel(m_camHandle,
                                       attr,
-                                      dataCB,
-                                      userData);
+                                      (dataCB != NULL) ? superBufNotifyCB : NULL,
+                                      this);
     if (m_handle == 0) {
         ALOGE("%s: Add channel failed", __func__);
         return UNKNOWN_ERROR;
@@ -181,6 +212,32 @@ int32_t QCameraChannel::init(mm_camera_channel_attr_t *attr,
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : superBufNotifyCB
+ *
+ * DESCRIPTION: channel data callback registered with mm-camera-interface.
+ *              Makes the super buffer coherent for the CPU in one pass and
+ *              hands it to the channel owner.
+ *
+ * PARAMETERS :
+ *   @recvd_frame : received super buffer
+ *   @userdata    : ptr to QCameraChannel
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraChannel::superBufNotifyCB(mm_camera_super_buf_t *recvd_frame,
+        void *userdata)
+{
+    QCameraChannel *pme = (QCameraChannel *)userdata;
+    if ((pme == NULL) || (pme->mDataCB == NULL)) {
+        ALOGE("%s: invalid channel", __func__);
+        return;
+    }
+
+    QCameraMemory::syncForCpu(recvd_frame);
+    pme->mDataCB(recvd_frame, pme->mUserData);
+}
+
 /*===========================================================================
  * FUNCTION   : addStream
  *
@@ -71,8 +71,12 @@ public:
     void deleteChannel();
     int32_t setStreamSyncCB (cam_stream_type_t stream_type,
             stream_cb_routine stream_cb);
+    int32_t setStreamBlockingCB(cam_stream_type_t stream_type);
 
 protected:
+    static void superBufNotifyCB(mm_camera_super_buf_t *recvd_frame,
+            void *userdata);
+
     uint32_t m_camHandle;
     mm_camera_ops_t *m_camOps;
     bool m_bIsActive;
@@ -28,11 +28,14 @@
  */
 #define LOG_TAG "QCameraHWI_Mem"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <utils/Errors.h>
 #include <utils/Log.h>
+#include <cutils/properties.h>
 #include <gralloc_priv.h>
 #include <QComOMXMetadata.h>
 #include <OMX_IVCommon.h>
@@ -40,6 +43,8 @@
 #include "QCamera2HWI.h"
 #include "QCameraMem.h"
 #include "QCameraParameters.h"
+#include "QCameraExecutor.h"
+#include "QCameraMemBudget.h"
 
 // Media dependencies
 #ifdef USE_MEDIA_EXTENSIONS
@@ -74,12 +79,14 @@ QCameraMemory::QCameraMemory(bool cached,
         QCameraMemoryPool *pool,
         cam_stream_type_t streamType, cam_stream_buf_type bufType)
     :m_bCached(cached),
+     m_bCacheTracking(false),
      mMemoryPool(pool),
      mStreamType(streamType),
      mBufType(bufType)
 {
     mBufferCount = 0;
     reset();
+    resetCacheState();
 }
 
 /*===========================================================================
@@ -98,18 +105,25 @@ QCameraMemory::~QCameraMemory()
 /*===========================================================================
  * FUNCTION   : cacheOpsInternal
  *
- * DESCRIPTION: ion related memory cache operations
+ * DESCRIPTION: memory cache operations, through the buffer allocator. With
+ *              cache tracking on, clean and invalidate only cover what the
+ *              CPU wrote and are dropped when it wrote nothing, a clean
+ *              invalidate of a buffer the CPU did not write is issued as
+ *              an invalidate.
  *
  * PARAMETERS :
  *   @index   : index of the buffer
  *   @cmd     : cache ops command
  *   @vaddr   : ptr to the virtual address
+ *   @offset  : start of the range
+ *   @len     : length of the range, 0 for the rest of the buffer
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
-int QCameraMemory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr)
+int QCameraMemory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr,
+        size_t offset, size_t len)
 {
     if (!m_bCached) {
         // Memory is not cached, no need for cache ops
@@ -117,35 +131,227 @@ int QCameraMemory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vadd
         return OK;
     }
 
-    struct ion_flush_data cache_inv_data;
-    struct ion_custom_data custom_data;
-    int ret = OK;
-
     if (index >= mBufferCount) {
         ALOGE("%s: index %d out of bound [0, %d)", __func__, index, mBufferCount);
         return BAD_INDEX;
     }
 
-    memset(&cache_inv_data, 0, sizeof(cache_inv_data));
-    memset(&custom_data, 0, sizeof(custom_data));
-    cache_inv_data.vaddr = vaddr;
-    cache_inv_data.fd = mMemInfo[index].fd;
-    cache_inv_data.handle = mMemInfo[index].handle;
-    cache_inv_data.length =
-            ( /* FIXME: Should remove this after ION interface changes */ unsigned int)
-            mMemInfo[index].size;
-    custom_data.cmd = cmd;
-    custom_data.arg = (unsigned long)&cache_inv_data;
-
-    CDBG_HIGH("%s: addr = %p, fd = %d, handle = %lx length = %d, ION Fd = %d",
-         __func__, cache_inv_data.vaddr, cache_inv_data.fd,
-         (unsigned long)cache_inv_data.handle, cache_inv_data.length,
-         mMemInfo[index].main_ion_fd);
-    ret = ioctl(mMemInfo[index].main_ion_fd, ION_IOC_CUSTOM, &custom_data);
-    if (ret < 0)
-        ALOGE("%s: Cache Invalidate failed: %s\n", __func__, strerror(errno));
+    QCameraBufferAllocator &allocator = QCameraBufferAllocator::getInstance();
+    if (!m_bCacheTracking) {
+        return allocator.cacheOps(mMemInfo[index], vaddr, cmd, offset, len);
+    }
 
-    return ret;
+    size_t size = mMemInfo[index].size;
+    if (offset >= size) {
+        return OK;
+    }
+    size_t end = ((len == 0) || (len > size - offset)) ? size : offset + len;
+
+    struct QCameraCacheState &state = mCacheState[index];
+    size_t dirtyEnd = (state.dirtyEnd < size) ? state.dirtyEnd : size;
+    size_t writtenStart = (state.dirtyStart > offset) ? state.dirtyStart : offset;
+    size_t writtenEnd = (dirtyEnd < end) ? dirtyEnd : end;
+    bool written = (writtenStart < writtenEnd);
+
+    switch (cmd) {
+    case ION_IOC_CLEAN_CACHES:
+    case ION_IOC_INV_CACHES:
+        // only lines the CPU wrote need a clean, and only those could be
+        // written back on top of what a device writes next
+        if (!written) {
+            allocator.noteCacheSkipped(end - offset);
+            return OK;
+        }
+        if ((writtenEnd - writtenStart) < (end - offset)) {
+            allocator.noteCacheNarrowed(
+                    (end - offset) - (writtenEnd - writtenStart));
+            offset = writtenStart;
+            end = writtenEnd;
+        }
+        break;
+    case ION_IOC_CLEAN_INV_CACHES:
+        if (!written) {
+            cmd = ION_IOC_INV_CACHES;
+        }
+        break;
+    default:
+        break;
+    }
+
+    int rc = allocator.cacheOps(mMemInfo[index], vaddr, cmd, offset,
+            end - offset);
+    if (rc == OK) {
+        if ((offset <= state.dirtyStart) && (end >= dirtyEnd)) {
+            state.dirtyStart = 0;
+            state.dirtyEnd = 0;
+        }
+        if ((cmd != ION_IOC_CLEAN_CACHES) && (offset == 0) && (end == size)) {
+            state.stale = false;
+        }
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : resetCacheState
+ *
+ * DESCRIPTION: forget what is known about the CPU caches of all buffers,
+ *              they are all taken as fully written by the CPU
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::resetCacheState()
+{
+    for (uint32_t i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+        mCacheState[i].dirtyStart = 0;
+        mCacheState[i].dirtyEnd = (size_t)-1;
+        mCacheState[i].stale = false;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : setCacheTracking
+ *
+ * DESCRIPTION: turn on tracking of CPU writes for cache operations. The
+ *              owner promises that every CPU write to the buffers is
+ *              reported with markCpuWrite() or followed by cleanCache().
+ *
+ * PARAMETERS :
+ *   @enable  : track or not
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::setCacheTracking(bool enable)
+{
+    if (enable && !m_bCacheTracking) {
+        resetCacheState();
+    }
+    m_bCacheTracking = enable;
+}
+
+/*===========================================================================
+ * FUNCTION   : markCpuWrite
+ *
+ * DESCRIPTION: report a CPU write to a buffer
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *   @offset  : start of the written range
+ *   @len     : length of the written range, 0 for the rest of the buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::markCpuWrite(uint32_t index, size_t offset, size_t len)
+{
+    if (!m_bCacheTracking || (index >= mBufferCount)) {
+        return;
+    }
+
+    struct QCameraCacheState &state = mCacheState[index];
+    size_t end = (len == 0) ? (size_t)-1 : offset + len;
+    if (state.dirtyStart >= state.dirtyEnd) {
+        state.dirtyStart = offset;
+        state.dirtyEnd = end;
+    } else {
+        if (offset < state.dirtyStart) {
+            state.dirtyStart = offset;
+        }
+        if (end > state.dirtyEnd) {
+            state.dirtyEnd = end;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : markDeviceWrite
+ *
+ * DESCRIPTION: a device wrote the buffer. Instead of invalidating right
+ *              away the buffer is flagged stale, the invalidate is done by
+ *              syncForCpu() when a consumer gets it. Buffers the CPU wrote
+ *              are clean invalidated immediately.
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::markDeviceWrite(uint32_t index)
+{
+    if (!m_bCached || !m_bCacheTracking || (index >= mBufferCount) ||
+            (mCacheState[index].dirtyStart < mCacheState[index].dirtyEnd)) {
+        return cleanInvalidateCache(index);
+    }
+
+    mCacheState[index].stale = true;
+    QCameraBufferAllocator::getInstance().noteCacheDeferred();
+    return OK;
+}
+
+/*===========================================================================
+ * FUNCTION   : syncForCpu
+ *
+ * DESCRIPTION: make a buffer flagged by markDeviceWrite() coherent for
+ *              the CPU
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::syncForCpu(uint32_t index)
+{
+    if (!m_bCacheTracking || (index >= mBufferCount) ||
+            !mCacheState[index].stale) {
+        return OK;
+    }
+    return cleanInvalidateCache(index);
+}
+
+/*===========================================================================
+ * FUNCTION   : syncForCpu
+ *
+ * DESCRIPTION: make all buffers of a super buffer coherent for the CPU in
+ *              one pass, before it is handed to its consumer
+ *
+ * PARAMETERS :
+ *   @frame   : super buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::syncForCpu(mm_camera_super_buf_t *frame)
+{
+    if (frame == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < frame->num_bufs; i++) {
+        mm_camera_buf_def_t *buf = frame->bufs[i];
+        if ((buf == NULL) || (buf->mem_info == NULL)) {
+            continue;
+        }
+
+        bool listed = false;
+        for (uint32_t j = 0; j < i; j++) {
+            if ((frame->bufs[j] != NULL) &&
+                    (frame->bufs[j]->mem_info == buf->mem_info) &&
+                    (frame->bufs[j]->buf_idx == buf->buf_idx)) {
+                listed = true;
+                break;
+            }
+        }
+        if (listed) {
+            QCameraBufferAllocator::getInstance().noteCacheMerged();
+            continue;
+        }
+
+        ((QCameraMemory *)buf->mem_info)->syncForCpu(buf->buf_idx);
+    }
 }
 
 /*===========================================================================
@@ -198,6 +404,25 @@ uint8_t QCameraMemory::getCnt() const
     return mBufferCount;
 }
 
+/*===========================================================================
+ * FUNCTION   : isSecure
+ *
+ * DESCRIPTION: query if any buffer was allocated from secure memory
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : true if the object holds secure buffers
+ *==========================================================================*/
+bool QCameraMemory::isSecure() const
+{
+    for (uint8_t i = 0; i < mBufferCount; i++) {
+        if (mMemInfo[i].secure_mode != NON_SECURE) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /*===========================================================================
  * FUNCTION   : reset
  *
@@ -341,10 +566,31 @@ int32_t QCameraMemory::getUserBufDef(const cam_stream_user_buf_info_t &buf_info,
 }
 
 
+/* shared state of one parallel alloc(). Reference counted, a helper that
+ * gets scheduled after the caller returned only drops its reference */
+struct QCameraMemory::QCameraAllocJob {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t refs;
+    QCameraMemory *mem;
+    unsigned int heap_id;
+    size_t size;
+    uint32_t secure_mode;
+    int next;       // next slot to claim
+    int end;
+    int claimed;
+    int done;
+    bool failed;
+    bool allocated[MM_CAMERA_MAX_NUM_FRAMES];
+};
+
 /*===========================================================================
  * FUNCTION   : alloc
  *
- * DESCRIPTION: allocate requested number of buffers of certain size
+ * DESCRIPTION: allocate requested number of buffers of certain size. Large
+ *              requests are spread over the blocking executor, the calling
+ *              thread allocates too so the call completes even when no
+ *              worker is free.
  *
  * PARAMETERS :
  *   @count   : number of buffers to be allocated
@@ -359,6 +605,7 @@ int QCameraMemory::alloc(int count, size_t size, unsigned int heap_id,
         uint32_t secure_mode)
 {
     int rc = OK;
+    char value[PROPERTY_VALUE_MAX];
 
     int new_bufCnt = mBufferCount + count;
     ATRACE_BEGIN_SNPRINTF("%s %zu %d", "Memsize", size, count);
@@ -370,38 +617,212 @@ int QCameraMemory::alloc(int count, size_t size, unsigned int heap_id,
         return BAD_INDEX;
     }
 
-    for (int i = mBufferCount; i < new_bufCnt; i ++) {
-        if ( NULL == mMemoryPool ) {
-            CDBG_HIGH("%s : No memory pool available, allocating now", __func__);
-            rc = allocOneBuffer(mMemInfo[i], heap_id, size, m_bCached,
-                     secure_mode);
-            if (rc < 0) {
-                ALOGE("%s: AllocateIonMemory failed", __func__);
-                for (int j = i-1; j >= 0; j--)
-                    deallocOneBuffer(mMemInfo[j]);
-                break;
-            }
-        } else {
-            rc = mMemoryPool->allocateBuffer(mMemInfo[i],
-                                             heap_id,
-                                             size,
-                                             m_bCached,
-                                             mStreamType,
-                                             secure_mode);
+    property_get("persist.camera.mem.alloc.threads", value, "3");
+    int threads = atoi(value);
+    if (threads > QCAMERA_EXEC_BLOCKING_WORKERS) {
+        threads = QCAMERA_EXEC_BLOCKING_WORKERS;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+
+    QCameraAllocJob *job = NULL;
+    if (threads > 1) {
+        job = (QCameraAllocJob *)malloc(sizeof(QCameraAllocJob));
+    }
+
+    if (NULL == job) {
+        for (int i = mBufferCount; i < new_bufCnt; i ++) {
+            rc = allocSlot(i, heap_id, size, secure_mode);
             if (rc < 0) {
-                ALOGE("%s: Memory pool allocation failed", __func__);
-                for (int j = i-1; j >= 0; j--)
-                    mMemoryPool->releaseBuffer(mMemInfo[j],
-                                               mStreamType);
+                ALOGE("%s: Buffer allocation failed", __func__);
+                for (int j = i-1; j >= mBufferCount; j--)
+                    deallocSlot(j);
                 break;
             }
         }
+        ATRACE_END();
+        return rc;
+    }
+
+    memset(job, 0, sizeof(QCameraAllocJob));
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+    job->refs = 1;
+    job->mem = this;
+    job->heap_id = heap_id;
+    job->size = size;
+    job->secure_mode = secure_mode;
+    job->next = mBufferCount;
+    job->end = new_bufCnt;
+
+    for (int i = 1; i < threads; i++) {
+        pthread_mutex_lock(&job->lock);
+        job->refs++;
+        pthread_mutex_unlock(&job->lock);
+        if (QCameraExecutor::getBlockingInstance().submit(allocRoutine, job)
+                != NO_ERROR) {
+            putAllocJob(job);
+            break;
+        }
+    }
+
+    runAllocJob(job);
+
+    // nothing is left to claim, wait for the slots helpers are still on
+    pthread_mutex_lock(&job->lock);
+    while (job->done < job->claimed) {
+        pthread_cond_wait(&job->cond, &job->lock);
+    }
+    if (job->failed) {
+        ALOGE("%s: Buffer allocation failed", __func__);
+        rc = NO_MEMORY;
+    }
+    pthread_mutex_unlock(&job->lock);
 
+    if (rc < 0) {
+        for (int i = mBufferCount; i < new_bufCnt; i++) {
+            if (job->allocated[i]) {
+                deallocSlot(i);
+            }
+        }
     }
+    putAllocJob(job);
+
     ATRACE_END();
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : runAllocJob
+ *
+ * DESCRIPTION: claim and allocate slots of a parallel alloc() until none
+ *              is left or one of them failed
+ *
+ * PARAMETERS :
+ *   @job     : shared allocation state
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::runAllocJob(QCameraAllocJob *job)
+{
+    pthread_mutex_lock(&job->lock);
+    while (!job->failed && (job->next < job->end)) {
+        int index = job->next++;
+        job->claimed++;
+        pthread_mutex_unlock(&job->lock);
+
+        int rc = job->mem->allocSlot(index, job->heap_id, job->size,
+                job->secure_mode);
+
+        pthread_mutex_lock(&job->lock);
+        if (rc < 0) {
+            job->failed = true;
+        } else {
+            job->allocated[index] = true;
+        }
+        job->done++;
+        pthread_cond_signal(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : allocRoutine
+ *
+ * DESCRIPTION: executor task helping a parallel alloc()
+ *
+ * PARAMETERS :
+ *   @data    : shared allocation state
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::allocRoutine(void *data)
+{
+    QCameraAllocJob *job = (QCameraAllocJob *)data;
+    runAllocJob(job);
+    putAllocJob(job);
+}
+
+/*===========================================================================
+ * FUNCTION   : putAllocJob
+ *
+ * DESCRIPTION: drop a reference to the state of a parallel alloc(), the
+ *              last one frees it
+ *
+ * PARAMETERS :
+ *   @job     : shared allocation state
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::putAllocJob(QCameraAllocJob *job)
+{
+    pthread_mutex_lock(&job->lock);
+    bool last = (--job->refs == 0);
+    pthread_mutex_unlock(&job->lock);
+    if (last) {
+        pthread_cond_destroy(&job->cond);
+        pthread_mutex_destroy(&job->lock);
+        free(job);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : allocSlot
+ *
+ * DESCRIPTION: allocate one buffer into a slot, from the memory pool if
+ *              there is one
+ *
+ * PARAMETERS :
+ *   @index   : slot to fill
+ *   @heap_id : heap id to indicate where the buffer will be allocated from
+ *   @size    : lenght of the buffer to be allocated
+ *   @secure_mode : secure or non secure buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemory::allocSlot(int index, unsigned int heap_id, size_t size,
+        uint32_t secure_mode)
+{
+    int rc;
+
+    if ( NULL == mMemoryPool ) {
+        CDBG_HIGH("%s : No memory pool available, allocating now", __func__);
+        rc = allocOneBuffer(mMemInfo[index], heap_id, size, m_bCached,
+                secure_mode);
+    } else {
+        rc = mMemoryPool->allocateBuffer(mMemInfo[index],
+                                         heap_id,
+                                         size,
+                                         m_bCached,
+                                         mStreamType,
+                                         secure_mode);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : deallocSlot
+ *
+ * DESCRIPTION: release the buffer of a slot, to the memory pool if there
+ *              is one
+ *
+ * PARAMETERS :
+ *   @index   : slot to release
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemory::deallocSlot(int index)
+{
+    if ( NULL == mMemoryPool ) {
+        deallocOneBuffer(mMemInfo[index]);
+    } else {
+        mMemoryPool->releaseBuffer(mMemInfo[index], mStreamType);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : dealloc
  *
@@ -414,12 +835,9 @@ int QCameraMemory::alloc(int count, size_t size, unsigned int heap_id,
 void QCameraMemory::dealloc()
 {
     for (int i = 0; i < mBufferCount; i++) {
-        if ( NULL == mMemoryPool ) {
-            deallocOneBuffer(mMemInfo[i]);
-        } else {
-            mMemoryPool->releaseBuffer(mMemInfo[i], mStreamType);
-        }
+        deallocSlot(i);
     }
+    resetCacheState();
 }
 
 /*===========================================================================
@@ -440,68 +858,15 @@ void QCameraMemory::dealloc()
 int QCameraMemory::allocOneBuffer(QCameraMemInfo &memInfo,
         unsigned int heap_id, size_t size, bool cached, uint32_t secure_mode)
 {
-    int rc = OK;
-    struct ion_handle_data handle_data;
-    struct ion_allocation_data alloc;
-    struct ion_fd_data ion_info_fd;
-    int main_ion_fd = -1;
-
-    main_ion_fd = open("/dev/ion", O_RDONLY);
-    if (main_ion_fd < 0) {
-        ALOGE("Ion dev open failed: %s\n", strerror(errno));
-        goto ION_OPEN_FAILED;
-    }
-
-    memset(&alloc, 0, sizeof(alloc));
-    alloc.len = size;
-    /* to make it page size aligned */
-    alloc.len = (alloc.len + 4095U) & (~4095U);
-    alloc.align = 4096;
-    if (cached) {
-        alloc.flags = ION_FLAG_CACHED;
-    }
-    alloc.heap_id_mask = heap_id;
-    if (secure_mode == SECURE) {
-        ALOGD("%s: Allocate secure buffer\n", __func__);
-        alloc.flags = ION_SECURE;
-        alloc.heap_id_mask = ION_HEAP(ION_CP_MM_HEAP_ID);
-        alloc.align = 1048576; // 1 MiB alignment to be able to protect later
-        alloc.len = (alloc.len + 1048575U) & (~1048575U);
-    }
-
-    rc = ioctl(main_ion_fd, ION_IOC_ALLOC, &alloc);
-    if (rc < 0) {
-        ALOGE("ION allocation failed: %s\n", strerror(errno));
-        goto ION_ALLOC_FAILED;
-    }
-
-    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
-    ion_info_fd.handle = alloc.handle;
-    rc = ioctl(main_ion_fd, ION_IOC_SHARE, &ion_info_fd);
+    int rc = QCameraBufferAllocator::getInstance().allocate(size, heap_id,
+            cached, secure_mode, memInfo);
     if (rc < 0) {
-        ALOGE("ION map failed %s\n", strerror(errno));
-        goto ION_MAP_FAILED;
+        return NO_MEMORY;
     }
-
-    memInfo.main_ion_fd = main_ion_fd;
-    memInfo.fd = ion_info_fd.fd;
-    memInfo.handle = ion_info_fd.handle;
-    memInfo.size = alloc.len;
     memInfo.cached = cached;
     memInfo.heap_id = heap_id;
-
-    ALOGD("%s : ION buffer %lx with size %d allocated",
-            __func__, (unsigned long)memInfo.handle, alloc.len);
+    memInfo.secure_mode = secure_mode;
     return OK;
-
-ION_MAP_FAILED:
-    memset(&handle_data, 0, sizeof(handle_data));
-    handle_data.handle = ion_info_fd.handle;
-    ioctl(main_ion_fd, ION_IOC_FREE, &handle_data);
-ION_ALLOC_FAILED:
-    close(main_ion_fd);
-ION_OPEN_FAILED:
-    return NO_MEMORY;
 }
 
 /*===========================================================================
@@ -516,36 +881,44 @@ ION_OPEN_FAILED:
  *==========================================================================*/
 void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
 {
-    struct ion_handle_data handle_data;
-
-    if (memInfo.fd >= 0) {
-        close(memInfo.fd);
-        memInfo.fd = -1;
-    }
-
-    if (memInfo.main_ion_fd >= 0) {
-        memset(&handle_data, 0, sizeof(handle_data));
-        handle_data.handle = memInfo.handle;
-        ioctl(memInfo.main_ion_fd, ION_IOC_FREE, &handle_data);
-        close(memInfo.main_ion_fd);
-        memInfo.main_ion_fd = -1;
-    }
-    memInfo.handle = 0;
-    memInfo.size = 0;
+    QCameraBufferAllocator::getInstance().release(memInfo);
 }
 
+QCameraMemoryPool::pool_profile_t
+        QCameraMemoryPool::sProfiles[MM_CAMERA_MAX_NUM_SENSORS][CAM_STREAM_TYPE_MAX];
+pthread_mutex_t QCameraMemoryPool::sProfileLock = PTHREAD_MUTEX_INITIALIZER;
+
 /*===========================================================================
  * FUNCTION   : QCameraMemoryPool
  *
  * DESCRIPTION: default constructor of QCameraMemoryPool
  *
- * PARAMETERS : None
+ * PARAMETERS :
+ *   @cameraId : camera the pool belongs to, selects the pre-warm profile
  *
  * RETURN     : None
  *==========================================================================*/
-QCameraMemoryPool::QCameraMemoryPool()
+QCameraMemoryPool::QCameraMemoryPool(uint32_t cameraId)
+    : mCameraId(cameraId),
+      mSeq(0),
+      mBgJobs(0),
+      mTrimPending(false)
 {
+    char value[PROPERTY_VALUE_MAX];
+
+    // watermarks are in MB
+    property_get("persist.camera.mem.pool.high", value, "128");
+    mHighWatermark = (size_t)atoi(value) << 20;
+    property_get("persist.camera.mem.pool.low", value, "64");
+    mLowWatermark = (size_t)atoi(value) << 20;
+    if (mLowWatermark > mHighWatermark) {
+        mLowWatermark = mHighWatermark;
+    }
+
+    memset(mOutstanding, 0, sizeof(mOutstanding));
+    memset(&mStats, 0, sizeof(mStats));
     pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mBgCond, NULL);
 }
 
 
@@ -560,152 +933,1138 @@ QCameraMemoryPool::QCameraMemoryPool()
  *==========================================================================*/
 QCameraMemoryPool::~QCameraMemoryPool()
 {
-    clear();
-    pthread_mutex_destroy(&mLock);
+    clear();
+    pthread_cond_destroy(&mBgCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getBucket
+ *
+ * DESCRIPTION: map a buffer size to its size class. Every power of two is
+ *              split into QCAMERA_POOL_SUB_BUCKETS linear sub buckets.
+ *
+ * PARAMETERS :
+ *   @size    : size of the buffer
+ *
+ * RETURN     : bucket index
+ *==========================================================================*/
+uint32_t QCameraMemoryPool::getBucket(size_t size)
+{
+    if (size < ((size_t)1 << QCAMERA_POOL_MIN_SHIFT)) {
+        return 0;
+    }
+    if (size > UINT32_MAX) {
+        return QCAMERA_POOL_NUM_BUCKETS - 1;
+    }
+
+    uint32_t msb = 31 - (uint32_t)__builtin_clz((uint32_t)size);
+    uint32_t sub = (uint32_t)(size >> (msb - 2)) & (QCAMERA_POOL_SUB_BUCKETS - 1);
+    uint32_t idx = (msb - QCAMERA_POOL_MIN_SHIFT) * QCAMERA_POOL_SUB_BUCKETS + sub;
+
+    return (idx < QCAMERA_POOL_NUM_BUCKETS) ? idx : QCAMERA_POOL_NUM_BUCKETS - 1;
+}
+
+/*===========================================================================
+ * FUNCTION   : getBucketBase
+ *
+ * DESCRIPTION: smallest buffer size that maps to a bucket
+ *
+ * PARAMETERS :
+ *   @idx     : bucket index
+ *
+ * RETURN     : size in bytes
+ *==========================================================================*/
+static size_t getBucketBase(uint32_t idx)
+{
+    uint32_t msb = idx / QCAMERA_POOL_SUB_BUCKETS + QCAMERA_POOL_MIN_SHIFT;
+    uint32_t sub = idx % QCAMERA_POOL_SUB_BUCKETS;
+
+    return ((size_t)1 << msb) + sub * ((size_t)1 << (msb - 2));
+}
+
+/*===========================================================================
+ * FUNCTION   : putBufferLocked
+ *
+ * DESCRIPTION: add an idle buffer to its size class. Caller holds mLock.
+ *
+ * PARAMETERS :
+ *   @memInfo : reference to struct that stores additional memory allocation info
+ *   @streamType: Type of stream the buffers belongs to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::putBufferLocked(
+        struct QCameraMemory::QCameraMemInfo &memInfo,
+        cam_stream_type_t streamType)
+{
+    pool_entry_t entry;
+    entry.info = memInfo;
+    entry.streamType = streamType;
+    entry.seq = mSeq++;
+    mBuckets[getBucket(memInfo.size)].push_back(entry);
+
+    mStats.cachedBytes += memInfo.size;
+    mStats.cachedCnt++;
+    if (mStats.cachedBytes > mStats.peakCachedBytes) {
+        mStats.peakCachedBytes = mStats.cachedBytes;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : trimLocked
+ *
+ * DESCRIPTION: evict least recently released buffers until the cache holds
+ *              at most target bytes. Victims are returned to the caller so
+ *              they can be freed without holding mLock.
+ *
+ * PARAMETERS :
+ *   @target  : number of cached bytes to keep
+ *   @victims : [output] evicted buffers
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trimLocked(size_t target,
+        List<QCameraMemory::QCameraMemInfo> &victims)
+{
+    while (mStats.cachedBytes > target) {
+        int oldest = -1;
+        for (uint32_t i = 0; i < QCAMERA_POOL_NUM_BUCKETS; i++) {
+            // entries are appended in release order, so the head is the
+            // oldest buffer of its bucket
+            if (!mBuckets[i].empty() && ((oldest < 0) ||
+                    ((*mBuckets[i].begin()).seq <
+                    (*mBuckets[oldest].begin()).seq))) {
+                oldest = (int)i;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+
+        List<pool_entry_t>::iterator it = mBuckets[oldest].begin();
+        victims.push_back((*it).info);
+        mStats.cachedBytes -= (*it).info.size;
+        mStats.cachedCnt--;
+        mStats.trims++;
+        mStats.bytesTrimmed += (*it).info.size;
+        mBuckets[oldest].erase(it);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : waitBgJobsLocked
+ *
+ * DESCRIPTION: wait until no trim or pre-warm task of this pool is queued
+ *              on the executor. Caller holds mLock.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::waitBgJobsLocked()
+{
+    while (mBgJobs > 0) {
+        pthread_cond_wait(&mBgCond, &mLock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : trimRoutine
+ *
+ * DESCRIPTION: executor task shrinking the cache down to the low watermark
+ *
+ * PARAMETERS :
+ *   @data    : ptr to QCameraMemoryPool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trimRoutine(void *data)
+{
+    QCameraMemoryPool *pme = (QCameraMemoryPool *)data;
+    List<QCameraMemory::QCameraMemInfo> victims;
+
+    pthread_mutex_lock(&pme->mLock);
+    pme->trimLocked(pme->mLowWatermark, victims);
+    pthread_mutex_unlock(&pme->mLock);
+
+    for (List<QCameraMemory::QCameraMemInfo>::iterator it = victims.begin();
+            it != victims.end(); it++) {
+        QCameraMemory::deallocOneBuffer(*it);
+    }
+
+    pthread_mutex_lock(&pme->mLock);
+    pme->mTrimPending = false;
+    pme->mBgJobs--;
+    pthread_cond_broadcast(&pme->mBgCond);
+    pthread_mutex_unlock(&pme->mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseBuffer
+ *
+ * DESCRIPTION: release one cached buffers. Crossing the high watermark
+ *              schedules a background trim down to the low watermark.
+ *
+ * PARAMETERS :
+ *   @memInfo : reference to struct that stores additional memory allocation info
+ *   @streamType: Type of stream the buffers belongs to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::releaseBuffer(
+        struct QCameraMemory::QCameraMemInfo &memInfo,
+        cam_stream_type_t streamType)
+{
+    List<QCameraMemory::QCameraMemInfo> victims;
+
+    pthread_mutex_lock(&mLock);
+
+    if (mOutstanding[streamType] > 0) {
+        mOutstanding[streamType]--;
+    }
+    putBufferLocked(memInfo, streamType);
+
+    if ((mStats.cachedBytes > mHighWatermark) && !mTrimPending) {
+        mTrimPending = true;
+        mBgJobs++;
+        if (QCameraExecutor::getBlockingInstance().submit(trimRoutine, this) != NO_ERROR) {
+            mTrimPending = false;
+            mBgJobs--;
+            trimLocked(mLowWatermark, victims);
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    for (List<QCameraMemory::QCameraMemInfo>::iterator it = victims.begin();
+            it != victims.end(); it++) {
+        QCameraMemory::deallocOneBuffer(*it);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: clears all cached buffers
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::clear()
+{
+    List<QCameraMemory::QCameraMemInfo> victims;
+
+    pthread_mutex_lock(&mLock);
+    waitBgJobsLocked();
+    trimLocked(0, victims);
+    pthread_mutex_unlock(&mLock);
+
+    for (List<QCameraMemory::QCameraMemInfo>::iterator it = victims.begin();
+            it != victims.end(); it++) {
+        QCameraMemory::deallocOneBuffer(*it);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : trim
+ *
+ * DESCRIPTION: drops least recently used buffers until the cache is under
+ *              the low watermark. Used on mode switches instead of clear()
+ *              so the next configuration can still reuse buffers.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trim()
+{
+    List<QCameraMemory::QCameraMemInfo> victims;
+
+    pthread_mutex_lock(&mLock);
+    trimLocked(mLowWatermark, victims);
+    pthread_mutex_unlock(&mLock);
+
+    for (List<QCameraMemory::QCameraMemInfo>::iterator it = victims.begin();
+            it != victims.end(); it++) {
+        QCameraMemory::deallocOneBuffer(*it);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : reclaim
+ *
+ * DESCRIPTION: frees every idle buffer for the memory budget. Unlike clear()
+ *              it does not wait for background jobs, it may run on one of
+ *              their allocations.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : bytes freed
+ *==========================================================================*/
+size_t QCameraMemoryPool::reclaim()
+{
+    List<QCameraMemory::QCameraMemInfo> victims;
+    size_t freed = 0;
+
+    pthread_mutex_lock(&mLock);
+    trimLocked(0, victims);
+    pthread_mutex_unlock(&mLock);
+
+    for (List<QCameraMemory::QCameraMemInfo>::iterator it = victims.begin();
+            it != victims.end(); it++) {
+        freed += (*it).size;
+        QCameraMemory::deallocOneBuffer(*it);
+    }
+
+    return freed;
+}
+
+/*===========================================================================
+ * FUNCTION   : findBufferLocked
+ *
+ * DESCRIPTION: search for a appropriate cached buffer. Buffers of any stream
+ *              type are eligible; the smallest one of the first non empty
+ *              size class that fits is taken. Offline reprocess buffers
+ *              still need an exact size match. Secure and non secure
+ *              buffers are never handed out for each other.
+ *
+ * PARAMETERS :
+ *   @memInfo : reference to struct that stores additional memory allocation info
+ *   @heap_id : type of heap
+ *   @size    : size of the buffer
+ *   @cached  : whether the buffer should be cached
+ *   @streaType: type of stream this buffer belongs to
+ *   @secure_mode: secure or non secure buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemoryPool::findBufferLocked(
+        struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
+        size_t size, bool cached, cam_stream_type_t streamType,
+        uint32_t secure_mode)
+{
+    size_t maxSize = size;
+    if (streamType != CAM_STREAM_TYPE_OFFLINE_PROC) {
+        maxSize = size / QCAMERA_POOL_MAX_WASTE_DEN * QCAMERA_POOL_MAX_WASTE_NUM;
+    }
+
+    for (uint32_t b = getBucket(size);
+            (b < QCAMERA_POOL_NUM_BUCKETS) && (getBucketBase(b) <= maxSize);
+            b++) {
+        List<pool_entry_t>::iterator best = mBuckets[b].end();
+        List<pool_entry_t>::iterator it = mBuckets[b].begin();
+        for( ; it != mBuckets[b].end() ; it++) {
+            if (((*it).info.size >= size) &&
+                    ((*it).info.size <= maxSize) &&
+                    ((*it).info.heap_id == heap_id) &&
+                    ((*it).info.cached == cached) &&
+                    ((*it).info.secure_mode == secure_mode) &&
+                    ((best == mBuckets[b].end()) ||
+                    ((*it).info.size < (*best).info.size))) {
+                best = it;
+            }
+        }
+
+        if (best != mBuckets[b].end()) {
+            memInfo = (*best).info;
+            CDBG("%s : Found buffer %lx size %zu from stream type %d",
+                    __func__, (unsigned long)memInfo.handle, memInfo.size,
+                    (*best).streamType);
+            mStats.cachedBytes -= memInfo.size;
+            mStats.cachedCnt--;
+            mBuckets[b].erase(best);
+            return NO_ERROR;
+        }
+    }
+
+    return NAME_NOT_FOUND;
+}
+
+/*===========================================================================
+ * FUNCTION   : recordProfileLocked
+ *
+ * DESCRIPTION: remember the buffer set a stream type uses so the next open
+ *              of this camera can pre-warm it. Caller holds mLock.
+ *
+ * PARAMETERS :
+ *   @streamType: type of stream the buffer is allocated for
+ *   @size    : size of the buffer
+ *   @heap_id : type of heap
+ *   @cached  : whether the buffer is cached
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::recordProfileLocked(cam_stream_type_t streamType,
+        size_t size, unsigned int heap_id, bool cached)
+{
+    if (mCameraId >= MM_CAMERA_MAX_NUM_SENSORS) {
+        return;
+    }
+
+    pthread_mutex_lock(&sProfileLock);
+    pool_profile_t &profile = sProfiles[mCameraId][streamType];
+    uint32_t count = mOutstanding[streamType];
+    if (count > MM_CAMERA_MAX_NUM_FRAMES) {
+        count = MM_CAMERA_MAX_NUM_FRAMES;
+    }
+    if ((profile.size != size) || (profile.heap_id != heap_id) ||
+            (profile.cached != cached)) {
+        profile.size = size;
+        profile.heap_id = heap_id;
+        profile.cached = cached;
+        profile.count = (uint8_t)count;
+    } else if (count > profile.count) {
+        profile.count = (uint8_t)count;
+    }
+    pthread_mutex_unlock(&sProfileLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : allocateBuffer
+ *
+ * DESCRIPTION: allocates a buffer from the memory pool,
+ *              it will re-use cached buffers if possible
+ *
+ * PARAMETERS :
+ *   @memInfo : reference to struct that stores additional memory allocation info
+ *   @heap_id : type of heap
+ *   @size    : size of the buffer
+ *   @cached  : whether the buffer should be cached
+ *   @streaType: type of stream this buffer belongs to
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraMemoryPool::allocateBuffer(
+        struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
+        size_t size, bool cached, cam_stream_type_t streamType,
+        uint32_t secure_mode)
+{
+    int rc = NO_ERROR;
+
+    pthread_mutex_lock(&mLock);
+
+    rc = findBufferLocked(memInfo, heap_id, size, cached, streamType,
+            secure_mode);
+    if (NO_ERROR == rc) {
+        mStats.hits++;
+        mStats.bytesReused += memInfo.size;
+    } else {
+        CDBG_HIGH("%s : Buffer not found!", __func__);
+        mStats.misses++;
+        // do not hold the pool while the allocator works
+        pthread_mutex_unlock(&mLock);
+        rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size, cached,
+                 secure_mode);
+        pthread_mutex_lock(&mLock);
+        if (NO_ERROR == rc) {
+            mStats.bytesAllocated += memInfo.size;
+        }
+    }
+
+    if (NO_ERROR == rc) {
+        mOutstanding[streamType]++;
+        if (NON_SECURE == secure_mode) {
+            recordProfileLocked(streamType, size, heap_id, cached);
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : prewarm
+ *
+ * DESCRIPTION: allocates a set of buffers ahead of use and keeps them idle
+ *              in the cache. Stops early at the high watermark.
+ *
+ * PARAMETERS :
+ *   @streamType: type of stream the buffers are expected for
+ *   @size    : size of each buffer
+ *   @count   : number of buffers
+ *   @heap_id : type of heap
+ *   @cached  : whether the buffers should be cached
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraMemoryPool::prewarm(cam_stream_type_t streamType, size_t size,
+        uint8_t count, unsigned int heap_id, bool cached)
+{
+    int32_t rc = NO_ERROR;
+
+    // pre-warmed buffers would be the first to go under pressure
+    if (QCameraMemBudget::getInstance().getPressure() !=
+            QCAMERA_MEM_PRESSURE_NORMAL) {
+        CDBG_HIGH("%s: skipped under memory pressure", __func__);
+        return NO_ERROR;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        QCameraMemory::QCameraMemInfo memInfo;
+
+        pthread_mutex_lock(&mLock);
+        bool full = (mStats.cachedBytes + size) > mHighWatermark;
+        pthread_mutex_unlock(&mLock);
+        if (full) {
+            CDBG_HIGH("%s: high watermark reached after %d buffers",
+                    __func__, i);
+            break;
+        }
+
+        rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size, cached,
+                NON_SECURE);
+        if (rc != NO_ERROR) {
+            ALOGE("%s: pre-warm allocation of %zu bytes failed",
+                    __func__, size);
+            break;
+        }
+
+        pthread_mutex_lock(&mLock);
+        putBufferLocked(memInfo, streamType);
+        mStats.prewarmed++;
+        mStats.bytesAllocated += memInfo.size;
+        pthread_mutex_unlock(&mLock);
+    }
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : prewarmRoutine
+ *
+ * DESCRIPTION: executor task replaying the buffer sets this camera used
+ *              last time, minus what streams already hold
+ *
+ * PARAMETERS :
+ *   @data    : ptr to QCameraMemoryPool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::prewarmRoutine(void *data)
+{
+    QCameraMemoryPool *pme = (QCameraMemoryPool *)data;
+    pool_profile_t profiles[CAM_STREAM_TYPE_MAX];
+
+    pthread_mutex_lock(&sProfileLock);
+    memcpy(profiles, sProfiles[pme->mCameraId], sizeof(profiles));
+    pthread_mutex_unlock(&sProfileLock);
+
+    for (int i = CAM_STREAM_TYPE_DEFAULT; i < CAM_STREAM_TYPE_MAX; i++) {
+        if (profiles[i].count == 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&pme->mLock);
+        uint32_t held = pme->mOutstanding[i];
+        pthread_mutex_unlock(&pme->mLock);
+        if (held >= profiles[i].count) {
+            continue;
+        }
+
+        pme->prewarm((cam_stream_type_t)i, profiles[i].size,
+                (uint8_t)(profiles[i].count - held),
+                profiles[i].heap_id, profiles[i].cached);
+    }
+
+    pthread_mutex_lock(&pme->mLock);
+    pme->mBgJobs--;
+    pthread_cond_broadcast(&pme->mBgCond);
+    pthread_mutex_unlock(&pme->mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : prewarm
+ *
+ * DESCRIPTION: schedules pre-allocation of the buffer sets this camera used
+ *              in its previous session. Runs on the blocking executor.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraMemoryPool::prewarm()
+{
+    int32_t rc = NO_ERROR;
+
+    if (mCameraId >= MM_CAMERA_MAX_NUM_SENSORS) {
+        return BAD_VALUE;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mBgJobs++;
+    rc = QCameraExecutor::getBlockingInstance().submit(prewarmRoutine, this);
+    if (rc != NO_ERROR) {
+        ALOGE("%s: cannot schedule pool pre-warm", __func__);
+        mBgJobs--;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : getStats
+ *
+ * DESCRIPTION: snapshot of the pool statistics
+ *
+ * PARAMETERS :
+ *   @stats   : [output] pool statistics
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::getStats(qcamera_pool_stats_t &stats)
+{
+    pthread_mutex_lock(&mLock);
+    stats = mStats;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print pool statistics
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::dump(int fd)
+{
+    qcamera_pool_stats_t stats;
+    getStats(stats);
+
+    dprintf(fd, "\n Memory pool: hits %u misses %u prewarmed %u trims %u",
+            stats.hits, stats.misses, stats.prewarmed, stats.trims);
+    dprintf(fd, "\n   bytes allocated %llu reused %llu trimmed %llu",
+            (unsigned long long)stats.bytesAllocated,
+            (unsigned long long)stats.bytesReused,
+            (unsigned long long)stats.bytesTrimmed);
+    dprintf(fd, "\n   cached %zu bytes in %u buffers, peak %zu, watermarks %zu/%zu\n",
+            stats.cachedBytes, stats.cachedCnt, stats.peakCachedBytes,
+            mLowWatermark, mHighWatermark);
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraStreamBufCache
+ *
+ * DESCRIPTION: constructor of QCameraStreamBufCache
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraStreamBufCache::QCameraStreamBufCache()
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    // budget is in MB, 0 disables the cache
+    property_get("persist.camera.mem.cache.budget", value, "96");
+    mBudget = (size_t)atoi(value) << 20;
+
+    memset(&mStats, 0, sizeof(mStats));
+    pthread_mutex_init(&mLock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraStreamBufCache
+ *
+ * DESCRIPTION: deconstructor of QCameraStreamBufCache
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraStreamBufCache::~QCameraStreamBufCache()
+{
+    clear();
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : keyMatch
+ *
+ * DESCRIPTION: compare two buffer set keys
+ *
+ * PARAMETERS :
+ *   @a       : first key
+ *   @b       : second key
+ *
+ * RETURN     : true if a set described by a can serve b
+ *==========================================================================*/
+bool QCameraStreamBufCache::keyMatch(const qcamera_buf_cache_key_t &a,
+        const qcamera_buf_cache_key_t &b)
+{
+    return (a.streamType == b.streamType) &&
+            (a.format == b.format) &&
+            (a.size == b.size) &&
+            (a.stride == b.stride) &&
+            (a.scanline == b.scanline) &&
+            (a.bufferCnt == b.bufferCnt) &&
+            (a.cached == b.cached);
+}
+
+/*===========================================================================
+ * FUNCTION   : evictLocked
+ *
+ * DESCRIPTION: drop least recently released sets until at most target bytes
+ *              are cached. Caller holds mLock and frees the victims.
+ *
+ * PARAMETERS :
+ *   @target  : number of cached bytes to keep
+ *   @victims : [output] evicted memory objects
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStreamBufCache::evictLocked(size_t target,
+        List<QCameraMemory *> &victims)
+{
+    while ((mStats.cachedBytes > target) && !mEntries.empty()) {
+        List<cache_entry_t>::iterator it = mEntries.begin();
+        victims.push_back((*it).mem);
+        mStats.cachedBytes -= (*it).bytes;
+        mStats.cachedCnt--;
+        mStats.evictions++;
+        mEntries.erase(it);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : acquire
+ *
+ * DESCRIPTION: take a cached buffer set matching the key. Cached buffers are
+ *              invalidated so no stale CPU lines overwrite the next DMA.
+ *
+ * PARAMETERS :
+ *   @key     : description of the required buffer set
+ *
+ * RETURN     : ptr to a memory obj holding the buffers, NULL if none matches
+ *==========================================================================*/
+QCameraMemory *QCameraStreamBufCache::acquire(const qcamera_buf_cache_key_t &key)
+{
+    QCameraMemory *mem = NULL;
+
+    pthread_mutex_lock(&mLock);
+    List<cache_entry_t>::iterator it = mEntries.begin();
+    for (; it != mEntries.end(); it++) {
+        if (keyMatch((*it).key, key)) {
+            mem = (*it).mem;
+            mStats.cachedBytes -= (*it).bytes;
+            mStats.cachedCnt--;
+            mEntries.erase(it);
+            break;
+        }
+    }
+    if (mem != NULL) {
+        mStats.hits++;
+    } else {
+        mStats.misses++;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    // the set goes back to a device writer, only lines the previous
+    // stream wrote on the CPU have to go
+    if ((mem != NULL) && mem->isCached()) {
+        for (uint32_t i = 0; i < mem->getCnt(); i++) {
+            mem->invalidateCache(i);
+        }
+    }
+
+    CDBG("%s: stream type %d size %zu cnt %d: %s", __func__, key.streamType,
+            key.size, key.bufferCnt, (mem != NULL) ? "hit" : "miss");
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : release
+ *
+ * DESCRIPTION: keep a buffer set for a later stream with the same key.
+ *              Older sets are freed to stay within the budget.
+ *
+ * PARAMETERS :
+ *   @key     : description of the buffer set
+ *   @mem     : memory obj holding the buffers
+ *
+ * RETURN     : true if the cache took ownership of mem, false if the
+ *              caller still has to free it
+ *==========================================================================*/
+bool QCameraStreamBufCache::release(const qcamera_buf_cache_key_t &key,
+        QCameraMemory *mem)
+{
+    List<QCameraMemory *> victims;
+    size_t bytes = 0;
+
+    for (uint32_t i = 0; i < mem->getCnt(); i++) {
+        bytes += (size_t)mem->getSize(i);
+    }
+
+    pthread_mutex_lock(&mLock);
+    if ((bytes == 0) || (bytes > mBudget)) {
+        mStats.rejected++;
+        pthread_mutex_unlock(&mLock);
+        return false;
+    }
+
+    cache_entry_t entry;
+    entry.key = key;
+    entry.mem = mem;
+    entry.bytes = bytes;
+    mEntries.push_back(entry);
+    mStats.cachedBytes += bytes;
+    mStats.cachedCnt++;
+    evictLocked(mBudget, victims);
+    pthread_mutex_unlock(&mLock);
+
+    for (List<QCameraMemory *>::iterator it = victims.begin();
+            it != victims.end(); it++) {
+        (*it)->deallocate();
+        delete *it;
+    }
+
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: free all cached buffer sets
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : bytes freed
+ *==========================================================================*/
+size_t QCameraStreamBufCache::clear()
+{
+    List<QCameraMemory *> victims;
+    size_t freed;
+
+    pthread_mutex_lock(&mLock);
+    freed = mStats.cachedBytes;
+    evictLocked(0, victims);
+    pthread_mutex_unlock(&mLock);
+
+    for (List<QCameraMemory *>::iterator it = victims.begin();
+            it != victims.end(); it++) {
+        (*it)->deallocate();
+        delete *it;
+    }
+
+    return freed;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print cache statistics
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStreamBufCache::dump(int fd)
+{
+    pthread_mutex_lock(&mLock);
+    qcamera_buf_cache_stats_t stats = mStats;
+    pthread_mutex_unlock(&mLock);
+
+    dprintf(fd, "\n Stream buffer cache: hits %u misses %u evictions %u rejected %u",
+            stats.hits, stats.misses, stats.evictions, stats.rejected);
+    dprintf(fd, "\n   cached %zu bytes in %u sets, budget %zu\n",
+            stats.cachedBytes, stats.cachedCnt, mBudget);
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraCallbackBufPool
+ *
+ * DESCRIPTION: constructor of QCameraCallbackBufPool. Copy buffers are
+ *              allocated on first use, the pool starts with the reference
+ *              of its owner.
+ *
+ * PARAMETERS :
+ *   @getMemory : camera memory request ops table
+ *   @cbCookie  : camera callback cookie
+ *   @size      : size of a compacted frame
+ *   @count     : number of copy buffers
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraCallbackBufPool::QCameraCallbackBufPool(camera_request_memory getMemory,
+        void *cbCookie, size_t size, uint32_t count)
+    : mGetMemory(getMemory),
+      mCallbackCookie(cbCookie),
+      mSize(size),
+      mCount(count),
+      mNext(0),
+      mRefs(1)
+{
+    if (mCount == 0) {
+        mCount = 1;
+    } else if (mCount > QCAMERA_CB_POOL_MAX_BUFS) {
+        mCount = QCAMERA_CB_POOL_MAX_BUFS;
+    }
+
+    memset(mCopyBufs, 0, sizeof(mCopyBufs));
+    memset(mMapBufs, 0, sizeof(mMapBufs));
+    for (uint32_t i = 0; i < QCAMERA_CB_POOL_MAX_BUFS; i++) {
+        mCopyBufs[i].pool = this;
+        mCopyBufs[i].fd = -1;
+    }
+    for (uint32_t i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+        mMapBufs[i].pool = this;
+        mMapBufs[i].fd = -1;
+    }
+    memset(&mStats, 0, sizeof(mStats));
+    pthread_mutex_init(&mLock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraCallbackBufPool
+ *
+ * DESCRIPTION: deconstructor of QCameraCallbackBufPool, only reached once
+ *              the owner and all callbacks have dropped their references
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraCallbackBufPool::~QCameraCallbackBufPool()
+{
+    for (uint32_t i = 0; i < QCAMERA_CB_POOL_MAX_BUFS; i++) {
+        if (mCopyBufs[i].mem != NULL) {
+            mCopyBufs[i].mem->release(mCopyBufs[i].mem);
+        }
+    }
+    for (uint32_t i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+        if (mMapBufs[i].mem != NULL) {
+            mMapBufs[i].mem->release(mMapBufs[i].mem);
+        }
+    }
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : takeLocked
+ *
+ * DESCRIPTION: hand out a buffer for one callback. mLock must be held.
+ *
+ * PARAMETERS :
+ *   @buf     : pool buffer
+ *   @token   : returns the cookie to pass to releaseBuffer
+ *
+ * RETURN     : camera memory of the buffer
+ *==========================================================================*/
+camera_memory_t *QCameraCallbackBufPool::takeLocked(cb_buf_t *buf, void **token)
+{
+    buf->refs++;
+    mRefs++;
+    *token = buf;
+    return buf->mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : getBuffer
+ *
+ * DESCRIPTION: get a free copy buffer, starting after the one handed out
+ *              last so a buffer stays with the app as long as possible
+ *
+ * PARAMETERS :
+ *   @token   : returns the cookie to pass to releaseBuffer
+ *
+ * RETURN     : camera memory of mSize bytes
+ *              NULL if all buffers are in flight or allocation failed,
+ *              the caller has to allocate one for this frame
+ *==========================================================================*/
+camera_memory_t *QCameraCallbackBufPool::getBuffer(void **token)
+{
+    camera_memory_t *mem = NULL;
+
+    pthread_mutex_lock(&mLock);
+    for (uint32_t i = 0; i < mCount; i++) {
+        uint32_t idx = (mNext + i) % mCount;
+        cb_buf_t *buf = &mCopyBufs[idx];
+        if (buf->refs != 0) {
+            continue;
+        }
+        if (buf->mem == NULL) {
+            buf->mem = mGetMemory(-1, mSize, 1, mCallbackCookie);
+            if ((buf->mem != NULL) && (buf->mem->data == NULL)) {
+                buf->mem->release(buf->mem);
+                buf->mem = NULL;
+            }
+            if (buf->mem == NULL) {
+                ALOGE("%s: Failed to allocate callback buffer of %zu bytes",
+                        __func__, mSize);
+                break;
+            }
+        }
+        mNext = (idx + 1) % mCount;
+        mStats.copies++;
+        mem = takeLocked(buf, token);
+        break;
+    }
+    if (mem == NULL) {
+        mStats.fallbacks++;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : getMapping
+ *
+ * DESCRIPTION: get the mapping of a stream buffer to send it to the app
+ *              without a copy. The mapping is made once per buffer index
+ *              and kept for the life of the pool.
+ *
+ * PARAMETERS :
+ *   @fd      : stream buffer fd
+ *   @index   : stream buffer index
+ *   @size    : size the app sees
+ *   @token   : returns the cookie to pass to releaseBuffer
+ *
+ * RETURN     : camera memory mapping the stream buffer
+ *              NULL if the buffer can't be mapped, or its cached mapping
+ *              is stale and still in flight
+ *==========================================================================*/
+camera_memory_t *QCameraCallbackBufPool::getMapping(int fd, uint32_t index,
+        size_t size, void **token)
+{
+    camera_memory_t *mem = NULL;
+
+    pthread_mutex_lock(&mLock);
+    if ((fd < 0) || (index >= MM_CAMERA_MAX_NUM_FRAMES)) {
+        mStats.fallbacks++;
+        pthread_mutex_unlock(&mLock);
+        return NULL;
+    }
+
+    cb_buf_t *buf = &mMapBufs[index];
+    if ((buf->mem != NULL) && (buf->refs == 0) &&
+            ((buf->fd != fd) || (buf->size != size))) {
+        buf->mem->release(buf->mem);
+        buf->mem = NULL;
+    }
+    if (buf->mem == NULL) {
+        buf->mem = mGetMemory(fd, size, 1, mCallbackCookie);
+        if ((buf->mem != NULL) && (buf->mem->data == NULL)) {
+            buf->mem->release(buf->mem);
+            buf->mem = NULL;
+        }
+        if (buf->mem != NULL) {
+            buf->fd = fd;
+            buf->size = size;
+            mStats.mappings++;
+        }
+    }
+    if ((buf->mem != NULL) && (buf->fd == fd) && (buf->size == size)) {
+        mStats.mapped++;
+        mem = takeLocked(buf, token);
+    } else {
+        mStats.fallbacks++;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return mem;
 }
 
 /*===========================================================================
  * FUNCTION   : releaseBuffer
  *
- * DESCRIPTION: release one cached buffers
+ * DESCRIPTION: release callback of a pooled buffer, matches the release_cb
+ *              signature of the callback notifier
  *
  * PARAMETERS :
- *   @memInfo : reference to struct that stores additional memory allocation info
- *   @streamType: Type of stream the buffers belongs to
+ *   @data     : token returned with the buffer
+ *   @cookie   : not used
+ *   @cbStatus : callback status
  *
- * RETURN     : none
+ * RETURN     : None
  *==========================================================================*/
-void QCameraMemoryPool::releaseBuffer(
-        struct QCameraMemory::QCameraMemInfo &memInfo,
-        cam_stream_type_t streamType)
+void QCameraCallbackBufPool::releaseBuffer(void *data,
+        void * /*cookie*/, int32_t /*cbStatus*/)
 {
-    pthread_mutex_lock(&mLock);
-
-    mPools[streamType].push_back(memInfo);
-
-    pthread_mutex_unlock(&mLock);
+    cb_buf_t *buf = (cb_buf_t *)data;
+    if ((buf != NULL) && (buf->pool != NULL)) {
+        buf->pool->put(buf);
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : clear
+ * FUNCTION   : put
  *
- * DESCRIPTION: clears all cached buffers
+ * DESCRIPTION: drop the reference of a callback, frees the pool after
+ *              it is retired and the last callback is done
  *
- * PARAMETERS : none
+ * PARAMETERS :
+ *   @buf     : pool buffer
  *
- * RETURN     : none
+ * RETURN     : None
  *==========================================================================*/
-void QCameraMemoryPool::clear()
+void QCameraCallbackBufPool::put(cb_buf_t *buf)
 {
     pthread_mutex_lock(&mLock);
+    buf->refs--;
+    bool last = (--mRefs == 0);
+    pthread_mutex_unlock(&mLock);
 
-    for (int i = CAM_STREAM_TYPE_DEFAULT; i < CAM_STREAM_TYPE_MAX; i++ ) {
-        List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-        it = mPools[i].begin();
-        for( ; it != mPools[i].end() ; it++) {
-            QCameraMemory::deallocOneBuffer(*it);
-        }
-
-        mPools[i].clear();
+    if (last) {
+        delete this;
     }
-
-    pthread_mutex_unlock(&mLock);
 }
 
 /*===========================================================================
- * FUNCTION   : findBufferLocked
+ * FUNCTION   : retire
  *
- * DESCRIPTION: search for a appropriate cached buffer
+ * DESCRIPTION: drop the reference of the owner. The pool must not be
+ *              used by the owner afterwards.
  *
- * PARAMETERS :
- *   @memInfo : reference to struct that stores additional memory allocation info
- *   @heap_id : type of heap
- *   @size    : size of the buffer
- *   @cached  : whether the buffer should be cached
- *   @streaType: type of stream this buffer belongs to
+ * PARAMETERS : None
  *
- * RETURN     : int32_t type of status
- *              NO_ERROR  -- success
- *              none-zero failure code
+ * RETURN     : None
  *==========================================================================*/
-int QCameraMemoryPool::findBufferLocked(
-        struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
-        size_t size, bool cached, cam_stream_type_t streamType)
+void QCameraCallbackBufPool::retire()
 {
-    int rc = NAME_NOT_FOUND;
-
-    if (mPools[streamType].empty()) {
-        return NAME_NOT_FOUND;
-    }
+    pthread_mutex_lock(&mLock);
+    bool last = (--mRefs == 0);
+    pthread_mutex_unlock(&mLock);
 
-    List<struct QCameraMemory::QCameraMemInfo>::iterator it = mPools[streamType].begin();
-    if (streamType == CAM_STREAM_TYPE_OFFLINE_PROC) {
-        for( ; it != mPools[streamType].end() ; it++) {
-            if( ((*it).size == size) &&
-                    ((*it).heap_id == heap_id) &&
-                    ((*it).cached == cached) ) {
-                memInfo = *it;
-                ALOGE("%s : Found buffer %lx size %d",
-                        __func__, (unsigned long)memInfo.handle, memInfo.size);
-                mPools[streamType].erase(it);
-                rc = NO_ERROR;
-                break;
-            }
-        }
-    } else {
-        for( ; it != mPools[streamType].end() ; it++) {
-            if(((*it).size >= size) &&
-                    ((*it).heap_id == heap_id) &&
-                    ((*it).cached == cached) ) {
-                memInfo = *it;
-                ALOGE("%s : Found buffer %lx size %d",
-                        __func__, (unsigned long)memInfo.handle, memInfo.size);
-                mPools[streamType].erase(it);
-                rc = NO_ERROR;
-                break;
-            }
-        }
+    if (last) {
+        delete this;
     }
-
-    return rc;
 }
 
 /*===========================================================================
- * FUNCTION   : allocateBuffer
+ * FUNCTION   : dump
  *
- * DESCRIPTION: allocates a buffer from the memory pool,
- *              it will re-use cached buffers if possible
+ * DESCRIPTION: print pool statistics
  *
  * PARAMETERS :
- *   @memInfo : reference to struct that stores additional memory allocation info
- *   @heap_id : type of heap
- *   @size    : size of the buffer
- *   @cached  : whether the buffer should be cached
- *   @streaType: type of stream this buffer belongs to
+ *   @fd      : file descriptor to write to
  *
- * RETURN     : int32_t type of status
- *              NO_ERROR  -- success
- *              none-zero failure code
+ * RETURN     : none
  *==========================================================================*/
-int QCameraMemoryPool::allocateBuffer(
-        struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
-        size_t size, bool cached, cam_stream_type_t streamType,
-        uint32_t secure_mode)
+void QCameraCallbackBufPool::dump(int fd)
 {
-    int rc = NO_ERROR;
-
     pthread_mutex_lock(&mLock);
-
-    rc = findBufferLocked(memInfo, heap_id, size, cached, streamType);
-    if (NAME_NOT_FOUND == rc ) {
-        CDBG_HIGH("%s : Buffer not found!", __func__);
-        rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size, cached,
-                 secure_mode);
-    }
-
+    qcamera_cb_pool_stats_t stats = mStats;
     pthread_mutex_unlock(&mLock);
 
-    return rc;
+    dprintf(fd, "\n Preview callback buffers: %u x %zu bytes", mCount, mSize);
+    dprintf(fd, "\n   copies %u mapped %u fallbacks %u mappings %u\n",
+            stats.copies, stats.mapped, stats.fallbacks, stats.mappings);
 }
 
 /*===========================================================================
@@ -802,8 +2161,11 @@ int QCameraHeapMemory::allocate(uint8_t count, size_t size, uint32_t isSecure)
                 }
                 ATRACE_END();
                 return NO_MEMORY;
-            } else
+            } else {
                 mPtr[i] = vaddr;
+                QCameraBufferAllocator::getInstance().adviseMapping(vaddr,
+                        mMemInfo[i].size);
+            }
         }
     }
     if (rc == 0) {
@@ -852,6 +2214,8 @@ int QCameraHeapMemory::allocateMore(uint8_t count, size_t size)
             return NO_MEMORY;
         } else {
             mPtr[i] = vaddr;
+            QCameraBufferAllocator::getInstance().adviseMapping(vaddr,
+                    mMemInfo[i].size);
         }
     }
     mBufferCount = (uint8_t)(mBufferCount + count);
@@ -886,16 +2250,19 @@ void QCameraHeapMemory::deallocate()
  * PARAMETERS :
  *   @index   : index of the buffer
  *   @cmd     : cache ops command
+ *   @offset  : start of the range
+ *   @len     : length of the range, 0 for the rest of the buffer
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
-int QCameraHeapMemory::cacheOps(uint32_t index, unsigned int cmd)
+int QCameraHeapMemory::cacheOps(uint32_t index, unsigned int cmd,
+        size_t offset, size_t len)
 {
     if (index >= mBufferCount)
         return BAD_INDEX;
-    return cacheOpsInternal(index, cmd, mPtr[index]);
+    return cacheOpsInternal(index, cmd, mPtr[index], offset, len);
 }
 
 /*===========================================================================
@@ -1145,16 +2512,19 @@ void QCameraStreamMemory::deallocate()
  * PARAMETERS :
  *   @index   : index of the buffer
  *   @cmd     : cache ops command
+ *   @offset  : start of the range
+ *   @len     : length of the range, 0 for the rest of the buffer
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
-int QCameraStreamMemory::cacheOps(uint32_t index, unsigned int cmd)
+int QCameraStreamMemory::cacheOps(uint32_t index, unsigned int cmd,
+        size_t offset, size_t len)
 {
     if (index >= mBufferCount)
         return BAD_INDEX;
-    return cacheOpsInternal(index, cmd, mCameraMemory[index]->data);
+    return cacheOpsInternal(index, cmd, mCameraMemory[index]->data, offset, len);
 }
 
 /*===========================================================================
@@ -1791,10 +3161,30 @@ int QCameraVideoMemory::convCamtoOMXFormat(cam_format_t format)
  * RETURN     : none
  *==========================================================================*/
 QCameraGrallocMemory::QCameraGrallocMemory(camera_request_memory memory, void *user)
-        : QCameraMemory(true), mColorSpace(ITU_R_601_FR)
+        : QCameraMemory(true), mColorSpace(ITU_R_601_FR),
+          mDisplayQ(NULL, NULL, QCAMERA_QUEUE_RING_SIZE)
 {
+    char value[PROPERTY_VALUE_MAX];
+
     mMinUndequeuedBuffers = 0;
     mMappableBuffers = 0;
+    mEnqueuedBuffers = 0;
+    mDisplayActive = false;
+    mDisplayRetFn = NULL;
+    mDisplayUser = NULL;
+    memset(mDisplayJobs, 0, sizeof(mDisplayJobs));
+    memset(&mDisplayStats, 0, sizeof(mDisplayStats));
+    memset(mDataHeld, 0, sizeof(mDataHeld));
+    memset(mRetDeferred, 0, sizeof(mRetDeferred));
+    memset(mRetMapNeeded, 0, sizeof(mRetMapNeeded));
+    // frames allowed to wait for the display thread before the oldest
+    // one is dropped
+    property_get("persist.camera.display.pending", value, "1");
+    mMaxDisplayPending = (uint32_t)atoi(value);
+    if (mMaxDisplayPending < 1) {
+        mMaxDisplayPending = 1;
+    }
+    pthread_mutex_init(&mLock, NULL);
     mWindow = NULL;
     mWidth = mHeight = mStride = mScanline = mUsage = 0;
     mDisplayFormat = HAL_PIXEL_FORMAT_YCrCb_420_SP;
@@ -1818,6 +3208,8 @@ QCameraGrallocMemory::QCameraGrallocMemory(camera_request_memory memory, void *u
  *==========================================================================*/
 QCameraGrallocMemory::~QCameraGrallocMemory()
 {
+    stopDisplay();
+    pthread_mutex_destroy(&mLock);
 }
 
 /*===========================================================================
@@ -2086,7 +3478,7 @@ int32_t QCameraGrallocMemory::dequeueBuffer()
                 void *cbcr_data = (void *)((uint8_t *)mCameraMemory[dequeuedIdx]->data
                         + (mStride * mScanline));
                 size_t cbcr_len = mPrivateHandle[dequeuedIdx]->size - (mStride * mScanline);
-                memset(cbcr_data, 128, mPrivateHandle[dequeuedIdx]->size);
+                memset(cbcr_data, 128, cbcr_len);
             }
             mMappableBuffers++;
         }
@@ -2098,6 +3490,363 @@ int32_t QCameraGrallocMemory::dequeueBuffer()
 }
 
 
+/*===========================================================================
+ * FUNCTION   : displayBufferAsync
+ *
+ * DESCRIPTION: hand a frame to the display thread, which enqueues it to the
+ *              window and dequeues whatever buffers the window can give
+ *              back. When the display thread is behind, the oldest frame
+ *              still waiting is dropped and returned right away instead of
+ *              holding up the stream. The frame stays held for the data
+ *              path until releaseDataHold, so it is not returned to the
+ *              stream while still being read.
+ *
+ * PARAMETERS :
+ *   @index     : index of preview frame
+ *   @timeStamp : frame presentation time, 0 if none
+ *   @retFn     : called with buffers returned to the stream
+ *   @user      : user data of retFn
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraGrallocMemory::displayBufferAsync(uint32_t index,
+        nsecs_t timeStamp, display_ret_fn retFn, void *user)
+{
+    display_job_t *dropped = NULL;
+
+    if ((index >= mBufferCount) || (BUFFER_NOT_OWNED == mLocalFlag[index])) {
+        ALOGE("%s: buffer %d to be displayed is not owned", __func__, index);
+        return INVALID_OPERATION;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mDisplayRetFn = retFn;
+    mDisplayUser = user;
+    if (!mDisplayActive) {
+        memset(&mDisplayStats, 0, sizeof(mDisplayStats));
+        mDisplayQ.init();
+        if (mDisplayTh.launch(displayRoutine, this) != NO_ERROR) {
+            pthread_mutex_unlock(&mLock);
+            ALOGE("%s: Failed to launch display thread", __func__);
+            return UNKNOWN_ERROR;
+        }
+        mDisplayActive = true;
+    }
+
+    if ((uint32_t)mDisplayQ.getCurrentSize() >= mMaxDisplayPending) {
+        dropped = (display_job_t *)mDisplayQ.dequeue();
+        if (dropped != NULL) {
+            mDisplayStats.dropped++;
+        }
+    }
+    mDataHeld[index] = true;
+    mDisplayJobs[index].index = index;
+    mDisplayJobs[index].timeStamp = timeStamp;
+    mDisplayQ.enqueue((void *)&mDisplayJobs[index]);
+    mDisplayStats.queued++;
+    pthread_mutex_unlock(&mLock);
+
+    mDisplayTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+
+    if (dropped != NULL) {
+        CDBG_HIGH("%s: display behind, dropping frame %d", __func__,
+                dropped->index);
+        returnBuffer(dropped->index, false, retFn, user);
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseDataHold
+ *
+ * DESCRIPTION: the data path is done reading a frame handed to
+ *              displayBufferAsync. If the display stage gave the buffer
+ *              back in the meantime, it is returned to the stream now.
+ *
+ * PARAMETERS :
+ *   @index   : index of preview frame
+ *
+ * RETURN     : true if the frame was held, false if it never reached the
+ *              display stage and the caller still owns it
+ *==========================================================================*/
+bool QCameraGrallocMemory::releaseDataHold(uint32_t index)
+{
+    bool deferred, mapNeeded;
+    display_ret_fn retFn;
+    void *user;
+
+    if (index >= MM_CAMERA_MAX_NUM_FRAMES) {
+        return false;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (!mDataHeld[index]) {
+        pthread_mutex_unlock(&mLock);
+        return false;
+    }
+    mDataHeld[index] = false;
+    deferred = mRetDeferred[index];
+    mapNeeded = mRetMapNeeded[index];
+    mRetDeferred[index] = false;
+    retFn = mDisplayRetFn;
+    user = mDisplayUser;
+    pthread_mutex_unlock(&mLock);
+
+    if (deferred && (retFn != NULL)) {
+        retFn(index, mapNeeded, user);
+    }
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : returnBuffer
+ *
+ * DESCRIPTION: give a buffer the display stage is done with back to the
+ *              stream, or leave it to releaseDataHold while the data path
+ *              still holds it
+ *
+ * PARAMETERS :
+ *   @index     : buffer index
+ *   @mapNeeded : buffer is new to the backend and has to be mapped first
+ *   @retFn     : called with the buffer
+ *   @user      : user data of retFn
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraGrallocMemory::returnBuffer(uint32_t index, bool mapNeeded,
+        display_ret_fn retFn, void *user)
+{
+    pthread_mutex_lock(&mLock);
+    if (mDataHeld[index]) {
+        mRetDeferred[index] = true;
+        mRetMapNeeded[index] = mapNeeded;
+        pthread_mutex_unlock(&mLock);
+        return;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    retFn(index, mapNeeded, user);
+}
+
+/*===========================================================================
+ * FUNCTION   : stopDisplay
+ *
+ * DESCRIPTION: stop the display thread. Frames still waiting stay owned by
+ *              the HAL and are cancelled to the window on deallocate.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraGrallocMemory::stopDisplay()
+{
+    pthread_mutex_lock(&mLock);
+    bool active = mDisplayActive;
+    mDisplayActive = false;
+    pthread_mutex_unlock(&mLock);
+
+    if (!active) {
+        return;
+    }
+
+    mDisplayTh.exit();
+    // jobs point into mDisplayJobs, drain rather than flush
+    while (mDisplayQ.dequeue() != NULL) {
+    }
+    // the stream is stopped, no data path release comes any more
+    pthread_mutex_lock(&mLock);
+    memset(mDataHeld, 0, sizeof(mDataHeld));
+    memset(mRetDeferred, 0, sizeof(mRetDeferred));
+    pthread_mutex_unlock(&mLock);
+
+    ALOGI("%s: queued %u displayed %u dropped %u returned %u, "
+            "stalls enqueue %u dequeue %u (%lld us, max %lld us), "
+            "dequeue misses %u", __func__,
+            mDisplayStats.queued, mDisplayStats.displayed,
+            mDisplayStats.dropped, mDisplayStats.returned,
+            mDisplayStats.enqueueStalls, mDisplayStats.dequeueStalls,
+            (long long)(mDisplayStats.stallTime / 1000),
+            (long long)(mDisplayStats.maxStall / 1000),
+            mDisplayStats.dequeueMisses);
+}
+
+/*===========================================================================
+ * FUNCTION   : getDisplayStats
+ *
+ * DESCRIPTION: query display stage counters
+ *
+ * PARAMETERS :
+ *   @stats   : [output] display counters
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraGrallocMemory::getDisplayStats(qcamera_display_stats_t &stats)
+{
+    pthread_mutex_lock(&mLock);
+    stats = mDisplayStats;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : noteWindowCall
+ *
+ * DESCRIPTION: account a window call that took more than half a frame
+ *              interval as a display stall
+ *
+ * PARAMETERS :
+ *   @start   : time the call was issued
+ *   @stalls  : stall counter of the call type
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraGrallocMemory::noteWindowCall(nsecs_t start, uint32_t &stalls)
+{
+    nsecs_t duration = systemTime() - start;
+    nsecs_t threshold = 500000000LL / ((mMaxFPS > 0) ? mMaxFPS : 30);
+
+    if (duration < threshold) {
+        return;
+    }
+    pthread_mutex_lock(&mLock);
+    stalls++;
+    mDisplayStats.stallTime += duration;
+    if (duration > mDisplayStats.maxStall) {
+        mDisplayStats.maxStall = duration;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : processDisplayJob
+ *
+ * DESCRIPTION: enqueue one frame to the window, then dequeue buffers for as
+ *              long as the window holds more than its min undequeued count,
+ *              so dequeue_buffer is not called when it would have to block
+ *
+ * PARAMETERS :
+ *   @job     : frame to display
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraGrallocMemory::processDisplayJob(display_job_t *job)
+{
+    int32_t err = NO_ERROR;
+    nsecs_t start;
+
+    pthread_mutex_lock(&mLock);
+    display_ret_fn retFn = mDisplayRetFn;
+    void *user = mDisplayUser;
+    pthread_mutex_unlock(&mLock);
+
+    if (job->timeStamp != 0) {
+        err = mWindow->set_timestamp(mWindow, job->timeStamp);
+        if (err != NO_ERROR) {
+            ALOGE("%s: Failed to native window timestamp", __func__);
+        }
+    }
+
+    start = systemTime();
+    err = mWindow->enqueue_buffer(mWindow,
+            (buffer_handle_t *)mBufferHandle[job->index]);
+    noteWindowCall(start, mDisplayStats.enqueueStalls);
+    if (err != 0) {
+        ALOGE("%s: enqueue_buffer failed, err = %d", __func__, err);
+        // the window did not take it, give it back to the stream
+        returnBuffer(job->index, false, retFn, user);
+    } else {
+        CDBG("%s: enqueue_buffer hdl=%p", __func__,
+                *mBufferHandle[job->index]);
+        pthread_mutex_lock(&mLock);
+        mLocalFlag[job->index] = BUFFER_NOT_OWNED;
+        mEnqueuedBuffers++;
+        mDisplayStats.displayed++;
+        pthread_mutex_unlock(&mLock);
+    }
+
+    while (true) {
+        pthread_mutex_lock(&mLock);
+        bool available = (mEnqueuedBuffers > 0) && mDisplayActive;
+        pthread_mutex_unlock(&mLock);
+        if (!available) {
+            break;
+        }
+
+        uint8_t numMapped = mMappableBuffers;
+        start = systemTime();
+        int32_t dequeuedIdx = dequeueBuffer();
+        noteWindowCall(start, mDisplayStats.dequeueStalls);
+        if ((dequeuedIdx < 0) || (dequeuedIdx >= mBufferCount)) {
+            CDBG_HIGH("%s: Invalid dequeued buffer index %d from display",
+                    __func__, dequeuedIdx);
+            pthread_mutex_lock(&mLock);
+            mDisplayStats.dequeueMisses++;
+            pthread_mutex_unlock(&mLock);
+            break;
+        }
+
+        pthread_mutex_lock(&mLock);
+        mEnqueuedBuffers--;
+        mDisplayStats.returned++;
+        pthread_mutex_unlock(&mLock);
+        returnBuffer((uint32_t)dequeuedIdx, (dequeuedIdx >= numMapped),
+                retFn, user);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : displayRoutine
+ *
+ * DESCRIPTION: display thread, works through the frames queued by
+ *              displayBufferAsync
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCameraGrallocMemory)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCameraGrallocMemory::displayRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    QCameraGrallocMemory *pme = (QCameraGrallocMemory *)data;
+    QCameraCmdThread *cmdThread = &pme->mDisplayTh;
+    cmdThread->setName("CAM_Display");
+
+    CDBG_HIGH("%s: E", __func__);
+    do {
+        do {
+            ret = cmdThread->waitCmd();
+            if (ret != 0 && errno != EINVAL) {
+                ALOGE("%s: waitCmd error (%s)",
+                        __func__, strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            {
+                // NULL when the frame was dropped in the meantime
+                display_job_t *job = (display_job_t *)pme->mDisplayQ.dequeue();
+                if (job != NULL) {
+                    pme->processDisplayJob(job);
+                }
+            }
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+    CDBG_HIGH("%s: X", __func__);
+    return NULL;
+}
+
 /*===========================================================================
  * FUNCTION   : allocate
  *
@@ -2291,6 +4040,9 @@ int QCameraGrallocMemory::allocate(uint8_t count, size_t /*size*/,
         err = mWindow->cancel_buffer(mWindow, mBufferHandle[i]);
         mLocalFlag[i] = BUFFER_NOT_OWNED;
     }
+    // the window can give back what was never dequeued, the cancelled
+    // buffers stay with it as its min undequeued share
+    mEnqueuedBuffers = (uint8_t)(mBufferCount - mMappableBuffers);
 
 end:
     CDBG(" %s : X ",__func__);
@@ -2331,6 +4083,8 @@ void QCameraGrallocMemory::deallocate()
 {
     CDBG("%s: E ", __FUNCTION__);
 
+    stopDisplay();
+
     for (int cnt = 0; cnt < mMappableBuffers; cnt++) {
         mCameraMemory[cnt]->release(mCameraMemory[cnt]);
         struct ion_handle_data ion_handle;
@@ -2365,16 +4119,19 @@ void QCameraGrallocMemory::deallocate()
  * PARAMETERS :
  *   @index   : index of the buffer
  *   @cmd     : cache ops command
+ *   @offset  : start of the range
+ *   @len     : length of the range, 0 for the rest of the buffer
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
-int QCameraGrallocMemory::cacheOps(uint32_t index, unsigned int cmd)
+int QCameraGrallocMemory::cacheOps(uint32_t index, unsigned int cmd,
+        size_t offset, size_t len)
 {
     if (index >= mMappableBuffers)
         return BAD_INDEX;
-    return cacheOpsInternal(index, cmd, mCameraMemory[index]->data);
+    return cacheOpsInternal(index, cmd, mCameraMemory[index]->data, offset, len);
 }
 
 /*===========================================================================
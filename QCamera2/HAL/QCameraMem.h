@@ -45,6 +45,8 @@ extern "C" {
 #include <linux/msm_ion.h>
 #include <mm_camera_interface.h>
 }
+#include "QCameraBufferAllocator.h"
+#include "QCameraCmdThread.h"
 
 //OFFSET, SIZE, USAGE, TIMESTAMP, FORMAT
 #define VIDEO_METADATA_NUM_INTS 5
@@ -66,27 +68,39 @@ class QCameraMemoryPool;
 class QCameraMemory {
 
 public:
-    int cleanCache(uint32_t index)
+    // after CPU writes, before a device reads
+    int cleanCache(uint32_t index, size_t offset = 0, size_t len = 0)
     {
-        return cacheOps(index, ION_IOC_CLEAN_CACHES);
+        return cacheOps(index, ION_IOC_CLEAN_CACHES, offset, len);
     }
-    int invalidateCache(uint32_t index)
+    // before a device writes, drops CPU lines that could land on its data
+    int invalidateCache(uint32_t index, size_t offset = 0, size_t len = 0)
     {
-        return cacheOps(index, ION_IOC_INV_CACHES);
+        return cacheOps(index, ION_IOC_INV_CACHES, offset, len);
     }
-    int cleanInvalidateCache(uint32_t index)
+    // after a device writes, before the CPU reads
+    int cleanInvalidateCache(uint32_t index, size_t offset = 0, size_t len = 0)
     {
-        return cacheOps(index, ION_IOC_CLEAN_INV_CACHES);
+        return cacheOps(index, ION_IOC_CLEAN_INV_CACHES, offset, len);
     }
+    void setCacheTracking(bool enable);
+    void markCpuWrite(uint32_t index, size_t offset = 0, size_t len = 0);
+    int markDeviceWrite(uint32_t index);
+    int syncForCpu(uint32_t index);
+    static void syncForCpu(mm_camera_super_buf_t *frame);
     int getFd(uint32_t index) const;
     ssize_t getSize(uint32_t index) const;
     uint8_t getCnt() const;
     virtual uint8_t getMappable() const;
+    virtual bool isReusable() const {return false;};
+    bool isCached() const {return m_bCached;};
+    bool isSecure() const;
 
     virtual int allocate(uint8_t count, size_t size, uint32_t is_secure) = 0;
     virtual void deallocate() = 0;
     virtual int allocateMore(uint8_t count, size_t size) = 0;
-    virtual int cacheOps(uint32_t index, unsigned int cmd) = 0;
+    virtual int cacheOps(uint32_t index, unsigned int cmd,
+            size_t offset, size_t len) = 0;
     virtual int getRegFlags(uint8_t *regFlags) const = 0;
     virtual camera_memory_t *getMemory(uint32_t index,
             bool metadata) const = 0;
@@ -112,36 +126,76 @@ protected:
 
     friend class QCameraMemoryPool;
 
-    struct QCameraMemInfo {
-        int fd;
-        int main_ion_fd;
-        ion_user_handle_t handle;
-        size_t size;
+    struct QCameraMemInfo : public qcamera_alloc_buf_t {
         bool cached;
         unsigned int heap_id;
+        uint32_t secure_mode;
     };
 
+    /* CPU side cache state of a buffer, kept when tracking is on */
+    struct QCameraCacheState {
+        size_t dirtyStart;  // [dirtyStart, dirtyEnd) may hold dirty lines
+        size_t dirtyEnd;
+        bool stale;         // device wrote, CPU lines not invalidated yet
+    };
+
+    struct QCameraAllocJob;
+
     int alloc(int count, size_t size, unsigned int heap_id,
             uint32_t is_secure);
     void dealloc();
+    int allocSlot(int index, unsigned int heap_id, size_t size,
+            uint32_t is_secure);
+    void deallocSlot(int index);
+    static void runAllocJob(QCameraAllocJob *job);
+    static void allocRoutine(void *data);
+    static void putAllocJob(QCameraAllocJob *job);
     static int allocOneBuffer(struct QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached, uint32_t is_secure);
     static void deallocOneBuffer(struct QCameraMemInfo &memInfo);
-    int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr);
+    int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr,
+            size_t offset, size_t len);
+    void resetCacheState();
 
     bool m_bCached;
     uint8_t mBufferCount;
     struct QCameraMemInfo mMemInfo[MM_CAMERA_MAX_NUM_FRAMES];
+    bool m_bCacheTracking;
+    struct QCameraCacheState mCacheState[MM_CAMERA_MAX_NUM_FRAMES];
     QCameraMemoryPool *mMemoryPool;
     cam_stream_type_t mStreamType;
     cam_stream_buf_type mBufType;
 };
 
+/* size classes of the memory pool: 4 sub buckets per power of two,
+ * starting at 4KB */
+#define QCAMERA_POOL_MIN_SHIFT       12
+#define QCAMERA_POOL_SUB_BUCKETS     4
+#define QCAMERA_POOL_NUM_BUCKETS     ((32 - QCAMERA_POOL_MIN_SHIFT) * \
+                                      QCAMERA_POOL_SUB_BUCKETS)
+/* a cached buffer is only handed out for requests of at least
+ * 2/3 of its size, so best fit never wastes more than 50% */
+#define QCAMERA_POOL_MAX_WASTE_NUM   3
+#define QCAMERA_POOL_MAX_WASTE_DEN   2
+
+typedef struct {
+    uint32_t hits;            // requests served from the cache
+    uint32_t misses;          // requests that went to the allocator
+    uint32_t trims;           // buffers freed by watermark trimming
+    uint32_t prewarmed;       // buffers allocated ahead of use
+    uint64_t bytesAllocated;  // bytes requested from the allocator
+    uint64_t bytesReused;     // bytes handed out from the cache
+    uint64_t bytesTrimmed;    // bytes freed by watermark trimming
+    size_t cachedBytes;       // bytes currently idle in the cache
+    size_t peakCachedBytes;
+    uint32_t cachedCnt;
+} qcamera_pool_stats_t;
+
 class QCameraMemoryPool {
 
 public:
 
-    QCameraMemoryPool();
+    QCameraMemoryPool(uint32_t cameraId = 0);
     virtual ~QCameraMemoryPool();
 
     int allocateBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
@@ -150,14 +204,157 @@ public:
     void releaseBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
             cam_stream_type_t streamType);
     void clear();
+    void trim();
+    size_t reclaim();
+    int32_t prewarm(cam_stream_type_t streamType, size_t size,
+            uint8_t count, unsigned int heap_id, bool cached);
+    int32_t prewarm();
+    void getStats(qcamera_pool_stats_t &stats);
+    void dump(int fd);
 
 protected:
 
+    typedef struct {
+        QCameraMemory::QCameraMemInfo info;
+        cam_stream_type_t streamType;
+        uint64_t seq;         // release order, lowest is least recently used
+    } pool_entry_t;
+
+    /* buffer set a stream type used last time, per camera */
+    typedef struct {
+        size_t size;
+        unsigned int heap_id;
+        bool cached;
+        uint8_t count;
+    } pool_profile_t;
+
     int findBufferLocked(struct QCameraMemory::QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached,
+            cam_stream_type_t streamType, uint32_t secure_mode);
+    void putBufferLocked(struct QCameraMemory::QCameraMemInfo &memInfo,
             cam_stream_type_t streamType);
+    void trimLocked(size_t target,
+            android::List<QCameraMemory::QCameraMemInfo> &victims);
+    void recordProfileLocked(cam_stream_type_t streamType, size_t size,
+            unsigned int heap_id, bool cached);
+    void waitBgJobsLocked();
+    static uint32_t getBucket(size_t size);
+    static void trimRoutine(void *data);
+    static void prewarmRoutine(void *data);
+
+    uint32_t mCameraId;
+    android::List<pool_entry_t> mBuckets[QCAMERA_POOL_NUM_BUCKETS];
+    uint64_t mSeq;
+    size_t mHighWatermark;
+    size_t mLowWatermark;
+    uint32_t mOutstanding[CAM_STREAM_TYPE_MAX]; // buffers handed out
+    uint32_t mBgJobs;         // trim/prewarm tasks queued on the executor
+    bool mTrimPending;
+    qcamera_pool_stats_t mStats;
+    pthread_mutex_t mLock;
+    pthread_cond_t mBgCond;
+
+    static pool_profile_t sProfiles[MM_CAMERA_MAX_NUM_SENSORS][CAM_STREAM_TYPE_MAX];
+    static pthread_mutex_t sProfileLock;
+};
 
-    android::List<QCameraMemory::QCameraMemInfo> mPools[CAM_STREAM_TYPE_MAX];
+typedef struct {
+    cam_stream_type_t streamType;
+    cam_format_t format;
+    size_t size;
+    int stride;
+    int scanline;
+    uint8_t bufferCnt;
+    bool cached;
+} qcamera_buf_cache_key_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;       // sets freed without being reused
+    uint32_t rejected;        // sets larger than the whole budget
+    size_t cachedBytes;
+    uint32_t cachedCnt;
+} qcamera_buf_cache_stats_t;
+
+// Keeps complete stream buffer sets of a camera session alive after their
+// stream is torn down, so a restart with a compatible configuration skips
+// allocation, mmap and framework memory registration.
+class QCameraStreamBufCache {
+public:
+    QCameraStreamBufCache();
+    virtual ~QCameraStreamBufCache();
+
+    QCameraMemory *acquire(const qcamera_buf_cache_key_t &key);
+    bool release(const qcamera_buf_cache_key_t &key, QCameraMemory *mem);
+    size_t clear();
+    void dump(int fd);
+
+private:
+    typedef struct {
+        qcamera_buf_cache_key_t key;
+        QCameraMemory *mem;
+        size_t bytes;
+    } cache_entry_t;
+
+    static bool keyMatch(const qcamera_buf_cache_key_t &a,
+            const qcamera_buf_cache_key_t &b);
+    void evictLocked(size_t target, android::List<QCameraMemory *> &victims);
+
+    android::List<cache_entry_t> mEntries;  // least recently released first
+    size_t mBudget;
+    qcamera_buf_cache_stats_t mStats;
+    pthread_mutex_t mLock;
+};
+
+#define QCAMERA_CB_POOL_MAX_BUFS     8
+
+typedef struct {
+    uint32_t copies;          // frames compacted into a pooled buffer
+    uint32_t mapped;          // frames sent in place through a cached mapping
+    uint32_t fallbacks;       // no pooled buffer free, one made for the frame
+    uint32_t mappings;        // stream buffer mappings created
+} qcamera_cb_pool_stats_t;
+
+// Buffers handed to the app with preview data callbacks. Compacted frames
+// go to a small set of buffers reused round robin, frames sent as they are
+// reuse one mapping per stream buffer. The owner and every callback in
+// flight hold a reference, whoever drops the last one frees the pool.
+class QCameraCallbackBufPool {
+public:
+    QCameraCallbackBufPool(camera_request_memory getMemory, void *cbCookie,
+            size_t size, uint32_t count);
+
+    size_t getSize() const { return mSize; }
+    camera_memory_t *getBuffer(void **token);
+    camera_memory_t *getMapping(int fd, uint32_t index, size_t size,
+            void **token);
+    static void releaseBuffer(void *data, void *cookie, int32_t cbStatus);
+    void retire();
+    void dump(int fd);
+
+private:
+    typedef struct {
+        QCameraCallbackBufPool *pool;
+        camera_memory_t *mem;
+        int fd;
+        size_t size;
+        uint32_t refs;        // callbacks in flight with this buffer
+    } cb_buf_t;
+
+    virtual ~QCameraCallbackBufPool();
+    camera_memory_t *takeLocked(cb_buf_t *buf, void **token);
+    void put(cb_buf_t *buf);
+
+    camera_request_memory mGetMemory;
+    void *mCallbackCookie;
+    size_t mSize;
+    uint32_t mCount;
+    uint32_t mNext;           // next copy buffer to try
+    uint32_t mRefs;
+    cb_buf_t mCopyBufs[QCAMERA_CB_POOL_MAX_BUFS];
+    cb_buf_t mMapBufs[MM_CAMERA_MAX_NUM_FRAMES];
+    qcamera_cb_pool_stats_t mStats;
     pthread_mutex_t mLock;
 };
 
@@ -171,7 +368,8 @@ public:
     virtual int allocate(uint8_t count, size_t size, uint32_t is_secure);
     virtual int allocateMore(uint8_t count, size_t size);
     virtual void deallocate();
-    virtual int cacheOps(uint32_t index, unsigned int cmd);
+    virtual int cacheOps(uint32_t index, unsigned int cmd,
+            size_t offset, size_t len);
     virtual int getRegFlags(uint8_t *regFlags) const;
     virtual camera_memory_t *getMemory(uint32_t index, bool metadata) const;
     virtual int getMatchBufIndex(const void *opaque, bool metadata) const;
@@ -204,11 +402,13 @@ public:
     virtual int allocate(uint8_t count, size_t size, uint32_t is_secure);
     virtual int allocateMore(uint8_t count, size_t size);
     virtual void deallocate();
-    virtual int cacheOps(uint32_t index, unsigned int cmd);
+    virtual int cacheOps(uint32_t index, unsigned int cmd,
+            size_t offset, size_t len);
     virtual int getRegFlags(uint8_t *regFlags) const;
     virtual camera_memory_t *getMemory(uint32_t index, bool metadata) const;
     virtual int getMatchBufIndex(const void *opaque, bool metadata) const;
     virtual void *getPtr(uint32_t index) const;
+    virtual bool isReusable() const {return true;};
 
 protected:
     camera_request_memory mGetMemory;
@@ -251,6 +451,21 @@ private:
 
 
 // Gralloc Memory is acquired from preview window
+// returns a buffer the display stage is done with to its stream
+typedef void (*display_ret_fn)(uint32_t index, bool mapNeeded, void *user);
+
+typedef struct {
+    uint32_t queued;          // frames handed to the display stage
+    uint32_t displayed;       // frames enqueued to the window
+    uint32_t dropped;         // frames returned undisplayed, display behind
+    uint32_t returned;        // buffers dequeued back from the window
+    uint32_t enqueueStalls;   // enqueue_buffer calls over half a frame
+    uint32_t dequeueStalls;   // dequeue_buffer calls over half a frame
+    uint32_t dequeueMisses;   // dequeue_buffer had no free buffer
+    nsecs_t stallTime;        // time spent in stalled window calls
+    nsecs_t maxStall;
+} qcamera_display_stats_t;
+
 class QCameraGrallocMemory : public QCameraMemory {
     enum {
         BUFFER_NOT_OWNED,
@@ -264,7 +479,8 @@ public:
     virtual int allocate(uint8_t count, size_t size, uint32_t is_secure);
     virtual int allocateMore(uint8_t count, size_t size);
     virtual void deallocate();
-    virtual int cacheOps(uint32_t index, unsigned int cmd);
+    virtual int cacheOps(uint32_t index, unsigned int cmd,
+            size_t offset, size_t len);
     virtual int getRegFlags(uint8_t *regFlags) const;
     virtual camera_memory_t *getMemory(uint32_t index, bool metadata) const;
     virtual int getMatchBufIndex(const void *opaque, bool metadata) const;
@@ -281,8 +497,28 @@ public:
     void setMaxFPS(int maxFPS);
     int32_t enqueueBuffer(uint32_t index, nsecs_t timeStamp = 0);
     int32_t dequeueBuffer();
+    // Queue buffer[index] to the display thread. Buffers dequeued from
+    // the window, and frames dropped while the display is behind, come
+    // back through retFn. The frame is held for the data path until
+    // releaseDataHold, a buffer is not returned while held.
+    int32_t displayBufferAsync(uint32_t index, nsecs_t timeStamp,
+            display_ret_fn retFn, void *user);
+    bool releaseDataHold(uint32_t index);
+    void stopDisplay();
+    void getDisplayStats(qcamera_display_stats_t &stats);
 
 private:
+    typedef struct {
+        uint32_t index;
+        nsecs_t timeStamp;
+    } display_job_t;
+
+    static void *displayRoutine(void *data);
+    void processDisplayJob(display_job_t *job);
+    void noteWindowCall(nsecs_t start, uint32_t &stalls);
+    void returnBuffer(uint32_t index, bool mapNeeded, display_ret_fn retFn,
+            void *user);
+
     buffer_handle_t *mBufferHandle[MM_CAMERA_MAX_NUM_FRAMES];
     int mLocalFlag[MM_CAMERA_MAX_NUM_FRAMES];
     struct private_handle_t *mPrivateHandle[MM_CAMERA_MAX_NUM_FRAMES];
@@ -295,7 +531,18 @@ private:
     enum ColorSpace_t mColorSpace;
     uint8_t mMappableBuffers;
     pthread_mutex_t mLock;
-    uint8_t mEnqueuedBuffers;
+    uint8_t mEnqueuedBuffers; // buffers the window can give back
+    QCameraCmdThread mDisplayTh;
+    QCameraQueue mDisplayQ;
+    display_job_t mDisplayJobs[MM_CAMERA_MAX_NUM_FRAMES];
+    bool mDisplayActive;
+    display_ret_fn mDisplayRetFn;
+    void *mDisplayUser;
+    uint32_t mMaxDisplayPending;
+    bool mDataHeld[MM_CAMERA_MAX_NUM_FRAMES];     // data path still reads it
+    bool mRetDeferred[MM_CAMERA_MAX_NUM_FRAMES];  // returned while held
+    bool mRetMapNeeded[MM_CAMERA_MAX_NUM_FRAMES];
+    qcamera_display_stats_t mDisplayStats;
 };
 
 }; // namespace qcamera
@@ -2526,9 +2526,9 @@ void* QCameraMuxer::composeMpoRoutine(void *data)
 
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)", __func__, strerror(errno));
+                ALOGE("%s: waitCmd error (%s)", __func__, strerror(errno));
                 return NULL;
             }
         } while (ret != 0);
@@ -2542,7 +2542,7 @@ void* QCameraMuxer::composeMpoRoutine(void *data)
                 is_active = TRUE;
 
                 // signal cmd is completed
-                cam_sem_post(&cmdThread->sync_sem);
+                cmdThread->sync_sem.post();
             }
             break;
         case CAMERA_CMD_TYPE_STOP_DATA_PROC:
@@ -2551,7 +2551,7 @@ void* QCameraMuxer::composeMpoRoutine(void *data)
                 is_active = FALSE;
 
                 // signal cmd is completed
-                cam_sem_post(&cmdThread->sync_sem);
+                cmdThread->sync_sem.post();
             }
             break;
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
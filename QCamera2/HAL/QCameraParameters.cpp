@@ -193,6 +193,9 @@ const char QCameraParameters::KEY_QC_MANUAL_WB_VALUE[] = "manual-wb-value";
 const char QCameraParameters::WHITE_BALANCE_MANUAL[] = "manual";
 const char QCameraParameters::FOCUS_MODE_MANUAL_POSITION[] = "manual";
 const char QCameraParameters::KEY_QC_CACHE_VIDEO_BUFFERS[] = "cache-video-buffers";
+const char QCameraParameters::KEY_QC_PREVIEW_FRAME_STRIDED[] = "preview-frame-strided";
+const char QCameraParameters::KEY_QC_PREVIEW_FRAME_STRIDE[] = "preview-frame-stride";
+const char QCameraParameters::KEY_QC_PREVIEW_FRAME_SCANLINE[] = "preview-frame-scanline";
 
 const char QCameraParameters::KEY_QC_LONG_SHOT[] = "long-shot";
 const char QCameraParameters::KEY_QC_INSTANT_AEC[] = "instant-aec";
@@ -868,6 +871,8 @@ QCameraParameters::QCameraParameters()
       mOfflineRAW(false),
       m_bTruePortraitOn(false),
       m_bIsLowMemoryDevice(false),
+    mMemPressure(QCAMERA_MEM_PRESSURE_NORMAL),
+      mMemPressure(QCAMERA_MEM_PRESSURE_NORMAL),
       mCds_mode(CAM_CDS_MODE_OFF),
       m_bLtmForSeeMoreEnabled(false),
       m_bInstantAEC(false),
@@ -4910,6 +4915,7 @@ int32_t QCameraParameters::updateParameters(QCameraParameters& params,
     if ((rc = setCDSMode(params)))                      final_rc = rc;
     if ((rc = setTemporalDenoise(params)))              final_rc = rc;
     if ((rc = setCacheVideoBuffers(params)))            final_rc = rc;
+    if ((rc = setStridedPreviewFrames(params)))         final_rc = rc;
     if ((rc = setInstantCapture(params)))               final_rc = rc;
     if ((rc = setInstantAEC(params)))                   final_rc = rc;
     if ((rc = setInitialExposureIndex(params)))         final_rc = rc;
@@ -5793,6 +5799,8 @@ int32_t QCameraParameters::initDefaultParameters()
     memset(mStreamPpMask, 0, sizeof(uint32_t)*CAM_STREAM_TYPE_MAX);
     //Set video buffers as uncached by default
     set(KEY_QC_CACHE_VIDEO_BUFFERS, VALUE_DISABLE);
+    // Preview callbacks are compacted to width unless the app opts in
+    set(KEY_QC_PREVIEW_FRAME_STRIDED, VALUE_DISABLE);
 
     // Set default longshot mode
     set(KEY_QC_LONG_SHOT, "off");
@@ -9175,6 +9183,42 @@ int32_t QCameraParameters::setCacheVideoBuffers(const QCameraParameters& params)
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : setStridedPreviewFrames
+ *
+ * DESCRIPTION: set whether preview callbacks may carry the padded stream
+ *              layout. Apps enabling it read the layout from
+ *              KEY_QC_PREVIEW_FRAME_STRIDE/SCANLINE once preview started,
+ *              and get the frames without a copy.
+ *
+ * PARAMETERS :
+ *   @params  : user setting parameters
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraParameters::setStridedPreviewFrames(const QCameraParameters& params)
+{
+    const char *str = params.get(KEY_QC_PREVIEW_FRAME_STRIDED);
+    const char *prev_str = get(KEY_QC_PREVIEW_FRAME_STRIDED);
+
+    if (str != NULL) {
+        if (prev_str == NULL || strcmp(str, prev_str) != 0) {
+            int32_t value = lookupAttr(ENABLE_DISABLE_MODES_MAP,
+                    PARAM_MAP_SIZE(ENABLE_DISABLE_MODES_MAP), str);
+            if (value == NAME_NOT_FOUND) {
+                ALOGE("%s: Invalid strided preview frames value: %s",
+                        __func__, str);
+                return BAD_VALUE;
+            }
+            CDBG_HIGH("%s: strided preview frames %s", __func__, str);
+            updateParamEntry(KEY_QC_PREVIEW_FRAME_STRIDED, str);
+        }
+    }
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : restoreAEBracket
  *
@@ -9989,8 +10033,10 @@ uint8_t QCameraParameters::getZSLQueueDepth()
     if (qdepth < 0) {
         qdepth = 2;
     }
-    if (isLowMemoryDevice()) {
+    if (isLowMemoryDevice() || (mMemPressure == QCAMERA_MEM_PRESSURE_CRITICAL)) {
         qdepth = 1;
+    } else if ((mMemPressure == QCAMERA_MEM_PRESSURE_MODERATE) && (qdepth > 2)) {
+        qdepth = 2;
     }
     return (uint8_t)qdepth;
 }
@@ -10010,7 +10056,7 @@ uint8_t QCameraParameters::getZSLBackLookCount()
     if (look_back < 0) {
         look_back = 2;
     }
-    if (isLowMemoryDevice()) {
+    if (isLowMemoryDevice() || (mMemPressure == QCAMERA_MEM_PRESSURE_CRITICAL)) {
         look_back = 1;
     }
     return (uint8_t)look_back;
@@ -10034,6 +10080,44 @@ bool QCameraParameters::isVideoBuffersCached()
     }
     return false;
 }
+
+/*===========================================================================
+ * FUNCTION   : isStridedPreviewFrames
+ *
+ * DESCRIPTION: Query if the app accepts preview callbacks with the padded
+ *              stream layout
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true if frames can be sent without compacting them
+ *==========================================================================*/
+bool QCameraParameters::isStridedPreviewFrames()
+{
+    const char *str = get(KEY_QC_PREVIEW_FRAME_STRIDED);
+    if ((str != NULL) && (strcmp(str, VALUE_ENABLE) == 0)) {
+        return true;
+    }
+    return false;
+}
+
+/*===========================================================================
+ * FUNCTION   : setPreviewFrameLayout
+ *
+ * DESCRIPTION: publish the layout of strided preview callback frames,
+ *              luma and chroma planes share stride, chroma starts at
+ *              stride * scanline
+ *
+ * PARAMETERS :
+ *   @stride   : plane stride in bytes
+ *   @scanline : luma plane scanlines
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraParameters::setPreviewFrameLayout(int stride, int scanline)
+{
+    set(KEY_QC_PREVIEW_FRAME_STRIDE, stride);
+    set(KEY_QC_PREVIEW_FRAME_SCANLINE, scanline);
+}
 /*===========================================================================
  * FUNCTION   : getZSLMaxUnmatchedFrames
  *
@@ -10045,9 +10129,31 @@ bool QCameraParameters::isVideoBuffersCached()
  *==========================================================================*/
 uint8_t QCameraParameters::getMaxUnmatchedFramesInQueue()
 {
+    if (mMemPressure == QCAMERA_MEM_PRESSURE_CRITICAL) {
+        return (uint8_t)m_pCapability->min_num_pp_bufs;
+    }
     return (uint8_t)(m_pCapability->min_num_pp_bufs + (m_nBurstNum / 10));
 }
 
+/*===========================================================================
+ * FUNCTION   : updateMemPressure
+ *
+ * DESCRIPTION: sample the HAL memory pressure. Queue depths and extra
+ *              buffer counts of the next stream configuration follow it.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::updateMemPressure()
+{
+    qcamera_mem_pressure_t pressure = QCameraMemBudget::getInstance().getPressure();
+    if (pressure != mMemPressure) {
+        CDBG_HIGH("%s: memory pressure %d -> %d", __func__, mMemPressure, pressure);
+        mMemPressure = pressure;
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : setRecordingHintValue
  *
@@ -13406,8 +13512,9 @@ int32_t QCameraParameters::setToneMapMode(uint32_t enable, bool initCommit)
  *==========================================================================*/
 uint8_t QCameraParameters::getLongshotStages()
 {
-    uint8_t numStages =
-            isLowMemoryDevice() ? CAMERA_MIN_LONGSHOT_STAGES : CAMERA_DEFAULT_LONGSHOT_STAGES;
+    uint8_t numStages = (isLowMemoryDevice() ||
+            (mMemPressure == QCAMERA_MEM_PRESSURE_CRITICAL)) ?
+            CAMERA_MIN_LONGSHOT_STAGES : CAMERA_DEFAULT_LONGSHOT_STAGES;
 
     char prop[PROPERTY_VALUE_MAX];
     memset(prop, 0, sizeof(prop));
@@ -27,6 +27,7 @@
 #include "cam_intf.h"
 #include "cam_types.h"
 #include "QCameraMem.h"
+#include "QCameraMemBudget.h"
 #include "QCameraThermalAdapter.h"
 
 extern "C" {
@@ -245,6 +246,9 @@ public:
     static const char KEY_QC_CURRENT_EXPOSURE_TIME[];
     static const char KEY_QC_CURRENT_ISO[];
     static const char KEY_QC_CACHE_VIDEO_BUFFERS[];
+    static const char KEY_QC_PREVIEW_FRAME_STRIDED[];
+    static const char KEY_QC_PREVIEW_FRAME_STRIDE[];
+    static const char KEY_QC_PREVIEW_FRAME_SCANLINE[];
 
     // DENOISE
     static const char KEY_QC_DENOISE[];
@@ -666,6 +670,8 @@ public:
     int32_t getExifAltitude(rat_t *altitude, char *altRef);
     int32_t getExifGpsDateTimeStamp(char *gpsDateStamp, uint32_t bufLen, rat_t *gpsTimeStamp);
     bool isVideoBuffersCached();
+    bool isStridedPreviewFrames();
+    void setPreviewFrameLayout(int stride, int scanline);
     int32_t updateFocusDistances(cam_focus_distances_info_t *focusDistances);
 
     bool isAEBracketEnabled();
@@ -741,6 +747,8 @@ public:
     inline bool isStillMoreEnabled() {return m_bStillMoreOn;};
     bool isOptiZoomEnabled();
     inline bool isLowMemoryDevice() {return m_bIsLowMemoryDevice;};
+    void updateMemPressure();
+    inline qcamera_mem_pressure_t getMemPressure() {return mMemPressure;};
     bool isPreviewSeeMoreRequired();
     int32_t commitAFBracket(cam_af_bracketing_t afBracket);
     int32_t commitFlashBracket(cam_flash_bracketing_t flashBracket);
@@ -910,6 +918,7 @@ private:
     int32_t setRdiMode(const QCameraParameters& );
     int32_t setSecureMode(const QCameraParameters& );
     int32_t setCacheVideoBuffers(const QCameraParameters& params);
+    int32_t setStridedPreviewFrames(const QCameraParameters& params);
     int32_t setCustomParams(const QCameraParameters& params);
     int32_t setAutoExposure(const char *autoExp);
     int32_t setPreviewFpsRange(int min_fps,int max_fps,
@@ -1125,6 +1134,7 @@ private:
     bool m_bStreamsConfigured;
     int32_t mParmZoomLevel;
     bool m_bIsLowMemoryDevice;
+    qcamera_mem_pressure_t mMemPressure; // sampled at stream configuration
     int32_t mCds_mode;
     bool m_bLtmForSeeMoreEnabled;
     int32_t mParmEffect;
@@ -69,11 +69,14 @@ QCameraPostProcessor::QCameraPostProcessor(QCamera2HardwareInterface *cam_ctrl)
       m_bThumbnailNeeded(TRUE),
       mTotalNumReproc(0),
       m_bInited(FALSE),
-      m_inputPPQ(releasePPInputData, this),
-      m_ongoingPPQ(releaseOngoingPPData, this),
-      m_inputJpegQ(releaseJpegData, this),
-      m_ongoingJpegQ(releaseJpegData, this),
-      m_inputRawQ(releaseRawData, this),
+      m_inputPPQ(releasePPInputData, this, QCAMERA_QUEUE_RING_SIZE),
+      m_ongoingPPQ(releaseOngoingPPData, this, QCAMERA_QUEUE_RING_SIZE),
+      m_inputJpegQ(releaseJpegData, this, QCAMERA_QUEUE_RING_SIZE),
+      m_ongoingJpegQ(releaseJpegData, this, QCAMERA_QUEUE_RING_SIZE),
+      m_inputRawQ(releaseRawData, this, QCAMERA_QUEUE_RING_SIZE),
+      m_inputSaveQ(NULL, NULL, QCAMERA_QUEUE_RING_SIZE),
+      m_dataProcActive(FALSE),
+      m_saveProcActive(FALSE),
       mSaveFrmCnt(0),
       mUseSaveProc(false),
       mUseJpegBurst(false),
@@ -169,8 +172,9 @@ int32_t QCameraPostProcessor::init(jpeg_encode_callback_t jpeg_cb, void *user_da
 {
     mJpegCB = jpeg_cb;
     mJpegUserData = user_data;
-    m_dataProcTh.launch(dataProcessRoutine, this);
-    m_saveProcTh.launch(dataSaveRoutine, this);
+    // jpeg encoding and file writes block, keep them off the data pool
+    m_dataProcStrand.setExecutor(QCameraExecutor::getBlockingInstance());
+    m_saveProcStrand.setExecutor(QCameraExecutor::getBlockingInstance());
     m_parent->mParameters.setReprocCount();
     m_bInited = TRUE;
     return NO_ERROR;
@@ -190,8 +194,8 @@ int32_t QCameraPostProcessor::init(jpeg_encode_callback_t jpeg_cb, void *user_da
 int32_t QCameraPostProcessor::deinit()
 {
     if (m_bInited == TRUE) {
-        m_dataProcTh.exit();
-        m_saveProcTh.exit();
+        m_dataProcStrand.drain();
+        m_saveProcStrand.drain();
         m_bInited = FALSE;
     }
     return NO_ERROR;
@@ -200,8 +204,8 @@ int32_t QCameraPostProcessor::deinit()
 /*===========================================================================
  * FUNCTION   : start
  *
- * DESCRIPTION: start postprocessor. Data process thread and data notify thread
- *              will be launched.
+ * DESCRIPTION: start postprocessor. Data process and data save jobs
+ *              will be accepted.
  *
  * PARAMETERS :
  *   @pSrcChannel : source channel obj ptr that possibly needs reprocess
@@ -280,7 +284,9 @@ int32_t QCameraPostProcessor::start(QCameraChannel *pSrcChannel)
 
     m_PPindex = 0;
     m_InputMetadata.clear();
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, TRUE, FALSE);
+    m_saveProcStrand.post(dataSaveStartJob, this);
+    m_dataProcStrand.post(dataProcStartJob, this);
+    m_dataProcStrand.drain();
     m_parent->m_cbNotifier.startSnapshots();
     CDBG_HIGH("%s: X ", __func__);
     return rc;
@@ -289,7 +295,8 @@ int32_t QCameraPostProcessor::start(QCameraChannel *pSrcChannel)
 /*===========================================================================
  * FUNCTION   : stop
  *
- * DESCRIPTION: stop postprocessor. Data process and notify thread will be stopped.
+ * DESCRIPTION: stop postprocessor. Data process and data save jobs will be
+ *              stopped.
  *
  * PARAMETERS : None
  *
@@ -309,8 +316,16 @@ int32_t QCameraPostProcessor::stop()
             m_DataMem = NULL;
         }
 
-        // dataProc Thread need to process "stop" as sync call because abort jpeg job should be a sync call
-        m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
+        // jobs queued before the stop jobs only drop their data
+        __atomic_store_n(&m_saveProcActive, FALSE, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_dataProcActive, FALSE, __ATOMIC_RELAXED);
+
+        // saving stops first, then "stop" is processed as sync call
+        // because abort jpeg job should be a sync call
+        m_saveProcStrand.post(dataSaveStopJob, this);
+        m_saveProcStrand.drain();
+        m_dataProcStrand.post(dataProcStopJob, this);
+        m_dataProcStrand.drain();
     }
     // stop reproc channel if exists
     for (int8_t i = 0; i < mTotalNumReproc; i++) {
@@ -910,7 +925,7 @@ int32_t QCameraPostProcessor::processData(mm_camera_super_buf_t *frame)
         }
     }
 
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    m_dataProcStrand.post(dataProcNextJob, this);
     return NO_ERROR;
 }
 
@@ -935,7 +950,7 @@ int32_t QCameraPostProcessor::processRawData(mm_camera_super_buf_t *frame)
 
     // enqueu to raw input queue
     if (m_inputRawQ.enqueue((void *)frame)) {
-        m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        m_dataProcStrand.post(dataProcNextJob, this);
     } else {
         CDBG_HIGH("%s : m_inputRawQ is not active!!!", __func__);
         releaseSuperBuf(frame);
@@ -969,6 +984,8 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
         return UNKNOWN_ERROR;
     }
 
+    MM_CAMERA_TRACE_ASYNC_END("JpegEncode", evt->jobId);
+
     int32_t rc = NO_ERROR;
     camera_memory_t *jpeg_mem = NULL;
     omx_jpeg_ouput_buf_t *jpeg_out = NULL;
@@ -981,7 +998,7 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
         }
         *saveData = *evt;
         if (m_inputSaveQ.enqueue((void *) saveData)) {
-            m_saveProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+            m_saveProcStrand.post(dataSaveNextJob, this);
         } else {
             CDBG("%s : m_inputSaveQ PP Q is not active!!!", __func__);
             free(saveData);
@@ -1000,7 +1017,7 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
         m_ongoingJpegQ.flushNodes(matchJobId, (void*)&evt->jobId);
 
         if (m_inputPPQ.getCurrentSize() > 0) {
-            m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+            m_dataProcStrand.post(dataProcNextJob, this);
         }
         CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, evt->jobId);
 
@@ -1040,7 +1057,7 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
               pthread_mutex_lock(&m_parent->m_int_lock);
               pthread_cond_signal(&m_parent->m_int_cond);
               pthread_mutex_unlock(&m_parent->m_int_lock);
-              m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+              m_dataProcStrand.post(dataProcNextJob, this);
               return rc;
         }
         if (!mJpegMemOpt) {
@@ -1112,7 +1129,7 @@ end:
 
     // wait up data proc thread to do next job,
     // if previous request is blocked due to ongoing jpeg job
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    m_dataProcStrand.post(dataProcNextJob, this);
 
     return rc;
 }
@@ -1308,7 +1325,7 @@ int32_t QCameraPostProcessor::processPPData(mm_camera_super_buf_t *frame)
     // wait up data proc thread
 
     if (triggerEvent) {
-        m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        m_dataProcStrand.post(dataProcNextJob, this);
     }
 
     return NO_ERROR;
@@ -2319,6 +2336,7 @@ int32_t QCameraPostProcessor::encodeData(qcamera_jpeg_data_t *jpeg_job_data,
     if (ret == NO_ERROR) {
         // remember job info
         jpeg_job_data->jobId = jobId;
+        MM_CAMERA_TRACE_ASYNC_BEGIN("JpegEncode", jobId);
     }
 
     return ret;
@@ -2471,335 +2489,309 @@ int32_t QCameraPostProcessor::processRawImageImpl(mm_camera_super_buf_t *recvd_f
 }
 
 /*===========================================================================
- * FUNCTION   : dataSaveRoutine
+ * FUNCTION   : dataSaveStartJob
  *
- * DESCRIPTION: data saving routine
+ * DESCRIPTION: save strand job that starts data saving
  *
  * PARAMETERS :
  *   @data    : user data ptr (QCameraPostProcessor)
  *
  * RETURN     : None
  *==========================================================================*/
-void *QCameraPostProcessor::dataSaveRoutine(void *data)
+void QCameraPostProcessor::dataSaveStartJob(void *data)
 {
-    int running = 1;
-    int ret;
-    uint8_t is_active = FALSE;
     QCameraPostProcessor *pme = (QCameraPostProcessor *)data;
-    QCameraCmdThread *cmdThread = &pme->m_saveProcTh;
-    cmdThread->setName("CAM_JpegSave");
-    char saveName[PROPERTY_VALUE_MAX];
 
-    CDBG_HIGH("%s: E", __func__);
-    do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                           __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
-
-        // we got notified about new cmd avail in cmd queue
-        camera_cmd_type_t cmd = cmdThread->getCmd();
-        switch (cmd) {
-        case CAMERA_CMD_TYPE_START_DATA_PROC:
-            CDBG_HIGH("%s: start data proc", __func__);
-            is_active = TRUE;
-            pme->m_inputSaveQ.init();
-            break;
-        case CAMERA_CMD_TYPE_STOP_DATA_PROC:
-            {
-                CDBG_HIGH("%s: stop data proc", __func__);
-                is_active = FALSE;
+    CDBG_HIGH("%s: start data proc", __func__);
+    pme->m_inputSaveQ.init();
+    __atomic_store_n(&pme->m_saveProcActive, TRUE, __ATOMIC_RELAXED);
+}
 
-                // flush input save Queue
-                pme->m_inputSaveQ.flush();
+/*===========================================================================
+ * FUNCTION   : dataSaveStopJob
+ *
+ * DESCRIPTION: save strand job that stops data saving
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCameraPostProcessor)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::dataSaveStopJob(void *data)
+{
+    QCameraPostProcessor *pme = (QCameraPostProcessor *)data;
 
-                // signal cmd is completed
-                cam_sem_post(&cmdThread->sync_sem);
-            }
-            break;
-        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
+    CDBG_HIGH("%s: stop data proc", __func__);
+    __atomic_store_n(&pme->m_saveProcActive, FALSE, __ATOMIC_RELAXED);
 
-                qcamera_jpeg_evt_payload_t *job_data = (qcamera_jpeg_evt_payload_t *) pme->m_inputSaveQ.dequeue();
-                if (job_data == NULL) {
-                    ALOGE("%s: Invalid jpeg event data", __func__);
-                    continue;
-                }
-                //qcamera_jpeg_data_t *jpeg_job =
-                //        (qcamera_jpeg_data_t *)pme->m_ongoingJpegQ.dequeue(false);
-                //uint32_t frame_idx = jpeg_job->src_frame->bufs[0]->frame_idx;
-                uint32_t frame_idx = 75;
-
-                pme->m_ongoingJpegQ.flushNodes(matchJobId, (void*)&job_data->jobId);
-
-                CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, job_data->jobId);
-
-                if (is_active == TRUE) {
-                    memset(saveName, '\0', sizeof(saveName));
-                    snprintf(saveName,
-                             sizeof(saveName),
-                             QCameraPostProcessor::STORE_LOCATION,
-                             pme->mSaveFrmCnt);
-
-                    int file_fd = open(saveName, O_RDWR | O_CREAT, 0655);
-                    if (file_fd >= 0) {
-                        ssize_t written_len = write(file_fd, job_data->out_data.buf_vaddr,
-                                job_data->out_data.buf_filled_len);
-                        if ((ssize_t)job_data->out_data.buf_filled_len != written_len) {
-                            ALOGE("%s: Failed save complete data %d bytes "
-                                  "written instead of %d bytes!",
-                                  __func__, written_len,
-                                  job_data->out_data.buf_filled_len);
-                        } else {
-                            CDBG_HIGH("%s: written number of bytes %d\n",
-                                __func__, written_len);
-                        }
+    // flush input save Queue
+    pme->m_inputSaveQ.flush();
+}
 
-                        close(file_fd);
-                    } else {
-                        ALOGE("%s: fail t open file for saving", __func__);
-                    }
-                    pme->mSaveFrmCnt++;
-
-                    camera_memory_t* jpeg_mem = pme->m_parent->mGetMemory(-1,
-                                                         strlen(saveName),
-                                                         1,
-                                                         pme->m_parent->mCallbackCookie);
-                    if (NULL == jpeg_mem) {
-                        ret = NO_MEMORY;
-                        ALOGE("%s : getMemory for jpeg, ret = NO_MEMORY", __func__);
-                        goto end;
-                    }
-                    memcpy(jpeg_mem->data, saveName, strlen(saveName));
-
-                    CDBG_HIGH("%s : Calling upperlayer callback to store JPEG image", __func__);
-                    qcamera_release_data_t release_data;
-                    memset(&release_data, 0, sizeof(qcamera_release_data_t));
-                    release_data.data = jpeg_mem;
-                    release_data.unlinkFile = true;
-                    CDBG_HIGH("[KPI Perf] %s: PROFILE_JPEG_CB ",__func__);
-                    ret = pme->sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
-                            jpeg_mem,
-                            0,
-                            NULL,
-                            &release_data,
-                            frame_idx);
-                }
+/*===========================================================================
+ * FUNCTION   : dataSaveNextJob
+ *
+ * DESCRIPTION: save strand job that stores one encoded jpeg
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCameraPostProcessor)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::dataSaveNextJob(void *data)
+{
+    QCameraPostProcessor *pme = (QCameraPostProcessor *)data;
+    uint8_t is_active = __atomic_load_n(&pme->m_saveProcActive,
+            __ATOMIC_RELAXED);
+    char saveName[PROPERTY_VALUE_MAX];
 
-end:
-                free(job_data);
+    CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
+
+    qcamera_jpeg_evt_payload_t *job_data = (qcamera_jpeg_evt_payload_t *) pme->m_inputSaveQ.dequeue();
+    if (job_data == NULL) {
+        ALOGE("%s: Invalid jpeg event data", __func__);
+        return;
+    }
+    //qcamera_jpeg_data_t *jpeg_job =
+    //        (qcamera_jpeg_data_t *)pme->m_ongoingJpegQ.dequeue(false);
+    //uint32_t frame_idx = jpeg_job->src_frame->bufs[0]->frame_idx;
+    uint32_t frame_idx = 75;
+
+    pme->m_ongoingJpegQ.flushNodes(matchJobId, (void*)&job_data->jobId);
+
+    CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, job_data->jobId);
+
+    if (is_active == TRUE) {
+        memset(saveName, '\0', sizeof(saveName));
+        snprintf(saveName,
+                 sizeof(saveName),
+                 QCameraPostProcessor::STORE_LOCATION,
+                 pme->mSaveFrmCnt);
+
+        int file_fd = open(saveName, O_RDWR | O_CREAT, 0655);
+        if (file_fd >= 0) {
+            ssize_t written_len = write(file_fd, job_data->out_data.buf_vaddr,
+                    job_data->out_data.buf_filled_len);
+            if ((ssize_t)job_data->out_data.buf_filled_len != written_len) {
+                ALOGE("%s: Failed save complete data %d bytes "
+                      "written instead of %d bytes!",
+                      __func__, written_len,
+                      job_data->out_data.buf_filled_len);
+            } else {
+                CDBG_HIGH("%s: written number of bytes %d\n",
+                    __func__, written_len);
             }
-            break;
-        case CAMERA_CMD_TYPE_EXIT:
-            CDBG_HIGH("%s : save thread exit", __func__);
-            running = 0;
-            break;
-        default:
-            break;
+
+            close(file_fd);
+        } else {
+            ALOGE("%s: fail t open file for saving", __func__);
+        }
+        pme->mSaveFrmCnt++;
+
+        camera_memory_t* jpeg_mem = pme->m_parent->mGetMemory(-1,
+                                             strlen(saveName),
+                                             1,
+                                             pme->m_parent->mCallbackCookie);
+        if (NULL == jpeg_mem) {
+            ALOGE("%s : getMemory for jpeg, ret = NO_MEMORY", __func__);
+            goto end;
         }
-    } while (running);
-    CDBG_HIGH("%s: X", __func__);
-    return NULL;
+        memcpy(jpeg_mem->data, saveName, strlen(saveName));
+
+        CDBG_HIGH("%s : Calling upperlayer callback to store JPEG image", __func__);
+        qcamera_release_data_t release_data;
+        memset(&release_data, 0, sizeof(qcamera_release_data_t));
+        release_data.data = jpeg_mem;
+        release_data.unlinkFile = true;
+        CDBG_HIGH("[KPI Perf] %s: PROFILE_JPEG_CB ",__func__);
+        pme->sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
+                jpeg_mem,
+                0,
+                NULL,
+                &release_data,
+                frame_idx);
+    }
+
+end:
+    free(job_data);
 }
 
 /*===========================================================================
- * FUNCTION   : dataProcessRoutine
+ * FUNCTION   : dataProcStartJob
  *
- * DESCRIPTION: data process routine that handles input data either from input
- *              Jpeg Queue to do jpeg encoding, or from input PP Queue to do
- *              reprocess.
+ * DESCRIPTION: data process strand job that starts data processing
  *
  * PARAMETERS :
  *   @data    : user data ptr (QCameraPostProcessor)
  *
  * RETURN     : None
  *==========================================================================*/
-void *QCameraPostProcessor::dataProcessRoutine(void *data)
+void QCameraPostProcessor::dataProcStartJob(void *data)
 {
-    int running = 1;
-    int ret;
-    uint8_t is_active = FALSE;
     QCameraPostProcessor *pme = (QCameraPostProcessor *)data;
-    QCameraCmdThread *cmdThread = &pme->m_dataProcTh;
-    cmdThread->setName("CAM_DataProc");
-
-    CDBG_HIGH("%s: E", __func__);
-    do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                           __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
-
-        // we got notified about new cmd avail in cmd queue
-        camera_cmd_type_t cmd = cmdThread->getCmd();
-        switch (cmd) {
-        case CAMERA_CMD_TYPE_START_DATA_PROC:
-            CDBG_HIGH("%s: start data proc", __func__);
-            is_active = TRUE;
-
-            pme->m_ongoingPPQ.init();
-            pme->m_inputJpegQ.init();
-            pme->m_inputPPQ.init();
-            pme->m_inputRawQ.init();
-
-            pme->m_saveProcTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC,
-                                      FALSE,
-                                      FALSE);
-
-            // signal cmd is completed
-            cam_sem_post(&cmdThread->sync_sem);
 
-            break;
-        case CAMERA_CMD_TYPE_STOP_DATA_PROC:
-            {
-                CDBG_HIGH("%s: stop data proc", __func__);
-                is_active = FALSE;
-
-                pme->m_saveProcTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC,
-                                           TRUE,
-                                           TRUE);
-                // cancel all ongoing jpeg jobs
-                qcamera_jpeg_data_t *jpeg_job =
-                    (qcamera_jpeg_data_t *)pme->m_ongoingJpegQ.dequeue();
-                while (jpeg_job != NULL) {
-                    pme->mJpegHandle.abort_job(jpeg_job->jobId);
+    CDBG_HIGH("%s: start data proc", __func__);
+    pme->m_ongoingPPQ.init();
+    pme->m_inputJpegQ.init();
+    pme->m_inputPPQ.init();
+    pme->m_inputRawQ.init();
+    __atomic_store_n(&pme->m_dataProcActive, TRUE, __ATOMIC_RELAXED);
+}
 
-                    pme->releaseJpegJobData(jpeg_job);
-                    free(jpeg_job);
+/*===========================================================================
+ * FUNCTION   : dataProcStopJob
+ *
+ * DESCRIPTION: data process strand job that stops data processing, aborts
+ *              ongoing jpeg jobs and flushes the input queues
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCameraPostProcessor)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::dataProcStopJob(void *data)
+{
+    QCameraPostProcessor *pme = (QCameraPostProcessor *)data;
 
-                    jpeg_job = (qcamera_jpeg_data_t *)pme->m_ongoingJpegQ.dequeue();
-                }
+    CDBG_HIGH("%s: stop data proc", __func__);
+    __atomic_store_n(&pme->m_dataProcActive, FALSE, __ATOMIC_RELAXED);
 
-                // destroy jpeg encoding session
-                if ( 0 < pme->mJpegSessionId ) {
-                    pme->mJpegHandle.destroy_session(pme->mJpegSessionId);
-                    pme->mJpegSessionId = 0;
-                }
+    // cancel all ongoing jpeg jobs
+    qcamera_jpeg_data_t *jpeg_job =
+        (qcamera_jpeg_data_t *)pme->m_ongoingJpegQ.dequeue();
+    while (jpeg_job != NULL) {
+        pme->mJpegHandle.abort_job(jpeg_job->jobId);
 
-                // free jpeg out buf and exif obj
-                FREE_JPEG_OUTPUT_BUFFER(pme->m_pJpegOutputMem,
-                    pme->m_JpegOutputMemCount);
+        pme->releaseJpegJobData(jpeg_job);
+        free(jpeg_job);
 
-                if (pme->m_pJpegExifObj != NULL) {
-                    delete pme->m_pJpegExifObj;
-                    pme->m_pJpegExifObj = NULL;
-                }
+        jpeg_job = (qcamera_jpeg_data_t *)pme->m_ongoingJpegQ.dequeue();
+    }
 
-                // flush ongoing postproc Queue
-                pme->m_ongoingPPQ.flush();
+    // destroy jpeg encoding session
+    if ( 0 < pme->mJpegSessionId ) {
+        pme->mJpegHandle.destroy_session(pme->mJpegSessionId);
+        pme->mJpegSessionId = 0;
+    }
 
-                // flush input jpeg Queue
-                pme->m_inputJpegQ.flush();
+    // free jpeg out buf and exif obj
+    FREE_JPEG_OUTPUT_BUFFER(pme->m_pJpegOutputMem,
+        pme->m_JpegOutputMemCount);
 
-                // flush input Postproc Queue
-                pme->m_inputPPQ.flush();
+    if (pme->m_pJpegExifObj != NULL) {
+        delete pme->m_pJpegExifObj;
+        pme->m_pJpegExifObj = NULL;
+    }
 
-                // flush input raw Queue
-                pme->m_inputRawQ.flush();
+    // flush ongoing postproc Queue
+    pme->m_ongoingPPQ.flush();
 
-                // signal cmd is completed
-                cam_sem_post(&cmdThread->sync_sem);
+    // flush input jpeg Queue
+    pme->m_inputJpegQ.flush();
 
-                pme->mNewJpegSessionNeeded = true;
-            }
-            break;
-        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
-                if (is_active == TRUE) {
-                    qcamera_jpeg_data_t *jpeg_job =
-                        (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
-
-                    if (NULL != jpeg_job) {
-                        // To avoid any race conditions,
-                        // sync any stream specific parameters here.
-                        if (pme->m_parent->mParameters.isAdvCamFeaturesEnabled()) {
-                            // Sync stream params, only if advanced features configured
-                            // Reduces the latency for normal snapshot.
-                            pme->syncStreamParams(jpeg_job->src_frame, NULL);
-                        }
+    // flush input Postproc Queue
+    pme->m_inputPPQ.flush();
 
-                        // add into ongoing jpeg job Q
-                        if (pme->m_ongoingJpegQ.enqueue((void *)jpeg_job)) {
-                            ret = pme->encodeData(jpeg_job,
-                                      pme->mNewJpegSessionNeeded);
-                            if (NO_ERROR != ret) {
-                                // dequeue the last one
-                                pme->m_ongoingJpegQ.dequeue(false);
-                                pme->releaseJpegJobData(jpeg_job);
-                                free(jpeg_job);
-                                jpeg_job = NULL;
-                                pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
-                            }
-                        } else {
-                            CDBG_HIGH("%s : m_ongoingJpegQ is not active!!!", __func__);
-                            pme->releaseJpegJobData(jpeg_job);
-                            free(jpeg_job);
-                            jpeg_job = NULL;
-                        }
-                    }
+    // flush input raw Queue
+    pme->m_inputRawQ.flush();
 
+    pme->mNewJpegSessionNeeded = true;
+}
 
-                    // process raw data if any
-                    mm_camera_super_buf_t *super_buf =
-                        (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue();
+/*===========================================================================
+ * FUNCTION   : dataProcNextJob
+ *
+ * DESCRIPTION: data process strand job that handles input data either from
+ *              input Jpeg Queue to do jpeg encoding, or from input PP Queue
+ *              to do reprocess.
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCameraPostProcessor)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::dataProcNextJob(void *data)
+{
+    int ret;
+    QCameraPostProcessor *pme = (QCameraPostProcessor *)data;
+    uint8_t is_active = __atomic_load_n(&pme->m_dataProcActive,
+            __ATOMIC_RELAXED);
 
-                    if (NULL != super_buf) {
-                        //play shutter sound
-                        pme->m_parent->playShutter();
-                        ret = pme->processRawImageImpl(super_buf);
-                        if (NO_ERROR != ret) {
-                            pme->releaseSuperBuf(super_buf);
-                            free(super_buf);
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
-                        }
-                    }
+    CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
+    if (is_active == TRUE) {
+        qcamera_jpeg_data_t *jpeg_job =
+            (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
+
+        if (NULL != jpeg_job) {
+            // To avoid any race conditions,
+            // sync any stream specific parameters here.
+            if (pme->m_parent->mParameters.isAdvCamFeaturesEnabled()) {
+                // Sync stream params, only if advanced features configured
+                // Reduces the latency for normal snapshot.
+                pme->syncStreamParams(jpeg_job->src_frame, NULL);
+            }
+
+            // add into ongoing jpeg job Q
+            if (pme->m_ongoingJpegQ.enqueue((void *)jpeg_job)) {
+                ret = pme->encodeData(jpeg_job,
+                          pme->mNewJpegSessionNeeded);
+                if (NO_ERROR != ret) {
+                    // dequeue the last one
+                    pme->m_ongoingJpegQ.dequeue(false);
+                    pme->releaseJpegJobData(jpeg_job);
+                    free(jpeg_job);
+                    jpeg_job = NULL;
+                    pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
+                }
+            } else {
+                CDBG_HIGH("%s : m_ongoingJpegQ is not active!!!", __func__);
+                pme->releaseJpegJobData(jpeg_job);
+                free(jpeg_job);
+                jpeg_job = NULL;
+            }
+        }
 
-                    ret = pme->doReprocess();
-                    if (NO_ERROR != ret) {
-                        pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
-                    } else {
-                        ret = pme->stopCapture();
-                    }
 
-                } else {
-                    // not active, simply return buf and do no op
-                    qcamera_jpeg_data_t *jpeg_data =
-                        (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
-                    if (NULL != jpeg_data) {
-                        pme->releaseJpegJobData(jpeg_data);
-                        free(jpeg_data);
-                    }
-                    mm_camera_super_buf_t *super_buf =
-                        (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue();
-                    if (NULL != super_buf) {
-                        pme->releaseSuperBuf(super_buf);
-                        free(super_buf);
-                    }
+        // process raw data if any
+        mm_camera_super_buf_t *super_buf =
+            (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue();
 
-                    // flush input Postproc Queue
-                    pme->m_inputPPQ.flush();
-                }
+        if (NULL != super_buf) {
+            //play shutter sound
+            pme->m_parent->playShutter();
+            ret = pme->processRawImageImpl(super_buf);
+            if (NO_ERROR != ret) {
+                pme->releaseSuperBuf(super_buf);
+                free(super_buf);
+                pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
             }
-            break;
-        case CAMERA_CMD_TYPE_EXIT:
-            running = 0;
-            break;
-        default:
-            break;
         }
-    } while (running);
-    CDBG_HIGH("%s: X", __func__);
-    return NULL;
+
+        ret = pme->doReprocess();
+        if (NO_ERROR != ret) {
+            pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
+        } else {
+            pme->stopCapture();
+        }
+
+    } else {
+        // not active, simply return buf and do no op
+        qcamera_jpeg_data_t *jpeg_data =
+            (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
+        if (NULL != jpeg_data) {
+            pme->releaseJpegJobData(jpeg_data);
+            free(jpeg_data);
+        }
+        mm_camera_super_buf_t *super_buf =
+            (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue();
+        if (NULL != super_buf) {
+            pme->releaseSuperBuf(super_buf);
+            free(super_buf);
+        }
+
+        // flush input Postproc Queue
+        pme->m_inputPPQ.flush();
+    }
 }
 
 /*===========================================================================
@@ -175,8 +175,12 @@ private:
     static void releasePPInputData(void *data, void *user_data);
     static void releaseOngoingPPData(void *data, void *user_data);
 
-    static void *dataProcessRoutine(void *data);
-    static void *dataSaveRoutine(void *data);
+    static void dataProcStartJob(void *data);
+    static void dataProcStopJob(void *data);
+    static void dataProcNextJob(void *data);
+    static void dataSaveStartJob(void *data);
+    static void dataSaveStopJob(void *data);
+    static void dataSaveNextJob(void *data);
 
     int32_t setYUVFrameInfo(mm_camera_super_buf_t *recvd_frame);
     static bool matchJobId(void *data, void *user_data, void *match_data);
@@ -212,8 +216,12 @@ private:
     QCameraQueue m_ongoingJpegQ;        // ongoing jpeg job queue
     QCameraQueue m_inputRawQ;           // input raw job queue
     QCameraQueue m_inputSaveQ;          // input save job queue
-    QCameraCmdThread m_dataProcTh;      // thread for data processing
-    QCameraCmdThread m_saveProcTh;      // thread for storing buffers
+    QCameraStrand m_dataProcStrand;     // serial queue for data processing
+    QCameraStrand m_saveProcStrand;     // serial queue for storing buffers
+    /* set by the start jobs, cleared by stop() ahead of the stop jobs so
+     * jobs still queued only drop their data. Atomic access only */
+    uint8_t m_dataProcActive;
+    uint8_t m_saveProcActive;
     uint32_t mSaveFrmCnt;               // save frame counter
     static const char *STORE_LOCATION;  // path for storing buffers
     bool mUseSaveProc;                  // use store thread
@@ -109,8 +109,8 @@ void *QCameraStateMachine::smEvtProcRoutine(void *data)
  * RETURN     : none
  *==========================================================================*/
 QCameraStateMachine::QCameraStateMachine(QCamera2HardwareInterface *ctrl) :
-    api_queue(),
-    evt_queue()
+    api_queue(NULL, NULL, QCAMERA_QUEUE_RING_SIZE),
+    evt_queue(NULL, NULL, QCAMERA_QUEUE_RING_SIZE)
 {
     m_parent = ctrl;
     m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
@@ -426,7 +426,7 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
     case QCAMERA_SM_EVT_COMMIT_PARAMS:
         {
             if (m_bPreviewNeedsRestart) {
-                m_parent->m_memoryPool.clear();
+                m_parent->m_memoryPool.trim();
             }
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
@@ -442,7 +442,7 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
         {
             int needRestart = *((int*)payload);
             if (m_bPreviewNeedsRestart || needRestart) {
-                m_parent->m_memoryPool.clear();
+                m_parent->m_memoryPool.trim();
             }
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
@@ -846,8 +846,8 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
                 CDBG("Restarting preview...");
                 // need restart preview for parameters to take effect
                 m_parent->unpreparePreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pool, keep recent buffers for the restart
+                m_parent->m_memoryPool.trim();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
                 // prepare preview again
@@ -872,8 +872,8 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
                 CDBG("Stopping preview for restart...");
                 // need restart preview for parameters to take effect
                 m_parent->unpreparePreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pool, keep recent buffers for the restart
+                m_parent->m_memoryPool.trim();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
             } else {
@@ -1251,8 +1251,8 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
                 CDBG("Restarting preview...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pool, keep recent buffers for the restart
+                m_parent->m_memoryPool.trim();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
                 // start preview again
@@ -1283,8 +1283,8 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
                 CDBG("Stopping preview for restart...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pool, keep recent buffers for the restart
+                m_parent->m_memoryPool.trim();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
             } else {
@@ -1557,8 +1557,8 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
             if ((CAMERA_CMD_LONGSHOT_ON == cmd_payload->cmd) &&
                     (m_bPreviewNeedsRestart)) {
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pool, keep recent buffers for the restart
+                m_parent->m_memoryPool.trim();
 
                 if (!m_bPreviewDelayedRestart) {
                     // start preview again
@@ -3306,8 +3306,8 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
                 CDBG("Restarting preview...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pool, keep recent buffers for the restart
+                m_parent->m_memoryPool.trim();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
                 // start preview again
@@ -3338,8 +3338,8 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
                 CDBG("Stopping preview for restart...");
                 // stop preview
                 m_parent->stopPreview();
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pool, keep recent buffers for the restart
+                m_parent->m_memoryPool.trim();
                 // commit parameter changes to server
                 m_parent->commitParameterChanges();
             } else {
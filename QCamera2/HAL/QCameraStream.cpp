@@ -32,6 +32,7 @@
 #include <utils/Errors.h>
 #include <QComOMXMetadata.h>
 #include "QCameraBufferMaps.h"
+#include "QCameraStreamStats.h"
 #include "QCamera2HWI.h"
 #include "QCameraStream.h"
 
@@ -312,7 +313,7 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
         mDataCB(NULL),
         mSYNCDataCB(NULL),
         mUserData(NULL),
-        mDataQ(releaseFrameData, this),
+        mDataQ(releaseFrameData, this, QCAMERA_QUEUE_RING_SIZE),
         mStreamInfoBuf(NULL),
         mMiscBuf(NULL),
         mStreamBufs(NULL),
@@ -324,7 +325,8 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
         mStreamBufsAcquired(false),
         m_bActive(false),
         mDynBufAlloc(false),
-        mBufAllocPid(0),
+        mDeferCacheInv(false),
+        mBufAllocRunning(false),
         mDefferedAllocation(deffered),
         wait_for_cond(false),
         mAllocTaskId(0),
@@ -366,6 +368,10 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
  *==========================================================================*/
 QCameraStream::~QCameraStream()
 {
+    // no data job may run past this point
+    mProcStrand.drain();
+    stopBufAlloc();
+
     pthread_mutex_destroy(&mCropLock);
     pthread_mutex_destroy(&mParameterLock);
 
@@ -820,8 +826,8 @@ int32_t QCameraStream::calcOffset(cam_stream_info_t *streamInfo)
 /*===========================================================================
  * FUNCTION   : start
  *
- * DESCRIPTION: start stream. Will start main stream thread to handle stream
- *              related ops.
+ * DESCRIPTION: start stream. Frames are processed as jobs on the stream's
+ *              strand of the shared executor.
  *
  * PARAMETERS : none
  *
@@ -831,19 +837,16 @@ int32_t QCameraStream::calcOffset(cam_stream_info_t *streamInfo)
  *==========================================================================*/
 int32_t QCameraStream::start()
 {
-    int32_t rc = 0;
     mDataQ.init();
-    rc = mProcTh.launch(dataProcRoutine, this);
-    if (rc == NO_ERROR) {
-        m_bActive = true;
-    }
-    return rc;
+    m_bActive = true;
+    return NO_ERROR;
 }
 
 /*===========================================================================
  * FUNCTION   : stop
  *
- * DESCRIPTION: stop stream. Will stop main stream thread
+ * DESCRIPTION: stop stream. Waits for in-flight data jobs and returns any
+ *              frame still queued.
  *
  * PARAMETERS : none
  *
@@ -853,12 +856,13 @@ int32_t QCameraStream::start()
  *==========================================================================*/
 int32_t QCameraStream::stop()
 {
-    int32_t rc = 0;
     m_bActive = false;
     mAllocator.waitForBackgroundTask(mAllocTaskId);
     mAllocator.waitForBackgroundTask(mMapTaskId);
-    rc = mProcTh.exit();
-    return rc;
+    mProcStrand.drain();
+    /* flush data buf queue */
+    mDataQ.flush();
+    return NO_ERROR;
 }
 
 /*===========================================================================
@@ -960,7 +964,7 @@ int32_t QCameraStream::processDataNotify(mm_camera_super_buf_t *frame)
 {
     CDBG("%s:\n", __func__);
     if (mDataQ.enqueue((void *)frame)) {
-        return mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        return mProcStrand.post(dataProcJob, this);
     } else {
         CDBG_HIGH("%s: Stream thread is not active, no ops here", __func__);
         bufDone(frame->bufs[0]->buf_idx);
@@ -993,6 +997,9 @@ void QCameraStream::dataNotifySYNCCB(mm_camera_super_buf_t *recvd_frame,
         ALOGE("%s: Not a valid stream to handle buf", __func__);
         return;
     }
+    if (stream->mDeferCacheInv) {
+        QCameraMemory::syncForCpu(recvd_frame);
+    }
     if (stream->mSYNCDataCB != NULL)
         stream->mSYNCDataCB(recvd_frame, stream, stream->mUserData);
     return;
@@ -1032,70 +1039,44 @@ void QCameraStream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         return;
     }
     *frame = *recvd_frame;
+    if (stream->mDeferCacheInv) {
+        QCameraMemory::syncForCpu(frame);
+    }
     stream->processDataNotify(frame);
     return;
 }
 
 /*===========================================================================
- * FUNCTION   : dataProcRoutine
+ * FUNCTION   : dataProcJob
  *
- * DESCRIPTION: function to process data in the main stream thread
+ * DESCRIPTION: process one frame from the data queue. Runs on the stream's
+ *              strand, so frames of a stream are handled one at a time and
+ *              in order.
  *
  * PARAMETERS :
  *   @data    : user data ptr
  *
  * RETURN     : none
  *==========================================================================*/
-void *QCameraStream::dataProcRoutine(void *data)
+void QCameraStream::dataProcJob(void *data)
 {
-    int running = 1;
-    int ret;
     QCameraStream *pme = (QCameraStream *)data;
-    QCameraCmdThread *cmdThread = &pme->mProcTh;
-    cmdThread->setName("CAM_strmDatProc");
-
-    CDBG("%s: E", __func__);
-    do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                      __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
-
-        // we got notified about new cmd avail in cmd queue
-        camera_cmd_type_t cmd = cmdThread->getCmd();
-        switch (cmd) {
-        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                CDBG_HIGH("%s: Do next job", __func__);
-                mm_camera_super_buf_t *frame =
-                    (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
-                    if (pme->mDataCB != NULL) {
-                        pme->mDataCB(frame, pme, pme->mUserData);
-                    } else {
-                        // no data cb routine, return buf here
-                        pme->bufDone(frame->bufs[0]->buf_idx);
-                        free(frame);
-                    }
-                }
-            }
-            break;
-        case CAMERA_CMD_TYPE_EXIT:
-            CDBG_HIGH("%s: Exit", __func__);
-            /* flush data buf queue */
-            pme->mDataQ.flush();
-            running = 0;
-            break;
-        default:
-            break;
+
+    CDBG_HIGH("%s: Do next job", __func__);
+    mm_camera_super_buf_t *frame =
+        (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
+    if (NULL != frame) {
+        MM_CAMERA_TRACE_FRAME("HalDataCb", frame->bufs[0]->frame_idx,
+                pme->getMyType());
+        frame->bufs[0]->cb_time = systemTime(SYSTEM_TIME_BOOTTIME);
+        if (pme->mDataCB != NULL) {
+            pme->mDataCB(frame, pme, pme->mUserData);
+        } else {
+            // no data cb routine, return buf here
+            pme->bufDone(frame->bufs[0]->buf_idx);
+            free(frame);
         }
-    } while (running);
-    CDBG_HIGH("%s: X", __func__);
-    return NULL;
+    }
 }
 
 /*===========================================================================
@@ -1217,6 +1198,27 @@ int32_t QCameraStream::getNumQueuedBuf()
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : dumpStats
+ *
+ * DESCRIPTION: print latency stats of this stream
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStream::dumpStats(int fd)
+{
+    mm_camera_stream_stats_t stats;
+
+    if ((mHandle == 0) || (mCamOps->get_stream_stats(mCamHandle,
+            mChannelHandle, mHandle, &stats) != 0)) {
+        return;
+    }
+    dumpStreamStats(fd, getMyType(), mHandle, stats);
+}
+
 /*===========================================================================
  * FUNCTION   : getBufs
  *
@@ -1275,6 +1277,7 @@ int32_t QCameraStream::getBufs(cam_frame_len_offset_t *offset,
         ALOGE("%s: Failed to allocate stream buffers", __func__);
         return NO_MEMORY;
     }
+    setupCacheOps();
 
     mNumBufs = (uint8_t)(numBufAlloc + mNumBufsNeedAlloc);
     uint8_t numBufsToMap = mStreamBufs->getMappable();
@@ -1368,14 +1371,9 @@ int32_t QCameraStream::getBufs(cam_frame_len_offset_t *offset,
         pthread_mutex_lock(&m_lock);
         wait_for_cond = TRUE;
         pthread_mutex_unlock(&m_lock);
+        // the rest is allocated on the executor once the stream is on
         CDBG_HIGH("%s: Still need to allocate %d buffers",
               __func__, mNumBufsNeedAlloc);
-        // start another thread to allocate the rest of buffers
-        pthread_create(&mBufAllocPid,
-                       NULL,
-                       BufAllocRoutine,
-                       this);
-        pthread_setname_np(mBufAllocPid, "CAM_strmBuf");
     }
 
     return NO_ERROR;
@@ -1514,6 +1512,7 @@ int32_t QCameraStream::allocateBuffers()
         ALOGE("%s: Failed to allocate stream buffers", __func__);
         return NO_MEMORY;
     }
+    setupCacheOps();
 
     mNumBufs = (uint8_t)(numBufAlloc + mNumBufsNeedAlloc);
     uint8_t numBufsToMap = mStreamBufs->getMappable();
@@ -1572,14 +1571,9 @@ int32_t QCameraStream::allocateBuffers()
         pthread_mutex_lock(&m_lock);
         wait_for_cond = TRUE;
         pthread_mutex_unlock(&m_lock);
+        // the rest is allocated on the executor once the stream is on
         CDBG_HIGH("%s: Still need to allocate %d buffers",
               __func__, mNumBufsNeedAlloc);
-        // start another thread to allocate the rest of buffers
-        pthread_create(&mBufAllocPid,
-                       NULL,
-                       BufAllocRoutine,
-                       this);
-        pthread_setname_np(mBufAllocPid, "CAM_strmBufAlloc");
     }
     return rc;
 }
@@ -1861,13 +1855,7 @@ int32_t QCameraStream::releaseBuffs()
 {
     int rc = NO_ERROR;
 
-    if (mBufAllocPid != 0) {
-        cond_signal(true);
-        CDBG_HIGH("%s: wait for buf allocation thread dead", __func__);
-        pthread_join(mBufAllocPid, NULL);
-        mBufAllocPid = 0;
-        CDBG_HIGH("%s: return from buf allocation thread", __func__);
-    }
+    stopBufAlloc();
 
     if (mStreamInfo->streaming_mode == CAM_STREAMING_MODE_BATCH) {
         return releaseBatchBufs(NULL);
@@ -1881,17 +1869,19 @@ int32_t QCameraStream::releaseBuffs()
                 ALOGE("%s: map_stream_buf failed: %d", __func__, rc);
             }
         }
-
+    }
+    if (!mStreamBufsAcquired && mStreamBufs != NULL) {
+        mAllocator.releaseStreamBuf(mStreamInfo->stream_type, mStreamBufs,
+                mFrameLenOffset.frame_len, mFrameLenOffset.mp[0].stride,
+                mFrameLenOffset.mp[0].scanline);
+        mStreamBufs = NULL;
+    }
+    if (NULL != mBufDefs) {
         // mBufDefs just keep a ptr to the buffer
         // mm-camera-interface own the buffer, so no need to free
         mBufDefs = NULL;
         memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
     }
-    if (!mStreamBufsAcquired && mStreamBufs != NULL) {
-        mStreamBufs->deallocate();
-        delete mStreamBufs;
-        mStreamBufs = NULL;
-    }
 
     return rc;
 }
@@ -1950,100 +1940,164 @@ int32_t QCameraStream::releaseBatchBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
 /*===========================================================================
  * FUNCTION   : BufAllocRoutine
  *
- * DESCRIPTION: function to allocate additional stream buffers
+ * DESCRIPTION: executor task allocating the stream buffers left out of
+ *              getBufs. Buffers are allocated a few at a time, in parallel,
+ *              and each one is mapped and queued as soon as its batch is
+ *              done, so the stream gains buffers while the rest are still
+ *              being allocated.
  *
  * PARAMETERS :
  *   @data    : user data ptr
  *
  * RETURN     : none
  *==========================================================================*/
-void *QCameraStream::BufAllocRoutine(void *data)
+void QCameraStream::BufAllocRoutine(void *data)
 {
     QCameraStream *pme = (QCameraStream *)data;
     int32_t rc = NO_ERROR;
+    char value[PROPERTY_VALUE_MAX];
+    nsecs_t startTime = systemTime();
+    uint8_t numQueued = 0;
 
     CDBG_HIGH("%s: E", __func__);
-    pme->cond_wait();
-    if (pme->mNumBufsNeedAlloc > 0) {
-        uint8_t numBufAlloc = (uint8_t)(pme->mNumBufs - pme->mNumBufsNeedAlloc);
+    property_get("persist.camera.mem.alloc.threads", value, "3");
+    int batchSize = atoi(value);
+    if (batchSize < 1) {
+        batchSize = 1;
+    }
+
+    while (rc == NO_ERROR) {
+        pthread_mutex_lock(&pme->m_lock);
+        uint8_t numBufAlloc = pme->mNumBufsNeedAlloc;
+        pthread_mutex_unlock(&pme->m_lock);
+        if (numBufAlloc > batchSize) {
+            numBufAlloc = (uint8_t)batchSize;
+        }
+        if (numBufAlloc == 0) {
+            break;
+        }
+
+        uint8_t first = pme->mStreamBufs->getCnt();
+        uint8_t total = numBufAlloc;
         rc = pme->mAllocator.allocateMoreStreamBuf(pme->mStreamBufs,
-                                                   pme->mFrameLenOffset.frame_len,
-                                                   pme->mNumBufsNeedAlloc);
+                pme->mFrameLenOffset.frame_len, total);
         if (rc != NO_ERROR) {
             ALOGE("%s: Failed to allocate buffers", __func__);
-            pme->mNumBufsNeedAlloc = 0;
-            return NULL;
+            break;
         }
 
-        pme->mNumBufsNeedAlloc = 0;
-        QCameraBufferMaps bufferMaps;
-        for (uint32_t i = numBufAlloc; i < pme->mNumBufs; i++) {
-            ssize_t bufSize = pme->mStreamBufs->getSize(i);
-            if (BAD_INDEX == bufSize) {
-                ALOGE("%s: Failed to retrieve buffer size (bad index)", __func__);
-                return NULL;
-            }
-
-            rc = bufferMaps.enqueue(CAM_MAPPING_BUF_TYPE_STREAM_BUF,
-                    pme->mHandle, i /*buf index*/, -1 /*plane index*/,
-                    0 /*cookie*/, pme->mStreamBufs->getFd(i), bufSize);
+        pthread_mutex_lock(&pme->m_lock);
+        if (pme->mNumBufsNeedAlloc >= numBufAlloc) {
+            pme->mNumBufsNeedAlloc = (uint8_t)(pme->mNumBufsNeedAlloc - numBufAlloc);
+        }
+        pthread_mutex_unlock(&pme->m_lock);
 
-            if (rc < 0) {
-                ALOGE("%s: Failed to map buffers", __func__);
-                return NULL;
+        for (uint32_t i = first; i < total; i++) {
+            rc = pme->queueNewBuffer(i);
+            if (rc != NO_ERROR) {
+                break;
             }
+            numQueued++;
         }
+    }
 
-        cam_buf_map_type_list bufMapList;
-        rc = bufferMaps.getCamBufMapList(bufMapList);
-        if (rc == NO_ERROR) {
-            rc = pme->m_MemOpsTbl.bundled_map_ops(&bufMapList, pme->m_MemOpsTbl.userdata);
-        }
-        if (rc != 0) {
-            ALOGE("%s: Failed to map buffers with return code %d", __func__, rc);
-            return NULL;
-        }
+    ALOGI("[KPI Perf] %s: stream type %d, %d more buffers queued in %lld us",
+            __func__, pme->getMyType(), numQueued,
+            (long long)((systemTime() - startTime) / 1000));
 
-        for (uint32_t i = numBufAlloc; i < pme->mNumBufs; i++) {
-            pme->mStreamBufs->getBufDef(pme->mFrameLenOffset, pme->mBufDefs[i], i);
-            pme->mCamOps->qbuf(pme->mCamHandle, pme->mChannelHandle,
-                    &pme->mBufDefs[i]);
-        }
-    }
+    pthread_mutex_lock(&pme->m_lock);
+    pme->mNumBufsNeedAlloc = 0;
+    pme->mBufAllocRunning = false;
+    pthread_cond_broadcast(&pme->m_cond);
+    pthread_mutex_unlock(&pme->m_lock);
     CDBG_HIGH("%s: X", __func__);
-    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : queueNewBuffer
+ *
+ * DESCRIPTION: map a buffer allocated after streamon and hand it to the
+ *              running stream
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraStream::queueNewBuffer(uint32_t index)
+{
+    int32_t rc = NO_ERROR;
+
+    ssize_t bufSize = mStreamBufs->getSize(index);
+    if (BAD_INDEX == bufSize) {
+        ALOGE("%s: Failed to retrieve buffer size (bad index)", __func__);
+        return INVALID_OPERATION;
+    }
+
+    cam_buf_map_type_list bufMapList;
+    rc = QCameraBufferMaps::makeSingletonBufMapList(
+            CAM_MAPPING_BUF_TYPE_STREAM_BUF, mHandle, index,
+            -1 /*plane index*/, 0 /*cookie*/, mStreamBufs->getFd(index),
+            bufSize, bufMapList);
+    if (rc == NO_ERROR) {
+        rc = m_MemOpsTbl.bundled_map_ops(&bufMapList, m_MemOpsTbl.userdata);
+    }
+    if (rc != 0) {
+        ALOGE("%s: Failed to map buffer %d with return code %d",
+                __func__, index, rc);
+        return INVALID_OPERATION;
+    }
+
+    mStreamBufs->getBufDef(mFrameLenOffset, mBufDefs[index], index);
+    return mCamOps->qbuf(mCamHandle, mChannelHandle, &mBufDefs[index]);
 }
 
 /*===========================================================================
  * FUNCTION   : cond_signal
  *
- * DESCRIPTION: signal if flag "wait_for_cond" is set
+ * DESCRIPTION: signal if flag "wait_for_cond" is set. Starts the allocation
+ *              of the remaining stream buffers, or drops it on forceExit.
  *
  *==========================================================================*/
 void QCameraStream::cond_signal(bool forceExit)
 {
+    bool start = false;
+
     pthread_mutex_lock(&m_lock);
+    if (forceExit) {
+        mNumBufsNeedAlloc = 0;
+    }
     if(wait_for_cond == TRUE){
         wait_for_cond = FALSE;
-        if (forceExit) {
-            mNumBufsNeedAlloc = 0;
+        if (mNumBufsNeedAlloc > 0) {
+            mBufAllocRunning = true;
+            start = true;
         }
-        pthread_cond_signal(&m_cond);
     }
     pthread_mutex_unlock(&m_lock);
-}
 
+    if (start && (QCameraExecutor::getBlockingInstance().submit(BufAllocRoutine,
+            this) != NO_ERROR)) {
+        ALOGE("%s: Failed to schedule buffer allocation", __func__);
+        BufAllocRoutine(this);
+    }
+}
 
 /*===========================================================================
- * FUNCTION   : cond_wait
+ * FUNCTION   : stopBufAlloc
  *
- * DESCRIPTION: wait on if flag "wait_for_cond" is set
+ * DESCRIPTION: drop buffers still to be allocated and wait for a running
+ *              BufAllocRoutine to return
  *
  *==========================================================================*/
-void QCameraStream::cond_wait()
+void QCameraStream::stopBufAlloc()
 {
+    cond_signal(true);
     pthread_mutex_lock(&m_lock);
-    while (wait_for_cond == TRUE) {
+    while (mBufAllocRunning) {
+        CDBG_HIGH("%s: wait for buf allocation", __func__);
         pthread_cond_wait(&m_cond, &m_lock);
     }
     pthread_mutex_unlock(&m_lock);
@@ -2065,13 +2119,7 @@ int32_t QCameraStream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
 {
     int rc = NO_ERROR;
 
-    if (mBufAllocPid != 0) {
-        cond_signal(true);
-        CDBG_HIGH("%s: wait for buf allocation thread dead", __func__);
-        pthread_join(mBufAllocPid, NULL);
-        mBufAllocPid = 0;
-        CDBG_HIGH("%s: return from buf allocation thread", __func__);
-    }
+    stopBufAlloc();
 
     uint8_t numBufsToUnmap = mStreamBufs->getMappable();
     for (uint32_t i = 0; i < numBufsToUnmap; i++) {
@@ -2082,12 +2130,13 @@ int32_t QCameraStream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
     }
     mBufDefs = NULL; // mBufDefs just keep a ptr to the buffer
                      // mm-camera-interface own the buffer, so no need to free
-    memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
     if ( !mStreamBufsAcquired ) {
-        mStreamBufs->deallocate();
-        delete mStreamBufs;
+        mAllocator.releaseStreamBuf(mStreamInfo->stream_type, mStreamBufs,
+                mFrameLenOffset.frame_len, mFrameLenOffset.mp[0].stride,
+                mFrameLenOffset.mp[0].scanline);
         mStreamBufs = NULL;
     }
+    memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
 
     return rc;
 }
@@ -2123,9 +2172,55 @@ int32_t QCameraStream::invalidateBuf(uint32_t index)
  *==========================================================================*/
 int32_t QCameraStream::cleanInvalidateBuf(uint32_t index)
 {
+    if (mDeferCacheInv) {
+        return mStreamBufs->markDeviceWrite(index);
+    }
     return mStreamBufs->cleanInvalidateCache(index);
 }
 
+/*===========================================================================
+ * FUNCTION   : setupCacheOps
+ *
+ * DESCRIPTION: pick the cache maintenance of freshly acquired stream buffers.
+ *              The HAL only writes stream buffers in the listed types through
+ *              paths that report it, so their clean/invalidate can follow
+ *              the CPU writes. Snapshot and raw frames often sit in the
+ *              super buffer queue and get dropped unseen, their dequeue
+ *              invalidate waits until the frame reaches the HAL.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStream::setupCacheOps()
+{
+    char value[PROPERTY_VALUE_MAX];
+    bool track = false;
+
+    property_get("persist.camera.mem.cache.track", value, "1");
+    if ((atoi(value) > 0) && (mStreamInfo->is_secure != SECURE) &&
+            (mStreamInfo->streaming_mode != CAM_STREAMING_MODE_BATCH)) {
+        switch (mStreamInfo->stream_type) {
+        case CAM_STREAM_TYPE_PREVIEW:
+        case CAM_STREAM_TYPE_POSTVIEW:
+        case CAM_STREAM_TYPE_SNAPSHOT:
+        case CAM_STREAM_TYPE_VIDEO:
+        case CAM_STREAM_TYPE_RAW:
+        case CAM_STREAM_TYPE_CALLBACK:
+        case CAM_STREAM_TYPE_ANALYSIS:
+            track = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    mStreamBufs->setCacheTracking(track);
+    mDeferCacheInv = track &&
+            ((mStreamInfo->stream_type == CAM_STREAM_TYPE_SNAPSHOT) ||
+            (mStreamInfo->stream_type == CAM_STREAM_TYPE_RAW));
+}
+
 /*===========================================================================
  * FUNCTION   : isTypeOf
  *
@@ -2594,4 +2689,23 @@ int32_t QCameraStream::setSyncDataCB(stream_cb_routine data_cb)
     return UNKNOWN_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : setBlockingDataCB
+ *
+ * DESCRIPTION: the data callback of this stream may block, run it on the
+ *              blocking executor so it does not hold up other streams.
+ *              To be called before the stream is started.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              non-zero failure code
+ *==========================================================================*/
+int32_t QCameraStream::setBlockingDataCB()
+{
+    mProcStrand.setExecutor(QCameraExecutor::getBlockingInstance());
+    return NO_ERROR;
+}
+
 }; // namespace qcamera
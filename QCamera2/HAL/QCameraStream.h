@@ -32,6 +32,7 @@
 
 #include <hardware/camera.h>
 #include "QCameraCmdThread.h"
+#include "QCameraExecutor.h"
 #include "QCameraMem.h"
 #include "QCameraAllocator.h"
 
@@ -76,8 +77,8 @@ public:
     static void dataNotifyCB(mm_camera_super_buf_t *recvd_frame, void *userdata);
     static void dataNotifySYNCCB(mm_camera_super_buf_t *recvd_frame,
             void *userdata);
-    static void *dataProcRoutine(void *data);
-    static void *BufAllocRoutine(void *data);
+    static void dataProcJob(void *data);
+    static void BufAllocRoutine(void *data);
     uint32_t getMyHandle() const {return mHandle;}
     bool isTypeOf(cam_stream_type_t type);
     bool isOrignalTypeOf(cam_stream_type_t type);
@@ -116,15 +117,16 @@ public:
     uint8_t getBufferCount() { return mNumBufs; }
     uint32_t getChannelHandle() { return mChannelHandle; }
     int32_t getNumQueuedBuf();
+    void dumpStats(int fd);
 
     uint32_t mDumpFrame;
     uint32_t mDumpMetaFrame;
     uint32_t mDumpSkipCnt;
 
-    void cond_wait();
     void cond_signal(bool forceExit = false);
 
     int32_t setSyncDataCB(stream_cb_routine data_cb);
+    int32_t setBlockingDataCB();
     //Stream time stamp. We need this for preview stream to update display
     nsecs_t mStreamTimestamp;
 
@@ -144,7 +146,7 @@ private:
     void *mUserData;
 
     QCameraQueue     mDataQ;
-    QCameraCmdThread mProcTh; // thread for dataCB
+    QCameraStrand    mProcStrand; // serial executor strand for dataCB
 
     QCameraHeapMemory *mStreamInfoBuf;
     QCameraHeapMemory *mMiscBuf;
@@ -160,9 +162,10 @@ private:
     pthread_mutex_t mCropLock; // lock to protect crop info
     pthread_mutex_t mParameterLock; // lock to sync access to parameters
     bool mStreamBufsAcquired;
-    bool m_bActive; // if stream mProcTh is active
+    bool m_bActive; // if stream data processing is active
     bool mDynBufAlloc; // allow buf allocation in 2 steps
-    pthread_t mBufAllocPid;
+    bool mDeferCacheInv; // dequeue invalidate waits for the frame consumer
+    bool mBufAllocRunning; // BufAllocRoutine is queued or running
     mm_camera_map_unmap_ops_tbl_t m_MemOpsTbl;
     cam_stream_parm_buffer_t m_OutputCrop;
     cam_stream_parm_buffer_t m_ImgProp;
@@ -222,6 +225,9 @@ private:
 
     int32_t invalidateBuf(uint32_t index);
     int32_t cleanInvalidateBuf(uint32_t index);
+    void setupCacheOps();
+    int32_t queueNewBuffer(uint32_t index);
+    void stopBufAlloc();
     int32_t calcOffset(cam_stream_info_t *streamInfo);
     int32_t unmapStreamInfoBuf();
     int32_t releaseStreamInfoBuf();
@@ -48,6 +48,7 @@
 #include "QCamera3Channel.h"
 #include "QCamera3PostProc.h"
 #include "QCamera3VendorTags.h"
+#include "QCameraMemBudget.h"
 #include <cutils/properties.h>
 #include <dlfcn.h>
 
@@ -621,6 +622,7 @@ int QCamera3HardwareInterface::openCamera()
     }
 
     mCameraOpened = true;
+    QCameraMemBudget::getInstance().addSession(NULL, this);
 
     rc = mCameraHandle->ops->register_event_notify(mCameraHandle->camera_handle,
             camEvtHandle, (void *)this);
@@ -697,6 +699,7 @@ int QCamera3HardwareInterface::closeCamera()
     rc = mCameraHandle->ops->close_camera(mCameraHandle->camera_handle);
     mCameraHandle = NULL;
     mCameraOpened = false;
+    QCameraMemBudget::getInstance().removeSession(this);
 
     //Notify display HAL that there is no active camera session
     //but avoid calling the same during bootup. Refer to openCamera
@@ -1546,15 +1549,22 @@ int QCamera3HardwareInterface::configureStreams(
                     newStream->priv = (QCamera3Channel*)mRawChannel;
                     break;
                 case HAL_PIXEL_FORMAT_BLOB:
+                {
                     // Max live snapshot inflight buffer is 1. This is to mitigate
                     // frame drop issues for video snapshot. The more buffers being
                     // allocated, the more frame drops there are.
+                    // Still capture trims its inflight snapshots to what fits
+                    // in the HAL memory budget.
+                    uint8_t numBuffers = m_bIsVideo ? 1 :
+                            QCameraMemBudget::getInstance().adjustBufferCount(
+                            (size_t)newStream->width * newStream->height * 3 / 2,
+                            MAX_INFLIGHT_REQUESTS, 1);
                     mPictureChannel = new QCamera3PicChannel(mCameraHandle->camera_handle,
                             mCameraHandle->ops, captureResultCb,
                             &padding_info, this, newStream,
                             mStreamConfigInfo.postprocess_mask[i],
                             m_bIs4KVideo, mMetadataChannel,
-                            (m_bIsVideo ? 1 : MAX_INFLIGHT_REQUESTS));
+                            numBuffers);
                     if (mPictureChannel == NULL) {
                         ALOGE("%s: allocation of channel failed", __func__);
                         pthread_mutex_unlock(&mMutex);
@@ -1563,6 +1573,7 @@ int QCamera3HardwareInterface::configureStreams(
                     newStream->priv = (QCamera3Channel*)mPictureChannel;
                     newStream->max_buffers = mPictureChannel->getNumBuffers();
                     break;
+                }
 
                 default:
                     ALOGE("%s: not a supported format 0x%x", __func__, newStream->format);
@@ -3051,8 +3062,36 @@ void QCamera3HardwareInterface::dump(int fd)
     }
     dprintf(fd, "-------+-----------\n");
 
+    dprintf(fd, "\nStream latency stats:");
+    for (List<stream_info_t*>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        QCamera3Channel *channel = (*it)->channel;
+        if (channel == NULL) {
+            continue;
+        }
+        for (uint32_t j = 0; j < channel->getNumOfStreams(); j++) {
+            QCamera3Stream *stream = channel->getStreamByIndex(j);
+            if (stream != NULL) {
+                stream->dumpStats(fd);
+            }
+        }
+    }
+    if (mMetadataChannel != NULL) {
+        QCamera3Stream *stream = mMetadataChannel->getStreamByIndex(0);
+        if (stream != NULL) {
+            stream->dumpStats(fd);
+        }
+    }
+
     dprintf(fd, "\n Camera HAL3 information End \n");
 
+    if (gMmCameraTraceLevel > 0) {
+        // chrome trace JSON of the recorded frame lifecycle events
+        dprintf(fd, "\n Camera trace Begin \n");
+        mm_camera_trace_dump(fd);
+        dprintf(fd, " Camera trace End \n");
+    }
+
     /* use dumpsys media.camera as trigger to send update debug level event */
     mUpdateDebugLevel = true;
     pthread_mutex_unlock(&mMutex);
@@ -8409,6 +8448,7 @@ void QCamera3HardwareInterface::getLogLevel()
 
     property_get("persist.camera.kpi.debug", prop, "1");
     gKpiDebugLevel = atoi(prop);
+    mm_camera_trace_update_level();
 
     property_get("persist.camera.global.debug", prop, "0");
     val = atoi(prop);
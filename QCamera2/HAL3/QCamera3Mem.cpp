@@ -62,10 +62,7 @@ QCamera3Memory::QCamera3Memory()
 {
     mBufferCount = 0;
     for (int i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
-        mMemInfo[i].fd = -1;
-        mMemInfo[i].main_ion_fd = -1;
-        mMemInfo[i].handle = 0;
-        mMemInfo[i].size = 0;
+        QCameraBufferAllocator::initBuf(mMemInfo[i]);
     }
 }
 
@@ -85,7 +82,7 @@ QCamera3Memory::~QCamera3Memory()
 /*===========================================================================
  * FUNCTION   : cacheOpsInternal
  *
- * DESCRIPTION: ion related memory cache operations
+ * DESCRIPTION: memory cache operations, through the buffer allocator
  *
  * PARAMETERS :
  *   @index   : index of the buffer
@@ -100,39 +97,19 @@ int QCamera3Memory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vad
 {
     Mutex::Autolock lock(mLock);
 
-    struct ion_flush_data cache_inv_data;
-    struct ion_custom_data custom_data;
-    int ret = OK;
-
     if (MM_CAMERA_MAX_NUM_FRAMES <= index) {
         ALOGE("%s: index %d out of bound [0, %d)",
                 __func__, index, MM_CAMERA_MAX_NUM_FRAMES);
         return BAD_INDEX;
     }
 
-    if (0 == mMemInfo[index].handle) {
+    if (0 > mMemInfo[index].fd) {
         ALOGE("%s: Buffer at %d not registered", __func__, index);
         return BAD_INDEX;
     }
 
-    memset(&cache_inv_data, 0, sizeof(cache_inv_data));
-    memset(&custom_data, 0, sizeof(custom_data));
-    cache_inv_data.vaddr = vaddr;
-    cache_inv_data.fd = mMemInfo[index].fd;
-    cache_inv_data.handle = mMemInfo[index].handle;
-    cache_inv_data.length = (unsigned int)mMemInfo[index].size;
-    custom_data.cmd = cmd;
-    custom_data.arg = (unsigned long)&cache_inv_data;
-
-    CDBG("%s: addr = %p, fd = %d, handle = %lx length = %d, ION Fd = %d",
-         __func__, cache_inv_data.vaddr, cache_inv_data.fd,
-         (unsigned long)cache_inv_data.handle, cache_inv_data.length,
-         mMemInfo[index].main_ion_fd);
-    ret = ioctl(mMemInfo[index].main_ion_fd, ION_IOC_CUSTOM, &custom_data);
-    if (ret < 0)
-        ALOGE("%s: Cache Invalidate failed: %s\n", __func__, strerror(errno));
-
-    return ret;
+    return QCameraBufferAllocator::getInstance().cacheOps(mMemInfo[index],
+            vaddr, cmd);
 }
 
 /*===========================================================================
@@ -153,7 +130,7 @@ int QCamera3Memory::getFd(uint32_t index)
         return BAD_INDEX;
     }
 
-    if (0 == mMemInfo[index].handle) {
+    if (0 > mMemInfo[index].fd) {
         return BAD_INDEX;
     }
 
@@ -178,7 +155,7 @@ ssize_t QCamera3Memory::getSize(uint32_t index)
         return BAD_INDEX;
     }
 
-    if (0 == mMemInfo[index].handle) {
+    if (0 > mMemInfo[index].fd) {
         return BAD_INDEX;
     }
 
@@ -348,54 +325,9 @@ void QCamera3HeapMemory::dealloc()
 int QCamera3HeapMemory::allocOneBuffer(QCamera3MemInfo &memInfo,
         unsigned int heap_id, size_t size)
 {
-    int rc = OK;
-    struct ion_handle_data handle_data;
-    struct ion_allocation_data allocData;
-    struct ion_fd_data ion_info_fd;
-    int main_ion_fd = -1;
-
-    main_ion_fd = open("/dev/ion", O_RDONLY);
-    if (main_ion_fd < 0) {
-        ALOGE("Ion dev open failed: %s\n", strerror(errno));
-        goto ION_OPEN_FAILED;
-    }
-
-    memset(&allocData, 0, sizeof(allocData));
-    allocData.len = size;
-    /* to make it page size aligned */
-    allocData.len = (allocData.len + 4095U) & (~4095U);
-    allocData.align = 4096;
-    allocData.flags = ION_FLAG_CACHED;
-    allocData.heap_id_mask = heap_id;
-    rc = ioctl(main_ion_fd, ION_IOC_ALLOC, &allocData);
-    if (rc < 0) {
-        ALOGE("ION allocation for len %d failed: %s\n", allocData.len,
-            strerror(errno));
-        goto ION_ALLOC_FAILED;
-    }
-
-    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
-    ion_info_fd.handle = allocData.handle;
-    rc = ioctl(main_ion_fd, ION_IOC_SHARE, &ion_info_fd);
-    if (rc < 0) {
-        ALOGE("ION map failed %s\n", strerror(errno));
-        goto ION_MAP_FAILED;
-    }
-
-    memInfo.main_ion_fd = main_ion_fd;
-    memInfo.fd = ion_info_fd.fd;
-    memInfo.handle = ion_info_fd.handle;
-    memInfo.size = allocData.len;
-    return OK;
-
-ION_MAP_FAILED:
-    memset(&handle_data, 0, sizeof(handle_data));
-    handle_data.handle = ion_info_fd.handle;
-    ioctl(main_ion_fd, ION_IOC_FREE, &handle_data);
-ION_ALLOC_FAILED:
-    close(main_ion_fd);
-ION_OPEN_FAILED:
-    return NO_MEMORY;
+    int rc = QCameraBufferAllocator::getInstance().allocate(size, heap_id,
+            true, NON_SECURE, memInfo);
+    return (rc < 0) ? NO_MEMORY : OK;
 }
 
 /*===========================================================================
@@ -410,22 +342,7 @@ ION_OPEN_FAILED:
  *==========================================================================*/
 void QCamera3HeapMemory::deallocOneBuffer(QCamera3MemInfo &memInfo)
 {
-    struct ion_handle_data handle_data;
-
-    if (memInfo.fd >= 0) {
-        close(memInfo.fd);
-        memInfo.fd = -1;
-    }
-
-    if (memInfo.main_ion_fd >= 0) {
-        memset(&handle_data, 0, sizeof(handle_data));
-        handle_data.handle = memInfo.handle;
-        ioctl(memInfo.main_ion_fd, ION_IOC_FREE, &handle_data);
-        close(memInfo.main_ion_fd);
-        memInfo.main_ion_fd = -1;
-    }
-    memInfo.handle = 0;
-    memInfo.size = 0;
+    QCameraBufferAllocator::getInstance().release(memInfo);
 }
 
 /*===========================================================================
@@ -495,8 +412,11 @@ int QCamera3HeapMemory::allocate(uint32_t count, size_t size, bool queueAll)
                 rc = NO_MEMORY;
                 break;
             }
-        } else
+        } else {
             mPtr[i] = vaddr;
+            QCameraBufferAllocator::getInstance().adviseMapping(vaddr,
+                    mMemInfo[i].size);
+        }
     }
     if (rc == 0)
         mBufferCount = count;
@@ -712,7 +632,12 @@ int QCamera3GrallocMemory::registerBuffer(buffer_handle_t *buffer,
             MAP_SHARED,
             mMemInfo[idx].fd, 0);
     if (vaddr == MAP_FAILED) {
-        mMemInfo[idx].handle = 0;
+        struct ion_handle_data ion_handle;
+        memset(&ion_handle, 0, sizeof(ion_handle));
+        ion_handle.handle = mMemInfo[idx].handle;
+        ioctl(mMemInfo[idx].main_ion_fd, ION_IOC_FREE, &ion_handle);
+        close(mMemInfo[idx].main_ion_fd);
+        QCameraBufferAllocator::initBuf(mMemInfo[idx]);
         ret = NO_MEMORY;
     } else {
         mPtr[idx] = vaddr;
@@ -748,8 +673,7 @@ int32_t QCamera3GrallocMemory::unregisterBufferLocked(size_t idx)
         ALOGE("ion free failed");
     }
     close(mMemInfo[idx].main_ion_fd);
-    memset(&mMemInfo[idx], 0, sizeof(struct QCamera3MemInfo));
-    mMemInfo[idx].main_ion_fd = -1;
+    QCameraBufferAllocator::initBuf(mMemInfo[idx]);
     mBufferHandle[idx] = NULL;
     mPrivateHandle[idx] = NULL;
     mBufferCount--;
@@ -782,7 +706,7 @@ int32_t QCamera3GrallocMemory::unregisterBuffer(size_t idx)
         return BAD_VALUE;
     }
 
-    if (0 == mMemInfo[idx].handle) {
+    if (0 > mMemInfo[idx].fd) {
         ALOGE("%s: Trying to unregister buffer at %d which still not registered",
                 __func__, idx);
         return BAD_VALUE;
@@ -812,7 +736,7 @@ void QCamera3GrallocMemory::unregisterBuffers()
     CDBG("%s: E ", __FUNCTION__);
 
     for (uint32_t cnt = 0; cnt < MM_CAMERA_MAX_NUM_FRAMES; cnt++) {
-        if (0 == mMemInfo[cnt].handle) {
+        if (0 > mMemInfo[cnt].fd) {
             continue;
         }
         err = unregisterBufferLocked(cnt);
@@ -850,7 +774,7 @@ int32_t QCamera3GrallocMemory::markFrameNumber(uint32_t index, uint32_t frameNum
         return BAD_INDEX;
     }
 
-    if (0 == mMemInfo[index].handle) {
+    if (0 > mMemInfo[index].fd) {
         ALOGE("%s: Buffer at %d not registered", __func__, index);
         return BAD_INDEX;
     }
@@ -883,7 +807,7 @@ int32_t QCamera3GrallocMemory::getFrameNumber(uint32_t index)
         return -1;
     }
 
-    if (0 == mMemInfo[index].handle) {
+    if (0 > mMemInfo[index].fd) {
         ALOGE("%s: Buffer at %d not registered", __func__, index);
         return -1;
     }
@@ -982,7 +906,7 @@ int QCamera3GrallocMemory::getFreeIndexLocked()
     }
 
     for (size_t i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
-        if (0 == mMemInfo[i].handle) {
+        if (0 > mMemInfo[i].fd) {
             index = i;
             break;
         }
@@ -1010,7 +934,7 @@ void *QCamera3GrallocMemory::getPtrLocked(uint32_t index)
         return NULL;
     }
 
-    if (0 == mMemInfo[index].handle) {
+    if (0 > mMemInfo[index].fd) {
         ALOGE("%s: Buffer at %d not registered", __func__, index);
         return NULL;
     }
@@ -1055,7 +979,7 @@ void *QCamera3GrallocMemory::getBufferHandle(uint32_t index)
         return NULL;
     }
 
-    if (0 == mMemInfo[index].handle) {
+    if (0 > mMemInfo[index].fd) {
         ALOGE("%s: Buffer at %d not registered", __func__, index);
         return NULL;
     }
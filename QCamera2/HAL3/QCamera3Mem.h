@@ -37,6 +37,7 @@ extern "C" {
 #include <linux/msm_ion.h>
 #include <mm_camera_interface.h>
 }
+#include "QCameraBufferAllocator.h"
 
 using namespace android;
 
@@ -74,11 +75,8 @@ public:
             mm_camera_buf_def_t &bufDef, uint32_t index);
 
 protected:
-    struct QCamera3MemInfo {
-        int fd;
-        int main_ion_fd;
-        ion_user_handle_t handle;
-        size_t size;
+    /* a slot holds a buffer while its fd is valid */
+    struct QCamera3MemInfo : public qcamera_alloc_buf_t {
     };
 
     int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr);
@@ -1510,9 +1510,9 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
 
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
+                ALOGE("%s: waitCmd error (%s)",
                            __func__, strerror(errno));
                 return NULL;
             }
@@ -1532,7 +1532,7 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
             pme->m_inputFWKPPQ.init();
             pme->m_inputRawQ.init();
             pme->m_inputMetaQ.init();
-            cam_sem_post(&cmdThread->sync_sem);
+            cmdThread->sync_sem.post();
 
             break;
         case CAMERA_CMD_TYPE_STOP_DATA_PROC:
@@ -1578,7 +1578,7 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
                 pme->m_inputMetaQ.flush();
 
                 // signal cmd is completed
-                cam_sem_post(&cmdThread->sync_sem);
+                cmdThread->sync_sem.post();
             }
             break;
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
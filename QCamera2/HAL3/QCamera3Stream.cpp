@@ -35,6 +35,7 @@
 #include "QCamera3HWI.h"
 #include "QCamera3Stream.h"
 #include "QCamera3Channel.h"
+#include "QCameraStreamStats.h"
 
 using namespace android;
 
@@ -469,9 +470,9 @@ void *QCamera3Stream::dataProcRoutine(void *data)
     CDBG("%s: E", __func__);
     do {
         do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            ret = cmdThread->waitCmd();
             if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
+                ALOGE("%s: waitCmd error (%s)",
                       __func__, strerror(errno));
                 return NULL;
             }
@@ -486,6 +487,7 @@ void *QCamera3Stream::dataProcRoutine(void *data)
                 mm_camera_super_buf_t *frame =
                     (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
                 if (NULL != frame) {
+                    frame->bufs[0]->cb_time = systemTime(SYSTEM_TIME_BOOTTIME);
                     if (pme->mDataCB != NULL) {
                         pme->mDataCB(frame, pme, pme->mUserData);
                     } else {
@@ -841,6 +843,27 @@ int32_t QCamera3Stream::getFormat(cam_format_t &fmt)
     return -1;
 }
 
+/*===========================================================================
+ * FUNCTION   : dumpStats
+ *
+ * DESCRIPTION: print latency stats of this stream
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3Stream::dumpStats(int fd)
+{
+    mm_camera_stream_stats_t stats;
+
+    if ((mHandle == 0) || (mCamOps->get_stream_stats(mCamHandle,
+            mChannelHandle, mHandle, &stats) != 0)) {
+        return;
+    }
+    dumpStreamStats(fd, getMyType(), mHandle, stats);
+}
+
 /*===========================================================================
  * FUNCTION   : getMyServerID
  *
@@ -81,6 +81,7 @@ public:
     int32_t getFormat(cam_format_t &fmt);
     QCamera3Memory *getStreamBufs() {return mStreamBufs;};
     uint32_t getMyServerID();
+    void dumpStats(int fd);
 
     int32_t mapBuf(uint8_t buf_type, uint32_t buf_idx,
             int32_t plane_idx, int fd, size_t size);
@@ -102,7 +103,10 @@ private:
     void *mUserData;
 
     QCameraQueue     mDataQ;
-    QCameraCmdThread mProcTh; // thread for dataCB
+    // thread for dataCB. Kept off the HAL executor: channel callbacks
+    // take the HWI mutex, which configure_streams and flush hold while
+    // stopping channels, so they can block for that long
+    QCameraCmdThread mProcTh;
 
     QCamera3HeapMemory *mStreamInfoBuf;
     QCamera3Memory *mStreamBufs;
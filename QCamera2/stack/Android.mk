@@ -3,3 +3,4 @@ include $(LOCAL_PATH)/mm-camera-interface/Android.mk
 include $(LOCAL_PATH)/mm-jpeg-interface/Android.mk
 include $(LOCAL_PATH)/mm-jpeg-interface/test/Android.mk
 include $(LOCAL_PATH)/mm-camera-test/Android.mk
+include $(LOCAL_PATH)/mm-camera-sim/Android.mk
@@ -0,0 +1,127 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __CAM_HIST_H__
+#define __CAM_HIST_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/* Fixed size log-linear histogram. Each power of two range is split into
+ * CAM_HIST_SUB_CNT linear buckets, so a recorded value is off by at most
+ * 1/CAM_HIST_SUB_CNT. Values above 2^(CAM_HIST_MAX_EXP + 1) - 1 are clamped
+ * and counted in overflow. */
+#define CAM_HIST_SUB_BITS 3
+#define CAM_HIST_SUB_CNT (1U << CAM_HIST_SUB_BITS)
+#define CAM_HIST_MAX_EXP 24
+#define CAM_HIST_MAX_VAL ((1U << (CAM_HIST_MAX_EXP + 1)) - 1)
+#define CAM_HIST_NUM_BUCKETS \
+    ((CAM_HIST_MAX_EXP - CAM_HIST_SUB_BITS + 2) * CAM_HIST_SUB_CNT)
+
+typedef struct {
+    uint32_t count;
+    uint32_t overflow;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[CAM_HIST_NUM_BUCKETS];
+} cam_hist_t;
+
+static inline void cam_hist_reset(cam_hist_t *hist)
+{
+    memset(hist, 0, sizeof(cam_hist_t));
+}
+
+static inline uint32_t cam_hist_bucket(uint32_t val)
+{
+    uint32_t shift;
+
+    if (val < CAM_HIST_SUB_CNT) {
+        return val;
+    }
+    shift = (uint32_t)(31 - __builtin_clz(val)) - CAM_HIST_SUB_BITS;
+    return (shift + 1) * CAM_HIST_SUB_CNT +
+            ((val >> shift) & (CAM_HIST_SUB_CNT - 1));
+}
+
+/* largest value that falls into bucket idx */
+static inline uint32_t cam_hist_bucket_max(uint32_t idx)
+{
+    uint32_t shift;
+
+    if (idx < CAM_HIST_SUB_CNT) {
+        return idx;
+    }
+    shift = idx / CAM_HIST_SUB_CNT - 1;
+    return ((CAM_HIST_SUB_CNT + idx % CAM_HIST_SUB_CNT) << shift) +
+            (1U << shift) - 1;
+}
+
+static inline void cam_hist_record(cam_hist_t *hist, uint32_t val)
+{
+    if (val > CAM_HIST_MAX_VAL) {
+        val = CAM_HIST_MAX_VAL;
+        hist->overflow++;
+    }
+    if ((0 == hist->count) || (val < hist->min)) {
+        hist->min = val;
+    }
+    if (val > hist->max) {
+        hist->max = val;
+    }
+    hist->count++;
+    hist->sum += val;
+    hist->buckets[cam_hist_bucket(val)]++;
+}
+
+/* value at the given percentile, permille in [0, 1000] */
+static inline uint32_t cam_hist_percentile(const cam_hist_t *hist,
+        uint32_t permille)
+{
+    uint64_t target, seen = 0;
+    uint32_t i;
+
+    if (0 == hist->count) {
+        return 0;
+    }
+    target = ((uint64_t)hist->count * permille + 999) / 1000;
+    if (0 == target) {
+        target = 1;
+    }
+    for (i = 0; i < CAM_HIST_NUM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= target) {
+            uint32_t val = cam_hist_bucket_max(i);
+            return (val > hist->max) ? hist->max : val;
+        }
+    }
+    return hist->max;
+}
+
+#endif /* __CAM_HIST_H__ */
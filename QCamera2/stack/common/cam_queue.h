@@ -34,10 +34,22 @@ typedef struct {
     void *data;
 } cam_node_t;
 
+typedef struct {
+    uint32_t slab_cnt;      /* nodes preallocated in the slab */
+    uint32_t node_allocs;   /* node requests, slab and heap */
+    uint32_t node_mallocs;  /* nodes that had to come from the heap */
+    uint32_t overflow_cnt;  /* heap allocations while slab was exhausted */
+    uint32_t high_water;    /* max number of nodes queued at once */
+} cam_queue_stats_t;
+
 typedef struct {
     cam_node_t head; /* dummy head */
     uint32_t size;
     pthread_mutex_t lock;
+    /* optional node slab, free nodes are chained through list.next */
+    cam_node_t *slab;
+    struct cam_list *free_list;
+    cam_queue_stats_t stats;
 } cam_queue_t;
 
 static inline int32_t cam_queue_init(cam_queue_t *queue)
@@ -45,23 +57,106 @@ static inline int32_t cam_queue_init(cam_queue_t *queue)
     pthread_mutex_init(&queue->lock, NULL);
     cam_list_init(&queue->head.list);
     queue->size = 0;
+    queue->slab = NULL;
+    queue->free_list = NULL;
+    memset(&queue->stats, 0, sizeof(cam_queue_stats_t));
     return 0;
 }
 
-static inline int32_t cam_queue_enq(cam_queue_t *queue, void *data)
+/* Initialize queue with a preallocated slab of node_cnt nodes. Enqueue and
+ * dequeue take nodes from the slab's free list and only fall back to the
+ * heap when more than node_cnt nodes are queued at the same time. */
+static inline int32_t cam_queue_init_slab(cam_queue_t *queue,
+        uint32_t node_cnt)
 {
-    cam_node_t *node =
-        (cam_node_t *)malloc(sizeof(cam_node_t));
-    if (NULL == node) {
+    uint32_t i;
+
+    cam_queue_init(queue);
+    if (0 == node_cnt) {
+        return 0;
+    }
+
+    queue->slab = (cam_node_t *)malloc(sizeof(cam_node_t) * node_cnt);
+    if (NULL == queue->slab) {
+        /* queue still works, every node goes to the heap */
         return -1;
     }
+    memset(queue->slab, 0, sizeof(cam_node_t) * node_cnt);
+    for (i = 0; i < node_cnt; i++) {
+        queue->slab[i].list.next = queue->free_list;
+        queue->free_list = &queue->slab[i].list;
+    }
+    queue->stats.slab_cnt = node_cnt;
+    return 0;
+}
+
+/* Get a node from the slab or the heap. Caller holds queue->lock. */
+static inline cam_node_t *cam_queue_node_get(cam_queue_t *queue)
+{
+    cam_node_t *node = NULL;
 
+    queue->stats.node_allocs++;
+    if (NULL != queue->free_list) {
+        node = member_of(queue->free_list, cam_node_t, list);
+        queue->free_list = queue->free_list->next;
+    } else {
+        node = (cam_node_t *)malloc(sizeof(cam_node_t));
+        if (NULL == node) {
+            return NULL;
+        }
+        queue->stats.node_mallocs++;
+        if (NULL != queue->slab) {
+            queue->stats.overflow_cnt++;
+        }
+    }
     memset(node, 0, sizeof(cam_node_t));
-    node->data = data;
+    return node;
+}
+
+/* Return a node to the slab, or free it if it came from the heap.
+ * Caller holds queue->lock. */
+static inline void cam_queue_node_put(cam_queue_t *queue, cam_node_t *node)
+{
+    if ((NULL != queue->slab) && (node >= queue->slab) &&
+            (node < queue->slab + queue->stats.slab_cnt)) {
+        node->data = NULL;
+        node->list.next = queue->free_list;
+        queue->free_list = &node->list;
+    } else {
+        free(node);
+    }
+}
+
+/* Account a newly linked node. Caller holds queue->lock. */
+static inline void cam_queue_size_inc(cam_queue_t *queue)
+{
+    queue->size++;
+    if (queue->size > queue->stats.high_water) {
+        queue->stats.high_water = queue->size;
+    }
+}
+
+static inline void cam_queue_get_stats(cam_queue_t *queue,
+        cam_queue_stats_t *stats)
+{
+    pthread_mutex_lock(&queue->lock);
+    *stats = queue->stats;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static inline int32_t cam_queue_enq(cam_queue_t *queue, void *data)
+{
+    cam_node_t *node = NULL;
 
     pthread_mutex_lock(&queue->lock);
+    node = cam_queue_node_get(queue);
+    if (NULL == node) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    node->data = data;
     cam_list_add_tail_node(&node->list, &queue->head.list);
-    queue->size++;
+    cam_queue_size_inc(queue);
     pthread_mutex_unlock(&queue->lock);
 
     return 0;
@@ -81,13 +176,10 @@ static inline void *cam_queue_deq(cam_queue_t *queue)
         node = member_of(pos, cam_node_t, list);
         cam_list_del_node(&node->list);
         queue->size--;
-    }
-    pthread_mutex_unlock(&queue->lock);
-
-    if (NULL != node) {
         data = node->data;
-        free(node);
+        cam_queue_node_put(queue, node);
     }
+    pthread_mutex_unlock(&queue->lock);
 
     return data;
 }
@@ -114,7 +206,7 @@ static inline int32_t cam_queue_flush(cam_queue_t *queue)
         if (NULL != node->data) {
             free(node->data);
         }
-        free(node);
+        cam_queue_node_put(queue, node);
 
     }
     queue->size = 0;
@@ -126,5 +218,10 @@ static inline int32_t cam_queue_deinit(cam_queue_t *queue)
 {
     cam_queue_flush(queue);
     pthread_mutex_destroy(&queue->lock);
+    if (NULL != queue->slab) {
+        free(queue->slab);
+        queue->slab = NULL;
+    }
+    queue->free_list = NULL;
     return 0;
 }
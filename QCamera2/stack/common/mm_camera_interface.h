@@ -35,6 +35,7 @@
 #include <utils/Timers.h>
 #include "cam_intf.h"
 #include "cam_queue.h"
+#include "cam_hist.h"
 
 #define MM_CAMERA_MAX_NUM_SENSORS MSM_MAX_CAMERA_SENSORS
 #define MM_CAMERA_MAX_NUM_FRAMES CAM_MAX_NUM_BUFS_PER_STREAM
@@ -116,6 +117,12 @@ typedef struct {
 *    @frame_len : length of the whole frame, to be filled during
 *               mem allocation
 *    @mem_info : user specific pointer to additional mem info
+*    @dq_time : CLOCK_BOOTTIME ns when dequeued from kernel
+*    @match_time : CLOCK_BOOTTIME ns when matched into a super buf
+*    @cb_time : CLOCK_BOOTTIME ns when HAL data callback ran
+*    @consume_time : CLOCK_BOOTTIME ns when sent to display/encoder
+*                  stage times are 0 if the stage was not reached and
+*                  feed the per stream latency stats on buf done
 **/
 typedef struct mm_camera_buf_def {
     uint32_t stream_id;
@@ -133,8 +140,37 @@ typedef struct mm_camera_buf_def {
     void *buffer;
     size_t frame_len;
     void *mem_info;
+    int64_t dq_time;
+    int64_t match_time;
+    int64_t cb_time;
+    int64_t consume_time;
 } mm_camera_buf_def_t;
 
+/** mm_camera_lat_stage_t: latency stats of a stream buffer, all
+*   stages except sensor to dequeue and jitter are measured from
+*   the kernel dequeue
+**/
+typedef enum {
+    MM_CAMERA_LAT_SENSOR_TO_DQ,  /* sensor timestamp to dequeue */
+    MM_CAMERA_LAT_DQ_TO_MATCH,   /* dequeue to super buf match */
+    MM_CAMERA_LAT_DQ_TO_CB,      /* dequeue to HAL data callback */
+    MM_CAMERA_LAT_DQ_TO_CONSUME, /* dequeue to display/encoder */
+    MM_CAMERA_LAT_DQ_TO_DONE,    /* dequeue to queued back to kernel */
+    MM_CAMERA_LAT_JITTER,        /* change of sensor frame interval */
+    MM_CAMERA_LAT_MAX
+} mm_camera_lat_stage_t;
+
+/** mm_camera_stream_stats_t: per stream latency stats
+*    @frames : frames dequeued
+*    @drops : frames missing from the frame_idx sequence
+*    @hist : histograms in us, indexed by mm_camera_lat_stage_t
+**/
+typedef struct {
+    uint32_t frames;
+    uint32_t drops;
+    cam_hist_t hist[MM_CAMERA_LAT_MAX];
+} mm_camera_stream_stats_t;
+
 /** mm_camera_super_buf_t: super buf structure for bundled
 *   stream frames
 *    @camera_handle : camera handler to uniquely identify
@@ -360,6 +396,25 @@ typedef enum {
 } mm_camera_stream_cb_type;
 
 
+/** mm_camera_poll_mode_t: data poll thread topology of a channel
+*    @MM_CAMERA_POLL_MODE_DEFAULT :
+*       use persist.camera.poll.mode (shared if unset)
+*    @MM_CAMERA_POLL_MODE_SHARED :
+*       one data poll thread for all streams of the channel
+*    @MM_CAMERA_POLL_MODE_PER_STREAM :
+*       one data poll thread per stream, so a slow stream cannot delay
+*       buffer dequeue of the other streams in the channel
+*    @MM_CAMERA_POLL_MODE_GLOBAL :
+*       one data poll thread shared by all such channels of the camera
+**/
+typedef enum {
+    MM_CAMERA_POLL_MODE_DEFAULT,
+    MM_CAMERA_POLL_MODE_SHARED,
+    MM_CAMERA_POLL_MODE_PER_STREAM,
+    MM_CAMERA_POLL_MODE_GLOBAL,
+    MM_CAMERA_POLL_MODE_MAX
+} mm_camera_poll_mode_t;
+
 /** mm_camera_channel_attr_t: structure for defining channel
 *                             attributes
 *    @notify_mode : notify mode: burst or continuous
@@ -372,11 +427,14 @@ typedef enum {
 *    @max_unmatched_frames : max number of unmatched frames in
 *                     queue
 *    @enable_frame_sync: Enables frame sync for dual camera
+*    @frame_sync_id : frame sync group, channels of different cameras
+*                     with the same id are synced with each other
 *    @priority : save matched priority frames only
 *    @instant_capture_enabled : flag to indicate whether
 *                     instant capture enabled or not.
 *    @aec_frame_bound : Number of frames, camera interface will wait for
 *                     getting the instant capture frame.
+*    @poll_mode : data poll thread topology of the channel
 **/
 typedef struct {
     mm_camera_super_buf_notify_mode_t notify_mode;
@@ -385,9 +443,11 @@ typedef struct {
     uint8_t post_frame_skip;
     uint8_t max_unmatched_frames;
     uint8_t enable_frame_sync;
+    uint32_t frame_sync_id;
     mm_camera_super_buf_priority_t priority;
     uint8_t instant_capture_enabled;
     uint8_t aec_frame_bound;
+    mm_camera_poll_mode_t poll_mode;
 } mm_camera_channel_attr_t;
 
 typedef struct {
@@ -867,6 +927,20 @@ typedef struct {
     int32_t (*register_stream_buf_cb) (uint32_t camera_handle,
             uint32_t ch_id, uint32_t stream_id, mm_camera_buf_notify_t buf_cb,
             mm_camera_stream_cb_type cb_type, void *userdata);
+
+    /** get_stream_stats: fucntion definition for reading stream
+     *                    latency stats
+     *    @camera_handle : camer handler
+     *    @ch_id : channel handler
+     *    @stream_id : stream handler
+     *    @stats : stats to be filled
+     *  Return value: 0 -- success
+     *                -1 -- failure
+     **/
+    int32_t (*get_stream_stats) (uint32_t camera_handle,
+            uint32_t ch_id,
+            uint32_t stream_id,
+            mm_camera_stream_stats_t *stats);
 } mm_camera_ops_t;
 
 /** mm_camera_vtbl_t: virtual table for camera operations
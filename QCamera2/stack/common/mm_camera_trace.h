@@ -0,0 +1,93 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __MM_CAMERA_TRACE_H__
+#define __MM_CAMERA_TRACE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* In-process trace recorder. Every thread writes into its own ring of
+ * events, no lock is taken on the record path. The rings are exported on
+ * demand as Chrome/Perfetto JSON (chrome://tracing, ui.perfetto.dev).
+ *
+ * Controlled by persist.camera.trace.rec:
+ *   0: off
+ *   1: frame lifecycle events and KPI_ATRACE_* sections
+ *   2: also ATRACE_* debug sections */
+
+#define MM_CAMERA_TRACE_NAME_LEN 24
+/* events kept per thread, power of 2 */
+#define MM_CAMERA_TRACE_RING_SIZE 1024
+#define MM_CAMERA_TRACE_MAX_THREADS 64
+
+#define MM_CAMERA_TRACE_KPI 1
+#define MM_CAMERA_TRACE_DBG 2
+
+/* chrome trace event phases */
+#define MM_CAMERA_TRACE_PH_BEGIN       'B'
+#define MM_CAMERA_TRACE_PH_END         'E'
+#define MM_CAMERA_TRACE_PH_INSTANT     'i'
+#define MM_CAMERA_TRACE_PH_COUNTER     'C'
+#define MM_CAMERA_TRACE_PH_ASYNC_BEGIN 'b'
+#define MM_CAMERA_TRACE_PH_ASYNC_END   'e'
+
+extern volatile uint32_t gMmCameraTraceLevel;
+
+void mm_camera_trace_update_level(void);
+void mm_camera_trace_event(char phase, const char *name,
+        uint32_t frame_idx, int64_t value);
+int32_t mm_camera_trace_dump(int fd);
+
+#define MM_CAMERA_TRACE(level, phase, name, frame_idx, value) do { \
+    if (gMmCameraTraceLevel >= (level)) { \
+        mm_camera_trace_event((phase), (name), (frame_idx), (value)); \
+    } \
+} while (0)
+
+/* frame lifecycle point, value carries e.g. stream type */
+#define MM_CAMERA_TRACE_FRAME(name, frame_idx, value) \
+    MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_INSTANT, \
+            name, frame_idx, value)
+/* span that may begin and end on different threads, matched by id */
+#define MM_CAMERA_TRACE_ASYNC_BEGIN(name, id) \
+    MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_ASYNC_BEGIN, \
+            name, id, 0)
+#define MM_CAMERA_TRACE_ASYNC_END(name, id) \
+    MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_ASYNC_END, \
+            name, id, 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MM_CAMERA_TRACE_H__ */
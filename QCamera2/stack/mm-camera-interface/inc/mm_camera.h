@@ -35,6 +35,7 @@
 #include "mm_camera_interface.h"
 #include <hardware/camera.h>
 #include <utils/Timers.h>
+#include <linux/media.h>
 
 /**********************************************************************************
 * Data structure declare
@@ -43,14 +44,23 @@
 #define MM_CAMERA_EVT_ENTRY_MAX 4
 /* num of data callbacks allowed in a stream obj */
 #define MM_CAMERA_STREAM_BUF_CB_MAX 4
-/* num of data poll threads allowed in a channel obj */
-#define MM_CAMERA_CHANNEL_POLL_THREAD_MAX 1
+/* num of data poll threads allowed in a channel obj, one per stream at most */
+#define MM_CAMERA_CHANNEL_POLL_THREAD_MAX MAX_STREAM_NUM_IN_BUNDLE
 
 #define MM_CAMERA_DEV_NAME_LEN 32
 #define MM_CAMERA_DEV_OPEN_TRIES 2
 #define MM_CAMERA_DEV_OPEN_RETRY_SLEEP 20
+/* max num of /dev/mediaN nodes in the cached sensor topology */
+#define MM_CAMERA_MAX_MEDIA_NODES 16
 #define THREAD_NAME_SIZE 15
 
+/* num of preallocated queue nodes in a cmd thread queue */
+#define MM_CAMERA_CMD_QUEUE_SLAB_SIZE 32
+/* num of preallocated queue nodes in a channel superbuf queue */
+#define MM_CHANNEL_SUPERBUF_QUEUE_SLAB_SIZE 32
+/* max num of map/unmap msgs in flight to the server */
+#define MM_CAMERA_MAP_MSG_MAX 32
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -123,6 +133,21 @@ typedef struct {
 
 typedef void (*mm_camera_cmd_cb_t)(mm_camera_cmdcb_t * cmd_cb, void* user_data);
 
+typedef enum {
+    MM_CAMERA_THREAD_CLASS_DEFAULT,  /* inherit policy, no pinning */
+    MM_CAMERA_THREAD_CLASS_RT,       /* preview/video/metadata path */
+    MM_CAMERA_THREAD_CLASS_BG,       /* snapshot/raw/reprocess path */
+    MM_CAMERA_THREAD_CLASS_MAX
+} mm_camera_thread_class_t;
+
+/* scheduling of a poll/cmd/cb thread, applied by the thread on start */
+typedef struct {
+    mm_camera_thread_class_t cls;
+    int policy;         /* SCHED_OTHER or SCHED_FIFO */
+    int priority;       /* rt priority, only used for SCHED_FIFO */
+    uint32_t cpu_mask;  /* allowed cpus, 0 means no pinning */
+} mm_camera_thread_sched_t;
+
 typedef struct {
     uint8_t is_active;     /*indicates whether thread is active or not */
     cam_queue_t cmd_queue; /* cmd queue (queuing dataCB, asyncCB, or exitCMD) */
@@ -131,12 +156,14 @@ typedef struct {
     cam_semaphore_t sync_sem;     /* semaphore for synchronization with cmd thread */
     mm_camera_cmd_cb_t cb;       /* cb for cmd */
     void* user_data;             /* user_data for cb */
+    mm_camera_thread_sched_t sched; /* set before launch */
     char threadName[THREAD_NAME_SIZE];
 } mm_camera_cmd_thread_t;
 
 typedef enum {
     MM_CAMERA_POLL_TYPE_EVT,
     MM_CAMERA_POLL_TYPE_DATA,
+    MM_CAMERA_POLL_TYPE_DATA_GLOBAL, /* data fds of several channels */
     MM_CAMERA_POLL_TYPE_MAX
 } mm_camera_poll_thread_type_t;
 
@@ -149,21 +176,27 @@ typedef struct {
     mm_camera_poll_notify_t notify_cb;
     uint32_t handler;
     void* user_data;
+    uint32_t gen; /* bumped on every add/del to drop stale epoll events */
+    uint32_t events; /* epoll events registered, one must be ready to notify */
 } mm_camera_poll_entry_t;
 
 typedef struct {
     mm_camera_poll_thread_type_t poll_type;
     /* array to store poll fd and cb info
      * for MM_CAMERA_POLL_TYPE_EVT, only index 0 is valid;
-     * for MM_CAMERA_POLL_TYPE_DATA, depends on valid stream fd */
-    mm_camera_poll_entry_t poll_entries[MAX_STREAM_NUM_IN_BUNDLE];
-    int32_t pfds[2];
+     * for MM_CAMERA_POLL_TYPE_DATA, indexed by stream handle;
+     * for MM_CAMERA_POLL_TYPE_DATA_GLOBAL, first free entry */
+    mm_camera_poll_entry_t *poll_entries;
+    uint32_t num_entries;
+    int32_t epoll_fd;   /* epoll set holding evt_fd and all entry fds */
+    int32_t evt_fd;     /* eventfd used to wake the poll thread for exit */
     pthread_t pid;
-    int32_t state;
+    pid_t tid;          /* kernel tid, for sched updates after launch */
+    mm_camera_thread_sched_t sched; /* set before launch */
+    int32_t state;      /* STOPPED once the thread exited, poll_entries
+                         * stays set until the thread is released */
     int timeoutms;
-    uint32_t cmd;
-    struct pollfd poll_fds[MAX_STREAM_NUM_IN_BUNDLE + 1];
-    uint8_t num_fds;
+    int32_t active_idx; /* entry whose notify_cb is running, -1 if none */
     pthread_mutex_t mutex;
     pthread_cond_t cond_v;
     int32_t status;
@@ -211,7 +244,7 @@ typedef struct {
 } mm_stream_data_cb_t;
 
 typedef struct {
-    /* buf reference count */
+    /* buf reference count, updated atomically */
     uint8_t buf_refcnt;
 
     /* This flag is to indicate if after allocation,
@@ -220,12 +253,22 @@ typedef struct {
      * so no need to qbuf these two bufs initially) */
     uint8_t initial_reg_flag;
 
-    /* indicate if buf is in kernel(1) or client(0) */
-    uint8_t in_kernel;
     /*indicate if this buffer is mapped to daemon*/
     uint8_t is_mapped;
+    /* async map msg sent, waiting for server ack. Written under buf_lock,
+     * read atomically by buf_done */
+    uint8_t map_pending;
+    /* async map failed, buffer cannot be used */
+    uint8_t map_failed;
 } mm_stream_buf_status_t;
 
+typedef struct {
+    mm_camera_stream_stats_t pub; /* stats handed out to clients */
+    int64_t prev_sensor_ts;       /* ns, 0 until first frame */
+    int64_t prev_interval;        /* ns, 0 until second frame */
+    uint32_t prev_frame_idx;
+} mm_stream_stats_t;
+
 typedef struct mm_stream {
     uint32_t my_hdl; /* local stream id */
     uint32_t server_stream_id; /* stream id from server */
@@ -253,6 +296,9 @@ typedef struct mm_stream {
     uint8_t buf_num; /* num of buffers allocated */
     mm_camera_buf_def_t* buf; /* ptr to buf array */
     mm_stream_buf_status_t buf_status[CAM_MAX_NUM_BUFS_PER_STREAM]; /* ptr to buf status array */
+    /* bit per buffer, set while the buffer is owned by kernel(1) and
+     * clear while owned by client(0). Updated atomically */
+    uint64_t kernel_mask;
 
     uint8_t plane_buf_num; /* num of plane buffers allocated  Used only in Batch mode*/
     mm_camera_buf_def_t *plane_buf; /*Pointer to plane buffer array Used only in Batch mode */
@@ -263,6 +309,9 @@ typedef struct mm_stream {
     /* reference to parent channel_obj */
     struct mm_channel* ch_obj;
 
+    /* data poll thread serving this stream, owned by channel or camera */
+    mm_camera_poll_thread_t *poll_thread;
+
     uint8_t is_bundled; /* flag if stream is bundled */
 
     /* reference to linked channel_obj */
@@ -274,12 +323,19 @@ typedef struct mm_stream {
 
     mm_camera_map_unmap_ops_tbl_t map_ops;
 
+    /* updated atomically, poll fd follows its 0<->1 transitions */
     int8_t queued_buffer_count;
+    pthread_mutex_t poll_lock; /* serializes poll fd add/del */
+    uint8_t poll_added; /* fd is in data poll thread, protected by poll_lock */
 
     /*latest timestamp of this stream frame received & last frameID*/
     uint32_t prev_frameID;
     nsecs_t prev_timestamp;
 
+    /* latency stats, protected by stats_lock */
+    pthread_mutex_t stats_lock;
+    mm_stream_stats_t *stats;
+
     /* Need to wait for buffer mapping before stream-on*/
     pthread_cond_t buf_cond;
 } mm_stream_t;
@@ -322,7 +378,8 @@ typedef enum {
     MM_CAMERA_EVT_CAPTURE_SETTING,
     MM_CHANNEL_EVT_GET_STREAM_QUEUED_BUF_COUNT,
     MM_CHANNEL_EVT_MAP_STREAM_BUFS,
-    MM_CHANNEL_EVT_REG_STREAM_BUF_CB
+    MM_CHANNEL_EVT_REG_STREAM_BUF_CB,
+    MM_CHANNEL_EVT_GET_STREAM_STATS
 } mm_channel_evt_type_t;
 
 typedef struct {
@@ -346,12 +403,20 @@ typedef struct {
 } mm_evt_paylod_reg_stream_buf_cb;
 
 
+/* slots of the frame_idx keyed index of unmatched superbufs, power of 2 */
+#define MM_CHANNEL_SUPERBUF_INDEX_SIZE 64
+
 typedef struct {
     uint8_t num_of_bufs;
     mm_camera_buf_info_t super_buf[MAX_STREAM_NUM_IN_BUNDLE];
     uint8_t matched;
     uint8_t expected;
     uint32_t frame_idx;
+    /* matcher bookkeeping, only valid while not matched */
+    uint32_t stream_mask;       /* bit per filled super_buf slot */
+    uint8_t indexed;            /* present in queue frame_index */
+    struct cam_list unmatched;  /* link in queue unmatched list */
+    cam_node_t *node;           /* queue node holding this superbuf */
 } mm_channel_queue_node_t;
 
 typedef struct {
@@ -370,6 +435,14 @@ typedef struct {
     uint32_t frame_skip_count;
     uint32_t nomatch_frame_id;
     uint32_t frame_num_for_instant_capture;
+
+    /* unmatched superbufs of que, in frame_idx order */
+    struct cam_list unmatched;
+    uint32_t unmatched_cnt;
+    /* unmatched superbufs by frame_idx % MM_CHANNEL_SUPERBUF_INDEX_SIZE;
+     * on a slot collision the newer one is left out and counted */
+    mm_channel_queue_node_t *frame_index[MM_CHANNEL_SUPERBUF_INDEX_SIZE];
+    uint32_t unindexed_cnt;
 } mm_channel_queue_t;
 
 typedef struct {
@@ -380,28 +453,74 @@ typedef struct {
     void *user_data;
 } mm_channel_bundle_t;
 
+/* Max number of camera channels in one frame sync group */
+#define MM_CAMERA_FRAME_SYNC_MAX_CAM 4
+/* Sync nodes kept per frame sync group */
+#define MM_CAMERA_FRAME_SYNC_MAX_NODES (MM_CAMERA_FRAME_SYNC_NODES * 2)
+
 /* Nodes used for frame sync */
 typedef struct {
-    /* Frame idx */
+    /* Frame idx of the first channel reporting this frame */
     uint32_t frame_idx;
-    /* Frame present for corresponding channel*/
-    uint32_t frame_valid[MAX_NUM_CAMERA_PER_BUNDLE];
+    /* Sensor timestamp in ns of the first channel reporting this frame */
+    int64_t ts;
+    /* Frame idx for corresponding channel, 0 if not present */
+    uint32_t frame_id[MM_CAMERA_FRAME_SYNC_MAX_CAM];
+    /* Sensor timestamp in ns for corresponding channel */
+    int64_t frame_ts[MM_CAMERA_FRAME_SYNC_MAX_CAM];
+    /* Bit mask of channels the frame is present in */
+    uint32_t valid_mask;
     /* Frame present in all channels*/
     uint32_t matched;
+    /* Insertion order, used to pick the node to evict */
+    uint32_t seq;
 } mm_channel_sync_node_t;
 
-/* Frame sync information */
+/* Frame sync statistics of a sync group */
 typedef struct {
+    /* frames added by any channel */
+    uint32_t frames;
+    /* nodes that got a frame from every channel */
+    uint32_t matched;
+    /* matched frame sets sent to HAL */
+    uint32_t delivered;
+    /* matched sets missing a superbuf in some channel queue */
+    uint32_t incomplete;
+    /* nodes overwritten before a match */
+    uint32_t evicted_unmatched;
+    /* matched nodes overwritten before delivery */
+    uint32_t evicted_matched;
+    /* sensor timestamp spread of matched frames in us */
+    cam_hist_t skew;
+} mm_channel_frame_sync_stats_t;
+
+/* Frame sync information, one per group of channels synced together */
+typedef struct mm_channel_frame_sync {
+    /* link in the list of sync groups */
+    struct cam_list list;
+    /* sync group id from the channel attr */
+    uint32_t sync_id;
+    /* channels holding a pointer to this group, under the list lock */
+    uint32_t refcnt;
+    /* protects all fields below */
+    pthread_mutex_t lock;
+    /* bumped whenever a channel registers or unregisters */
+    uint32_t gen;
     /* Number of camera channels that need to be synced*/
     uint8_t num_cam;
-    /* position of the next node to be updated */
-    uint8_t pos;
-    /* circular node array used to store frame information */
-    mm_channel_sync_node_t node[MM_CAMERA_FRAME_SYNC_NODES];
+    /* Bit mask of registered channel slots */
+    uint32_t cam_mask;
+    /* sequence number of the next node to be added */
+    uint32_t seq;
+    /* timestamp match tolerance in ns, 0 matches on frame idx only */
+    int64_t ts_tol;
+    /* node array used to store frame information */
+    mm_channel_sync_node_t node[MM_CAMERA_FRAME_SYNC_MAX_NODES];
     /* Channel corresponding to each camera */
-    struct mm_channel *ch_obj[MAX_NUM_CAMERA_PER_BUNDLE];
+    struct mm_channel *ch_obj[MM_CAMERA_FRAME_SYNC_MAX_CAM];
     /* Cb corresponding to each camera */
-    mm_camera_buf_notify_t cb[MAX_NUM_CAMERA_PER_BUNDLE];
+    mm_camera_buf_notify_t cb[MM_CAMERA_FRAME_SYNC_MAX_CAM];
+    mm_channel_frame_sync_stats_t stats;
 } mm_channel_frame_sync_info_t;
 
 /* Node information for multiple superbuf callbacks
@@ -410,9 +529,9 @@ typedef struct {
     /* Number of nodes to be sent*/
     uint8_t num_nodes;
     /* queue node information*/
-    mm_channel_queue_node_t *node[MAX_NUM_CAMERA_PER_BUNDLE];
+    mm_channel_queue_node_t *node[MM_CAMERA_FRAME_SYNC_MAX_CAM];
     /* channel information*/
-    struct mm_channel *ch_obj[MAX_NUM_CAMERA_PER_BUNDLE];
+    struct mm_channel *ch_obj[MM_CAMERA_FRAME_SYNC_MAX_CAM];
 } mm_channel_node_info_t;
 
 typedef enum {
@@ -438,15 +557,21 @@ typedef struct mm_channel {
     /* num of pending suferbuffers */
     uint8_t stopZslSnapshot;
 
+    /* frame sync group the channel is registered with, and its slot */
+    mm_channel_frame_sync_info_t *frame_sync;
+    uint8_t frame_sync_idx;
+
     /* cmd thread for superbuffer dataCB and async stop*/
     mm_camera_cmd_thread_t cmd_thread;
 
     /* cb thread for sending data cb */
     mm_camera_cmd_thread_t cb_thread;
 
-    /* data poll thread
-    * currently one data poll thread per channel
-    * could extended to support one data poll thread per stream in the channel */
+    /* data poll threads
+    * MM_CAMERA_POLL_MODE_SHARED: only poll_thread[0] is used
+    * MM_CAMERA_POLL_MODE_PER_STREAM: poll_thread[i] serves streams[i]
+    * MM_CAMERA_POLL_MODE_GLOBAL: none, cam_obj->data_poll_thread is used */
+    mm_camera_poll_mode_t poll_mode;
     mm_camera_poll_thread_t poll_thread[MM_CAMERA_CHANNEL_POLL_THREAD_MAX];
 
     /* container for all streams in channel */
@@ -492,6 +617,37 @@ typedef struct {
     mm_channel_queue_node_t* super_buf;
 } mm_channel_pp_info_t;
 
+/* called on the event poll thread once the server acked a map/unmap msg,
+ * or by the sender that gave up waiting for acks. status is 0 on
+ * success, -1 on failure */
+typedef void (*mm_camera_map_done_t)(int32_t status, void *user_data,
+        uint64_t cookie);
+
+/* map/unmap msg in flight to the server */
+typedef struct {
+    mm_camera_map_done_t done_cb;
+    void *user_data;
+    uint64_t cookie;
+    /* filled on ack for a sender waiting on the msg, NULL if none */
+    uint32_t *status;
+} mm_camera_map_msg_t;
+
+/* single fd map coalesced into a bundled map msg */
+typedef struct {
+    mm_camera_map_done_t done_cb;
+    void *user_data;
+    uint64_t cookie;
+} mm_camera_map_op_t;
+
+/* bundled map msg being filled from single fd maps. The server acks it
+ * once, the ack completes every op in it */
+typedef struct {
+    cam_sock_packet_t packet;
+    int fds[CAM_MAX_NUM_BUFS_PER_STREAM]; /* dups, closed once sent */
+    mm_camera_map_op_t ops[CAM_MAX_NUM_BUFS_PER_STREAM];
+    uint32_t num_ops;
+} mm_camera_map_batch_t;
+
 /* mm_camera */
 typedef struct {
     mm_camera_event_notify_t evt_cb;
@@ -515,27 +671,74 @@ typedef struct mm_camera_obj {
     mm_channel_t ch[MM_CAMERA_CHANNEL_MAX];
     mm_camera_evt_obj_t evt;
     mm_camera_poll_thread_t evt_poll_thread; /* evt poll thread */
+    /* data poll thread shared by channels in MM_CAMERA_POLL_MODE_GLOBAL */
+    pthread_mutex_t data_poll_lock;
+    mm_camera_poll_thread_t data_poll_thread;
+    uint32_t data_poll_refcnt;
     mm_camera_cmd_thread_t evt_thread;       /* thread for evt CB */
     mm_camera_vtbl_t vtbl;
 
+    /* map/unmap msgs sent to server. The server acks them one by one in
+     * send order, so the n-th ack belongs to seq n. Under evt_lock,
+     * every ack broadcasts evt_cond */
     pthread_mutex_t evt_lock;
     pthread_cond_t evt_cond;
-    mm_camera_event_t evt_rcvd;
+    mm_camera_map_msg_t map_msgs[MM_CAMERA_MAP_MSG_MAX];
+    uint32_t map_seq;    /* seq of the next msg to be sent */
+    uint32_t map_acked;  /* seq of the next msg to be acked */
+    uint32_t map_window; /* max msgs in flight */
+    uint8_t map_completing; /* done_cb of msg map_acked is running */
+    /* an ack did not come in time. Acks carry no seq, so all msgs in
+     * flight were failed and no more are sent until the camera is
+     * reopened */
+    uint8_t map_broken;
+    /* single fd maps not sent yet, under msg_lock. Sent as one bundled
+     * msg when full, before any other msg or when someone waits for it */
+    mm_camera_map_batch_t *map_batch;
+    uint8_t map_coalesce;
 
     pthread_mutex_t msg_lock; /* lock for sending msg through socket */
     uint32_t sessionid; /* Camera server session id */
 } mm_camera_obj_t;
 
+/* camera handle table slot. cam_obj is published with atomic stores and
+ * resolved without g_intf_lock; readers counts lookups in progress so that
+ * close can wait for them to drain before freeing the object. Slots are
+ * cache line aligned so that lookups on different cameras do not contend */
+typedef struct {
+    mm_camera_obj_t *cam_obj;
+    uint32_t readers;
+} __attribute__((aligned(64))) mm_camera_hdl_slot_t;
+
 typedef struct {
     int8_t num_cam;
     char video_dev_name[MM_CAMERA_MAX_NUM_SENSORS][MM_CAMERA_DEV_NAME_LEN];
-    mm_camera_obj_t *cam_obj[MM_CAMERA_MAX_NUM_SENSORS];
+    mm_camera_hdl_slot_t cam_slot[MM_CAMERA_MAX_NUM_SENSORS];
     struct camera_info info[MM_CAMERA_MAX_NUM_SENSORS];
     cam_sync_type_t cam_type[MM_CAMERA_MAX_NUM_SENSORS];
     cam_sync_mode_t cam_mode[MM_CAMERA_MAX_NUM_SENSORS];
     uint8_t is_yuv[MM_CAMERA_MAX_NUM_SENSORS]; // 1=CAM_SENSOR_YUV, 0=CAM_SENSOR_RAW
 } mm_camera_ctrl_t;
 
+/* what camera enumeration needs from one /dev/mediaN node */
+typedef struct {
+    struct media_device_info mdev_info; /* cache key of the node */
+    int32_t rc;                         /* <0 if MEDIA_IOC_DEVICE_INFO failed */
+    char vnode_name[MM_CAMERA_DEV_NAME_LEN]; /* MSM_CAMERA_NAME node */
+    char sinit_name[MM_CAMERA_DEV_NAME_LEN]; /* MSM_CONFIGURATION_NAME node */
+    uint8_t num_sensors;                     /* MSM_CONFIGURATION_NAME node */
+    uint32_t sensor_flags[MM_CAMERA_MAX_NUM_SENSORS];
+} mm_camera_media_node_t;
+
+/* sensor topology cached across get_num_of_cameras calls. It is checked
+ * against MEDIA_IOC_DEVICE_INFO of every node and rebuilt on mismatch */
+typedef struct {
+    uint8_t valid;
+    uint8_t probe_done; /* sensor_init probe wait completed */
+    int num_nodes;
+    mm_camera_media_node_t node[MM_CAMERA_MAX_MEDIA_NODES];
+} mm_camera_topology_t;
+
 typedef enum {
     mm_camera_async_call,
     mm_camera_sync_call
@@ -568,6 +771,34 @@ extern int32_t mm_camera_util_bundled_sendmsg(mm_camera_obj_t *my_obj,
                                               int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
                                               int numfds);
 
+/* send msg for fd mapping without waiting for the ack, done_cb is
+ * called once the server acked it. Single fd maps may be held back and
+ * coalesced into one bundled msg, see mm_camera_util_commit_map_msgs */
+extern int32_t mm_camera_util_sendmsg_async(mm_camera_obj_t *my_obj,
+                                            void *msg,
+                                            size_t buf_size,
+                                            int sendfd,
+                                            mm_camera_map_done_t done_cb,
+                                            void *user_data,
+                                            uint64_t cookie);
+
+/* send msg for bundled fd mapping without waiting for the ack */
+extern int32_t mm_camera_util_bundled_sendmsg_async(mm_camera_obj_t *my_obj,
+                                                    void *msg,
+                                                    size_t buf_size,
+                                                    int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
+                                                    int numfds,
+                                                    mm_camera_map_done_t done_cb,
+                                                    void *user_data,
+                                                    uint64_t cookie);
+
+/* send single fd maps held back for coalescing */
+extern void mm_camera_util_commit_map_msgs(mm_camera_obj_t *my_obj);
+
+/* wait for acks of all msgs sent so far, failing them if the server
+ * does not ack in time */
+extern void mm_camera_util_flush_map_msgs(mm_camera_obj_t *my_obj);
+
 /* Check if hardware target is A family */
 uint8_t mm_camera_util_chip_is_a_family(void);
 
@@ -575,6 +806,9 @@ uint8_t mm_camera_util_chip_is_a_family(void);
 extern int32_t mm_camera_open(mm_camera_obj_t *my_obj);
 extern int32_t mm_camera_close(mm_camera_obj_t *my_obj);
 extern int32_t mm_camera_close_fd(mm_camera_obj_t *my_obj);
+extern mm_camera_poll_thread_t *mm_camera_get_data_poll_thread(
+        mm_camera_obj_t *my_obj);
+extern void mm_camera_put_data_poll_thread(mm_camera_obj_t *my_obj);
 extern int32_t mm_camera_register_event_notify(mm_camera_obj_t *my_obj,
                                                mm_camera_event_notify_t evt_cb,
                                                void * user_data);
@@ -583,6 +817,9 @@ extern int32_t mm_camera_qbuf(mm_camera_obj_t *my_obj,
                               mm_camera_buf_def_t *buf);
 extern int32_t mm_camera_get_queued_buf_count(mm_camera_obj_t *my_obj,
         uint32_t ch_id, uint32_t stream_id);
+extern int32_t mm_camera_get_stream_stats(mm_camera_obj_t *my_obj,
+        uint32_t ch_id, uint32_t stream_id,
+        mm_camera_stream_stats_t *stats);
 extern int32_t mm_camera_query_capability(mm_camera_obj_t *my_obj);
 extern int32_t mm_camera_set_parms(mm_camera_obj_t *my_obj,
                                    parm_buffer_t *parms);
@@ -719,6 +956,8 @@ extern int32_t mm_stream_unmap_buf(mm_stream_t *my_obj,
                                    uint8_t buf_type,
                                    uint32_t frame_idx,
                                    int32_t plane_idx);
+extern int32_t mm_stream_get_stats(mm_stream_t *my_obj,
+                                   mm_camera_stream_stats_t *stats);
 
 
 /* utiltity fucntion declared in mm-camera-inteface2.c
@@ -726,6 +965,7 @@ extern int32_t mm_stream_unmap_buf(mm_stream_t *my_obj,
 uint32_t mm_camera_util_generate_handler(uint8_t index);
 const char * mm_camera_util_get_dev_name(uint32_t cam_handler);
 uint8_t mm_camera_util_get_index_by_handler(uint32_t handler);
+mm_camera_obj_t* mm_camera_util_lock_camera_by_handler(uint32_t cam_handler);
 
 /* poll/cmd thread functions */
 extern int32_t mm_camera_poll_thread_launch(
@@ -745,6 +985,15 @@ extern int32_t mm_camera_poll_thread_del_poll_fd(
                                 mm_camera_call_type_t);
 extern int32_t mm_camera_poll_thread_commit_updates(
         mm_camera_poll_thread_t * poll_cb);
+extern int32_t mm_camera_poll_thread_set_sched(
+        mm_camera_poll_thread_t * poll_cb,
+        const mm_camera_thread_sched_t *sched);
+extern void mm_camera_thread_get_sched(mm_camera_thread_class_t cls,
+        mm_camera_thread_sched_t *sched);
+extern int32_t mm_camera_thread_apply_sched(pid_t tid,
+        const mm_camera_thread_sched_t *sched);
+extern mm_camera_thread_class_t mm_camera_thread_class_for_stream(
+        cam_stream_type_t stream_type);
 extern int32_t mm_camera_cmd_thread_launch(
                                 mm_camera_cmd_thread_t * cmd_thread,
                                 mm_camera_cmd_cb_t cb,
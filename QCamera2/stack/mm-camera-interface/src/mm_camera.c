@@ -57,6 +57,12 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
                           uint8_t reg_flag);
 int32_t mm_camera_enqueue_evt(mm_camera_obj_t *my_obj,
                               mm_camera_event_t *event);
+static void mm_camera_util_map_msg_done(mm_camera_obj_t *my_obj,
+                                        uint32_t status);
+static void mm_camera_util_map_batch_done(int32_t status, void *user_data,
+                                          uint64_t cookie);
+static void mm_camera_util_drop_map_msgs(mm_camera_obj_t *my_obj);
+static void mm_camera_util_abandon_map_msgs(mm_camera_obj_t *my_obj);
 
 /*===========================================================================
  * FUNCTION   : mm_camera_util_get_channel_by_handler
@@ -126,8 +132,10 @@ static void mm_camera_dispatch_app_event(mm_camera_cmdcb_t *cmd_cb,
         pthread_mutex_lock(&my_obj->cb_lock);
         for(i = 0; i < MM_CAMERA_EVT_ENTRY_MAX; i++) {
             if(my_obj->evt.evt[i].evt_cb) {
+                /* my_hdl is cleared once close starts, events still
+                 * queued then go out under the handle the app knows */
                 my_obj->evt.evt[i].evt_cb(
-                    my_obj->my_hdl,
+                    my_obj->vtbl.camera_handle,
                     event,
                     my_obj->evt.evt[i].user_data);
             }
@@ -169,11 +177,7 @@ static void mm_camera_event_notify(void* user_data)
                 mm_camera_enqueue_evt(my_obj, &evt);
                 break;
             case CAM_EVENT_TYPE_MAP_UNMAP_DONE:
-                pthread_mutex_lock(&my_obj->evt_lock);
-                my_obj->evt_rcvd.server_event_type = msm_evt->command;
-                my_obj->evt_rcvd.status = msm_evt->status;
-                pthread_cond_signal(&my_obj->evt_cond);
-                pthread_mutex_unlock(&my_obj->evt_lock);
+                mm_camera_util_map_msg_done(my_obj, msm_evt->status);
                 break;
             case CAM_EVENT_TYPE_INT_TAKE_JPEG:
             case CAM_EVENT_TYPE_INT_TAKE_RAW:
@@ -344,6 +348,19 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
     pthread_mutex_init(&my_obj->cb_lock, NULL);
     pthread_mutex_init(&my_obj->evt_lock, NULL);
     pthread_cond_init(&my_obj->evt_cond, NULL);
+    my_obj->map_seq = 0;
+    my_obj->map_acked = 0;
+    my_obj->map_completing = FALSE;
+    my_obj->map_broken = FALSE;
+    property_get("persist.camera.map.inflight", prop, "16");
+    val = atoi(prop);
+    my_obj->map_window = ((val > 0) && (val <= MM_CAMERA_MAP_MSG_MAX)) ?
+            (uint32_t)val : MM_CAMERA_MAP_MSG_MAX;
+    my_obj->map_batch = NULL;
+    property_get("persist.camera.map.coalesce", prop, "1");
+    my_obj->map_coalesce = (atoi(prop) > 0) ? 1 : 0;
+    pthread_mutex_init(&my_obj->data_poll_lock, NULL);
+    my_obj->data_poll_refcnt = 0;
 
     CDBG("%s : Launch evt Thread in Cam Open",__func__);
     snprintf(my_obj->evt_thread.threadName, THREAD_NAME_SIZE, "CAM_Dispatch");
@@ -392,6 +409,56 @@ on_error:
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_get_data_poll_thread
+ *
+ * DESCRIPTION: take a reference on the data poll thread shared by channels
+ *              in MM_CAMERA_POLL_MODE_GLOBAL, launching it on first use
+ *
+ * PARAMETERS :
+ *   @my_obj   : camera object
+ *
+ * RETURN     : ptr to the poll thread, NULL if it cannot be launched
+ *==========================================================================*/
+mm_camera_poll_thread_t *mm_camera_get_data_poll_thread(mm_camera_obj_t *my_obj)
+{
+    mm_camera_poll_thread_t *poll_cb = &my_obj->data_poll_thread;
+
+    pthread_mutex_lock(&my_obj->data_poll_lock);
+    if (0 == my_obj->data_poll_refcnt) {
+        snprintf(poll_cb->threadName, THREAD_NAME_SIZE, "CAM_dataPollG");
+        if (0 != mm_camera_poll_thread_launch(poll_cb,
+                MM_CAMERA_POLL_TYPE_DATA_GLOBAL)) {
+            CDBG_ERROR("%s: failed to launch global data poll thread", __func__);
+            pthread_mutex_unlock(&my_obj->data_poll_lock);
+            return NULL;
+        }
+    }
+    my_obj->data_poll_refcnt++;
+    pthread_mutex_unlock(&my_obj->data_poll_lock);
+    return poll_cb;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_put_data_poll_thread
+ *
+ * DESCRIPTION: drop a reference on the global data poll thread, releasing
+ *              it with the last channel
+ *
+ * PARAMETERS :
+ *   @my_obj   : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_put_data_poll_thread(mm_camera_obj_t *my_obj)
+{
+    pthread_mutex_lock(&my_obj->data_poll_lock);
+    if ((my_obj->data_poll_refcnt > 0) && (0 == --my_obj->data_poll_refcnt)) {
+        mm_camera_poll_thread_release(&my_obj->data_poll_thread);
+    }
+    pthread_mutex_unlock(&my_obj->data_poll_lock);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_close
  *
@@ -425,11 +492,13 @@ int32_t mm_camera_close(mm_camera_obj_t *my_obj)
         mm_camera_socket_close(my_obj->ds_fd);
         my_obj->ds_fd = -1;
     }
+    mm_camera_util_drop_map_msgs(my_obj);
     pthread_mutex_destroy(&my_obj->msg_lock);
 
     pthread_mutex_destroy(&my_obj->cb_lock);
     pthread_mutex_destroy(&my_obj->evt_lock);
     pthread_cond_destroy(&my_obj->evt_cond);
+    pthread_mutex_destroy(&my_obj->data_poll_lock);
 
     pthread_mutex_unlock(&my_obj->cam_lock);
     return 0;
@@ -611,6 +680,45 @@ int32_t mm_camera_get_queued_buf_count(mm_camera_obj_t *my_obj,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_get_stream_stats
+ *
+ * DESCRIPTION: read latency stats of a stream
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @ch_id        : channel handle
+ *   @stream_id    : stream id
+ *   @stats        : stats to be filled
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_get_stream_stats(mm_camera_obj_t *my_obj,
+        uint32_t ch_id, uint32_t stream_id,
+        mm_camera_stream_stats_t *stats)
+{
+    int rc = -1;
+    mm_channel_t * ch_obj = NULL;
+    uint32_t payload;
+    ch_obj = mm_camera_util_get_channel_by_handler(my_obj, ch_id);
+    payload = stream_id;
+
+    if (NULL != ch_obj) {
+        pthread_mutex_lock(&ch_obj->ch_lock);
+        pthread_mutex_unlock(&my_obj->cam_lock);
+        rc = mm_channel_fsm_fn(ch_obj,
+                MM_CHANNEL_EVT_GET_STREAM_STATS,
+                (void *)&payload,
+                (void *)stats);
+    } else {
+        pthread_mutex_unlock(&my_obj->cam_lock);
+    }
+
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_query_capability
  *
@@ -1730,9 +1838,10 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
             CDBG_ERROR("%s: unsubscribe event rc = %d", __func__, rc);
             return rc;
         }
-        /* remove evt fd from the polling thraed when unreg the last event */
+        /* remove evt fd from the polling thraed when unreg the last event,
+         * by the handle it was added with, my_hdl is 0 on close */
         rc = mm_camera_poll_thread_del_poll_fd(&my_obj->evt_poll_thread,
-                                               my_obj->my_hdl,
+                                               my_obj->vtbl.camera_handle,
                                                mm_camera_sync_call);
     } else {
         rc = ioctl(my_obj->ctrl_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
@@ -1752,39 +1861,466 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_util_wait_for_event
+ * FUNCTION   : mm_camera_util_map_msg_done
  *
- * DESCRIPTION: utility function to wait for certain events
+ * DESCRIPTION: handle a map/unmap ack from server. Acks come in send
+ *              order, so the ack belongs to the oldest msg in flight.
+ *              Acks coming after the msgs were abandoned are dropped.
  *
  * PARAMETERS :
  *   @my_obj       : camera object
- *   @evt_mask     : mask for events to be waited. Any of event in the mask would
- *                   trigger the wait to end
- *   @status       : status of the event
+ *   @status       : status of the ack
  *
  * RETURN     : none
  *==========================================================================*/
-void mm_camera_util_wait_for_event(mm_camera_obj_t *my_obj,
-                                   uint32_t evt_mask,
-                                   uint32_t *status)
+static void mm_camera_util_map_msg_done(mm_camera_obj_t *my_obj,
+                                        uint32_t status)
+{
+    mm_camera_map_msg_t msg;
+    uint32_t seq;
+
+    pthread_mutex_lock(&my_obj->evt_lock);
+    if (my_obj->map_acked == my_obj->map_seq) {
+        pthread_mutex_unlock(&my_obj->evt_lock);
+        if (my_obj->map_broken) {
+            CDBG("%s: dropping late ack of an abandoned msg", __func__);
+        } else {
+            CDBG_ERROR("%s: map/unmap ack without msg in flight", __func__);
+        }
+        return;
+    }
+    seq = my_obj->map_acked;
+    msg = my_obj->map_msgs[seq % MM_CAMERA_MAP_MSG_MAX];
+    my_obj->map_completing = TRUE;
+    pthread_mutex_unlock(&my_obj->evt_lock);
+
+    /* only this thread retires acked msgs and no msg is sent once they
+     * were abandoned, so the entry stays ours. Retire it after done_cb so
+     * a flush does not return while done_cb still runs */
+    if (NULL != msg.done_cb) {
+        msg.done_cb((MSM_CAMERA_STATUS_SUCCESS == status) ? 0 : -1,
+                msg.user_data, msg.cookie);
+    }
+
+    pthread_mutex_lock(&my_obj->evt_lock);
+    msg = my_obj->map_msgs[seq % MM_CAMERA_MAP_MSG_MAX];
+    if (my_obj->map_acked == seq) {
+        if (NULL != msg.status) {
+            *msg.status = status;
+        }
+        my_obj->map_acked++;
+    }
+    my_obj->map_completing = FALSE;
+    pthread_cond_broadcast(&my_obj->evt_cond);
+    pthread_mutex_unlock(&my_obj->evt_lock);
+
+    if (mm_camera_util_map_batch_done == msg.done_cb) {
+        free(msg.user_data);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_wait_for_map_msg
+ *
+ * DESCRIPTION: wait until server acked the msg with the given seq. Called
+ *              with evt_lock held. If the ack does not come in time, every
+ *              msg in flight is abandoned, see
+ *              mm_camera_util_abandon_map_msgs.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @seq          : seq of the msg
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- acked
+ *              -1 -- timed out now or before, msgs were abandoned
+ *==========================================================================*/
+static int32_t mm_camera_util_wait_for_map_msg(mm_camera_obj_t *my_obj,
+                                               uint32_t seq)
 {
     int rc = 0;
     struct timespec ts;
 
-    pthread_mutex_lock(&my_obj->evt_lock);
-    while (!(my_obj->evt_rcvd.server_event_type & evt_mask)) {
-        clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += WAIT_TIMEOUT;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += WAIT_TIMEOUT;
+    /* seq is in flight while within [map_acked, map_seq) */
+    while ((seq - my_obj->map_acked) < (my_obj->map_seq - my_obj->map_acked)) {
         rc = pthread_cond_timedwait(&my_obj->evt_cond, &my_obj->evt_lock, &ts);
-        if (rc == ETIMEDOUT) {
-            ALOGE("%s pthread_cond_timedwait success\n", __func__);
-            break;
+        if ((rc == ETIMEDOUT) &&
+                ((seq - my_obj->map_acked) <
+                 (my_obj->map_seq - my_obj->map_acked))) {
+            ALOGE("%s: timed out waiting for ack of msg %d, acked %d",
+                    __func__, seq, my_obj->map_acked);
+            mm_camera_util_abandon_map_msgs(my_obj);
+        }
+    }
+    return my_obj->map_broken ? -1 : 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_abandon_map_msgs
+ *
+ * DESCRIPTION: fail every msg in flight after an ack did not come in time.
+ *              Acks carry no seq, so once one is lost later acks can not
+ *              be matched to their msgs any more. The window is drained,
+ *              late acks are dropped and no more msgs are sent until the
+ *              camera is reopened. Called with evt_lock held, drops it
+ *              while calling done_cb.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_util_abandon_map_msgs(mm_camera_obj_t *my_obj)
+{
+    mm_camera_map_msg_t msgs[MM_CAMERA_MAP_MSG_MAX];
+    uint32_t seq, num = 0, i;
+
+    CDBG_ERROR("%s: server stopped acking, failing %d map msgs", __func__,
+            my_obj->map_seq - my_obj->map_acked);
+    my_obj->map_broken = TRUE;
+    seq = my_obj->map_acked;
+    if (my_obj->map_completing && (seq != my_obj->map_seq)) {
+        /* its done_cb is running on the poll thread, which retires it.
+         * Its waiter returns once map_acked moves on, keep the status
+         * off the waiter's stack */
+        my_obj->map_msgs[seq % MM_CAMERA_MAP_MSG_MAX].status = NULL;
+        seq++;
+    }
+    for (; seq != my_obj->map_seq; seq++) {
+        mm_camera_map_msg_t *msg = &my_obj->map_msgs[seq % MM_CAMERA_MAP_MSG_MAX];
+        if (NULL != msg->status) {
+            *msg->status = MSM_CAMERA_ERR_CMD_FAIL;
+            msg->status = NULL;
+        }
+        msgs[num++] = *msg;
+    }
+    my_obj->map_acked = my_obj->map_seq;
+    pthread_cond_broadcast(&my_obj->evt_cond);
+
+    pthread_mutex_unlock(&my_obj->evt_lock);
+    for (i = 0; i < num; i++) {
+        if (NULL != msgs[i].done_cb) {
+            msgs[i].done_cb(-1, msgs[i].user_data, msgs[i].cookie);
+        }
+        if (mm_camera_util_map_batch_done == msgs[i].done_cb) {
+            free(msgs[i].user_data);
+        }
+    }
+    pthread_mutex_lock(&my_obj->evt_lock);
+
+    /* as after an ack, no done_cb may still run once a flush returns */
+    while (my_obj->map_completing) {
+        pthread_cond_wait(&my_obj->evt_cond, &my_obj->evt_lock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_send_map_msg_locked
+ *
+ * DESCRIPTION: send a map/unmap msg via domain socket, tagging it with the
+ *              next seq. Blocks while map_window msgs are in flight.
+ *              Fails once msgs were abandoned. Called with msg_lock held.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfds      : array of file descriptors to be sent
+ *   @numfds       : number of file descriptors to be sent, -1 for a
+ *                   single fd msg
+ *   @done_cb      : called once acked, may be NULL
+ *   @user_data    : user data for done_cb
+ *   @cookie       : cookie for done_cb
+ *   @status       : filled with the ack status, may be NULL
+ *   @seq          : seq of the msg sent
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_util_send_map_msg_locked(mm_camera_obj_t *my_obj,
+                                                  void *msg,
+                                                  size_t buf_size,
+                                                  int *sendfds,
+                                                  int numfds,
+                                                  mm_camera_map_done_t done_cb,
+                                                  void *user_data,
+                                                  uint64_t cookie,
+                                                  uint32_t *status,
+                                                  uint32_t *seq)
+{
+    int32_t rc = 0;
+    mm_camera_map_msg_t *entry = NULL;
+
+    pthread_mutex_lock(&my_obj->evt_lock);
+    if (my_obj->map_broken) {
+        CDBG_ERROR("%s: server lost acks, not sending", __func__);
+        rc = -1;
+    } else if ((my_obj->map_seq - my_obj->map_acked) >= my_obj->map_window) {
+        rc = mm_camera_util_wait_for_map_msg(my_obj,
+                my_obj->map_seq - my_obj->map_window);
+    }
+    if (0 == rc) {
+        *seq = my_obj->map_seq++;
+        entry = &my_obj->map_msgs[*seq % MM_CAMERA_MAP_MSG_MAX];
+        entry->done_cb = done_cb;
+        entry->user_data = user_data;
+        entry->cookie = cookie;
+        entry->status = status;
+    }
+    pthread_mutex_unlock(&my_obj->evt_lock);
+    if (0 != rc) {
+        return rc;
+    }
+
+    if (numfds < 0) {
+        rc = mm_camera_socket_sendmsg(my_obj->ds_fd, msg, buf_size, sendfds[0]);
+    } else {
+        rc = mm_camera_socket_bundle_sendmsg(my_obj->ds_fd, msg, buf_size,
+                sendfds, numfds);
+    }
+    if (rc <= 0) {
+        CDBG_ERROR("%s: sendmsg failed for msg %d", __func__, *seq);
+        /* no other sender can get in under msg_lock, take the seq back */
+        pthread_mutex_lock(&my_obj->evt_lock);
+        my_obj->map_seq--;
+        pthread_mutex_unlock(&my_obj->evt_lock);
+        rc = -1;
+    } else {
+        rc = 0;
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_send_map_batch
+ *
+ * DESCRIPTION: send coalesced single fd maps as one bundled map msg.
+ *              Called with msg_lock held.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success or nothing to send
+ *              -1 -- failure, ops of the batch were failed
+ *==========================================================================*/
+static int32_t mm_camera_util_send_map_batch(mm_camera_obj_t *my_obj)
+{
+    int32_t rc;
+    uint32_t i, seq;
+    mm_camera_map_batch_t *batch = my_obj->map_batch;
+
+    if (NULL == batch) {
+        return 0;
+    }
+    __atomic_store_n(&my_obj->map_batch, NULL, __ATOMIC_RELEASE);
+
+    batch->packet.msg_type = CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING;
+    batch->packet.payload.buf_map_list.length = batch->num_ops;
+    for (i = batch->num_ops; i < CAM_MAX_NUM_BUFS_PER_STREAM; i++) {
+        batch->packet.payload.buf_map_list.buf_maps[i].fd = -1;
+    }
+    rc = mm_camera_util_send_map_msg_locked(my_obj, &batch->packet,
+            sizeof(cam_sock_packet_t), batch->fds, (int)batch->num_ops,
+            mm_camera_util_map_batch_done, batch, 0, NULL, &seq);
+    /* server got its own copies of the fds with the msg */
+    for (i = 0; i < batch->num_ops; i++) {
+        close(batch->fds[i]);
+    }
+    if (0 != rc) {
+        CDBG_ERROR("%s: failed to send %d coalesced maps", __func__,
+                batch->num_ops);
+        mm_camera_util_map_batch_done(-1, batch, 0);
+        free(batch);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_map_batch_done
+ *
+ * DESCRIPTION: ack of a coalesced map msg, completes every single fd map
+ *              in it. The batch is freed by the caller once retired.
+ *
+ * PARAMETERS :
+ *   @status       : 0 if mapped, -1 if mapping failed
+ *   @user_data    : batch
+ *   @cookie       : not used
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_util_map_batch_done(int32_t status, void *user_data,
+        uint64_t cookie)
+{
+    mm_camera_map_batch_t *batch = (mm_camera_map_batch_t *)user_data;
+    mm_camera_map_done_t done_cb;
+    uint32_t i;
+
+    (void)cookie;
+    for (i = 0; i < batch->num_ops; i++) {
+        done_cb = batch->ops[i].done_cb;
+        if (NULL != done_cb) {
+            done_cb(status, batch->ops[i].user_data, batch->ops[i].cookie);
         }
     }
-    *status = my_obj->evt_rcvd.status;
-    /* reset local storage for recieved event for next event */
-    memset(&my_obj->evt_rcvd, 0, sizeof(mm_camera_event_t));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_queue_map_op
+ *
+ * DESCRIPTION: hold back a single fd map to send it with others in one
+ *              bundled map msg. The fd is duplicated so the caller may
+ *              close it before the batch goes out.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @packet       : single fd map msg
+ *   @sendfd       : fd to be mapped
+ *   @done_cb      : called once acked
+ *   @user_data    : user data for done_cb
+ *   @cookie       : cookie for done_cb
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- queued
+ *              -1 -- failure, done_cb will not be called
+ *==========================================================================*/
+static int32_t mm_camera_util_queue_map_op(mm_camera_obj_t *my_obj,
+                                           cam_sock_packet_t *packet,
+                                           int sendfd,
+                                           mm_camera_map_done_t done_cb,
+                                           void *user_data,
+                                           uint64_t cookie)
+{
+    int32_t rc = 0;
+    int fd;
+    mm_camera_map_batch_t *batch;
+
+    fd = dup(sendfd);
+    if (fd < 0) {
+        CDBG_ERROR("%s: dup of fd %d failed: %s", __func__, sendfd,
+                strerror(errno));
+        return -1;
+    }
+
+    pthread_mutex_lock(&my_obj->msg_lock);
+    batch = my_obj->map_batch;
+    if (NULL == batch) {
+        batch = (mm_camera_map_batch_t *)malloc(sizeof(mm_camera_map_batch_t));
+        if (NULL == batch) {
+            pthread_mutex_unlock(&my_obj->msg_lock);
+            CDBG_ERROR("%s: No memory for map batch", __func__);
+            close(fd);
+            return -1;
+        }
+        memset(&batch->packet, 0, sizeof(batch->packet));
+        batch->num_ops = 0;
+        __atomic_store_n(&my_obj->map_batch, batch, __ATOMIC_RELEASE);
+    }
+    batch->packet.payload.buf_map_list.buf_maps[batch->num_ops] =
+            packet->payload.buf_map;
+    batch->packet.payload.buf_map_list.buf_maps[batch->num_ops].fd = fd;
+    batch->fds[batch->num_ops] = fd;
+    batch->ops[batch->num_ops].done_cb = done_cb;
+    batch->ops[batch->num_ops].user_data = user_data;
+    batch->ops[batch->num_ops].cookie = cookie;
+    batch->num_ops++;
+    if (CAM_MAX_NUM_BUFS_PER_STREAM == batch->num_ops) {
+        /* ops are completed through the batch even if sending fails */
+        mm_camera_util_send_map_batch(my_obj);
+    }
+    pthread_mutex_unlock(&my_obj->msg_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_send_map_msg
+ *
+ * DESCRIPTION: send a map/unmap msg via domain socket after any single fd
+ *              maps held back, so the server sees them in call order.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfds      : array of file descriptors to be sent
+ *   @numfds       : number of file descriptors to be sent, -1 for a
+ *                   single fd msg
+ *   @done_cb      : called once acked, may be NULL
+ *   @user_data    : user data for done_cb
+ *   @cookie       : cookie for done_cb
+ *   @status       : filled with the ack status, may be NULL
+ *   @seq          : seq of the msg sent
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_util_send_map_msg(mm_camera_obj_t *my_obj,
+                                           void *msg,
+                                           size_t buf_size,
+                                           int *sendfds,
+                                           int numfds,
+                                           mm_camera_map_done_t done_cb,
+                                           void *user_data,
+                                           uint64_t cookie,
+                                           uint32_t *status,
+                                           uint32_t *seq)
+{
+    int32_t rc;
+
+    /* msg_lock keeps seq order and socket order the same */
+    pthread_mutex_lock(&my_obj->msg_lock);
+    mm_camera_util_send_map_batch(my_obj);
+    rc = mm_camera_util_send_map_msg_locked(my_obj, msg, buf_size, sendfds,
+            numfds, done_cb, user_data, cookie, status, seq);
+    pthread_mutex_unlock(&my_obj->msg_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_send_map_msg_sync
+ *
+ * DESCRIPTION: send a map/unmap msg and wait for its ack
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfds      : array of file descriptors to be sent
+ *   @numfds       : number of file descriptors, -1 for a single fd msg
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_util_send_map_msg_sync(mm_camera_obj_t *my_obj,
+                                                void *msg,
+                                                size_t buf_size,
+                                                int *sendfds,
+                                                int numfds)
+{
+    int32_t rc;
+    uint32_t seq = 0;
+    uint32_t status = MSM_CAMERA_ERR_CMD_FAIL;
+
+    rc = mm_camera_util_send_map_msg(my_obj, msg, buf_size, sendfds, numfds,
+            NULL, NULL, 0, &status, &seq);
+    if (0 != rc) {
+        return rc;
+    }
+
+    /* wait for event that mapping/unmapping is done */
+    pthread_mutex_lock(&my_obj->evt_lock);
+    /* on timeout the msg is abandoned, a late ack can not reach status */
+    rc = mm_camera_util_wait_for_map_msg(my_obj, seq);
+    if ((0 == rc) && (MSM_CAMERA_STATUS_SUCCESS != status)) {
+        rc = -1;
+    }
     pthread_mutex_unlock(&my_obj->evt_lock);
+    return rc;
 }
 
 /*===========================================================================
@@ -1809,20 +2345,8 @@ int32_t mm_camera_util_bundled_sendmsg(mm_camera_obj_t *my_obj,
                                        int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
                                        int numfds)
 {
-    int32_t rc = -1;
-    uint32_t status;
-
-    /* need to lock msg_lock, since sendmsg until response back is deemed as one operation*/
-    pthread_mutex_lock(&my_obj->msg_lock);
-    if(mm_camera_socket_bundle_sendmsg(my_obj->ds_fd, msg, buf_size, sendfds, numfds) > 0) {
-        /* wait for event that mapping/unmapping is done */
-        mm_camera_util_wait_for_event(my_obj, CAM_EVENT_TYPE_MAP_UNMAP_DONE, &status);
-        if (MSM_CAMERA_STATUS_SUCCESS == status) {
-            rc = 0;
-        }
-    }
-    pthread_mutex_unlock(&my_obj->msg_lock);
-    return rc;
+    return mm_camera_util_send_map_msg_sync(my_obj, msg, buf_size,
+            sendfds, numfds);
 }
 
 /*===========================================================================
@@ -1845,20 +2369,160 @@ int32_t mm_camera_util_sendmsg(mm_camera_obj_t *my_obj,
                                size_t buf_size,
                                int sendfd)
 {
-    int32_t rc = -1;
-    uint32_t status;
+    return mm_camera_util_send_map_msg_sync(my_obj, msg, buf_size,
+            &sendfd, -1);
+}
 
-    /* need to lock msg_lock, since sendmsg until reposonse back is deemed as one operation*/
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_sendmsg_async
+ *
+ * DESCRIPTION: send msg via domain socket without waiting for the ack.
+ *              Up to map_window msgs can be in flight. Single fd maps are
+ *              coalesced into bundled map msgs when map_coalesce is set.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfd       : >0 if any file descriptor need to be passed across process
+ *   @done_cb      : called on the event poll thread once acked
+ *   @user_data    : user data for done_cb
+ *   @cookie       : cookie for done_cb
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- msg sent
+ *              -1 -- failure, done_cb will not be called
+ *==========================================================================*/
+int32_t mm_camera_util_sendmsg_async(mm_camera_obj_t *my_obj,
+                                     void *msg,
+                                     size_t buf_size,
+                                     int sendfd,
+                                     mm_camera_map_done_t done_cb,
+                                     void *user_data,
+                                     uint64_t cookie)
+{
+    uint32_t seq;
+    cam_sock_packet_t *packet = (cam_sock_packet_t *)msg;
+
+    if (my_obj->map_coalesce && (sendfd >= 0) &&
+            (sizeof(cam_sock_packet_t) == buf_size) &&
+            (CAM_MAPPING_TYPE_FD_MAPPING == packet->msg_type)) {
+        return mm_camera_util_queue_map_op(my_obj, packet, sendfd,
+                done_cb, user_data, cookie);
+    }
+    return mm_camera_util_send_map_msg(my_obj, msg, buf_size, &sendfd, -1,
+            done_cb, user_data, cookie, NULL, &seq);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_bundled_sendmsg_async
+ *
+ * DESCRIPTION: send bundled msg via domain socket without waiting for the
+ *              ack. Up to map_window msgs can be in flight.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @msg          : message to be sent
+ *   @buf_size     : size of the message to be sent
+ *   @sendfds      : array of file descriptors to be sent
+ *   @numfds       : number of file descriptors to be sent
+ *   @done_cb      : called on the event poll thread once acked
+ *   @user_data    : user data for done_cb
+ *   @cookie       : cookie for done_cb
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- msg sent
+ *              -1 -- failure, done_cb will not be called
+ *==========================================================================*/
+int32_t mm_camera_util_bundled_sendmsg_async(mm_camera_obj_t *my_obj,
+                                             void *msg,
+                                             size_t buf_size,
+                                             int sendfds[CAM_MAX_NUM_BUFS_PER_STREAM],
+                                             int numfds,
+                                             mm_camera_map_done_t done_cb,
+                                             void *user_data,
+                                             uint64_t cookie)
+{
+    uint32_t seq;
+    return mm_camera_util_send_map_msg(my_obj, msg, buf_size, sendfds, numfds,
+            done_cb, user_data, cookie, NULL, &seq);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_commit_map_msgs
+ *
+ * DESCRIPTION: send single fd maps held back for coalescing. Must be
+ *              called before waiting for a map sent with
+ *              mm_camera_util_sendmsg_async. Not to be called with a lock
+ *              taken by done_cb held, the send may wait for acks.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_util_commit_map_msgs(mm_camera_obj_t *my_obj)
+{
+    if (NULL == __atomic_load_n(&my_obj->map_batch, __ATOMIC_ACQUIRE)) {
+        return;
+    }
     pthread_mutex_lock(&my_obj->msg_lock);
-    if(mm_camera_socket_sendmsg(my_obj->ds_fd, msg, buf_size, sendfd) > 0) {
-        /* wait for event that mapping/unmapping is done */
-        mm_camera_util_wait_for_event(my_obj, CAM_EVENT_TYPE_MAP_UNMAP_DONE, &status);
-        if (MSM_CAMERA_STATUS_SUCCESS == status) {
-            rc = 0;
+    mm_camera_util_send_map_batch(my_obj);
+    pthread_mutex_unlock(&my_obj->msg_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_drop_map_msgs
+ *
+ * DESCRIPTION: release coalesced maps that will never be acked, once the
+ *              event poll thread and the socket are gone on close
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_util_drop_map_msgs(mm_camera_obj_t *my_obj)
+{
+    uint32_t seq, i;
+    mm_camera_map_batch_t *batch = my_obj->map_batch;
+
+    if (NULL != batch) {
+        for (i = 0; i < batch->num_ops; i++) {
+            close(batch->fds[i]);
         }
+        free(batch);
+        my_obj->map_batch = NULL;
     }
-    pthread_mutex_unlock(&my_obj->msg_lock);
-    return rc;
+    for (seq = my_obj->map_acked; seq != my_obj->map_seq; seq++) {
+        mm_camera_map_msg_t *msg = &my_obj->map_msgs[seq % MM_CAMERA_MAP_MSG_MAX];
+        if (mm_camera_util_map_batch_done == msg->done_cb) {
+            free(msg->user_data);
+        }
+    }
+    my_obj->map_acked = my_obj->map_seq;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_flush_map_msgs
+ *
+ * DESCRIPTION: wait for acks of all msgs sent so far. If the server does
+ *              not ack in time, the msgs still in flight are failed, so
+ *              no done_cb runs once this returns either way.
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_util_flush_map_msgs(mm_camera_obj_t *my_obj)
+{
+    mm_camera_util_commit_map_msgs(my_obj);
+    pthread_mutex_lock(&my_obj->evt_lock);
+    if (my_obj->map_acked != my_obj->map_seq) {
+        mm_camera_util_wait_for_map_msg(my_obj, my_obj->map_seq - 1);
+    }
+    pthread_mutex_unlock(&my_obj->evt_lock);
 }
 
 /*===========================================================================
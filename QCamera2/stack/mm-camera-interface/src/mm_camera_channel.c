@@ -34,19 +34,23 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <stdlib.h>
+#include <cutils/properties.h>
 #include <cam_semaphore.h>
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
+#include "mm_camera_trace.h"
 
 extern mm_camera_obj_t* mm_camera_util_get_camera_by_handler(uint32_t cam_handler);
 extern mm_channel_t * mm_camera_util_get_channel_by_handler(mm_camera_obj_t * cam_obj,
                                                             uint32_t handler);
-/* Static frame sync info used between different camera channels*/
-static mm_channel_frame_sync_info_t fs = { .num_cam =0, .pos = 0};
-/* Frame sync info access lock */
-static pthread_mutex_t fs_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Frame sync groups, one per frame_sync_id in use. The list lock is only
+ * taken to register and unregister channels, the frame path goes through
+ * ch_obj->frame_sync and its own lock */
+static struct cam_list fs_list = { &fs_list, &fs_list };
+static pthread_mutex_t fs_list_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* internal function declare goes here */
 int32_t mm_channel_qbuf(mm_channel_t *my_obj,
@@ -84,6 +88,8 @@ int32_t mm_channel_set_stream_parm(mm_channel_t *my_obj,
                                    mm_evt_paylod_set_get_stream_parms_t *payload);
 int32_t mm_channel_get_queued_buf_count(mm_channel_t *my_obj,
         uint32_t stream_id);
+int32_t mm_channel_get_stream_stats(mm_channel_t *my_obj,
+        uint32_t stream_id, mm_camera_stream_stats_t *stats);
 
 int32_t mm_channel_get_stream_parm(mm_channel_t *my_obj,
                                    mm_evt_paylod_set_get_stream_parms_t *payload);
@@ -133,15 +139,17 @@ int32_t mm_channel_superbuf_flush_matched(mm_channel_t* my_obj,
                                           mm_channel_queue_t * queue);
 
 /* Start of Frame Sync util methods */
-void mm_frame_sync_reset();
+void mm_frame_sync_reset(mm_channel_frame_sync_info_t *fs);
 int32_t mm_frame_sync_register_channel(mm_channel_t *ch_obj);
 int32_t mm_frame_sync_unregister_channel(mm_channel_t *ch_obj);
-int32_t mm_frame_sync_add(uint32_t frame_id, mm_channel_t *ch_obj);
-int32_t mm_frame_sync_remove(uint32_t frame_id);
-uint32_t mm_frame_sync_find_matched(uint8_t oldest);
-int8_t mm_frame_sync_find_frame_index(uint32_t frame_id);
-void mm_frame_sync_lock_queues();
-void mm_frame_sync_unlock_queues();
+void mm_frame_sync_put(mm_channel_t *ch_obj);
+int32_t mm_frame_sync_add(uint32_t frame_id, int64_t ts, mm_channel_t *ch_obj);
+int32_t mm_frame_sync_remove(uint32_t frame_id, mm_channel_t *ch_obj);
+mm_channel_sync_node_t *mm_frame_sync_find_matched(
+        mm_channel_frame_sync_info_t *fs, uint8_t oldest);
+void mm_frame_sync_lock_queues(mm_channel_frame_sync_info_t *fs);
+void mm_frame_sync_unlock_queues(mm_channel_frame_sync_info_t *fs);
+static int64_t mm_frame_sync_buf_ts(mm_camera_buf_def_t *buf);
 void mm_channel_node_qbuf(mm_channel_t *ch_obj, mm_channel_queue_node_t *node);
 /* End of Frame Sync Util methods */
 void mm_channel_send_super_buf(mm_channel_node_info_t *info);
@@ -417,36 +425,35 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
         uint32_t match_frame = 0;
         mm_channel_node_info_t info;
         memset(&info, 0x0, sizeof(info));
-        if (ch_obj->req_type == MM_CAMERA_REQ_FRAME_SYNC_BUF) {
+        if ((ch_obj->req_type == MM_CAMERA_REQ_FRAME_SYNC_BUF) &&
+                (NULL != ch_obj->frame_sync)) {
+            mm_channel_frame_sync_info_t *fs = ch_obj->frame_sync;
             // Lock the Queues
-            mm_frame_sync_lock_queues();
-            uint32_t match_frame = mm_frame_sync_find_matched(FALSE);
-            if (match_frame) {
+            mm_frame_sync_lock_queues(fs);
+            mm_channel_sync_node_t *sync_node = mm_frame_sync_find_matched(fs, FALSE);
+            if (sync_node) {
                 uint8_t j = 0;
-                for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
-                    if (fs.ch_obj[j]) {
+                for (j = 0; j < MM_CAMERA_FRAME_SYNC_MAX_CAM; j++) {
+                    if (fs->ch_obj[j] && sync_node->frame_id[j]) {
                         mm_channel_queue_t *ch_queue =
-                                &fs.ch_obj[j]->bundle.superbuf_queue;
-                        if (ch_queue == NULL) {
-                            CDBG_HIGH("%s: Channel queue is NULL", __func__);
-                            break;
-                        }
+                                &fs->ch_obj[j]->bundle.superbuf_queue;
                         node = mm_channel_superbuf_dequeue_frame_internal(
-                                ch_queue, match_frame);
+                                ch_queue, sync_node->frame_id[j]);
                         if (node != NULL) {
-                            info.ch_obj[info.num_nodes] = fs.ch_obj[j];
+                            info.ch_obj[info.num_nodes] = fs->ch_obj[j];
                             info.node[info.num_nodes] = node;
                             info.num_nodes++;
                             CDBG_HIGH("%s: Added ch(%p) to node ,num nodes %d",
-                                    __func__, fs.ch_obj[j], info.num_nodes);
+                                    __func__, fs->ch_obj[j], info.num_nodes);
                         }
                     }
                 }
-                mm_frame_sync_remove(match_frame);
-                ALOGI("%s: match frame %d", __func__, match_frame);
-                if (info.num_nodes != fs.num_cam) {
+                ALOGI("%s: match frame %d", __func__, sync_node->frame_idx);
+                memset(sync_node, 0x00, sizeof(mm_channel_sync_node_t));
+                if (info.num_nodes != fs->num_cam) {
                     ALOGI("%s: num node %d != num cam (%d) Debug this",
-                            __func__, info.num_nodes, fs.num_cam);
+                            __func__, info.num_nodes, fs->num_cam);
+                    fs->stats.incomplete++;
                     uint8_t j = 0;
                     // free super buffers from various nodes
                     for (j = 0; j < info.num_nodes; j++) {
@@ -457,9 +464,11 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                     }
                     //we should not use it as matched dual camera frames
                     info.num_nodes = 0;
+                } else {
+                    fs->stats.delivered++;
                 }
             }
-            mm_frame_sync_unlock_queues();
+            mm_frame_sync_unlock_queues(fs);
         } else {
            node = mm_channel_superbuf_dequeue(&ch_obj->bundle.superbuf_queue, ch_obj);
            if (node != NULL) {
@@ -839,6 +848,13 @@ int32_t mm_channel_fsm_fn_stopped(mm_channel_t *my_obj,
             rc = mm_channel_get_queued_buf_count(my_obj, stream_id);
         }
         break;
+    case MM_CHANNEL_EVT_GET_STREAM_STATS:
+        {
+            uint32_t stream_id = *((uint32_t *)in_val);
+            rc = mm_channel_get_stream_stats(my_obj, stream_id,
+                    (mm_camera_stream_stats_t *)out_val);
+        }
+        break;
     case MM_CHANNEL_EVT_GET_STREAM_PARM:
         {
             mm_evt_paylod_set_get_stream_parms_t *payload =
@@ -970,6 +986,13 @@ int32_t mm_channel_fsm_fn_active(mm_channel_t *my_obj,
             rc = mm_channel_get_queued_buf_count(my_obj, stream_id);
         }
         break;
+    case MM_CHANNEL_EVT_GET_STREAM_STATS:
+        {
+            uint32_t stream_id = *((uint32_t *)in_val);
+            rc = mm_channel_get_stream_stats(my_obj, stream_id,
+                    (mm_camera_stream_stats_t *)out_val);
+        }
+        break;
     case MM_CHANNEL_EVT_GET_STREAM_PARM:
         {
             mm_evt_paylod_set_get_stream_parms_t *payload =
@@ -1133,6 +1156,107 @@ int32_t mm_channel_fsm_fn_paused(mm_channel_t *my_obj,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_get_poll_mode
+ *
+ * DESCRIPTION: resolve data poll thread topology of a channel, channel attr
+ *              first, then persist.camera.poll.mode
+ *
+ * PARAMETERS :
+ *   @attr    : bundle attribute of the channel, can be NULL
+ *
+ * RETURN     : mm_camera_poll_mode_t other than DEFAULT
+ *==========================================================================*/
+static mm_camera_poll_mode_t mm_channel_get_poll_mode(
+        mm_camera_channel_attr_t *attr)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    int mode;
+
+    if ((NULL != attr) && (MM_CAMERA_POLL_MODE_DEFAULT != attr->poll_mode) &&
+            (MM_CAMERA_POLL_MODE_MAX > attr->poll_mode)) {
+        return attr->poll_mode;
+    }
+    property_get("persist.camera.poll.mode", prop, "0");
+    mode = atoi(prop);
+    if ((mode <= MM_CAMERA_POLL_MODE_DEFAULT) || (mode >= MM_CAMERA_POLL_MODE_MAX)) {
+        mode = MM_CAMERA_POLL_MODE_SHARED;
+    }
+    return (mm_camera_poll_mode_t)mode;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_get_poll_thread
+ *
+ * DESCRIPTION: data poll thread serving the stream at a given index
+ *
+ * PARAMETERS :
+ *   @my_obj  : channel object
+ *   @idx     : stream index in the channel
+ *
+ * RETURN     : ptr to poll thread object
+ *==========================================================================*/
+static mm_camera_poll_thread_t *mm_channel_get_poll_thread(mm_channel_t *my_obj,
+        uint8_t idx)
+{
+    switch (my_obj->poll_mode) {
+    case MM_CAMERA_POLL_MODE_PER_STREAM:
+        return &my_obj->poll_thread[idx];
+    case MM_CAMERA_POLL_MODE_GLOBAL:
+        return &my_obj->cam_obj->data_poll_thread;
+    default:
+        return &my_obj->poll_thread[0];
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_config_poll_thread
+ *
+ * DESCRIPTION: set up the data poll thread of a configured stream. A
+ *              per-stream poll thread is launched with the scheduling of the
+ *              stream type; a shared one is raised to the most latency
+ *              critical class among its streams.
+ *
+ * PARAMETERS :
+ *   @my_obj     : channel object
+ *   @stream_obj : configured stream object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_channel_config_poll_thread(mm_channel_t *my_obj,
+        mm_stream_t *stream_obj)
+{
+    int32_t rc = 0;
+    uint8_t idx = mm_camera_util_get_index_by_handler(stream_obj->my_hdl);
+    mm_camera_poll_thread_t *poll_cb = stream_obj->poll_thread;
+    mm_camera_thread_sched_t sched;
+
+    mm_camera_thread_get_sched(
+            mm_camera_thread_class_for_stream(stream_obj->stream_info->stream_type),
+            &sched);
+
+    if (MM_CAMERA_POLL_MODE_PER_STREAM == my_obj->poll_mode) {
+        if (NULL == poll_cb->poll_entries) {
+            snprintf(poll_cb->threadName, THREAD_NAME_SIZE, "CAM_dataPoll%d", idx);
+            poll_cb->sched = sched;
+            rc = mm_camera_poll_thread_launch(poll_cb, MM_CAMERA_POLL_TYPE_DATA);
+        } else if (poll_cb->sched.cls != sched.cls) {
+            /* stream reconfigured to a different type */
+            mm_camera_poll_thread_set_sched(poll_cb, &sched);
+        }
+    } else if ((NULL != poll_cb->poll_entries) &&
+            (MM_CAMERA_THREAD_CLASS_RT == sched.cls ||
+            MM_CAMERA_THREAD_CLASS_DEFAULT == poll_cb->sched.cls) &&
+            (poll_cb->sched.cls != sched.cls)) {
+        /* shared thread: never demote below its most critical stream */
+        mm_camera_poll_thread_set_sched(poll_cb, &sched);
+    }
+    /* scheduling is best effort, only a failed launch is an error */
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_init
  *
@@ -1165,10 +1289,26 @@ int32_t mm_channel_init(mm_channel_t *my_obj,
         my_obj->bundle.superbuf_queue.attr = *attr;
     }
 
-    CDBG("%s : Launch data poll thread in channel open", __func__);
+    my_obj->poll_mode = mm_channel_get_poll_mode(attr);
+    CDBG("%s : poll mode %d", __func__, my_obj->poll_mode);
     snprintf(my_obj->threadName, THREAD_NAME_SIZE, "CAM_dataPoll");
-    mm_camera_poll_thread_launch(&my_obj->poll_thread[0],
-                                 MM_CAMERA_POLL_TYPE_DATA);
+    switch (my_obj->poll_mode) {
+    case MM_CAMERA_POLL_MODE_PER_STREAM:
+        /* launched per stream once the stream type is configured */
+        break;
+    case MM_CAMERA_POLL_MODE_GLOBAL:
+        if (NULL == mm_camera_get_data_poll_thread(my_obj->cam_obj)) {
+            rc = -1;
+        }
+        break;
+    default:
+        CDBG("%s : Launch data poll thread in channel open", __func__);
+        snprintf(my_obj->poll_thread[0].threadName, THREAD_NAME_SIZE,
+                "%s", my_obj->threadName);
+        rc = mm_camera_poll_thread_launch(&my_obj->poll_thread[0],
+                                          MM_CAMERA_POLL_TYPE_DATA);
+        break;
+    }
 
     /* change state to stopped state */
     my_obj->state = MM_CHANNEL_STATE_STOPPED;
@@ -1188,8 +1328,18 @@ int32_t mm_channel_init(mm_channel_t *my_obj,
  *==========================================================================*/
 void mm_channel_release(mm_channel_t *my_obj)
 {
+    uint8_t i;
+
     /* stop data poll thread */
-    mm_camera_poll_thread_release(&my_obj->poll_thread[0]);
+    if (MM_CAMERA_POLL_MODE_GLOBAL == my_obj->poll_mode) {
+        mm_camera_put_data_poll_thread(my_obj->cam_obj);
+    } else {
+        for (i = 0; i < MM_CAMERA_CHANNEL_POLL_THREAD_MAX; i++) {
+            if (NULL != my_obj->poll_thread[i].poll_entries) {
+                mm_camera_poll_thread_release(&my_obj->poll_thread[i]);
+            }
+        }
+    }
 
     /* change state to notused state */
     my_obj->state = MM_CHANNEL_STATE_NOTUSED;
@@ -1286,7 +1436,10 @@ uint32_t mm_channel_add_stream(mm_channel_t *my_obj)
     stream_obj->fd = -1;
     stream_obj->my_hdl = mm_camera_util_generate_handler(idx);
     stream_obj->ch_obj = my_obj;
+    stream_obj->poll_thread = mm_channel_get_poll_thread(my_obj, idx);
     pthread_mutex_init(&stream_obj->buf_lock, NULL);
+    pthread_mutex_init(&stream_obj->poll_lock, NULL);
+    pthread_mutex_init(&stream_obj->stats_lock, NULL);
     pthread_mutex_init(&stream_obj->cb_lock, NULL);
     pthread_mutex_init(&stream_obj->cmd_lock, NULL);
     pthread_cond_init(&stream_obj->buf_cond, NULL);
@@ -1302,6 +1455,8 @@ uint32_t mm_channel_add_stream(mm_channel_t *my_obj)
         /* error during acquire, de-init */
         pthread_cond_destroy(&stream_obj->buf_cond);
         pthread_mutex_destroy(&stream_obj->buf_lock);
+        pthread_mutex_destroy(&stream_obj->poll_lock);
+        pthread_mutex_destroy(&stream_obj->stats_lock);
         pthread_mutex_destroy(&stream_obj->cb_lock);
         pthread_mutex_destroy(&stream_obj->cmd_lock);
         memset(stream_obj, 0, sizeof(mm_stream_t));
@@ -1328,6 +1483,7 @@ int32_t mm_channel_del_stream(mm_channel_t *my_obj,
                               uint32_t stream_id)
 {
     int rc = -1;
+    uint8_t idx;
     mm_stream_t * stream_obj = NULL;
     stream_obj = mm_channel_util_get_stream_by_handler(my_obj, stream_id);
 
@@ -1348,11 +1504,18 @@ int32_t mm_channel_del_stream(mm_channel_t *my_obj,
         return 0;
     }
 
+    idx = mm_camera_util_get_index_by_handler(stream_id);
     rc = mm_stream_fsm_fn(stream_obj,
                           MM_STREAM_EVT_RELEASE,
                           NULL,
                           NULL);
 
+    if ((MM_CAMERA_POLL_MODE_PER_STREAM == my_obj->poll_mode) &&
+            (NULL != my_obj->poll_thread[idx].poll_entries)) {
+        /* stream fd is already out of the poll set after stream off */
+        mm_camera_poll_thread_release(&my_obj->poll_thread[idx]);
+    }
+
     return rc;
 }
 
@@ -1394,6 +1557,9 @@ int32_t mm_channel_config_stream(mm_channel_t *my_obj,
                           MM_STREAM_EVT_SET_FMT,
                           (void *)config,
                           NULL);
+    if (0 == rc) {
+        rc = mm_channel_config_poll_thread(my_obj, stream_obj);
+    }
     CDBG("%s : X rc = %d",__func__,rc);
     return rc;
 }
@@ -1471,6 +1637,7 @@ int32_t mm_channel_start(mm_channel_t *my_obj)
     mm_stream_t *s_obj = NULL;
     int meta_stream_idx = 0;
     cam_stream_type_t stream_type = CAM_STREAM_TYPE_DEFAULT;
+    mm_camera_thread_class_t cls, stream_cls;
 
     for (i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
         if (my_obj->streams[i].my_hdl > 0) {
@@ -1522,6 +1689,19 @@ int32_t mm_channel_start(mm_channel_t *my_obj)
             }
         }
 
+        /* superbuf threads follow the most latency critical bundled stream */
+        cls = MM_CAMERA_THREAD_CLASS_DEFAULT;
+        for (i = 0; i < num_streams_to_start; i++) {
+            stream_cls = mm_camera_thread_class_for_stream(
+                    s_objs[i]->stream_info->stream_type);
+            if ((MM_CAMERA_THREAD_CLASS_RT == stream_cls) ||
+                    (MM_CAMERA_THREAD_CLASS_DEFAULT == cls)) {
+                cls = stream_cls;
+            }
+        }
+        mm_camera_thread_get_sched(cls, &my_obj->cb_thread.sched);
+        my_obj->cmd_thread.sched = my_obj->cb_thread.sched;
+
         /* launch cb thread for dispatching super buf through cb */
         snprintf(my_obj->cb_thread.threadName, THREAD_NAME_SIZE, "CAM_SuperBuf");
         mm_camera_cmd_thread_launch(&my_obj->cb_thread,
@@ -1647,7 +1827,7 @@ int32_t mm_channel_start(mm_channel_t *my_obj)
         }
     }
     my_obj->bWaitForPrepSnapshotDone = 0;
-    if (my_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
+    if ((0 == rc) && my_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
         CDBG_HIGH("%s: registering Channel obj %p", __func__, my_obj);
         mm_frame_sync_register_channel(my_obj);
     }
@@ -1749,6 +1929,8 @@ int32_t mm_channel_stop(mm_channel_t *my_obj)
         /* deinit superbuf queue */
         mm_channel_superbuf_queue_deinit(&my_obj->bundle.superbuf_queue);
     }
+    /* bundle threads are gone, drop the sync group reference */
+    mm_frame_sync_put(my_obj);
 
     /* since all streams are stopped, we are safe to
      * release all buffers allocated in stream */
@@ -2068,6 +2250,38 @@ int32_t mm_channel_get_queued_buf_count(mm_channel_t *my_obj, uint32_t stream_id
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_get_stream_stats
+ *
+ * DESCRIPTION: read latency stats of a stream
+ *
+ * PARAMETERS :
+ *   @my_obj       : channel object
+ *   @stream_id    : steam_id
+ *   @stats        : stats to be filled
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_channel_get_stream_stats(mm_channel_t *my_obj,
+        uint32_t stream_id, mm_camera_stream_stats_t *stats)
+{
+    int32_t rc = -1;
+    mm_stream_t* s_obj = mm_channel_util_get_stream_by_handler(my_obj, stream_id);
+
+    if ((NULL != s_obj) && (NULL != stats)) {
+        if (s_obj->ch_obj != my_obj) {
+            /* Redirect to linked stream */
+            rc = mm_stream_get_stats(s_obj->linked_stream, stats);
+        } else {
+            rc = mm_stream_get_stats(s_obj, stats);
+        }
+    }
+
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_set_stream_parms
  *
@@ -2302,7 +2516,12 @@ int32_t mm_channel_unmap_stream_buf(mm_channel_t *my_obj,
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
 {
-    return cam_queue_init(&queue->que);
+    cam_list_init(&queue->unmatched);
+    queue->unmatched_cnt = 0;
+    queue->unindexed_cnt = 0;
+    memset(queue->frame_index, 0, sizeof(queue->frame_index));
+    return cam_queue_init_slab(&queue->que,
+            MM_CHANNEL_SUPERBUF_QUEUE_SLAB_SIZE);
 }
 
 /*===========================================================================
@@ -2319,6 +2538,13 @@ int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_deinit(mm_channel_queue_t * queue)
 {
+    cam_queue_stats_t stats;
+
+    cam_queue_get_stats(&queue->que, &stats);
+    CDBG_HIGH("%s: superbuf queue: slab %u, allocs %u, mallocs %u, "
+            "overflow %u, hwm %u", __func__, stats.slab_cnt,
+            stats.node_allocs, stats.node_mallocs, stats.overflow_cnt,
+            stats.high_water);
     return cam_queue_deinit(&queue->que);
 }
 
@@ -2613,6 +2839,149 @@ end:
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_stamp_match
+ *
+ * DESCRIPTION: stamp match time on all buffers of a matched super buf
+ *
+ * PARAMETERS :
+ *   @super_buf : matched super buf
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_stamp_match(mm_channel_queue_node_t *super_buf)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_BOOTTIME);
+    uint8_t i;
+
+    for (i = 0; i < super_buf->num_of_bufs; i++) {
+        if (NULL != super_buf->super_buf[i].buf) {
+            super_buf->super_buf[i].buf->match_time = now;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_track
+ *
+ * DESCRIPTION: add a new unmatched superbuf to the unmatched list and the
+ *              frame_idx index. Must be called with queue lock held.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @super_buf : new unmatched superbuf
+ *   @before    : unmatched superbuf to insert before, NULL for tail
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_track(mm_channel_queue_t *queue,
+        mm_channel_queue_node_t *super_buf, mm_channel_queue_node_t *before)
+{
+    uint32_t slot = super_buf->frame_idx & (MM_CHANNEL_SUPERBUF_INDEX_SIZE - 1);
+
+    if (NULL != before) {
+        cam_list_insert_before_node(&super_buf->unmatched, &before->unmatched);
+    } else {
+        cam_list_add_tail_node(&super_buf->unmatched, &queue->unmatched);
+    }
+    queue->unmatched_cnt++;
+
+    if (NULL == queue->frame_index[slot]) {
+        queue->frame_index[slot] = super_buf;
+        super_buf->indexed = TRUE;
+    } else {
+        super_buf->indexed = FALSE;
+        queue->unindexed_cnt++;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_untrack
+ *
+ * DESCRIPTION: drop a superbuf from matcher bookkeeping, before it is marked
+ *              matched or removed from the queue. No-op on matched superbufs.
+ *              Must be called with queue lock held.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @super_buf : superbuf
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_untrack(mm_channel_queue_t *queue,
+        mm_channel_queue_node_t *super_buf)
+{
+    uint32_t slot = super_buf->frame_idx & (MM_CHANNEL_SUPERBUF_INDEX_SIZE - 1);
+
+    if (super_buf->matched) {
+        return;
+    }
+    cam_list_del_node(&super_buf->unmatched);
+    queue->unmatched_cnt--;
+    if (super_buf->indexed) {
+        queue->frame_index[slot] = NULL;
+        super_buf->indexed = FALSE;
+    } else {
+        queue->unindexed_cnt--;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_lookup
+ *
+ * DESCRIPTION: find the unmatched superbuf of a frame. Constant time unless
+ *              index slots collided, then the unmatched list is walked.
+ *              Must be called with queue lock held.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @frame_idx : frame index
+ *
+ * RETURN     : unmatched superbuf, NULL if none
+ *==========================================================================*/
+static mm_channel_queue_node_t *mm_channel_superbuf_lookup(
+        mm_channel_queue_t *queue, uint32_t frame_idx)
+{
+    mm_channel_queue_node_t *super_buf =
+            queue->frame_index[frame_idx & (MM_CHANNEL_SUPERBUF_INDEX_SIZE - 1)];
+    struct cam_list *pos;
+
+    if ((NULL != super_buf) && (super_buf->frame_idx == frame_idx)) {
+        return super_buf;
+    }
+    if (0 == queue->unindexed_cnt) {
+        return NULL;
+    }
+    for (pos = queue->unmatched.next; pos != &queue->unmatched; pos = pos->next) {
+        super_buf = member_of(pos, mm_channel_queue_node_t, unmatched);
+        if (super_buf->frame_idx == frame_idx) {
+            return super_buf;
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_remove_node
+ *
+ * DESCRIPTION: unlink a superbuf node from the queue and return its cam node.
+ *              Must be called with queue lock held.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @node      : queue node holding the superbuf
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_remove_node(mm_channel_queue_t *queue,
+        cam_node_t *node)
+{
+    mm_channel_superbuf_untrack(queue, (mm_channel_queue_node_t *)node->data);
+    queue->que.size--;
+    cam_list_del_node(&node->list);
+    cam_queue_node_put(&queue->que, node);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_superbuf_comp_and_enqueue
  *
@@ -2636,8 +3005,9 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
     struct cam_list *head = NULL;
     struct cam_list *pos = NULL;
     mm_channel_queue_node_t* super_buf = NULL;
+    mm_channel_queue_node_t* oldest = NULL;
     uint8_t buf_s_idx, i, found_super_buf, unmatched_bundles;
-    struct cam_list *last_buf, *insert_before_buf, *last_buf_ptr;
+    struct cam_list *last_buf, *insert_before_buf, *last_buf_ptr, *uq;
 
     CDBG("%s: E", __func__);
 
@@ -2681,8 +3051,6 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
     /* comp */
     pthread_mutex_lock(&queue->que.lock);
     head = &queue->que.head.list;
-    /* get the last one in the queue which is possibly having no matching */
-    pos = head->next;
 
     found_super_buf = 0;
     unmatched_bundles = 0;
@@ -2690,49 +3058,83 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
     insert_before_buf = NULL;
     last_buf_ptr = NULL;
 
-    while (pos != head) {
-        node = member_of(pos, cam_node_t, list);
-        super_buf = (mm_channel_queue_node_t*)node->data;
-
-        if (NULL != super_buf) {
-            if (super_buf->matched) {
-                /* find a matched super buf, move to next one */
-                pos = pos->next;
-                continue;
-            } else if ( buf_info->frame_idx == super_buf->frame_idx
-                    /*Pick metadata greater than available frameID*/
-                    || ((queue->nomatch_frame_id != 0)
-                    && (queue->nomatch_frame_id <= buf_info->frame_idx)
-                    && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
-                    && (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA))
-                    /*Pick available metadata closest to frameID*/
-                    || ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
-                    && (buf_info->buf->stream_type != CAM_STREAM_TYPE_METADATA)
-                    && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
-                    && (super_buf->frame_idx > buf_info->frame_idx))){
-                /*super buffer frame IDs matching OR In low priority bundling
-                metadata frameID greater than avialbale super buffer frameID  OR
-                metadata frame closest to incoming frameID will be bundled*/
-                found_super_buf = 1;
-                queue->nomatch_frame_id = 0;
-                break;
-            } else {
-                unmatched_bundles++;
-                if ( NULL == last_buf ) {
-                    if ( super_buf->frame_idx < buf_info->frame_idx ) {
-                        last_buf = pos;
+    if (((queue->nomatch_frame_id != 0)
+            && (queue->nomatch_frame_id <= buf_info->frame_idx)
+            && (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA))
+            || ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
+            && (buf_info->buf->stream_type != CAM_STREAM_TYPE_METADATA))) {
+        /* nearest frame bundling, scan the queue in order */
+        pos = head->next;
+        while (pos != head) {
+            node = member_of(pos, cam_node_t, list);
+            super_buf = (mm_channel_queue_node_t*)node->data;
+
+            if (NULL != super_buf) {
+                if (super_buf->matched) {
+                    /* find a matched super buf, move to next one */
+                    pos = pos->next;
+                    continue;
+                } else if ( buf_info->frame_idx == super_buf->frame_idx
+                        /*Pick metadata greater than available frameID*/
+                        || ((queue->nomatch_frame_id != 0)
+                        && (queue->nomatch_frame_id <= buf_info->frame_idx)
+                        && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
+                        && (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA))
+                        /*Pick available metadata closest to frameID*/
+                        || ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
+                        && (buf_info->buf->stream_type != CAM_STREAM_TYPE_METADATA)
+                        && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
+                        && (super_buf->frame_idx > buf_info->frame_idx))){
+                    /*super buffer frame IDs matching OR In low priority bundling
+                    metadata frameID greater than avialbale super buffer frameID  OR
+                    metadata frame closest to incoming frameID will be bundled*/
+                    found_super_buf = 1;
+                    queue->nomatch_frame_id = 0;
+                    break;
+                } else {
+                    unmatched_bundles++;
+                    if ( NULL == last_buf ) {
+                        if ( super_buf->frame_idx < buf_info->frame_idx ) {
+                            last_buf = pos;
+                        }
                     }
-                }
-                if ( NULL == insert_before_buf ) {
-                    if ( super_buf->frame_idx > buf_info->frame_idx ) {
-                        insert_before_buf = pos;
+                    if ( NULL == insert_before_buf ) {
+                        if ( super_buf->frame_idx > buf_info->frame_idx ) {
+                            insert_before_buf = pos;
+                        }
                     }
+                    pos = pos->next;
                 }
-                pos = pos->next;
+            }
+        }
+    } else {
+        /* exact frame_idx bundling. Unmatched superbufs are kept in frame_idx
+         * order, so the oldest one and the insert position follow from the
+         * ends of the unmatched list instead of a queue walk. */
+        super_buf = mm_channel_superbuf_lookup(queue, buf_info->frame_idx);
+        if (NULL != super_buf) {
+            found_super_buf = 1;
+            queue->nomatch_frame_id = 0;
+            pos = &super_buf->node->list;
+        } else {
+            pos = head;
+            unmatched_bundles = (queue->unmatched_cnt > UINT8_MAX) ?
+                    UINT8_MAX : (uint8_t)queue->unmatched_cnt;
+            for (uq = queue->unmatched.prev; uq != &queue->unmatched; uq = uq->prev) {
+                oldest = member_of(uq, mm_channel_queue_node_t, unmatched);
+                if (oldest->frame_idx <= buf_info->frame_idx) {
+                    break;
+                }
+                insert_before_buf = &oldest->node->list;
+            }
+        }
+        if (queue->unmatched.next != &queue->unmatched) {
+            oldest = member_of(queue->unmatched.next, mm_channel_queue_node_t, unmatched);
+            if (oldest->frame_idx < buf_info->frame_idx) {
+                last_buf = &oldest->node->list;
             }
         }
     }
-
     if ( found_super_buf ) {
         if(super_buf->super_buf[buf_s_idx].frame_idx != 0) {
             //This can cause frame drop. We are overwriting same memory.
@@ -2745,17 +3147,16 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
 
         /*Insert incoming buffer to super buffer*/
         super_buf->super_buf[buf_s_idx] = *buf_info;
+        super_buf->stream_mask |= (1U << buf_s_idx);
 
         /* check if superbuf is all matched */
-        super_buf->matched = 1;
-        for (i=0; i < super_buf->num_of_bufs; i++) {
-            if (super_buf->super_buf[i].frame_idx == 0) {
-                super_buf->matched = 0;
-                break;
-            }
-        }
+        if (super_buf->stream_mask == ((1U << super_buf->num_of_bufs) - 1)) {
+            mm_channel_superbuf_untrack(queue, super_buf);
+            super_buf->matched = 1;
 
-        if (super_buf->matched) {
+            MM_CAMERA_TRACE_FRAME("SuperbufMatch", buf_info->frame_idx,
+                    super_buf->num_of_bufs);
+            mm_channel_superbuf_stamp_match(super_buf);
             if(ch_obj->isFlashBracketingEnabled) {
                queue->expected_frame_id =
                    queue->expected_frame_id_without_led;
@@ -2776,9 +3177,8 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
 
             queue->match_cnt++;
             if (ch_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
-                pthread_mutex_lock(&fs_lock);
-                mm_frame_sync_add(buf_info->frame_idx, ch_obj);
-                pthread_mutex_unlock(&fs_lock);
+                mm_frame_sync_add(buf_info->frame_idx,
+                        mm_frame_sync_buf_ts(buf_info->buf), ch_obj);
             }
             /* Any older unmatched buffer need to be released */
             if ( last_buf ) {
@@ -2791,10 +3191,8 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                                 mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
                             }
                         }
-                        queue->que.size--;
                         last_buf = last_buf->next;
-                        cam_list_del_node(&node->list);
-                        free(node);
+                        mm_channel_superbuf_remove_node(queue, node);
                         free(super_buf);
                     } else {
                         CDBG_ERROR(" %s : Invalid superbuf in queue!", __func__);
@@ -2828,11 +3226,11 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                             mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
                         }
                     }
-                    queue->que.size--;
-                    cam_list_del_node(&node->list);
-                    free(node);
+                    last_buf_ptr = last_buf_ptr->next;
+                    mm_channel_superbuf_remove_node(queue, node);
                     free(super_buf);
                     unmatched_bundles--;
+                    continue;
                 }
                 last_buf_ptr = last_buf_ptr->next;
             }
@@ -2845,9 +3243,7 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                         mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
                     }
                 }
-                queue->que.size--;
-                cam_list_del_node(&node->list);
-                free(node);
+                mm_channel_superbuf_remove_node(queue, node);
                 free(super_buf);
             }
 
@@ -2857,14 +3253,15 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
             cam_node_t* new_node = NULL;
 
             new_buf = (mm_channel_queue_node_t*)malloc(sizeof(mm_channel_queue_node_t));
-            new_node = (cam_node_t*)malloc(sizeof(cam_node_t));
+            new_node = cam_queue_node_get(&queue->que);
             if (NULL != new_buf && NULL != new_node) {
                 memset(new_buf, 0, sizeof(mm_channel_queue_node_t));
-                memset(new_node, 0, sizeof(cam_node_t));
                 new_node->data = (void *)new_buf;
                 new_buf->num_of_bufs = queue->num_streams;
                 new_buf->super_buf[buf_s_idx] = *buf_info;
+                new_buf->stream_mask = (1U << buf_s_idx);
                 new_buf->frame_idx = buf_info->frame_idx;
+                new_buf->node = new_node;
 
                 if (ch_obj->diverted_frame_id == buf_info->frame_idx) {
                     new_buf->expected = TRUE;
@@ -2877,18 +3274,24 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                 } else {
                     cam_list_add_tail_node(&new_node->list, &queue->que.head.list);
                 }
-                queue->que.size++;
+                cam_queue_size_inc(&queue->que);
 
                 if(queue->num_streams == 1) {
                     new_buf->matched = 1;
+                    cam_list_init(&new_buf->unmatched);
+                    MM_CAMERA_TRACE_FRAME("SuperbufMatch", buf_info->frame_idx, 1);
+                    mm_channel_superbuf_stamp_match(new_buf);
                     new_buf->expected = FALSE;
                     queue->expected_frame_id = buf_info->frame_idx + queue->attr.post_frame_skip;
                     queue->match_cnt++;
                     if (ch_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
-                        pthread_mutex_lock(&fs_lock);
-                        mm_frame_sync_add(buf_info->frame_idx, ch_obj);
-                        pthread_mutex_unlock(&fs_lock);
+                        mm_frame_sync_add(buf_info->frame_idx,
+                                mm_frame_sync_buf_ts(buf_info->buf), ch_obj);
                     }
+                } else {
+                    mm_channel_superbuf_track(queue, new_buf, (NULL != insert_before_buf) ?
+                            (mm_channel_queue_node_t *)member_of(insert_before_buf,
+                            cam_node_t, list)->data : NULL);
                 }
 
                 if ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
@@ -2903,7 +3306,7 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                     free(new_buf);
                 }
                 if (NULL != new_node) {
-                    free(new_node);
+                    cam_queue_node_put(&queue->que, new_node);
                 }
                 /* qbuf the new buf since we cannot enqueue */
                 mm_channel_qbuf(ch_obj, buf_info->buf);
@@ -2952,17 +3355,16 @@ mm_channel_queue_node_t* mm_channel_superbuf_dequeue_internal(
         }
         if (NULL != super_buf) {
             /* remove from the queue */
+            mm_channel_superbuf_untrack(queue, super_buf);
             cam_list_del_node(&node->list);
             queue->que.size--;
             if (super_buf->matched == TRUE) {
                 queue->match_cnt--;
                 if (ch_obj->bundle.superbuf_queue.attr.enable_frame_sync) {
-                    pthread_mutex_lock(&fs_lock);
-                    mm_frame_sync_remove(super_buf->frame_idx);
-                    pthread_mutex_unlock(&fs_lock);
+                    mm_frame_sync_remove(super_buf->frame_idx, ch_obj);
                 }
             }
-            free(node);
+            cam_queue_node_put(&queue->que, node);
         }
     }
 
@@ -3009,7 +3411,7 @@ mm_channel_queue_node_t* mm_channel_superbuf_dequeue_frame_internal(
             queue->que.size--;
             queue->match_cnt--;
             CDBG_HIGH("%s: Found match frame %d", __func__, frame_idx);
-            free(node);
+            cam_queue_node_put(&queue->que, node);
             break;
         }
         else {
@@ -3252,22 +3654,118 @@ int32_t mm_channel_superbuf_flush_matched(mm_channel_t* my_obj,
 }
 
 
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_buf_ts
+ *
+ * DESCRIPTION: sensor timestamp of a buffer in ns
+ *
+ * PARAMETERS :
+ *   @buf     : buffer
+ *
+ * RETURN     : timestamp in ns, 0 if not available
+ *==========================================================================*/
+static int64_t mm_frame_sync_buf_ts(mm_camera_buf_def_t *buf)
+{
+    if (NULL == buf) {
+        return 0;
+    }
+    return (int64_t)buf->ts.tv_sec * 1000000000LL + buf->ts.tv_nsec;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_reset
  *
- * DESCRIPTION: Reset Frame sync info
+ * DESCRIPTION: Reset frame nodes and stats of a sync group
+ *
+ * PARAMETERS :
+ *   @fs      : frame sync group
  *
  * RETURN     : None
  *==========================================================================*/
-void mm_frame_sync_reset() {
-    memset(&fs, 0x0, sizeof(fs));
+void mm_frame_sync_reset(mm_channel_frame_sync_info_t *fs) {
+    memset(fs->node, 0x0, sizeof(fs->node));
+    memset(&fs->stats, 0x0, sizeof(fs->stats));
+    fs->seq = 0;
     CDBG("%s: Reset Done", __func__);
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_get
+ *
+ * DESCRIPTION: find the sync group with the given id, create it if not
+ *              present. Called with fs_list_lock held.
+ *
+ * PARAMETERS :
+ *   @sync_id : sync group id
+ *
+ * RETURN     : sync group, NULL if out of memory
+ *==========================================================================*/
+static mm_channel_frame_sync_info_t *mm_frame_sync_get(uint32_t sync_id)
+{
+    mm_channel_frame_sync_info_t *fs = NULL;
+    struct cam_list *pos = NULL;
+    char prop[PROPERTY_VALUE_MAX];
+
+    for (pos = fs_list.next; pos != &fs_list; pos = pos->next) {
+        fs = member_of(pos, mm_channel_frame_sync_info_t, list);
+        if (fs->sync_id == sync_id) {
+            return fs;
+        }
+    }
+
+    fs = (mm_channel_frame_sync_info_t *)malloc(sizeof(*fs));
+    if (NULL == fs) {
+        CDBG_ERROR("%s: No memory for sync group %d", __func__, sync_id);
+        return NULL;
+    }
+    memset(fs, 0x0, sizeof(*fs));
+    fs->sync_id = sync_id;
+    pthread_mutex_init(&fs->lock, NULL);
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.fs.ts_tol_us", prop, "0");
+    fs->ts_tol = (int64_t)atoi(prop) * 1000;
+    if (fs->ts_tol < 0) {
+        fs->ts_tol = 0;
+    }
+    cam_list_add_tail_node(&fs->list, &fs_list);
+    CDBG_HIGH("%s: created sync group %d, ts tolerance %lld ns",
+            __func__, sync_id, (long long)fs->ts_tol);
+    return fs;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_dump_stats
+ *
+ * DESCRIPTION: log match rate and skew stats of a sync group. Called with
+ *              fs->lock held.
+ *
+ * PARAMETERS :
+ *   @fs      : frame sync group
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void mm_frame_sync_dump_stats(mm_channel_frame_sync_info_t *fs)
+{
+    mm_channel_frame_sync_stats_t *stats = &fs->stats;
+    uint32_t total = stats->matched + stats->evicted_unmatched;
+
+    CDBG_HIGH("%s: sync group %d: frames %d matched %d (%d permille) "
+            "delivered %d incomplete %d evicted unmatched %d matched %d",
+            __func__, fs->sync_id, stats->frames, stats->matched,
+            total ? (uint32_t)((uint64_t)stats->matched * 1000 / total) : 0,
+            stats->delivered, stats->incomplete,
+            stats->evicted_unmatched, stats->evicted_matched);
+    CDBG_HIGH("%s: sync group %d: skew us min %d p50 %d p99 %d max %d",
+            __func__, fs->sync_id, stats->skew.min,
+            cam_hist_percentile(&stats->skew, 500),
+            cam_hist_percentile(&stats->skew, 990), stats->skew.max);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_register_channel
  *
- * DESCRIPTION: Register Channel for frame sync
+ * DESCRIPTION: Register Channel for frame sync with the sync group given
+ *              by its frame_sync_id attr
  *
  * PARAMETERS :
  *   @ch_obj  : channel object
@@ -3277,42 +3775,60 @@ void mm_frame_sync_reset() {
  *              -1 -- failure
  *==========================================================================*/
 int32_t mm_frame_sync_register_channel(mm_channel_t *ch_obj) {
+    mm_channel_frame_sync_info_t *fs = NULL;
+    uint8_t i = 0;
+
+    if (!ch_obj || (NULL != ch_obj->frame_sync)) {
+        CDBG_ERROR("%s: DBG_FS Error!! channel %p already registered",
+                __func__, ch_obj);
+        return -1;
+    }
+    pthread_mutex_lock(&fs_list_lock);
+    fs = mm_frame_sync_get(ch_obj->bundle.superbuf_queue.attr.frame_sync_id);
+    if (NULL == fs) {
+        pthread_mutex_unlock(&fs_list_lock);
+        return -1;
+    }
     // Lock frame sync info
-    pthread_mutex_lock(&fs_lock);
-    if ((fs.num_cam >= MAX_NUM_CAMERA_PER_BUNDLE) || (!ch_obj)) {
+    pthread_mutex_lock(&fs->lock);
+    if (fs->num_cam >= MM_CAMERA_FRAME_SYNC_MAX_CAM) {
         CDBG_ERROR("%s: DBG_FS Error!! num cam(%d) is out of range ",
-                __func__, fs.num_cam);
-        pthread_mutex_unlock(&fs_lock);
+                __func__, fs->num_cam);
+        pthread_mutex_unlock(&fs->lock);
+        pthread_mutex_unlock(&fs_list_lock);
         return -1;
     }
-    if (fs.num_cam == 0) {
+    if (fs->num_cam == 0) {
         CDBG_HIGH("%s: First channel registering!!", __func__);
-        mm_frame_sync_reset();
+        mm_frame_sync_reset(fs);
     }
-    uint8_t i = 0;
-    for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-        if (fs.ch_obj[i] == NULL) {
-            fs.ch_obj[i] = ch_obj;
-            fs.cb[i] = ch_obj->bundle.super_buf_notify_cb;
-            fs.num_cam++;
+    for (i = 0; i < MM_CAMERA_FRAME_SYNC_MAX_CAM; i++) {
+        if (fs->ch_obj[i] == NULL) {
+            fs->ch_obj[i] = ch_obj;
+            fs->cb[i] = ch_obj->bundle.super_buf_notify_cb;
+            fs->cam_mask |= (1U << i);
+            fs->num_cam++;
+            fs->gen++;
+            fs->refcnt++;
+            ch_obj->frame_sync = fs;
+            ch_obj->frame_sync_idx = i;
             CDBG("%s: DBG_FS index %d", __func__, i);
             break;
         }
     }
-    if (i >= MAX_NUM_CAMERA_PER_BUNDLE) {
-        CDBG_HIGH("%s: X, DBG_FS Cannot register channel!!", __func__);
-        pthread_mutex_unlock(&fs_lock);
-        return -1;
-    }
-    CDBG_HIGH("%s: num_cam %d ", __func__, fs.num_cam);
-    pthread_mutex_unlock(&fs_lock);
+    CDBG_HIGH("%s: sync group %d num_cam %d ", __func__,
+            fs->sync_id, fs->num_cam);
+    pthread_mutex_unlock(&fs->lock);
+    pthread_mutex_unlock(&fs_list_lock);
     return 0;
 }
 
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_unregister_channel
  *
- * DESCRIPTION: un-register Channel for frame sync
+ * DESCRIPTION: un-register Channel for frame sync. The channel keeps its
+ *              reference to the sync group until mm_frame_sync_put, as
+ *              its bundle threads may still be using it.
  *
  * PARAMETERS :
  *   @ch_obj  : channel object
@@ -3322,37 +3838,169 @@ int32_t mm_frame_sync_register_channel(mm_channel_t *ch_obj) {
  *              -1 -- failure
  *==========================================================================*/
 int32_t mm_frame_sync_unregister_channel(mm_channel_t *ch_obj) {
+    mm_channel_frame_sync_info_t *fs = NULL;
+    mm_channel_sync_node_t *sync_node = NULL;
     uint8_t i = 0;
-    // Lock frame sync info
-    pthread_mutex_lock(&fs_lock);
-    if (!fs.num_cam || !ch_obj) {
+
+    if (!ch_obj || (NULL == ch_obj->frame_sync)) {
         CDBG_HIGH("%s: X, DBG_FS: channel not found  !!", __func__);
-        // Lock frame sync info
-        pthread_mutex_unlock(&fs_lock);
         return -1;
     }
-    for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-        if (fs.ch_obj[i] == ch_obj) {
-            CDBG("%s: found ch_obj at i (%d) ", __func__, i);
-            break;
+    fs = ch_obj->frame_sync;
+    i = ch_obj->frame_sync_idx;
+
+    /* waits for a sync delivery holding this channel's queue */
+    pthread_mutex_lock(&ch_obj->bundle.superbuf_queue.que.lock);
+    pthread_mutex_lock(&fs->lock);
+    if (fs->ch_obj[i] != ch_obj) {
+        CDBG_HIGH("%s: X, DBG_FS: channel already unregistered", __func__);
+        pthread_mutex_unlock(&fs->lock);
+        pthread_mutex_unlock(&ch_obj->bundle.superbuf_queue.que.lock);
+        return -1;
+    }
+    CDBG("%s: remove channel info at %d", __func__, i);
+    fs->ch_obj[i] = NULL;
+    fs->cb[i] = NULL;
+    fs->cam_mask &= ~(1U << i);
+    fs->num_cam--;
+    fs->gen++;
+    for (sync_node = fs->node;
+            sync_node < fs->node + MM_CAMERA_FRAME_SYNC_MAX_NODES; sync_node++) {
+        sync_node->frame_id[i] = 0;
+        sync_node->valid_mask &= ~(1U << i);
+        if (0 == sync_node->valid_mask) {
+            memset(sync_node, 0x00, sizeof(mm_channel_sync_node_t));
         }
     }
-    if (i < MAX_NUM_CAMERA_PER_BUNDLE) {
-        CDBG("%s: remove channel info ", __func__);
-        fs.ch_obj[i] = NULL;
-        fs.cb[i] = NULL;
-        fs.num_cam--;
-    } else {
-        CDBG("%s: DBG_FS Channel not found ", __func__);
+    mm_frame_sync_dump_stats(fs);
+    CDBG_HIGH("%s: X, sync group %d num_cam %d", __func__,
+            fs->sync_id, fs->num_cam);
+    pthread_mutex_unlock(&fs->lock);
+    pthread_mutex_unlock(&ch_obj->bundle.superbuf_queue.que.lock);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_put
+ *
+ * DESCRIPTION: drop the reference of a stopped channel to its sync group,
+ *              the group is freed with its last reference
+ *
+ * PARAMETERS :
+ *   @ch_obj  : channel object
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void mm_frame_sync_put(mm_channel_t *ch_obj) {
+    mm_channel_frame_sync_info_t *fs = ch_obj->frame_sync;
+
+    if (NULL == fs) {
+        return;
     }
-    if (fs.num_cam == 0) {
-        mm_frame_sync_reset();
+    pthread_mutex_lock(&fs_list_lock);
+    ch_obj->frame_sync = NULL;
+    if (0 == --fs->refcnt) {
+        CDBG_HIGH("%s: freeing sync group %d", __func__, fs->sync_id);
+        cam_list_del_node(&fs->list);
+        pthread_mutex_destroy(&fs->lock);
+        free(fs);
     }
-    CDBG_HIGH("%s: X, fs.num_cam %d", __func__, fs.num_cam);
-    pthread_mutex_unlock(&fs_lock);
-    return 0;
+    pthread_mutex_unlock(&fs_list_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_find_node
+ *
+ * DESCRIPTION: Find the sync node a channel frame belongs to. Without a
+ *              timestamp tolerance nodes match on frame idx, otherwise on
+ *              the closest sensor timestamp within tolerance among nodes
+ *              still missing this channel. Called with fs->lock held.
+ *
+ * PARAMETERS :
+ *   @fs       : frame sync group
+ *   @ch_idx   : channel slot
+ *   @frame_id : frame id
+ *   @ts       : sensor timestamp in ns
+ *
+ * RETURN     : node, NULL if none
+ *==========================================================================*/
+static mm_channel_sync_node_t *mm_frame_sync_find_node(
+        mm_channel_frame_sync_info_t *fs, uint8_t ch_idx,
+        uint32_t frame_id, int64_t ts)
+{
+    mm_channel_sync_node_t *sync_node = NULL;
+    mm_channel_sync_node_t *best = NULL;
+    int64_t best_diff = 0;
+    uint8_t i;
+
+    for (i = 0; i < MM_CAMERA_FRAME_SYNC_MAX_NODES; i++) {
+        sync_node = &fs->node[i];
+        if (0 == sync_node->valid_mask) {
+            continue;
+        }
+        if ((0 == fs->ts_tol) || (0 == ts) || (0 == sync_node->ts)) {
+            if (sync_node->frame_idx == frame_id) {
+                return sync_node;
+            }
+        } else if (!(sync_node->valid_mask & (1U << ch_idx))) {
+            int64_t diff = ts - sync_node->ts;
+            if (diff < 0) {
+                diff = -diff;
+            }
+            if ((diff <= fs->ts_tol) && ((NULL == best) || (diff < best_diff))) {
+                best = sync_node;
+                best_diff = diff;
+            }
+        }
+    }
+    return best;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_frame_sync_alloc_node
+ *
+ * DESCRIPTION: Get a node for a new frame, evicting the oldest unmatched
+ *              node, or the oldest matched one if all are matched. Called
+ *              with fs->lock held.
+ *
+ * PARAMETERS :
+ *   @fs       : frame sync group
+ *
+ * RETURN     : cleared node
+ *==========================================================================*/
+static mm_channel_sync_node_t *mm_frame_sync_alloc_node(
+        mm_channel_frame_sync_info_t *fs)
+{
+    mm_channel_sync_node_t *sync_node = NULL;
+    mm_channel_sync_node_t *victim = NULL;
+    uint8_t i;
+
+    for (i = 0; i < MM_CAMERA_FRAME_SYNC_MAX_NODES; i++) {
+        sync_node = &fs->node[i];
+        if (0 == sync_node->valid_mask) {
+            victim = sync_node;
+            break;
+        }
+        if ((NULL == victim) ||
+                (!sync_node->matched && victim->matched) ||
+                ((sync_node->matched == victim->matched) &&
+                 ((int32_t)(sync_node->seq - victim->seq) < 0))) {
+            victim = sync_node;
+        }
+    }
+    if (victim->valid_mask) {
+        if (victim->matched) {
+            fs->stats.evicted_matched++;
+        } else {
+            fs->stats.evicted_unmatched++;
+        }
+        CDBG("%s: evict frame %d matched %d", __func__,
+                victim->frame_idx, victim->matched);
+    }
+    memset(victim, 0x00, sizeof(mm_channel_sync_node_t));
+    victim->seq = fs->seq++;
+    return victim;
+}
 
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_add
@@ -3361,63 +4009,74 @@ int32_t mm_frame_sync_unregister_channel(mm_channel_t *ch_obj) {
  *
  * PARAMETERS :
  *   @frame_id  : frame id to be added
+ *   @ts        : sensor timestamp in ns of the frame
  *   @ch_obj  : channel object
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-int32_t mm_frame_sync_add(uint32_t frame_id, mm_channel_t *ch_obj) {
+int32_t mm_frame_sync_add(uint32_t frame_id, int64_t ts, mm_channel_t *ch_obj) {
+    mm_channel_frame_sync_info_t *fs = NULL;
+    mm_channel_sync_node_t *sync_node = NULL;
+    uint8_t ch_idx;
 
     CDBG("%s: E, frame id %d ch_obj %p", __func__, frame_id, ch_obj);
-    if (!frame_id || !ch_obj) {
+    if (!frame_id || !ch_obj || (NULL == ch_obj->frame_sync)) {
         CDBG_HIGH("%s: X, DBG_FS Error, cannot add sync frame !!", __func__);
         return -1;
     }
+    fs = ch_obj->frame_sync;
+    ch_idx = ch_obj->frame_sync_idx;
 
-    int8_t ch_idx = -1;
-    uint8_t i = 0;
-    for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-        if (fs.ch_obj[i] == ch_obj) {
-            ch_idx = i;
-            CDBG("%s: ch id %d ", __func__, ch_idx);
-            break;
-        }
-    }
-    if (ch_idx < 0) {
-        CDBG_HIGH("%s: X, DBG_FS ch not found!!", __func__);
+    pthread_mutex_lock(&fs->lock);
+    if (fs->ch_obj[ch_idx] != ch_obj) {
+        /* unregistered, waiting for mm_frame_sync_put */
+        pthread_mutex_unlock(&fs->lock);
         return -1;
     }
-    int8_t index = mm_frame_sync_find_frame_index(frame_id);
-    if ((index >= 0) && (index < MM_CAMERA_FRAME_SYNC_NODES)) {
-        fs.node[index].frame_valid[ch_idx] = 1;
-    } else if (index < 0) {
-        if (fs.pos >= MM_CAMERA_FRAME_SYNC_NODES) {
-            fs.pos = 0;
-        }
-        index = fs.pos;
-        memset(&fs.node[index], 0x00, sizeof(mm_channel_sync_node_t));
-        fs.pos++;
-        fs.node[index].frame_idx = frame_id;
-        fs.node[index].frame_valid[ch_idx] = 1;
-        if (fs.num_cam == 1) {
-            CDBG("%s: Single camera frame %d , matched ", __func__, frame_id);
-            fs.node[index].matched = 1;
-        }
-    }
-    uint8_t frames_valid = 0;
-    if (!fs.node[index].matched) {
-        for (i = 0; i < MAX_NUM_CAMERA_PER_BUNDLE; i++) {
-            if (fs.node[index].frame_valid[i]) {
-                frames_valid++;
+    fs->stats.frames++;
+    sync_node = mm_frame_sync_find_node(fs, ch_idx, frame_id, ts);
+    if (NULL == sync_node) {
+        sync_node = mm_frame_sync_alloc_node(fs);
+        sync_node->frame_idx = frame_id;
+        sync_node->ts = ts;
+    }
+    sync_node->frame_id[ch_idx] = frame_id;
+    sync_node->frame_ts[ch_idx] = ts;
+    sync_node->valid_mask |= (1U << ch_idx);
+
+    if (!sync_node->matched &&
+            ((sync_node->valid_mask & fs->cam_mask) == fs->cam_mask)) {
+        int64_t ts_min = 0, ts_max = 0;
+        uint8_t i;
+
+        sync_node->matched = 1;
+        fs->stats.matched++;
+        for (i = 0; i < MM_CAMERA_FRAME_SYNC_MAX_CAM; i++) {
+            if (!(fs->cam_mask & (1U << i))) {
+                continue;
+            }
+            if (0 == sync_node->frame_ts[i]) {
+                ts_max = -1;
+                break;
+            }
+            if ((0 == ts_min) || (sync_node->frame_ts[i] < ts_min)) {
+                ts_min = sync_node->frame_ts[i];
+            }
+            if (sync_node->frame_ts[i] > ts_max) {
+                ts_max = sync_node->frame_ts[i];
             }
         }
-        if (frames_valid == fs.num_cam) {
-            fs.node[index].matched = 1;
-            CDBG("%s: dual camera frame %d , matched ",
-                    __func__, frame_id);
+        if (ts_max >= ts_min) {
+            int64_t skew_us = (ts_max - ts_min) / 1000;
+            cam_hist_record(&fs->stats.skew, (skew_us > CAM_HIST_MAX_VAL) ?
+                    (CAM_HIST_MAX_VAL + 1) : (uint32_t)skew_us);
         }
+        CDBG("%s: frame %d matched in %d cameras",
+                __func__, frame_id, fs->num_cam);
     }
+    pthread_mutex_unlock(&fs->lock);
     return 0;
 }
 
@@ -3427,26 +4086,36 @@ int32_t mm_frame_sync_add(uint32_t frame_id, mm_channel_t *ch_obj) {
  * DESCRIPTION: Remove frame info from frame sync nodes
  *
  * PARAMETERS :
- *   @frame_id  : frame id to be removed
+ *   @frame_id  : frame id of the channel to be removed
+ *   @ch_obj  : channel object
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-int32_t mm_frame_sync_remove(uint32_t frame_id) {
-    int8_t index = -1;
+int32_t mm_frame_sync_remove(uint32_t frame_id, mm_channel_t *ch_obj) {
+    mm_channel_frame_sync_info_t *fs = NULL;
+    uint8_t ch_idx, i;
 
     CDBG("%s: E, frame_id %d", __func__, frame_id);
-    if (!frame_id) {
+    if (!frame_id || !ch_obj || (NULL == ch_obj->frame_sync)) {
         CDBG("%s: X, DBG_FS frame id invalid", __func__);
         return -1;
     }
-
-    index = mm_frame_sync_find_frame_index(frame_id);
-    if ((index >= 0) && (index < MM_CAMERA_FRAME_SYNC_NODES)) {
-        CDBG("%s: Removing sync frame %d", __func__, frame_id);
-        memset(&fs.node[index], 0x00, sizeof(mm_channel_sync_node_t));
+    fs = ch_obj->frame_sync;
+    ch_idx = ch_obj->frame_sync_idx;
+
+    pthread_mutex_lock(&fs->lock);
+    for (i = 0; (fs->ch_obj[ch_idx] == ch_obj) &&
+            (i < MM_CAMERA_FRAME_SYNC_MAX_NODES); i++) {
+        if ((fs->node[i].valid_mask & (1U << ch_idx)) &&
+                (fs->node[i].frame_id[ch_idx] == frame_id)) {
+            CDBG("%s: Removing sync frame %d", __func__, frame_id);
+            memset(&fs->node[i], 0x00, sizeof(mm_channel_sync_node_t));
+            break;
+        }
     }
+    pthread_mutex_unlock(&fs->lock);
     CDBG("%s: X ", __func__);
     return 0;
 }
@@ -3454,113 +4123,104 @@ int32_t mm_frame_sync_remove(uint32_t frame_id) {
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_find_matched
  *
- * DESCRIPTION: Find  a matched sync frame from the node array
+ * DESCRIPTION: Find  a matched sync frame from the node array. Called with
+ *              fs->lock held.
  *
  * PARAMETERS :
+ *   @fs      : frame sync group
  *   @oldest  : If enabled, find oldest matched frame.,
  *                  If not enabled, get the first matched frame found
  *
- * RETURN     : unt32_t type of status
- *              0  -- If no matched frames found
- *              frame index: inf matched frame found
+ * RETURN     : matched node, NULL if no matched frames found
  *==========================================================================*/
-uint32_t mm_frame_sync_find_matched(uint8_t oldest) {
+mm_channel_sync_node_t *mm_frame_sync_find_matched(
+        mm_channel_frame_sync_info_t *fs, uint8_t oldest) {
     CDBG_HIGH("%s: E, oldest %d ", __func__, oldest);
+    mm_channel_sync_node_t *sync_node = NULL;
     uint8_t i = 0;
-    uint32_t frame_idx = 0;
-    uint32_t curr_frame_idx = 0;
-    for (i = 0; i < MM_CAMERA_FRAME_SYNC_NODES; i++) {
-        if (fs.node[i].matched) {
-            curr_frame_idx = fs.node[i].frame_idx;
-            if (!frame_idx) {
-                frame_idx = curr_frame_idx;
+    for (i = 0; i < MM_CAMERA_FRAME_SYNC_MAX_NODES; i++) {
+        if (fs->node[i].matched) {
+            if ((NULL == sync_node) ||
+                    ((int32_t)(fs->node[i].seq - sync_node->seq) < 0)) {
+                sync_node = &fs->node[i];
             }
             if (!oldest) {
                 break;
-            } else if (frame_idx > curr_frame_idx) {
-                frame_idx = curr_frame_idx;
             }
         }
     }
-    CDBG_HIGH("%s: X, oldest %d frame idx %d", __func__, oldest, frame_idx);
-    return frame_idx;
+    CDBG_HIGH("%s: X, oldest %d frame idx %d", __func__, oldest,
+            (NULL != sync_node) ? sync_node->frame_idx : 0);
+    return sync_node;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_frame_sync_find_frame_index
+ * FUNCTION   : mm_frame_sync_lock_queues
  *
- * DESCRIPTION: Find sync frame index if present
+ * DESCRIPTION: Lock the queues of all channels in a sync group, then the
+ *              group itself. Retries if the channel set changed while
+ *              the queues were being locked.
  *
  * PARAMETERS :
- *   @frame_id  : frame id to be searched
+ *   @fs      : frame sync group
  *
- * RETURN     : int8_t type of status
- *              -1  -- If desired frame not found
- *              index: node array index if frame is found
+ * RETURN     : None
  *==========================================================================*/
-int8_t mm_frame_sync_find_frame_index(uint32_t frame_id) {
+void mm_frame_sync_lock_queues(mm_channel_frame_sync_info_t *fs) {
+    mm_channel_t *ch_objs[MM_CAMERA_FRAME_SYNC_MAX_CAM];
+    uint32_t gen;
+    uint8_t j = 0;
 
-    CDBG("%s: E, frame_id %d", __func__, frame_id);
-    int8_t index = -1, i = 0;
-    for (i = 0; i < MM_CAMERA_FRAME_SYNC_NODES; i++) {
-        if (fs.node[i].frame_idx == frame_id) {
-            index = i;
+    CDBG("%s: E ", __func__);
+    for (;;) {
+        pthread_mutex_lock(&fs->lock);
+        gen = fs->gen;
+        memcpy(ch_objs, fs->ch_obj, sizeof(ch_objs));
+        pthread_mutex_unlock(&fs->lock);
+
+        for (j = 0; j < MM_CAMERA_FRAME_SYNC_MAX_CAM; j++) {
+            if (ch_objs[j]) {
+                pthread_mutex_lock(&ch_objs[j]->bundle.superbuf_queue.que.lock);
+            }
+        }
+        pthread_mutex_lock(&fs->lock);
+        if (gen == fs->gen) {
             break;
         }
-    }
-    CDBG("%s: X index :%d", __func__, index);
-    return index;
-}
-
-/*===========================================================================
- * FUNCTION   : mm_frame_sync_lock_queues
- *
- * DESCRIPTION: Lock all channel queues present in node info
- *
- * RETURN     : None
- *==========================================================================*/
-void mm_frame_sync_lock_queues() {
-    uint8_t j = 0;
-    ALOGI("%s: E ", __func__);
-    for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
-        if (fs.ch_obj[j]) {
-            mm_channel_queue_t *ch_queue =
-                    &fs.ch_obj[j]->bundle.superbuf_queue;
-            if (ch_queue) {
-                pthread_mutex_lock(&ch_queue->que.lock);
-                ALOGI("%s: Done locking fs.ch_obj[%d] ", __func__, j);
+        pthread_mutex_unlock(&fs->lock);
+        for (j = 0; j < MM_CAMERA_FRAME_SYNC_MAX_CAM; j++) {
+            if (ch_objs[j]) {
+                pthread_mutex_unlock(&ch_objs[j]->bundle.superbuf_queue.que.lock);
             }
         }
+        CDBG_HIGH("%s: channels changed, retry", __func__);
     }
-    ALOGI("%s: Locking fs ", __func__);
-    pthread_mutex_lock(&fs_lock);
-    ALOGI("%s: X ", __func__);
+    CDBG("%s: X ", __func__);
 }
 
 /*===========================================================================
  * FUNCTION   : mm_frame_sync_unlock_queues
  *
- * DESCRIPTION: Unlock all channel queues
+ * DESCRIPTION: Unlock a sync group and its channel queues
+ *
+ * PARAMETERS :
+ *   @fs      : frame sync group
  *
  * RETURN     : None
  *==========================================================================*/
-void mm_frame_sync_unlock_queues() {
-    // Unlock all queues
+void mm_frame_sync_unlock_queues(mm_channel_frame_sync_info_t *fs) {
+    mm_channel_t *ch_objs[MM_CAMERA_FRAME_SYNC_MAX_CAM];
     uint8_t j = 0;
-    ALOGI("%s: E ", __func__);
-    pthread_mutex_unlock(&fs_lock);
-    ALOGI("%s: Done unlocking fs ", __func__);
-    for (j = 0; j < MAX_NUM_CAMERA_PER_BUNDLE; j++) {
-        if (fs.ch_obj[j]) {
-            mm_channel_queue_t *ch_queue =
-                    &fs.ch_obj[j]->bundle.superbuf_queue;
-            if (ch_queue) {
-                pthread_mutex_unlock(&ch_queue->que.lock);
-                ALOGI("%s: Done unlocking fs.ch_obj[%d] ", __func__, j);
-            }
+
+    CDBG("%s: E ", __func__);
+    memcpy(ch_objs, fs->ch_obj, sizeof(ch_objs));
+    pthread_mutex_unlock(&fs->lock);
+    for (j = 0; j < MM_CAMERA_FRAME_SYNC_MAX_CAM; j++) {
+        if (ch_objs[j]) {
+            pthread_mutex_unlock(&ch_objs[j]->bundle.superbuf_queue.que.lock);
         }
     }
-    ALOGI("%s: X ", __func__);
+    CDBG("%s: X ", __func__);
 }
 
 /*===========================================================================
@@ -39,17 +39,19 @@
 #include <media/msm_cam_sensor.h>
 #include <cutils/properties.h>
 #include <stdlib.h>
+#include <sched.h>
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera_sock.h"
 #include "mm_camera.h"
+#include "mm_camera_trace.h"
 
 static pthread_mutex_t g_intf_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static mm_camera_ctrl_t g_cam_ctrl = {0, {{0}}, {0}, {{0}}, {0}, {0}, {0}};
+static mm_camera_ctrl_t g_cam_ctrl = {0, {{0}}, {{0, 0}}, {{0}}, {0}, {0}, {0}};
+static mm_camera_topology_t g_cam_topo;
 
-static pthread_mutex_t g_handler_lock = PTHREAD_MUTEX_INITIALIZER;
 static uint16_t g_handler_history_count = 0; /* history count for handler */
 volatile uint32_t gMmCameraIntfLogLevel = 1;
 
@@ -90,14 +92,15 @@ nsecs_t getBootToMonoTimeOffset()
 uint32_t mm_camera_util_generate_handler(uint8_t index)
 {
     uint32_t handler = 0;
-    pthread_mutex_lock(&g_handler_lock);
-    g_handler_history_count++;
-    if (0 == g_handler_history_count) {
-        g_handler_history_count++;
-    }
-    handler = g_handler_history_count;
+    uint16_t count;
+
+    /* history count is the generation of the handle, 0 is never used */
+    do {
+        count = __atomic_add_fetch(&g_handler_history_count, 1,
+                __ATOMIC_RELAXED);
+    } while (0 == count);
+    handler = count;
     handler = (handler<<8) | index;
-    pthread_mutex_unlock(&g_handler_lock);
     return handler;
 }
 
@@ -146,7 +149,9 @@ const char *mm_camera_util_get_dev_name(uint32_t cam_handle)
  *   @cam_handle: camera handle
  *
  * RETURN     : ptr to the camera object stored in global variable
- * NOTE       : caller should not free the camera object ptr
+ * NOTE       : caller should not free the camera object ptr. Caller must
+ *              hold g_intf_lock, use mm_camera_util_lock_camera_by_handler
+ *              otherwise
  *==========================================================================*/
 mm_camera_obj_t* mm_camera_util_get_camera_by_handler(uint32_t cam_handle)
 {
@@ -154,10 +159,54 @@ mm_camera_obj_t* mm_camera_util_get_camera_by_handler(uint32_t cam_handle)
     uint8_t cam_idx = mm_camera_util_get_index_by_handler(cam_handle);
 
     if (cam_idx < MM_CAMERA_MAX_NUM_SENSORS &&
-        (NULL != g_cam_ctrl.cam_obj[cam_idx]) &&
-        (cam_handle == g_cam_ctrl.cam_obj[cam_idx]->my_hdl)) {
-        cam_obj = g_cam_ctrl.cam_obj[cam_idx];
+        (NULL != g_cam_ctrl.cam_slot[cam_idx].cam_obj) &&
+        (cam_handle == g_cam_ctrl.cam_slot[cam_idx].cam_obj->my_hdl)) {
+        cam_obj = g_cam_ctrl.cam_slot[cam_idx].cam_obj;
+    }
+    return cam_obj;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_util_lock_camera_by_handler
+ *
+ * DESCRIPTION: utility function to get camera object from camera handle and
+ *              lock its cam_lock, without taking g_intf_lock. The slot's
+ *              readers count keeps the object from being freed until
+ *              cam_lock is taken; the handle is checked again under
+ *              cam_lock since close may have won the race.
+ *
+ * PARAMETERS :
+ *   @cam_handle: camera handle
+ *
+ * RETURN     : ptr to the camera object with cam_lock held, NULL if the
+ *              handle is stale or invalid
+ *==========================================================================*/
+mm_camera_obj_t* mm_camera_util_lock_camera_by_handler(uint32_t cam_handle)
+{
+    mm_camera_obj_t *cam_obj = NULL;
+    mm_camera_hdl_slot_t *slot = NULL;
+    uint8_t cam_idx = mm_camera_util_get_index_by_handler(cam_handle);
+
+    if (cam_idx >= MM_CAMERA_MAX_NUM_SENSORS) {
+        return NULL;
+    }
+    slot = &g_cam_ctrl.cam_slot[cam_idx];
+
+    /* pairs with the slot clear and readers check in close */
+    __atomic_add_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+    cam_obj = __atomic_load_n(&slot->cam_obj, __ATOMIC_SEQ_CST);
+    if ((NULL != cam_obj) &&
+        (cam_handle == __atomic_load_n(&cam_obj->my_hdl, __ATOMIC_ACQUIRE))) {
+        pthread_mutex_lock(&cam_obj->cam_lock);
+        if (cam_handle != cam_obj->my_hdl) {
+            pthread_mutex_unlock(&cam_obj->cam_lock);
+            cam_obj = NULL;
+        }
+    } else {
+        cam_obj = NULL;
     }
+    __atomic_sub_fetch(&slot->readers, 1, __ATOMIC_RELEASE);
+
     return cam_obj;
 }
 
@@ -180,15 +229,10 @@ static int32_t mm_camera_intf_query_capability(uint32_t camera_handle)
 
     CDBG("%s E: camera_handler = %d ", __func__, camera_handle);
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_query_capability(my_obj);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -216,15 +260,10 @@ static int32_t mm_camera_intf_set_parms(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_set_parms(my_obj, parms);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -253,15 +292,10 @@ static int32_t mm_camera_intf_get_parms(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_get_parms(my_obj, parms);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -285,15 +319,10 @@ static int32_t mm_camera_intf_do_auto_focus(uint32_t camera_handle)
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_do_auto_focus(my_obj);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -315,15 +344,10 @@ static int32_t mm_camera_intf_cancel_auto_focus(uint32_t camera_handle)
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_cancel_auto_focus(my_obj);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -347,15 +371,10 @@ static int32_t mm_camera_intf_prepare_snapshot(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_prepare_snapshot(my_obj, do_af_flag);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -377,15 +396,10 @@ static int32_t mm_camera_intf_flush(uint32_t camera_handle)
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_flush(my_obj);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -424,13 +438,23 @@ static int32_t mm_camera_intf_close(uint32_t camera_handle)
         } else {
             /* need close camera here as no other reference
              * first empty g_cam_ctrl's referent to cam_obj */
-            g_cam_ctrl.cam_obj[cam_idx] = NULL;
+            __atomic_store_n(&g_cam_ctrl.cam_slot[cam_idx].cam_obj, NULL,
+                    __ATOMIC_SEQ_CST);
 
             pthread_mutex_lock(&my_obj->cam_lock);
+            /* lookups already past the slot wait on cam_lock and recheck
+             * the handle, clear it before close drops the lock */
+            __atomic_store_n(&my_obj->my_hdl, 0, __ATOMIC_RELEASE);
             pthread_mutex_unlock(&g_intf_lock);
 
             rc = mm_camera_close(my_obj);
 
+            /* those lookups hold a slot reader until they dropped cam_lock */
+            while (0 != __atomic_load_n(&g_cam_ctrl.cam_slot[cam_idx].readers,
+                    __ATOMIC_ACQUIRE)) {
+                sched_yield();
+            }
+
             pthread_mutex_destroy(&my_obj->cam_lock);
             free(my_obj);
         }
@@ -512,15 +536,10 @@ static uint32_t mm_camera_intf_add_channel(uint32_t camera_handle,
     mm_camera_obj_t * my_obj = NULL;
 
     CDBG("%s :E camera_handler = %d", __func__, camera_handle);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         ch_id = mm_camera_add_channel(my_obj, attr, channel_cb, userdata);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X ch_id = %d", __func__, ch_id);
     return ch_id;
@@ -548,15 +567,10 @@ static int32_t mm_camera_intf_del_channel(uint32_t camera_handle,
     mm_camera_obj_t * my_obj = NULL;
 
     CDBG("%s :E ch_id = %d", __func__, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_del_channel(my_obj, ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X", __func__);
     return rc;
@@ -586,15 +600,10 @@ static int32_t mm_camera_intf_get_bundle_info(uint32_t camera_handle,
     mm_camera_obj_t * my_obj = NULL;
 
     CDBG("%s :E ch_id = %d", __func__, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_get_bundle_info(my_obj, ch_id, bundle_info);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X", __func__);
     return rc;
@@ -622,15 +631,10 @@ static int32_t mm_camera_intf_register_event_notify(uint32_t camera_handle,
     mm_camera_obj_t * my_obj = NULL;
 
     CDBG("%s :E ", __func__);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_register_event_notify(my_obj, evt_cb, user_data);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :E rc = %d", __func__, rc);
     return rc;
@@ -657,15 +661,10 @@ static int32_t mm_camera_intf_qbuf(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_qbuf(my_obj, ch_id, buf);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X evt_type = %d",__func__,rc);
     return rc;
@@ -690,20 +689,50 @@ static int32_t mm_camera_intf_get_queued_buf_count(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_get_queued_buf_count(my_obj, ch_id, stream_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X queued buffer count = %d",__func__,rc);
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_intf_get_stream_stats
+ *
+ * DESCRIPTION: returns the latency stats of a stream
+ *
+ * PARAMETERS :
+ *   @camera_handle: camera handle
+ *   @ch_id        : channel handle
+ *   @stream_id    : stream id
+ *   @stats        : stats to be filled
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_intf_get_stream_stats(uint32_t camera_handle,
+        uint32_t ch_id, uint32_t stream_id,
+        mm_camera_stream_stats_t *stats)
+{
+    int32_t rc = -1;
+    mm_camera_obj_t * my_obj = NULL;
+
+    if (NULL == stats) {
+        return rc;
+    }
+
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
+
+    if(my_obj) {
+        rc = mm_camera_get_stream_stats(my_obj, ch_id, stream_id, stats);
+    }
+    CDBG("%s :X rc = %d",__func__,rc);
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_intf_link_stream
  *
@@ -730,15 +759,10 @@ static int32_t mm_camera_intf_link_stream(uint32_t camera_handle,
     CDBG("%s : E handle = %u ch_id = %u",
          __func__, camera_handle, ch_id);
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         id = mm_camera_link_stream(my_obj, ch_id, stream_id, linked_ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
 
     CDBG("%s :X stream_id = %u", __func__, stream_id);
@@ -767,15 +791,10 @@ static uint32_t mm_camera_intf_add_stream(uint32_t camera_handle,
     CDBG("%s : E handle = %d ch_id = %d",
          __func__, camera_handle, ch_id);
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         stream_id = mm_camera_add_stream(my_obj, ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X stream_id = %d", __func__, stream_id);
     return stream_id;
@@ -806,15 +825,10 @@ static int32_t mm_camera_intf_del_stream(uint32_t camera_handle,
     CDBG("%s : E handle = %d ch_id = %d stream_id = %d",
          __func__, camera_handle, ch_id, stream_id);
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_del_stream(my_obj, ch_id, stream_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -846,17 +860,12 @@ static int32_t mm_camera_intf_config_stream(uint32_t camera_handle,
     CDBG("%s :E handle = %d, ch_id = %d,stream_id = %d",
          __func__, camera_handle, ch_id, stream_id);
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     CDBG("%s :mm_camera_intf_config_stream stream_id = %d",__func__,stream_id);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_config_stream(my_obj, ch_id, stream_id, config);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -881,15 +890,10 @@ static int32_t mm_camera_intf_start_channel(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_start_channel(my_obj, ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -914,15 +918,10 @@ static int32_t mm_camera_intf_stop_channel(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_stop_channel(my_obj, ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -951,15 +950,12 @@ static int32_t mm_camera_intf_request_super_buf(uint32_t camera_handle,
          __func__, camera_handle, ch_id);
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    if (buf) {
+        my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
+    }
 
-    if(my_obj && buf) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
+    if(my_obj) {
         rc = mm_camera_request_super_buf (my_obj, ch_id, buf);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -987,15 +983,10 @@ static int32_t mm_camera_intf_cancel_super_buf_request(uint32_t camera_handle,
 
     CDBG("%s :E camera_handler = %d,ch_id = %d",
          __func__, camera_handle, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_cancel_super_buf_request(my_obj, ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -1023,15 +1014,10 @@ static int32_t mm_camera_intf_flush_super_buf_queue(uint32_t camera_handle,
 
     CDBG("%s :E camera_handler = %d,ch_id = %d",
          __func__, camera_handle, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_flush_super_buf_queue(my_obj, ch_id, frame_idx);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -1058,15 +1044,10 @@ static int32_t mm_camera_intf_start_zsl_snapshot(uint32_t camera_handle,
 
     CDBG("%s :E camera_handler = %d,ch_id = %d",
          __func__, camera_handle, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_start_zsl_snapshot_ch(my_obj, ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -1093,15 +1074,10 @@ static int32_t mm_camera_intf_stop_zsl_snapshot(uint32_t camera_handle,
 
     CDBG("%s :E camera_handler = %d,ch_id = %d",
          __func__, camera_handle, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_stop_zsl_snapshot_ch(my_obj, ch_id);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -1130,15 +1106,10 @@ static int32_t mm_camera_intf_configure_notify_mode(uint32_t camera_handle,
 
     CDBG("%s :E camera_handler = %d,ch_id = %d",
          __func__, camera_handle, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_config_channel_notify(my_obj, ch_id, notify_mode);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -1170,15 +1141,10 @@ static int32_t mm_camera_intf_map_buf(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_map_buf(my_obj, buf_type, fd, size);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -1189,15 +1155,10 @@ static int32_t mm_camera_intf_map_bufs(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_map_bufs(my_obj, buf_map_list);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -1224,15 +1185,10 @@ static int32_t mm_camera_intf_unmap_buf(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_unmap_buf(my_obj, buf_type);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -1263,18 +1219,13 @@ static int32_t mm_camera_intf_set_stream_parms(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     CDBG("%s :E camera_handle = %d,ch_id = %d,s_id = %d",
          __func__, camera_handle, ch_id, s_id);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_set_stream_parms(my_obj, ch_id, s_id, parms);
-    }else{
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s :X rc = %d", __func__, rc);
     return rc;
@@ -1308,18 +1259,13 @@ static int32_t mm_camera_intf_get_stream_parms(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     CDBG("%s :E camera_handle = %d,ch_id = %d,s_id = %d",
          __func__, camera_handle, ch_id, s_id);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_get_stream_parms(my_obj, ch_id, s_id, parms);
-    }else{
-        pthread_mutex_unlock(&g_intf_lock);
     }
 
     CDBG("%s :X rc = %d", __func__, rc);
@@ -1364,20 +1310,15 @@ static int32_t mm_camera_intf_map_stream_buf(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     CDBG("%s :E camera_handle = %d, ch_id = %d, s_id = %d, buf_idx = %d, plane_idx = %d",
          __func__, camera_handle, ch_id, stream_id, buf_idx, plane_idx);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_map_stream_buf(my_obj, ch_id, stream_id,
                                       buf_type, buf_idx, plane_idx,
                                       fd, size);
-    }else{
-        pthread_mutex_unlock(&g_intf_lock);
     }
 
     CDBG("%s :X rc = %d", __func__, rc);
@@ -1405,18 +1346,13 @@ static int32_t mm_camera_intf_map_stream_bufs(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     CDBG("%s :E camera_handle = %d, ch_id = %d",
          __func__, camera_handle, ch_id);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_map_stream_bufs(my_obj, ch_id, buf_map_list);
-    }else{
-        pthread_mutex_unlock(&g_intf_lock);
     }
 
     CDBG("%s :X rc = %d", __func__, rc);
@@ -1457,19 +1393,14 @@ static int32_t mm_camera_intf_unmap_stream_buf(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     CDBG("%s :E camera_handle = %d, ch_id = %d, s_id = %d, buf_idx = %d, plane_idx = %d",
          __func__, camera_handle, ch_id, stream_id, buf_idx, plane_idx);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_unmap_stream_buf(my_obj, ch_id, stream_id,
                                         buf_type, buf_idx, plane_idx);
-    }else{
-        pthread_mutex_unlock(&g_intf_lock);
     }
 
     CDBG("%s :X rc = %d", __func__, rc);
@@ -1496,15 +1427,10 @@ static int32_t mm_camera_intf_get_session_id(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_get_session_id(my_obj, sessionid);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
@@ -1529,105 +1455,307 @@ static int32_t mm_camera_intf_sync_related_sensors(uint32_t camera_handle,
     int32_t rc = -1;
     mm_camera_obj_t * my_obj = NULL;
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_sync_related_sensors(my_obj, related_cam_info);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return rc;
 }
 
+/* args of a media node probe thread */
+typedef struct {
+    int fd;
+    uint8_t sinit_only; /* sensors not probed yet, only find sensor_init */
+    mm_camera_media_node_t *node;
+} mm_camera_topology_probe_t;
+
 /*===========================================================================
- * FUNCTION   : get_sensor_info
+ * FUNCTION   : mm_camera_topology_probe_node
  *
- * DESCRIPTION: get sensor info like facing(back/front) and mount angle
+ * DESCRIPTION: read device info of one media node and walk its entities
+ *              for what camera enumeration needs. Runs on a probe thread
+ *              per node, so it must only touch its own node entry.
  *
  * PARAMETERS :
+ *   @data : ptr to the mm_camera_topology_probe_t of the node
  *
- * RETURN     :
+ * RETURN     : NULL
  *==========================================================================*/
-void get_sensor_info()
+static void *mm_camera_topology_probe_node(void *data)
 {
-    int rc = 0;
-    int dev_fd = -1;
-    struct media_device_info mdev_info;
-    int num_media_devices = 0;
-    size_t num_cameras = 0;
+    mm_camera_topology_probe_t *probe = (mm_camera_topology_probe_t *)data;
+    mm_camera_media_node_t *node = probe->node;
+    uint32_t num_entities = 1U;
+    uint8_t is_cfg, is_cam;
+
+    memset(node, 0, sizeof(*node));
+    node->rc = ioctl(probe->fd, MEDIA_IOC_DEVICE_INFO, &node->mdev_info);
+    if (node->rc < 0) {
+        CDBG_ERROR("Error: ioctl media_dev failed: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    is_cfg = (strncmp(node->mdev_info.model, MSM_CONFIGURATION_NAME,
+            sizeof(node->mdev_info.model)) == 0);
+    is_cam = (strncmp(node->mdev_info.model, MSM_CAMERA_NAME,
+            sizeof(node->mdev_info.model)) == 0);
+    if (!is_cfg && !is_cam) {
+        return NULL;
+    }
 
-    CDBG("%s : E", __func__);
     while (1) {
+        struct media_entity_desc entity;
+        memset(&entity, 0, sizeof(entity));
+        entity.id = num_entities++;
+        if (ioctl(probe->fd, MEDIA_IOC_ENUM_ENTITIES, &entity) < 0) {
+            CDBG("Done enumerating media entities\n");
+            break;
+        }
+        CDBG("entity name %s type %d group id %d",
+            entity.name, entity.type, entity.group_id);
+        if (is_cam) {
+            if (entity.type == MEDIA_ENT_T_DEVNODE_V4L &&
+                entity.group_id == QCAMERA_VNODE_GROUP_ID) {
+                strlcpy(node->vnode_name, entity.name,
+                        sizeof(node->vnode_name));
+                break;
+            }
+        } else if (entity.type == MEDIA_ENT_T_V4L2_SUBDEV) {
+            if (entity.group_id == MSM_CAMERA_SUBDEV_SENSOR_INIT) {
+                snprintf(node->sinit_name, sizeof(node->sinit_name),
+                        "/dev/%s", entity.name);
+                if (probe->sinit_only) {
+                    break;
+                }
+            } else if (entity.group_id == MSM_CAMERA_SUBDEV_SENSOR &&
+                    node->num_sensors < MM_CAMERA_MAX_NUM_SENSORS) {
+                node->sensor_flags[node->num_sensors++] = entity.flags;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_topology_scan
+ *
+ * DESCRIPTION: probe all /dev/mediaN nodes into the topology. Nodes are
+ *              opened in order to find how many there are, then probed in
+ *              parallel since they are independent.
+ *
+ * PARAMETERS :
+ *   @topo : topology to fill
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_topology_scan(mm_camera_topology_t *topo)
+{
+    int fds[MM_CAMERA_MAX_MEDIA_NODES];
+    pthread_t tids[MM_CAMERA_MAX_MEDIA_NODES];
+    uint8_t started[MM_CAMERA_MAX_MEDIA_NODES];
+    mm_camera_topology_probe_t probes[MM_CAMERA_MAX_MEDIA_NODES];
+    int i, num_nodes = 0;
+
+    while (num_nodes < MM_CAMERA_MAX_MEDIA_NODES) {
         char dev_name[32];
-        snprintf(dev_name, sizeof(dev_name), "/dev/media%d", num_media_devices);
-        dev_fd = open(dev_name, O_RDWR | O_NONBLOCK);
-        if (dev_fd < 0) {
-            CDBG("Done discovering media devices\n");
+        snprintf(dev_name, sizeof(dev_name), "/dev/media%d", num_nodes);
+        fds[num_nodes] = open(dev_name, O_RDWR | O_NONBLOCK);
+        if (fds[num_nodes] < 0) {
+            CDBG("Done discovering media devices: %s\n", strerror(errno));
             break;
         }
-        num_media_devices++;
-        memset(&mdev_info, 0, sizeof(mdev_info));
-        rc = ioctl(dev_fd, MEDIA_IOC_DEVICE_INFO, &mdev_info);
-        if (rc < 0) {
-            CDBG_ERROR("Error: ioctl media_dev failed: %s\n", strerror(errno));
+        num_nodes++;
+    }
+
+    /* probe the first node on this thread, the rest on probe threads */
+    for (i = 0; i < num_nodes; i++) {
+        probes[i].fd = fds[i];
+        probes[i].sinit_only = !topo->probe_done;
+        probes[i].node = &topo->node[i];
+        started[i] = (i > 0) && (0 == pthread_create(&tids[i], NULL,
+                mm_camera_topology_probe_node, &probes[i]));
+    }
+    for (i = 0; i < num_nodes; i++) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        } else {
+            mm_camera_topology_probe_node(&probes[i]);
+        }
+        close(fds[i]);
+    }
+    topo->num_nodes = num_nodes;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_topology_build
+ *
+ * DESCRIPTION: build the sensor topology from scratch. Sensor probing has
+ *              to finish before the camera nodes and sensor entities are
+ *              complete, so the nodes are scanned again after waiting on
+ *              sensor_init unless the wait was already done.
+ *
+ * PARAMETERS :
+ *   @topo : topology to build
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- no sensor_init subdev found
+ *==========================================================================*/
+static int32_t mm_camera_topology_build(mm_camera_topology_t *topo)
+{
+    int i;
+    int32_t sd_fd = -1;
+    char *subdev_name = NULL;
+    struct sensor_init_cfg_data cfg;
+
+    topo->valid = 0;
+    mm_camera_topology_scan(topo);
+    if (topo->probe_done) {
+        topo->valid = 1;
+        return 0;
+    }
+
+    for (i = 0; i < topo->num_nodes; i++) {
+        if (topo->node[i].sinit_name[0] != '\0') {
+            subdev_name = topo->node[i].sinit_name;
+        }
+    }
+    if (NULL == subdev_name) {
+        CDBG_ERROR("Open sensor_init subdev failed");
+        return -1;
+    }
+
+    /* Open sensor_init subdev */
+    sd_fd = open(subdev_name, O_RDWR);
+    if (sd_fd < 0) {
+        CDBG_ERROR("Open sensor_init subdev failed");
+        return -1;
+    }
+
+    cfg.cfgtype = CFG_SINIT_PROBE_WAIT_DONE;
+    cfg.cfg.setting = NULL;
+    if (ioctl(sd_fd, VIDIOC_MSM_SENSOR_INIT_CFG, &cfg) < 0) {
+        CDBG_ERROR("failed");
+    }
+    close(sd_fd);
+    topo->probe_done = 1;
+
+    mm_camera_topology_scan(topo);
+    topo->valid = 1;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_topology_validate
+ *
+ * DESCRIPTION: check the cached topology is still current. Costs one open
+ *              and one MEDIA_IOC_DEVICE_INFO per node instead of a full
+ *              entity walk.
+ *
+ * PARAMETERS :
+ *   @topo : topology to check
+ *
+ * RETURN     : TRUE if the cached topology can be used
+ *==========================================================================*/
+static uint8_t mm_camera_topology_validate(mm_camera_topology_t *topo)
+{
+    int i, dev_fd;
+    char dev_name[32];
+    struct media_device_info mdev_info;
+    uint8_t match = TRUE;
+
+    if (!topo->valid) {
+        return FALSE;
+    }
+
+    for (i = 0; (i <= topo->num_nodes) && match; i++) {
+        snprintf(dev_name, sizeof(dev_name), "/dev/media%d", i);
+        dev_fd = open(dev_name, O_RDWR | O_NONBLOCK);
+        if (i == topo->num_nodes) {
+            /* a node was added */
+            match = (dev_fd < 0) || (i == MM_CAMERA_MAX_MEDIA_NODES);
+        } else if (dev_fd < 0) {
+            match = FALSE;
+        } else if (topo->node[i].rc >= 0) {
+            memset(&mdev_info, 0, sizeof(mdev_info));
+            match = (ioctl(dev_fd, MEDIA_IOC_DEVICE_INFO, &mdev_info) >= 0) &&
+                    (memcmp(&mdev_info, &topo->node[i].mdev_info,
+                            sizeof(mdev_info)) == 0);
+        }
+        if (dev_fd >= 0) {
             close(dev_fd);
-            dev_fd = -1;
+        }
+    }
+    if (!match) {
+        CDBG_HIGH("%s: media topology changed, rescanning", __func__);
+    }
+    return match;
+}
+
+/*===========================================================================
+ * FUNCTION   : get_sensor_info
+ *
+ * DESCRIPTION: get camera nodes and sensor info like facing(back/front) and
+ *              mount angle from the sensor topology
+ *
+ * PARAMETERS :
+ *   @topo : sensor topology
+ *
+ * RETURN     :
+ *==========================================================================*/
+void get_sensor_info(mm_camera_topology_t *topo)
+{
+    int i;
+    uint8_t j;
+    int8_t num_cameras = 0;
+    size_t num_sensors = 0;
+
+    CDBG("%s : E", __func__);
+    for (i = 0; i < topo->num_nodes; i++) {
+        mm_camera_media_node_t *node = &topo->node[i];
+        if (node->rc < 0) {
             num_cameras = 0;
             break;
         }
-
-        if(strncmp(mdev_info.model,  MSM_CONFIGURATION_NAME, sizeof(mdev_info.model)) != 0) {
-            close(dev_fd);
-            dev_fd = -1;
+        if (strncmp(node->mdev_info.model, MSM_CAMERA_NAME,
+                sizeof(node->mdev_info.model)) != 0) {
+            continue;
+        }
+        if (num_cameras >= MM_CAMERA_MAX_NUM_SENSORS) {
             continue;
         }
+        strlcpy(g_cam_ctrl.video_dev_name[num_cameras], node->vnode_name,
+                MM_CAMERA_DEV_NAME_LEN);
+        CDBG("%s: dev_info[id=%d,name='%s']\n",
+            __func__, (int)num_cameras, g_cam_ctrl.video_dev_name[num_cameras]);
+        num_cameras++;
+    }
+    g_cam_ctrl.num_cam = num_cameras;
 
-        unsigned int num_entities = 1;
-        while (1) {
-            struct media_entity_desc entity;
-            uint32_t temp;
-            uint32_t mount_angle;
-            uint32_t facing;
-            int32_t type = 0;
-            uint8_t is_yuv;
-
-            memset(&entity, 0, sizeof(entity));
-            entity.id = num_entities++;
-            rc = ioctl(dev_fd, MEDIA_IOC_ENUM_ENTITIES, &entity);
-            if (rc < 0) {
-                CDBG("Done enumerating media entities\n");
-                rc = 0;
-                break;
-            }
-            if(entity.type == MEDIA_ENT_T_V4L2_SUBDEV &&
-                entity.group_id == MSM_CAMERA_SUBDEV_SENSOR) {
-                temp = entity.flags >> 8;
-                mount_angle = (temp & 0xFF) * 90;
-                facing = (temp & 0xFF00) >> 8;
-                type = ((entity.flags & CAM_SENSOR_TYPE_MASK) ?
-                        CAM_TYPE_AUX:CAM_TYPE_MAIN);
-                is_yuv = ((entity.flags & CAM_SENSOR_FORMAT_MASK) ?
-                        CAM_SENSOR_YUV:CAM_SENSOR_RAW);
-                ALOGI("index = %u flag = %x mount_angle = %u "
-                        "facing = %u type: %u is_yuv = %u\n",
-                        (unsigned int)num_cameras, (unsigned int)temp,
-                        (unsigned int)mount_angle, (unsigned int)facing,
-                        (unsigned int)type, (uint8_t)is_yuv);
-                g_cam_ctrl.info[num_cameras].facing = (int)facing;
-                g_cam_ctrl.info[num_cameras].orientation = (int)mount_angle;
-                g_cam_ctrl.cam_type[num_cameras] = type;
-                g_cam_ctrl.is_yuv[num_cameras] = is_yuv;
-                CDBG("%s: dev_info[id=%zu,name='%s']\n",
-                        __func__, num_cameras, g_cam_ctrl.video_dev_name[num_cameras]);
-                num_cameras++;
-                continue;
-            }
+    for (i = 0; i < topo->num_nodes; i++) {
+        mm_camera_media_node_t *node = &topo->node[i];
+        for (j = 0; (j < node->num_sensors) &&
+                (num_sensors < MM_CAMERA_MAX_NUM_SENSORS); j++) {
+            uint32_t flags = node->sensor_flags[j];
+            uint32_t temp = flags >> 8;
+            uint32_t mount_angle = (temp & 0xFF) * 90;
+            uint32_t facing = (temp & 0xFF00) >> 8;
+            int32_t type = ((flags & CAM_SENSOR_TYPE_MASK) ?
+                    CAM_TYPE_AUX:CAM_TYPE_MAIN);
+            uint8_t is_yuv = ((flags & CAM_SENSOR_FORMAT_MASK) ?
+                    CAM_SENSOR_YUV:CAM_SENSOR_RAW);
+            ALOGI("index = %u flag = %x mount_angle = %u "
+                    "facing = %u type: %u is_yuv = %u\n",
+                    (unsigned int)num_sensors, (unsigned int)temp,
+                    (unsigned int)mount_angle, (unsigned int)facing,
+                    (unsigned int)type, (uint8_t)is_yuv);
+            g_cam_ctrl.info[num_sensors].facing = (int)facing;
+            g_cam_ctrl.info[num_sensors].orientation = (int)mount_angle;
+            g_cam_ctrl.cam_type[num_sensors] = type;
+            g_cam_ctrl.is_yuv[num_sensors] = is_yuv;
+            num_sensors++;
         }
-        close(dev_fd);
-        dev_fd = -1;
     }
 
     CDBG("%s: num_cameras=%d\n", __func__, g_cam_ctrl.num_cam);
@@ -1769,16 +1897,10 @@ void sort_camera_info(int num_cam)
  *==========================================================================*/
 uint8_t get_num_of_cameras()
 {
-    int rc = 0;
-    int dev_fd = -1;
-    struct media_device_info mdev_info;
-    int num_media_devices = 0;
-    int8_t num_cameras = 0;
-    char subdev_name[32];
-    int32_t sd_fd = -1;
-    struct sensor_init_cfg_data cfg;
     char prop[PROPERTY_VALUE_MAX];
     uint32_t globalLogLevel = 0;
+    nsecs_t start;
+    uint8_t warm;
 
     property_get("persist.camera.hal.debug", prop, "0");
     int val = atoi(prop);
@@ -1795,6 +1917,8 @@ uint8_t get_num_of_cameras()
     if (gMmCameraIntfLogLevel < globalLogLevel)
         gMmCameraIntfLogLevel = globalLogLevel;
 
+    mm_camera_trace_update_level();
+
     CDBG("%s : E", __func__);
 
     property_get("vold.decrypt", prop, "0");
@@ -1805,126 +1929,19 @@ uint8_t get_num_of_cameras()
     /* lock the mutex */
     pthread_mutex_lock(&g_intf_lock);
 
-    while (1) {
-        uint32_t num_entities = 1U;
-        char dev_name[32];
-
-        snprintf(dev_name, sizeof(dev_name), "/dev/media%d", num_media_devices);
-        dev_fd = open(dev_name, O_RDWR | O_NONBLOCK);
-        if (dev_fd < 0) {
-            CDBG("Done discovering media devices\n");
-            break;
-        }
-        num_media_devices++;
-        rc = ioctl(dev_fd, MEDIA_IOC_DEVICE_INFO, &mdev_info);
-        if (rc < 0) {
-            CDBG_ERROR("Error: ioctl media_dev failed: %s\n", strerror(errno));
-            close(dev_fd);
-            dev_fd = -1;
-            break;
-        }
-
-        if (strncmp(mdev_info.model, MSM_CONFIGURATION_NAME,
-          sizeof(mdev_info.model)) != 0) {
-            close(dev_fd);
-            dev_fd = -1;
-            continue;
-        }
-
-        while (1) {
-            struct media_entity_desc entity;
-            memset(&entity, 0, sizeof(entity));
-            entity.id = num_entities++;
-            CDBG("entity id %d", entity.id);
-            rc = ioctl(dev_fd, MEDIA_IOC_ENUM_ENTITIES, &entity);
-            if (rc < 0) {
-                CDBG("Done enumerating media entities");
-                rc = 0;
-                break;
-            }
-            CDBG("entity name %s type %d group id %d",
-                entity.name, entity.type, entity.group_id);
-            if (entity.type == MEDIA_ENT_T_V4L2_SUBDEV &&
-                entity.group_id == MSM_CAMERA_SUBDEV_SENSOR_INIT) {
-                snprintf(subdev_name, sizeof(dev_name), "/dev/%s", entity.name);
-                break;
-            }
-        }
-        close(dev_fd);
-        dev_fd = -1;
-    }
-
-    /* Open sensor_init subdev */
-    sd_fd = open(subdev_name, O_RDWR);
-    if (sd_fd < 0) {
-        CDBG_ERROR("Open sensor_init subdev failed");
+    property_get("persist.camera.topo.cache", prop, "1");
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    warm = (atoi(prop) != 0) && mm_camera_topology_validate(&g_cam_topo);
+    if (!warm && (0 != mm_camera_topology_build(&g_cam_topo))) {
+        pthread_mutex_unlock(&g_intf_lock);
         return FALSE;
     }
+    ALOGI("%s: sensor topology %s in %lld us, %d media nodes", __func__,
+            warm ? "validated" : "scanned",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000),
+            g_cam_topo.num_nodes);
 
-    cfg.cfgtype = CFG_SINIT_PROBE_WAIT_DONE;
-    cfg.cfg.setting = NULL;
-    if (ioctl(sd_fd, VIDIOC_MSM_SENSOR_INIT_CFG, &cfg) < 0) {
-        CDBG_ERROR("failed");
-    }
-    close(sd_fd);
-    dev_fd = -1;
-
-
-    num_media_devices = 0;
-    while (1) {
-        uint32_t num_entities = 1U;
-        char dev_name[32];
-
-        snprintf(dev_name, sizeof(dev_name), "/dev/media%d", num_media_devices);
-        dev_fd = open(dev_name, O_RDWR | O_NONBLOCK);
-        if (dev_fd < 0) {
-            CDBG("Done discovering media devices: %s\n", strerror(errno));
-            break;
-        }
-        num_media_devices++;
-        memset(&mdev_info, 0, sizeof(mdev_info));
-        rc = ioctl(dev_fd, MEDIA_IOC_DEVICE_INFO, &mdev_info);
-        if (rc < 0) {
-            CDBG_ERROR("Error: ioctl media_dev failed: %s\n", strerror(errno));
-            close(dev_fd);
-            dev_fd = -1;
-            num_cameras = 0;
-            break;
-        }
-
-        if(strncmp(mdev_info.model, MSM_CAMERA_NAME, sizeof(mdev_info.model)) != 0) {
-            close(dev_fd);
-            dev_fd = -1;
-            continue;
-        }
-
-        while (1) {
-            struct media_entity_desc entity;
-            memset(&entity, 0, sizeof(entity));
-            entity.id = num_entities++;
-            rc = ioctl(dev_fd, MEDIA_IOC_ENUM_ENTITIES, &entity);
-            if (rc < 0) {
-                CDBG("Done enumerating media entities\n");
-                rc = 0;
-                break;
-            }
-            if(entity.type == MEDIA_ENT_T_DEVNODE_V4L && entity.group_id == QCAMERA_VNODE_GROUP_ID) {
-                strlcpy(g_cam_ctrl.video_dev_name[num_cameras],
-                     entity.name, sizeof(entity.name));
-                break;
-            }
-        }
-
-        CDBG("%s: dev_info[id=%d,name='%s']\n",
-            __func__, (int)num_cameras, g_cam_ctrl.video_dev_name[num_cameras]);
-
-        num_cameras++;
-        close(dev_fd);
-        dev_fd = -1;
-    }
-    g_cam_ctrl.num_cam = num_cameras;
-
-    get_sensor_info();
+    get_sensor_info(&g_cam_topo);
     sort_camera_info(g_cam_ctrl.num_cam);
     /* unlock the mutex */
     pthread_mutex_unlock(&g_intf_lock);
@@ -1957,16 +1974,11 @@ static int32_t mm_camera_intf_process_advanced_capture(uint32_t camera_handle,
 
     CDBG("%s: E camera_handler = %d,ch_id = %d",
          __func__, camera_handle, ch_id);
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_channel_advanced_capture(my_obj, ch_id, type,
                 (uint32_t)trigger, in_value);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     CDBG("%s: X ", __func__);
     return rc;
@@ -1999,16 +2011,11 @@ static int32_t mm_camera_intf_register_stream_buf_cb(uint32_t camera_handle,
     CDBG("%s : E handle = %u ch_id = %u",
          __func__, camera_handle, ch_id);
 
-    pthread_mutex_lock(&g_intf_lock);
-    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+    my_obj = mm_camera_util_lock_camera_by_handler(camera_handle);
 
     if(my_obj) {
-        pthread_mutex_lock(&my_obj->cam_lock);
-        pthread_mutex_unlock(&g_intf_lock);
         rc = mm_camera_reg_stream_buf_cb(my_obj, ch_id, stream_id,
                 buf_cb, cb_type, userdata);
-    } else {
-        pthread_mutex_unlock(&g_intf_lock);
     }
     return (int32_t)rc;
 }
@@ -2064,7 +2071,8 @@ static mm_camera_ops_t mm_camera_ops = {
     .get_session_id = mm_camera_intf_get_session_id,
     .sync_related_sensors = mm_camera_intf_sync_related_sensors,
     .flush = mm_camera_intf_flush,
-    .register_stream_buf_cb = mm_camera_intf_register_stream_buf_cb
+    .register_stream_buf_cb = mm_camera_intf_register_stream_buf_cb,
+    .get_stream_stats = mm_camera_intf_get_stream_stats
 };
 
 /*===========================================================================
@@ -2093,12 +2101,12 @@ int32_t camera_open(uint8_t camera_idx, mm_camera_vtbl_t **camera_vtbl)
 
     pthread_mutex_lock(&g_intf_lock);
     /* opened already */
-    if(NULL != g_cam_ctrl.cam_obj[camera_idx]) {
+    if(NULL != g_cam_ctrl.cam_slot[camera_idx].cam_obj) {
         /* Add reference */
-        g_cam_ctrl.cam_obj[camera_idx]->ref_count++;
+        g_cam_ctrl.cam_slot[camera_idx].cam_obj->ref_count++;
         pthread_mutex_unlock(&g_intf_lock);
         CDBG("%s:  opened alreadyn", __func__);
-        *camera_vtbl = &g_cam_ctrl.cam_obj[camera_idx]->vtbl;
+        *camera_vtbl = &g_cam_ctrl.cam_slot[camera_idx].cam_obj->vtbl;
         return rc;
     }
 
@@ -2129,7 +2137,7 @@ int32_t camera_open(uint8_t camera_idx, mm_camera_vtbl_t **camera_vtbl)
     if (rc != 0) {
         CDBG_ERROR("%s: mm_camera_open err = %d", __func__, rc);
         pthread_mutex_destroy(&cam_obj->cam_lock);
-        g_cam_ctrl.cam_obj[camera_idx] = NULL;
+        g_cam_ctrl.cam_slot[camera_idx].cam_obj = NULL;
         free(cam_obj);
         cam_obj = NULL;
         pthread_mutex_unlock(&g_intf_lock);
@@ -2137,7 +2145,9 @@ int32_t camera_open(uint8_t camera_idx, mm_camera_vtbl_t **camera_vtbl)
         return rc;
     } else {
         CDBG("%s: Open succeded\n", __func__);
-        g_cam_ctrl.cam_obj[camera_idx] = cam_obj;
+        /* publish to lock-free lookups */
+        __atomic_store_n(&g_cam_ctrl.cam_slot[camera_idx].cam_obj, cam_obj,
+                __ATOMIC_RELEASE);
         pthread_mutex_unlock(&g_intf_lock);
         *camera_vtbl = &cam_obj->vtbl;
         return 0;
@@ -42,6 +42,7 @@
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
+#include "mm_camera_trace.h"
 
 /* internal function decalre */
 int32_t mm_stream_qbuf(mm_stream_t *my_obj,
@@ -61,6 +62,7 @@ int32_t mm_stream_get_parm(mm_stream_t *my_obj,
 int32_t mm_stream_do_action(mm_stream_t *my_obj,
                             void *in_value);
 int32_t mm_stream_streamon(mm_stream_t *my_obj);
+int8_t mm_stream_need_wait_for_mapping(mm_stream_t * my_obj);
 int32_t mm_stream_streamoff(mm_stream_t *my_obj);
 int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
                                  mm_camera_buf_info_t* buf_info,
@@ -76,6 +78,14 @@ int32_t mm_stream_reg_buf(mm_stream_t * my_obj);
 int32_t mm_stream_buf_done(mm_stream_t * my_obj,
                            mm_camera_buf_def_t *frame);
 int32_t mm_stream_get_queued_buf_count(mm_stream_t * my_obj);
+static void mm_stream_stats_dq(mm_stream_t *my_obj, mm_camera_buf_def_t *buf);
+static void mm_stream_stats_done(mm_stream_t *my_obj, mm_camera_buf_def_t *buf);
+static uint8_t mm_stream_set_buf_owner(mm_stream_t *my_obj, uint32_t idx,
+                                       uint8_t in_kernel);
+static uint8_t mm_stream_buf_in_kernel(mm_stream_t *my_obj, uint32_t idx);
+static void mm_stream_update_poll_fd(mm_stream_t *my_obj);
+static int32_t mm_stream_stop_poll(mm_stream_t *my_obj);
+static void mm_stream_wait_buf_mapped(mm_stream_t *my_obj, uint32_t idx);
 
 int32_t mm_stream_calc_offset(mm_stream_t *my_obj);
 int32_t mm_stream_calc_offset_default(cam_format_t fmt,
@@ -202,6 +212,16 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
+    /* buf_lock keeps the link stable, ref count itself is atomic. The
+     * linked ref must be taken before the frame reaches either channel,
+     * the bundled one may release its ref and requeue the buffer first */
+    pthread_mutex_lock(&my_obj->buf_lock);
+    if(my_obj->is_linked) {
+        /* need to add into super buf for linking, add ref count */
+        __atomic_add_fetch(&my_obj->buf_status[buf_info->buf->buf_idx].buf_refcnt,
+                1, __ATOMIC_ACQ_REL);
+    }
+
     /* enqueue to super buf thread */
     if (my_obj->is_bundled) {
         rc = mm_stream_notify_channel(my_obj->ch_obj, buf_info);
@@ -210,11 +230,7 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
         }
     }
 
-    pthread_mutex_lock(&my_obj->buf_lock);
     if(my_obj->is_linked) {
-        /* need to add into super buf for linking, add ref count */
-        my_obj->buf_status[buf_info->buf->buf_idx].buf_refcnt++;
-
         rc = mm_stream_notify_channel(my_obj->linked_obj, buf_info);
         if (rc < 0) {
             CDBG_ERROR("%s: Unable to notify channel", __func__);
@@ -302,7 +318,7 @@ static void mm_stream_data_notify(void* user_data)
 {
     mm_stream_t *my_obj = (mm_stream_t*)user_data;
     int32_t i, rc;
-    uint8_t has_cb = 0, length = 0;
+    uint8_t has_cb = 0, length = 0, refs;
     mm_camera_buf_info_t buf_info;
 
     if (NULL == my_obj) {
@@ -348,18 +364,17 @@ static void mm_stream_data_notify(void* user_data)
     }
     pthread_mutex_unlock(&my_obj->cb_lock);
 
-    pthread_mutex_lock(&my_obj->buf_lock);
-    /* update buffer location */
-    my_obj->buf_status[idx].in_kernel = 0;
-
-    /* update buf ref count */
+    /* update buf ref count, buffer ownership was already moved to
+     * client on dequeue */
+    refs = has_cb;
     if (my_obj->is_bundled) {
         /* need to add into super buf since bundled, add ref count */
-        my_obj->buf_status[idx].buf_refcnt++;
+        refs++;
+    }
+    if (refs) {
+        __atomic_add_fetch(&my_obj->buf_status[idx].buf_refcnt, refs,
+                __ATOMIC_ACQ_REL);
     }
-    my_obj->buf_status[idx].buf_refcnt =
-        (uint8_t)(my_obj->buf_status[idx].buf_refcnt + has_cb);
-    pthread_mutex_unlock(&my_obj->buf_lock);
 
     mm_stream_handle_rcvd_buf(my_obj, &buf_info, has_cb);
 }
@@ -413,9 +428,9 @@ static void mm_stream_dispatch_app_data(mm_camera_cmdcb_t *cmd_cb,
                  * both case we need to call CB */
 
                 /* increase buf ref cnt */
-                pthread_mutex_lock(&my_obj->buf_lock);
-                my_obj->buf_status[buf_info->buf->buf_idx].buf_refcnt++;
-                pthread_mutex_unlock(&my_obj->buf_lock);
+                __atomic_add_fetch(
+                        &my_obj->buf_status[buf_info->buf->buf_idx].buf_refcnt,
+                        1, __ATOMIC_ACQ_REL);
 
                 /* callback */
                 my_obj->buf_cb[i].cb(&super_buf,
@@ -813,6 +828,8 @@ int32_t mm_stream_fsm_reg(mm_stream_t * my_obj,
             pthread_mutex_lock(&my_obj->cmd_lock);
             if (has_cb) {
                 snprintf(my_obj->cmd_thread.threadName, THREAD_NAME_SIZE, "CAM_StrmAppData");
+                mm_camera_thread_get_sched(mm_camera_thread_class_for_stream(
+                        my_obj->stream_info->stream_type), &my_obj->cmd_thread.sched);
                 mm_camera_cmd_thread_launch(&my_obj->cmd_thread,
                                             mm_stream_dispatch_app_data,
                                             (void *)my_obj);
@@ -1055,6 +1072,16 @@ int32_t mm_stream_config(mm_stream_t *my_obj,
     my_obj->mem_vtbl = config->mem_vtbl;
     my_obj->padding_info = config->padding_info;
 
+    pthread_mutex_lock(&my_obj->stats_lock);
+    if (NULL == my_obj->stats) {
+        /* stats are optional, stream works without them */
+        my_obj->stats = (mm_stream_stats_t *)calloc(1, sizeof(mm_stream_stats_t));
+        if (NULL == my_obj->stats) {
+            CDBG_ERROR("%s: No memory for stream stats", __func__);
+        }
+    }
+    pthread_mutex_unlock(&my_obj->stats_lock);
+
     if (config->stream_cb_sync != NULL) {
         /* SYNC callback is always placed at index 0*/
         my_obj->buf_cb[cb_index].cb = config->stream_cb_sync;
@@ -1102,9 +1129,19 @@ int32_t mm_stream_release(mm_stream_t *my_obj)
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
+    /* no map acks may reach the stream once it is reset */
+    if ((NULL != my_obj->ch_obj) && (NULL != my_obj->ch_obj->cam_obj)) {
+        mm_camera_util_flush_map_msgs(my_obj->ch_obj->cam_obj);
+    }
+
     pthread_mutex_lock(&my_obj->buf_lock);
     memset(my_obj->buf_status, 0, sizeof(my_obj->buf_status));
+    __atomic_store_n(&my_obj->kernel_mask, 0, __ATOMIC_RELEASE);
     pthread_mutex_unlock(&my_obj->buf_lock);
+    pthread_mutex_lock(&my_obj->stats_lock);
+    free(my_obj->stats);
+    my_obj->stats = NULL;
+    pthread_mutex_unlock(&my_obj->stats_lock);
 
     /* close fd */
     if(my_obj->fd >= 0)
@@ -1115,6 +1152,8 @@ int32_t mm_stream_release(mm_stream_t *my_obj)
     /* destroy mutex */
     pthread_cond_destroy(&my_obj->buf_cond);
     pthread_mutex_destroy(&my_obj->buf_lock);
+    pthread_mutex_destroy(&my_obj->poll_lock);
+    pthread_mutex_destroy(&my_obj->stats_lock);
     pthread_mutex_destroy(&my_obj->cb_lock);
     pthread_mutex_destroy(&my_obj->cmd_lock);
 
@@ -1146,25 +1185,40 @@ int32_t mm_stream_streamon(mm_stream_t *my_obj)
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
+    /* maps may still be held back for coalescing */
+    mm_camera_util_commit_map_msgs(my_obj->ch_obj->cam_obj);
     pthread_mutex_lock(&my_obj->buf_lock);
+    while (mm_stream_need_wait_for_mapping(my_obj)) {
+        CDBG ("%s: waiting for mapping to done: strm fd = %d",
+                __func__, my_obj->fd);
+        pthread_cond_wait(&my_obj->buf_cond, &my_obj->buf_lock);
+    }
     for (i = 0; i < my_obj->buf_num; i++) {
-        if ((!my_obj->buf_status[i].is_mapped) &&
-                (my_obj->buf_status[i].in_kernel)) {
-            CDBG ("%s: waiting for mapping to done: strm fd = %d",
-                    __func__, my_obj->fd);
-            pthread_cond_wait(&my_obj->buf_cond, &my_obj->buf_lock);
-            break;
+        if (mm_stream_buf_in_kernel(my_obj, (uint32_t)i) &&
+                my_obj->buf_status[i].map_failed) {
+            CDBG_ERROR("%s: buf %d queued but not mapped: strm fd = %d",
+                    __func__, i, my_obj->fd);
+            pthread_mutex_unlock(&my_obj->buf_lock);
+            mm_stream_stop_poll(my_obj);
+            return -1;
         }
     }
-
     pthread_mutex_unlock(&my_obj->buf_lock);
 
+    pthread_mutex_lock(&my_obj->stats_lock);
+    if (NULL != my_obj->stats) {
+        /* intervals do not carry over a stream restart */
+        my_obj->stats->prev_sensor_ts = 0;
+        my_obj->stats->prev_interval = 0;
+    }
+    pthread_mutex_unlock(&my_obj->stats_lock);
+
     rc = ioctl(my_obj->fd, VIDIOC_STREAMON, &buf_type);
     if (rc < 0) {
         CDBG_ERROR("%s: ioctl VIDIOC_STREAMON failed: rc=%d\n",
                    __func__, rc);
         /* remove fd from data poll thread in case of failure */
-        mm_camera_poll_thread_del_poll_fd(&my_obj->ch_obj->poll_thread[0], my_obj->my_hdl, mm_camera_sync_call);
+        mm_stream_stop_poll(my_obj);
     }
     CDBG("%s :X rc = %d",__func__,rc);
     return rc;
@@ -1190,12 +1244,11 @@ int32_t mm_stream_streamoff(mm_stream_t *my_obj)
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
     /* step1: remove fd from data poll thread */
-    rc = mm_camera_poll_thread_del_poll_fd(&my_obj->ch_obj->poll_thread[0],
-            my_obj->my_hdl, mm_camera_sync_call);
+    rc = mm_stream_stop_poll(my_obj);
     if (rc < 0) {
         /* The error might be due to async update. In this case
          * wait for all updates to complete before proceeding. */
-        rc = mm_camera_poll_thread_commit_updates(&my_obj->ch_obj->poll_thread[0]);
+        rc = mm_camera_poll_thread_commit_updates(my_obj->poll_thread);
         if (rc < 0) {
             CDBG_ERROR("%s: Poll sync failed %d",
                  __func__, rc);
@@ -1233,13 +1286,14 @@ int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
     struct msm_camera_user_buf_cont_t *cont_buf = NULL;
 
     if (buf->buf_type == CAM_STREAM_BUF_TYPE_USERPTR) {
-        my_obj->buf_status[buf->buf_idx].buf_refcnt--;
-        if (0 == my_obj->buf_status[buf->buf_idx].buf_refcnt) {
+        if (0 == __atomic_sub_fetch(&my_obj->buf_status[buf->buf_idx].buf_refcnt,
+                1, __ATOMIC_ACQ_REL)) {
             cont_buf = (struct msm_camera_user_buf_cont_t *)my_obj->buf[buf->buf_idx].buffer;
             cont_buf->buf_cnt = my_obj->buf[buf->buf_idx].user_buf.bufs_used;
             for (i = 0; i < (int32_t)cont_buf->buf_cnt; i++) {
                 cont_buf->buf_idx[i] = my_obj->buf[buf->buf_idx].user_buf.buf_idx[i];
             }
+            mm_stream_wait_buf_mapped(my_obj, buf->buf_idx);
             rc = mm_stream_qbuf(my_obj, buf);
             if(rc < 0) {
                 CDBG_ERROR("%s: mm_camera_stream_qbuf(idx=%d) err=%d\n",
@@ -1248,7 +1302,6 @@ int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
                 for (i = 0; i < (int32_t)cont_buf->buf_cnt; i++) {
                     my_obj->buf[buf->buf_idx].user_buf.buf_idx[i] = -1;
                 }
-                my_obj->buf_status[buf->buf_idx].in_kernel = 1;
                 my_obj->buf[buf->buf_idx].user_buf.buf_in_use = 1;
             }
         } else {
@@ -1261,7 +1314,7 @@ int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
     if ((my_obj->cur_buf_idx < 0)
             || (my_obj->cur_buf_idx >= my_obj->buf_num)) {
         for (i = 0; i < my_obj->buf_num; i++) {
-            if ((my_obj->buf_status[i].in_kernel)
+            if (mm_stream_buf_in_kernel(my_obj, (uint32_t)i)
                     || (my_obj->buf[i].user_buf.buf_in_use)) {
                 continue;
             }
@@ -1290,13 +1343,14 @@ int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
 
     if (my_obj->cur_bufs_staged
             == my_obj->buf[index].user_buf.bufs_used){
-        my_obj->buf_status[index].buf_refcnt--;
-        if (0 == my_obj->buf_status[index].buf_refcnt) {
+        if (0 == __atomic_sub_fetch(&my_obj->buf_status[index].buf_refcnt,
+                1, __ATOMIC_ACQ_REL)) {
             cont_buf = (struct msm_camera_user_buf_cont_t *)my_obj->buf[index].buffer;
             cont_buf->buf_cnt = my_obj->buf[index].user_buf.bufs_used;
             for (i = 0; i < (int32_t)cont_buf->buf_cnt; i++) {
                 cont_buf->buf_idx[i] = my_obj->buf[index].user_buf.buf_idx[i];
             }
+            mm_stream_wait_buf_mapped(my_obj, (uint32_t)index);
             rc = mm_stream_qbuf(my_obj, &my_obj->buf[index]);
             if(rc < 0) {
                 CDBG_ERROR("%s: mm_camera_stream_qbuf(idx=%d) err=%d\n",
@@ -1305,7 +1359,6 @@ int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
                 for (i = 0; i < (int32_t)cont_buf->buf_cnt; i++) {
                     my_obj->buf[index].user_buf.buf_idx[i] = -1;
                 }
-                my_obj->buf_status[index].in_kernel = 1;
                 my_obj->buf[index].user_buf.buf_in_use = 1;
                 my_obj->cur_bufs_staged = 0;
                 my_obj->cur_buf_idx = -1;
@@ -1361,6 +1414,7 @@ int32_t mm_stream_read_user_buf(mm_stream_t * my_obj,
 
     if (timeStamp <= my_obj->prev_timestamp) {
         CDBG_ERROR("%s: TimeStamp received less than expected", __func__);
+        mm_stream_wait_buf_mapped(my_obj, buf_info->buf->buf_idx);
         mm_stream_qbuf(my_obj, buf_info->buf);
         return rc;
     } else if (my_obj->prev_timestamp == 0
@@ -1438,16 +1492,15 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
     if (0 > rc) {
         CDBG_ERROR("%s: VIDIOC_DQBUF ioctl call failed on stream type %d (rc=%d): %s",
             __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
+    } else if ((vb.index >= CAM_MAX_NUM_BUFS_PER_STREAM) ||
+            !mm_stream_set_buf_owner(my_obj, vb.index, 0)) {
+        CDBG_ERROR("%s: buf %d dequeued but not owned by kernel, stream type %d",
+            __func__, vb.index, my_obj->stream_info->stream_type);
+        rc = -1;
     } else {
-        pthread_mutex_lock(&my_obj->buf_lock);
-        my_obj->queued_buffer_count--;
-        if (0 == my_obj->queued_buffer_count) {
-            CDBG_HIGH("%s: Stoping poll on stream %p type: %d", __func__,
-                my_obj, my_obj->stream_info->stream_type);
-            mm_camera_poll_thread_del_poll_fd(&my_obj->ch_obj->poll_thread[0],
-                my_obj->my_hdl, mm_camera_async_call);
-            CDBG_HIGH("%s: Stopped poll on stream %p type: %d", __func__,
-                my_obj, my_obj->stream_info->stream_type);
+        if (0 == __atomic_sub_fetch(&my_obj->queued_buffer_count, 1,
+                __ATOMIC_ACQ_REL)) {
+            mm_stream_update_poll_fd(my_obj);
         }
         uint32_t idx = vb.index;
         buf_info->buf = &my_obj->buf[idx];
@@ -1459,20 +1512,28 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
         buf_info->buf->frame_idx = vb.sequence;
         buf_info->buf->ts.tv_sec  = vb.timestamp.tv_sec;
         buf_info->buf->ts.tv_nsec = vb.timestamp.tv_usec * 1000;
+        MM_CAMERA_TRACE_FRAME("DQBUF", vb.sequence,
+                my_obj->stream_info->stream_type);
 
         CDBG_HIGH("%s: VIDIOC_DQBUF buf_index %d, frame_idx %d, stream type %d, rc %d,"
                 "queued: %d, buf_type = %d",
             __func__, vb.index, buf_info->buf->frame_idx,
             my_obj->stream_info->stream_type, rc,
-            my_obj->queued_buffer_count, buf_info->buf->buf_type);
+            __atomic_load_n(&my_obj->queued_buffer_count, __ATOMIC_RELAXED),
+            buf_info->buf->buf_type);
 
         buf_info->buf->is_uv_subsampled =
             (vb.reserved == V4L2_PIX_FMT_NV14 || vb.reserved == V4L2_PIX_FMT_NV41);
+        pthread_mutex_lock(&my_obj->stats_lock);
+        mm_stream_stats_dq(my_obj, buf_info->buf);
+        pthread_mutex_unlock(&my_obj->stats_lock);
 
         if(buf_info->buf->buf_type == CAM_STREAM_BUF_TYPE_USERPTR) {
+            /* batch staging state is shared with buf_done */
+            pthread_mutex_lock(&my_obj->buf_lock);
             mm_stream_read_user_buf(my_obj, buf_info);
+            pthread_mutex_unlock(&my_obj->buf_lock);
         }
-        pthread_mutex_unlock(&my_obj->buf_lock);
 
         if ( NULL != my_obj->mem_vtbl.clean_invalidate_buf ) {
             rc = my_obj->mem_vtbl.clean_invalidate_buf(idx,
@@ -1623,12 +1684,26 @@ int32_t mm_stream_qbuf(mm_stream_t *my_obj, mm_camera_buf_def_t *buf)
 {
     int32_t rc = 0;
     uint32_t length = 0;
+    uint32_t frame_idx;
+    cam_stream_buf_type buf_type;
     struct v4l2_buffer buffer;
     struct v4l2_plane planes[VIDEO_MAX_PLANES];
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d, stream type = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state,
          my_obj->stream_info->stream_type);
 
+    if (buf->buf_idx >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        CDBG_ERROR("%s: Invalid buf index %d", __func__, buf->buf_idx);
+        return -1;
+    }
+    /* hand the buffer to kernel before QBUF, it may be dequeued by the poll
+     * thread before the ioctl even returns */
+    if (mm_stream_set_buf_owner(my_obj, buf->buf_idx, 1)) {
+        CDBG_ERROR("%s: buf %d already queued on stream type %d",
+                   __func__, buf->buf_idx, my_obj->stream_info->stream_type);
+        return -1;
+    }
+
     if (buf->buf_type == CAM_STREAM_BUF_TYPE_USERPTR) {
         CDBG("%s: USERPTR num_buf = %d, idx = %d", __func__,
                 buf->user_buf.bufs_used, buf->buf_idx);
@@ -1666,54 +1741,182 @@ int32_t mm_stream_qbuf(mm_stream_t *my_obj, mm_camera_buf_def_t *buf)
             CDBG_ERROR("%s: Cache invalidate failed on buffer index: %d",
                        __func__,
                        buffer.index);
+            mm_stream_set_buf_owner(my_obj, buf->buf_idx, 0);
             return rc;
         }
     } else {
         CDBG_ERROR("%s: Cache invalidate op not added", __func__);
     }
 
-    my_obj->queued_buffer_count++;
-    if (1 == my_obj->queued_buffer_count) {
+    if (1 == __atomic_add_fetch(&my_obj->queued_buffer_count, 1,
+            __ATOMIC_ACQ_REL)) {
         /* Add fd to data poll thread */
-        CDBG_HIGH("%s: Starting poll on stream %p type: %d", __func__,
-            my_obj,my_obj->stream_info->stream_type);
-        rc = mm_camera_poll_thread_add_poll_fd(&my_obj->ch_obj->poll_thread[0],
-            my_obj->my_hdl, my_obj->fd, mm_stream_data_notify, (void*)my_obj,
-            mm_camera_async_call);
-        if (0 > rc) {
-            CDBG_ERROR("%s: Add poll on stream %p type: %d fd error (rc=%d)",
-                __func__, my_obj, my_obj->stream_info->stream_type, rc);
-        } else {
-            CDBG_HIGH("%s: Started poll on stream %p type: %d", __func__,
-                my_obj, my_obj->stream_info->stream_type);
-        }
+        mm_stream_update_poll_fd(my_obj);
     }
 
+    /* buf may be dequeued and rewritten as soon as QBUF is issued, keep
+     * what is logged afterwards */
+    frame_idx = buf->frame_idx;
+    buf_type = buf->buf_type;
     rc = ioctl(my_obj->fd, VIDIOC_QBUF, &buffer);
     if (0 > rc) {
         CDBG_ERROR("%s: VIDIOC_QBUF ioctl call failed on stream type %d (rc=%d): %s",
             __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
-        my_obj->queued_buffer_count--;
-        if (0 == my_obj->queued_buffer_count) {
+        mm_stream_set_buf_owner(my_obj, buffer.index, 0);
+        if (0 == __atomic_sub_fetch(&my_obj->queued_buffer_count, 1,
+                __ATOMIC_ACQ_REL)) {
             /* Remove fd from data poll in case of failing
              * first buffer queuing attempt */
-            CDBG_HIGH("%s: Stoping poll on stream %p type: %d", __func__,
-                my_obj, my_obj->stream_info->stream_type);
-            mm_camera_poll_thread_del_poll_fd(&my_obj->ch_obj->poll_thread[0],
-                my_obj->my_hdl, mm_camera_async_call);
-            CDBG_HIGH("%s: Stopped poll on stream %p type: %d", __func__,
-                my_obj, my_obj->stream_info->stream_type);
+            mm_stream_update_poll_fd(my_obj);
         }
     } else {
         CDBG_HIGH("%s: VIDIOC_QBUF buf_index %d, frame_idx %d stream type %d, rc %d,"
                 " queued: %d, buf_type = %d",
-                __func__, buffer.index, buf->frame_idx, my_obj->stream_info->stream_type, rc,
-                my_obj->queued_buffer_count, buf->buf_type);
+                __func__, buffer.index, frame_idx, my_obj->stream_info->stream_type, rc,
+                __atomic_load_n(&my_obj->queued_buffer_count, __ATOMIC_RELAXED),
+                buf_type);
     }
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_set_buf_owner
+ *
+ * DESCRIPTION: move a buffer between kernel and client in the ownership
+ *              bitmap. Lock free, safe from poll and callback threads.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @idx          : buffer index
+ *   @in_kernel    : new owner, kernel(1) or client(0)
+ *
+ * RETURN     : previous owner, kernel(1) or client(0)
+ *==========================================================================*/
+static uint8_t mm_stream_set_buf_owner(mm_stream_t *my_obj, uint32_t idx,
+                                       uint8_t in_kernel)
+{
+    uint64_t bit = 1ULL << idx;
+    uint64_t prev;
+
+    if (in_kernel) {
+        prev = __atomic_fetch_or(&my_obj->kernel_mask, bit, __ATOMIC_ACQ_REL);
+    } else {
+        prev = __atomic_fetch_and(&my_obj->kernel_mask, ~bit, __ATOMIC_ACQ_REL);
+    }
+    return (prev & bit) ? 1 : 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_buf_in_kernel
+ *
+ * DESCRIPTION: check if a buffer is currently owned by kernel
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @idx          : buffer index
+ *
+ * RETURN     : kernel(1) or client(0)
+ *==========================================================================*/
+static uint8_t mm_stream_buf_in_kernel(mm_stream_t *my_obj, uint32_t idx)
+{
+    return (uint8_t)((__atomic_load_n(&my_obj->kernel_mask,
+            __ATOMIC_ACQUIRE) >> idx) & 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_update_poll_fd
+ *
+ * DESCRIPTION: add or remove stream fd to/from data poll thread after the
+ *              queued buffer count went 0->1 or 1->0. The count is re-read
+ *              under poll_lock so racing transitions settle on its latest
+ *              value.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_update_poll_fd(mm_stream_t *my_obj)
+{
+    int32_t rc;
+
+    pthread_mutex_lock(&my_obj->poll_lock);
+    if (0 < __atomic_load_n(&my_obj->queued_buffer_count, __ATOMIC_ACQUIRE)) {
+        if (!my_obj->poll_added) {
+            CDBG_HIGH("%s: Starting poll on stream %p type: %d", __func__,
+                my_obj, my_obj->stream_info->stream_type);
+            rc = mm_camera_poll_thread_add_poll_fd(my_obj->poll_thread,
+                my_obj->my_hdl, my_obj->fd, mm_stream_data_notify,
+                (void*)my_obj, mm_camera_async_call);
+            if (0 > rc) {
+                CDBG_ERROR("%s: Add poll on stream %p type: %d fd error (rc=%d)",
+                    __func__, my_obj, my_obj->stream_info->stream_type, rc);
+            } else {
+                my_obj->poll_added = 1;
+                CDBG_HIGH("%s: Started poll on stream %p type: %d", __func__,
+                    my_obj, my_obj->stream_info->stream_type);
+            }
+        }
+    } else if (my_obj->poll_added) {
+        CDBG_HIGH("%s: Stoping poll on stream %p type: %d", __func__,
+            my_obj, my_obj->stream_info->stream_type);
+        mm_camera_poll_thread_del_poll_fd(my_obj->poll_thread,
+            my_obj->my_hdl, mm_camera_async_call);
+        my_obj->poll_added = 0;
+        CDBG_HIGH("%s: Stopped poll on stream %p type: %d", __func__,
+            my_obj, my_obj->stream_info->stream_type);
+    }
+    pthread_mutex_unlock(&my_obj->poll_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_stop_poll
+ *
+ * DESCRIPTION: synchronously remove stream fd from data poll thread.
+ *              poll_lock is not held across the call since the poll thread
+ *              may be waiting for it in mm_stream_update_poll_fd.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_stream_stop_poll(mm_stream_t *my_obj)
+{
+    pthread_mutex_lock(&my_obj->poll_lock);
+    my_obj->poll_added = 0;
+    pthread_mutex_unlock(&my_obj->poll_lock);
+
+    return mm_camera_poll_thread_del_poll_fd(my_obj->poll_thread,
+            my_obj->my_hdl, mm_camera_sync_call);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_wait_buf_mapped
+ *
+ * DESCRIPTION: buffer mapped while streaming, server must have it before it
+ *              gets filled. Called with buf_lock held.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @idx          : buffer index
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_wait_buf_mapped(mm_stream_t *my_obj, uint32_t idx)
+{
+    while ((MM_STREAM_STATE_ACTIVE == my_obj->state) &&
+            (idx < CAM_MAX_NUM_BUFS_PER_STREAM) &&
+            __atomic_load_n(&my_obj->buf_status[idx].map_pending,
+                    __ATOMIC_ACQUIRE)) {
+        CDBG_HIGH("%s: waiting for mapping of buf %d", __func__, idx);
+        pthread_cond_wait(&my_obj->buf_cond, &my_obj->buf_lock);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_request_buf
  *
@@ -1761,7 +1964,9 @@ int32_t mm_stream_request_buf(mm_stream_t * my_obj)
 /*===========================================================================
  * FUNCTION   : mm_stream_need_wait_for_mapping
  *
- * DESCRIPTION: Utility function to determine whether to wait for mapping
+ * DESCRIPTION: Utility function to determine whether to wait for mapping.
+ *              Only buffers already queued to kernel are needed at stream
+ *              on, the others are waited for when queued.
  *
  * PARAMETERS :
  *   @my_obj       : stream object
@@ -1775,7 +1980,8 @@ int8_t mm_stream_need_wait_for_mapping(mm_stream_t * my_obj)
     uint32_t i;
     for (i = 0; i < my_obj->buf_num; i++) {
         if ((!my_obj->buf_status[i].is_mapped)
-                && (my_obj->buf_status[i].in_kernel)) {
+                && (!my_obj->buf_status[i].map_failed)
+                && mm_stream_buf_in_kernel(my_obj, i)) {
             /*do not signal in case if any buffer is not mapped
               but queued to kernel.*/
             return 1;
@@ -1785,6 +1991,69 @@ int8_t mm_stream_need_wait_for_mapping(mm_stream_t * my_obj)
     return 0;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_is_tracked
+ *
+ * DESCRIPTION: check if mapping of a buffer type is tracked in buf_status,
+ *              tracked buffers are mapped asynchronously
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @buf_type     : type of buffer to be mapped
+ *
+ * RETURN     : 1 if tracked, 0 otherwise
+ *==========================================================================*/
+static uint8_t mm_stream_map_is_tracked(mm_stream_t *my_obj, uint8_t buf_type)
+{
+    return (buf_type == CAM_MAPPING_BUF_TYPE_STREAM_BUF)
+            || ((buf_type == CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF)
+            && (my_obj->stream_info != NULL)
+            && (my_obj->stream_info->streaming_mode
+            == CAM_STREAMING_MODE_BATCH));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_map_done
+ *
+ * DESCRIPTION: ack of an async buffer mapping, called on the event poll
+ *              thread. Wakes up stream on or qbuf waiting for the buffers.
+ *
+ * PARAMETERS :
+ *   @status       : 0 if mapped, -1 if mapping failed
+ *   @user_data    : stream object
+ *   @cookie       : bit mask of buffer indices in the mapping msg
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_map_done(int32_t status, void *user_data,
+        uint64_t cookie)
+{
+    mm_stream_t *my_obj = (mm_stream_t *)user_data;
+    mm_stream_buf_status_t *buf_status;
+    uint32_t i;
+
+    pthread_mutex_lock(&my_obj->buf_lock);
+    for (i = 0; i < CAM_MAX_NUM_BUFS_PER_STREAM; i++) {
+        if (!(cookie & (1ULL << i))) {
+            continue;
+        }
+        buf_status = &my_obj->buf_status[i];
+        if (buf_status->map_pending > 0) {
+            __atomic_sub_fetch(&buf_status->map_pending, 1, __ATOMIC_RELEASE);
+        }
+        if (0 != status) {
+            CDBG_ERROR("%s: mapping buf %d of stream %p type %d failed",
+                    __func__, i, my_obj, (NULL != my_obj->stream_info) ?
+                    (int)my_obj->stream_info->stream_type : -1);
+            buf_status->map_failed = 1;
+        } else if ((0 == buf_status->map_pending) && !buf_status->map_failed) {
+            buf_status->is_mapped = 1;
+        }
+    }
+    pthread_cond_broadcast(&my_obj->buf_cond);
+    pthread_mutex_unlock(&my_obj->buf_lock);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_map_buf
  *
@@ -1832,24 +2101,27 @@ int32_t mm_stream_map_buf(mm_stream_t * my_obj,
     packet.payload.buf_map.stream_id = my_obj->server_stream_id;
     packet.payload.buf_map.frame_idx = frame_idx;
     packet.payload.buf_map.plane_idx = plane_idx;
-    rc = mm_camera_util_sendmsg(my_obj->ch_obj->cam_obj,
-            &packet, sizeof(cam_sock_packet_t), fd);
 
-    if ((buf_type == CAM_MAPPING_BUF_TYPE_STREAM_BUF)
-            || ((buf_type
-            == CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF)
-            && (my_obj->stream_info != NULL)
-            && (my_obj->stream_info->streaming_mode
-            == CAM_STREAMING_MODE_BATCH))) {
+    if (mm_stream_map_is_tracked(my_obj, buf_type) &&
+            (frame_idx < CAM_MAX_NUM_BUFS_PER_STREAM)) {
+        /* stream on or qbuf waits for the ack, see mm_stream_map_done */
         pthread_mutex_lock(&my_obj->buf_lock);
-        my_obj->buf_status[frame_idx].is_mapped = 1;
-        if (mm_stream_need_wait_for_mapping(my_obj) == 0) {
-            CDBG ("%s: Buffer mapping Done: Signal strm fd = %d",
-                    __func__, my_obj->fd);
-            pthread_cond_signal(&my_obj->buf_cond);
-        }
+        my_obj->buf_status[frame_idx].is_mapped = 0;
+        my_obj->buf_status[frame_idx].map_failed = 0;
+        __atomic_add_fetch(&my_obj->buf_status[frame_idx].map_pending, 1,
+                __ATOMIC_RELEASE);
         pthread_mutex_unlock(&my_obj->buf_lock);
+        rc = mm_camera_util_sendmsg_async(my_obj->ch_obj->cam_obj,
+                &packet, sizeof(cam_sock_packet_t), fd,
+                mm_stream_map_done, my_obj, 1ULL << frame_idx);
+        if (0 != rc) {
+            mm_stream_map_done(rc, my_obj, 1ULL << frame_idx);
+        }
+        return rc;
     }
+
+    rc = mm_camera_util_sendmsg(my_obj->ch_obj->cam_obj,
+            &packet, sizeof(cam_sock_packet_t), fd);
     return rc;
 }
 
@@ -1900,28 +2172,33 @@ int32_t mm_stream_map_bufs(mm_stream_t * my_obj,
         sendfds[i] = -1;
     }
 
-    int32_t ret = mm_camera_util_bundled_sendmsg(my_obj->ch_obj->cam_obj,
-            &packet, sizeof(cam_sock_packet_t), sendfds, numbufs);
-    if ((numbufs > 0) && ((buf_map_list->buf_maps[0].type
-            == CAM_MAPPING_BUF_TYPE_STREAM_BUF)
-            || ((buf_map_list->buf_maps[0].type ==
-            CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF)
-            && (my_obj->stream_info != NULL)
-            && (my_obj->stream_info->streaming_mode
-            == CAM_STREAMING_MODE_BATCH)))) {
+    if ((numbufs > 0) &&
+            mm_stream_map_is_tracked(my_obj, buf_map_list->buf_maps[0].type)) {
+        uint64_t cookie = 0;
         pthread_mutex_lock(&my_obj->buf_lock);
         for (i = 0; i < numbufs; i++) {
-           my_obj->buf_status[i].is_mapped = 1;
-        }
-
-        if (mm_stream_need_wait_for_mapping(my_obj) == 0) {
-            CDBG ("%s: Buffer mapping Done: Signal strm fd = %d",
-                    __func__, my_obj->fd);
-            pthread_cond_signal(&my_obj->buf_cond);
+            uint32_t idx = buf_map_list->buf_maps[i].frame_idx;
+            if ((idx < CAM_MAX_NUM_BUFS_PER_STREAM) &&
+                    !(cookie & (1ULL << idx))) {
+                cookie |= 1ULL << idx;
+                my_obj->buf_status[idx].is_mapped = 0;
+                my_obj->buf_status[idx].map_failed = 0;
+                __atomic_add_fetch(&my_obj->buf_status[idx].map_pending, 1,
+                        __ATOMIC_RELEASE);
+            }
         }
         pthread_mutex_unlock(&my_obj->buf_lock);
+        int32_t ret = mm_camera_util_bundled_sendmsg_async(
+                my_obj->ch_obj->cam_obj, &packet, sizeof(cam_sock_packet_t),
+                sendfds, (int)numbufs, mm_stream_map_done, my_obj, cookie);
+        if (0 != ret) {
+            mm_stream_map_done(ret, my_obj, cookie);
+        }
+        return ret;
     }
-    return ret;
+
+    return mm_camera_util_bundled_sendmsg(my_obj->ch_obj->cam_obj,
+            &packet, sizeof(cam_sock_packet_t), sendfds, (int)numbufs);
 }
 
 /*===========================================================================
@@ -2117,23 +2394,29 @@ int32_t mm_stream_reg_buf(mm_stream_t * my_obj)
         return rc;
     }
 
+    pthread_mutex_lock(&my_obj->poll_lock);
+    __atomic_store_n(&my_obj->queued_buffer_count, 0, __ATOMIC_RELEASE);
+    my_obj->poll_added = 0;
+    pthread_mutex_unlock(&my_obj->poll_lock);
+
     pthread_mutex_lock(&my_obj->buf_lock);
-    my_obj->queued_buffer_count = 0;
+    __atomic_store_n(&my_obj->kernel_mask, 0, __ATOMIC_RELEASE);
     for(i = 0; i < my_obj->buf_num; i++){
         /* check if need to qbuf initially */
         if (my_obj->buf_status[i].initial_reg_flag) {
+            /* reset before qbuf, buffer can be dequeued right after it */
+            __atomic_store_n(&my_obj->buf_status[i].buf_refcnt, 0,
+                    __ATOMIC_RELEASE);
             rc = mm_stream_qbuf(my_obj, &my_obj->buf[i]);
             if (rc != 0) {
                 CDBG_ERROR("%s: VIDIOC_QBUF rc = %d\n", __func__, rc);
                 break;
             }
-            my_obj->buf_status[i].buf_refcnt = 0;
-            my_obj->buf_status[i].in_kernel = 1;
         } else {
             /* the buf is held by upper layer, will not queue into kernel.
              * add buf reference count */
-            my_obj->buf_status[i].buf_refcnt = 1;
-            my_obj->buf_status[i].in_kernel = 0;
+            __atomic_store_n(&my_obj->buf_status[i].buf_refcnt, 1,
+                    __ATOMIC_RELEASE);
         }
     }
     pthread_mutex_unlock(&my_obj->buf_lock);
@@ -2174,10 +2457,11 @@ int32_t mm_stream_unreg_buf(mm_stream_t * my_obj)
     pthread_mutex_lock(&my_obj->buf_lock);
     if (NULL != my_obj->buf_status) {
         for(i = 0; i < my_obj->buf_num; i++){
-            my_obj->buf_status[i].buf_refcnt = 0;
-            my_obj->buf_status[i].in_kernel = 0;
+            __atomic_store_n(&my_obj->buf_status[i].buf_refcnt, 0,
+                    __ATOMIC_RELEASE);
         }
     }
+    __atomic_store_n(&my_obj->kernel_mask, 0, __ATOMIC_RELEASE);
     pthread_mutex_unlock(&my_obj->buf_lock);
 
     return rc;
@@ -4155,19 +4439,16 @@ uint32_t mm_stream_calc_lcm(int32_t num1, int32_t num2)
         return num1;
     }
 
-    if (num1 > num2) {
-        lcm = num1;
-    } else {
-        lcm = num2;
-    }
-    temp = lcm;
-
-    while (1) {
-        if (((lcm%num1) == 0) && ((lcm%num2) == 0)) {
-            break;
-        }
-        lcm += temp;
+    /* lcm = num1 / gcd * num2, gcd by Euclid instead of stepping
+     * through multiples of the larger number */
+    lcm = (uint32_t)num1;
+    temp = (uint32_t)num2;
+    while (0 != temp) {
+        uint32_t rem = lcm % temp;
+        lcm = temp;
+        temp = rem;
     }
+    lcm = ((uint32_t)num1 / lcm) * (uint32_t)num2;
     return lcm;
 }
 
@@ -4361,36 +4642,65 @@ int32_t mm_stream_buf_done(mm_stream_t * my_obj,
                            mm_camera_buf_def_t *frame)
 {
     int32_t rc = 0;
+    uint8_t refcnt;
+    uint32_t idx = frame->buf_idx;
+    mm_stream_buf_status_t *buf_status;
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
-    pthread_mutex_lock(&my_obj->buf_lock);
     if (my_obj->stream_info->streaming_mode == CAM_STREAMING_MODE_BATCH) {
+        /* batch staging is shared state, keep it under buf_lock. A queued
+         * batch buffer may wait for a map held back for coalescing */
+        mm_camera_util_commit_map_msgs(my_obj->ch_obj->cam_obj);
+        pthread_mutex_lock(&my_obj->buf_lock);
         rc = mm_stream_write_user_buf(my_obj, frame);
-    } else if(my_obj->buf_status[frame->buf_idx].buf_refcnt == 0) {
-        CDBG("%s: Error Trying to free second time?(idx=%d) count=%d\n",
-                   __func__, frame->buf_idx,
-                   my_obj->buf_status[frame->buf_idx].buf_refcnt);
-        rc = -1;
-    } else {
-        my_obj->buf_status[frame->buf_idx].buf_refcnt--;
-        if (0 == my_obj->buf_status[frame->buf_idx].buf_refcnt) {
-            CDBG("<DEBUG> : Buf done for buffer:%d, stream:%d", frame->buf_idx, frame->stream_type);
-            rc = mm_stream_qbuf(my_obj, frame);
-            if(rc < 0) {
-                CDBG_ERROR("%s: mm_camera_stream_qbuf(idx=%d) err=%d\n",
-                           __func__, frame->buf_idx, rc);
-            } else {
-                my_obj->buf_status[frame->buf_idx].in_kernel = 1;
-            }
-        }else{
-            CDBG("<DEBUG> : Still ref count pending count :%d",
-                 my_obj->buf_status[frame->buf_idx].buf_refcnt);
-            CDBG("<DEBUG> : for buffer:%p:%d",
-                 my_obj, frame->buf_idx);
+        pthread_mutex_unlock(&my_obj->buf_lock);
+        return rc;
+    }
+
+    if (frame->buf_idx >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        CDBG_ERROR("%s: Invalid buf index %d", __func__, idx);
+        return -1;
+    }
+    buf_status = &my_obj->buf_status[idx];
+
+    /* only drop a reference that is actually held, so a second free can
+     * never push the buffer into kernel twice */
+    refcnt = __atomic_load_n(&buf_status->buf_refcnt, __ATOMIC_ACQUIRE);
+    do {
+        if (0 == refcnt) {
+            CDBG("%s: Error Trying to free second time?(idx=%d) count=%d\n",
+                       __func__, idx, refcnt);
+            return -1;
         }
+    } while (!__atomic_compare_exchange_n(&buf_status->buf_refcnt, &refcnt,
+            (uint8_t)(refcnt - 1), 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    if (1 == refcnt) {
+        CDBG("<DEBUG> : Buf done for buffer:%d, stream:%d", idx, frame->stream_type);
+        pthread_mutex_lock(&my_obj->stats_lock);
+        mm_stream_stats_done(my_obj, &my_obj->buf[idx]);
+        pthread_mutex_unlock(&my_obj->stats_lock);
+        MM_CAMERA_TRACE_FRAME("BufDone", frame->frame_idx,
+                frame->stream_type);
+        if (__atomic_load_n(&buf_status->map_pending, __ATOMIC_ACQUIRE)) {
+            mm_camera_util_commit_map_msgs(my_obj->ch_obj->cam_obj);
+            pthread_mutex_lock(&my_obj->buf_lock);
+            mm_stream_wait_buf_mapped(my_obj, idx);
+            pthread_mutex_unlock(&my_obj->buf_lock);
+        }
+        rc = mm_stream_qbuf(my_obj, frame);
+        if(rc < 0) {
+            CDBG_ERROR("%s: mm_camera_stream_qbuf(idx=%d) err=%d\n",
+                       __func__, idx, rc);
+        }
+    }else{
+        /* frame belongs to the other holders now, log the saved index */
+        CDBG("<DEBUG> : Still ref count pending count :%d",
+             refcnt - 1);
+        CDBG("<DEBUG> : for buffer:%p:%d",
+             my_obj, idx);
     }
-    pthread_mutex_unlock(&my_obj->buf_lock);
     return rc;
 }
 
@@ -4410,9 +4720,149 @@ int32_t mm_stream_get_queued_buf_count(mm_stream_t *my_obj)
     int32_t rc = 0;
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
             __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
-    pthread_mutex_lock(&my_obj->buf_lock);
-    rc = my_obj->queued_buffer_count;
-    pthread_mutex_unlock(&my_obj->buf_lock);
+    rc = __atomic_load_n(&my_obj->queued_buffer_count, __ATOMIC_ACQUIRE);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_stats_record
+ *
+ * DESCRIPTION: record a latency in ns into a us histogram, negative
+ *              latencies (clock domain mismatch) are dropped
+ *
+ * PARAMETERS :
+ *   @hist         : histogram
+ *   @lat_ns       : latency in ns
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_stats_record(cam_hist_t *hist, int64_t lat_ns)
+{
+    int64_t lat_us;
+
+    if (lat_ns < 0) {
+        return;
+    }
+    lat_us = lat_ns / 1000;
+    cam_hist_record(hist, (lat_us > CAM_HIST_MAX_VAL) ?
+            (CAM_HIST_MAX_VAL + 1) : (uint32_t)lat_us);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_stats_dq
+ *
+ * DESCRIPTION: stamp a dequeued buffer and update sensor latency, jitter
+ *              and drop stats. Called with stats_lock held.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @buf          : dequeued buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_stats_dq(mm_stream_t *my_obj, mm_camera_buf_def_t *buf)
+{
+    mm_stream_stats_t *stats = my_obj->stats;
+    nsecs_t now = systemTime(SYSTEM_TIME_BOOTTIME);
+    int64_t sensor_ts = (int64_t)buf->ts.tv_sec * 1000000000LL + buf->ts.tv_nsec;
+
+    buf->dq_time = now;
+    buf->match_time = 0;
+    buf->cb_time = 0;
+    buf->consume_time = 0;
+    if (NULL == stats) {
+        return;
+    }
+
+    if ((stats->pub.frames > 0) &&
+            (buf->frame_idx > stats->prev_frame_idx + 1)) {
+        stats->pub.drops += buf->frame_idx - stats->prev_frame_idx - 1;
+    }
+    stats->pub.frames++;
+    stats->prev_frame_idx = buf->frame_idx;
+
+    if (0 == sensor_ts) {
+        return;
+    }
+    mm_stream_stats_record(&stats->pub.hist[MM_CAMERA_LAT_SENSOR_TO_DQ],
+            now - sensor_ts);
+    if ((0 != stats->prev_sensor_ts) && (sensor_ts > stats->prev_sensor_ts)) {
+        int64_t interval = sensor_ts - stats->prev_sensor_ts;
+        if (0 != stats->prev_interval) {
+            int64_t jitter = interval - stats->prev_interval;
+            mm_stream_stats_record(&stats->pub.hist[MM_CAMERA_LAT_JITTER],
+                    (jitter < 0) ? -jitter : jitter);
+        }
+        stats->prev_interval = interval;
+    }
+    stats->prev_sensor_ts = sensor_ts;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_stats_done
+ *
+ * DESCRIPTION: update stage latency stats of a buffer going back to
+ *              kernel. Called with stats_lock held.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @buf          : buffer being queued
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_stream_stats_done(mm_stream_t *my_obj, mm_camera_buf_def_t *buf)
+{
+    mm_stream_stats_t *stats = my_obj->stats;
+    cam_hist_t *hist;
+    int64_t dq_time = buf->dq_time;
+
+    if ((NULL == stats) || (0 == dq_time)) {
+        return;
+    }
+    hist = stats->pub.hist;
+
+    if (0 != buf->match_time) {
+        mm_stream_stats_record(&hist[MM_CAMERA_LAT_DQ_TO_MATCH],
+                buf->match_time - dq_time);
+    }
+    if (0 != buf->cb_time) {
+        mm_stream_stats_record(&hist[MM_CAMERA_LAT_DQ_TO_CB],
+                buf->cb_time - dq_time);
+    }
+    if (0 != buf->consume_time) {
+        mm_stream_stats_record(&hist[MM_CAMERA_LAT_DQ_TO_CONSUME],
+                buf->consume_time - dq_time);
+    }
+    mm_stream_stats_record(&hist[MM_CAMERA_LAT_DQ_TO_DONE],
+            systemTime(SYSTEM_TIME_BOOTTIME) - dq_time);
+    /* initial qbuf and re-queue without dequeue are not counted */
+    buf->dq_time = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_get_stats
+ *
+ * DESCRIPTION: copy out latency stats of a stream
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @stats        : stats to be filled
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_stream_get_stats(mm_stream_t *my_obj,
+        mm_camera_stream_stats_t *stats)
+{
+    int32_t rc = -1;
+
+    pthread_mutex_lock(&my_obj->stats_lock);
+    if (NULL != my_obj->stats) {
+        *stats = my_obj->stats->pub;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&my_obj->stats_lock);
     return rc;
 }
 
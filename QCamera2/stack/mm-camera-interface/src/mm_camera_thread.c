@@ -29,245 +29,303 @@
 
 #include <pthread.h>
 #include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/prctl.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <cam_semaphore.h>
+#include <cutils/properties.h>
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
 
-typedef enum {
-    /* poll entries updated */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED,
-    /* poll entries updated asynchronous */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC,
-    /* commit updates */
-    MM_CAMERA_PIPE_CMD_COMMIT,
-    /* exit */
-    MM_CAMERA_PIPE_CMD_EXIT,
-    /* max count */
-    MM_CAMERA_PIPE_CMD_MAX
-} mm_camera_pipe_cmd_type_t;
-
 typedef enum {
     MM_CAMERA_POLL_TASK_STATE_STOPPED,
     MM_CAMERA_POLL_TASK_STATE_POLL,     /* polling pid in polling state. */
     MM_CAMERA_POLL_TASK_STATE_MAX
 } mm_camera_poll_task_state_type_t;
 
-typedef struct {
-    uint32_t cmd;
-    mm_camera_event_t event;
-} mm_camera_sig_evt_t;
-
-
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig_async
+ * FUNCTION   : mm_camera_poll_set_state
  *
- * DESCRIPTION: Asynchoronous call to send a command through pipe.
+ * DESCRIPTION: set a polling state
  *
  * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
+ *   @poll_cb : ptr to poll thread object
+ *   @state   : polling state (stopped/polling)
  *
- * RETURN     : int32_t type of status
- *              0  -- success
- *              -1 -- failure
+ * RETURN     : none
  *==========================================================================*/
-static int32_t mm_camera_poll_sig_async(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
+static void mm_camera_poll_set_state(mm_camera_poll_thread_t *poll_cb,
+                                     mm_camera_poll_task_state_type_t state)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
+    poll_cb->state = state;
+}
 
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-
-    /* send cmd to worker */
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if (len < 1) {
-        CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
-                (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
-        return 0;
+/*===========================================================================
+ * FUNCTION   : mm_camera_thread_class_for_stream
+ *
+ * DESCRIPTION: scheduling class of the threads serving a stream type.
+ *              Streams feeding display/encoder/3A are latency critical,
+ *              capture streams are throughput bound.
+ *
+ * PARAMETERS :
+ *   @stream_type : stream type
+ *
+ * RETURN     : mm_camera_thread_class_t
+ *==========================================================================*/
+mm_camera_thread_class_t mm_camera_thread_class_for_stream(
+        cam_stream_type_t stream_type)
+{
+    switch (stream_type) {
+    case CAM_STREAM_TYPE_PREVIEW:
+    case CAM_STREAM_TYPE_VIDEO:
+    case CAM_STREAM_TYPE_METADATA:
+    case CAM_STREAM_TYPE_CALLBACK:
+    case CAM_STREAM_TYPE_IMPL_DEFINED:
+        return MM_CAMERA_THREAD_CLASS_RT;
+    case CAM_STREAM_TYPE_POSTVIEW:
+    case CAM_STREAM_TYPE_SNAPSHOT:
+    case CAM_STREAM_TYPE_RAW:
+    case CAM_STREAM_TYPE_OFFLINE_PROC:
+        return MM_CAMERA_THREAD_CLASS_BG;
+    default:
+        return MM_CAMERA_THREAD_CLASS_DEFAULT;
     }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
-    return 0;
 }
 
-
-
+/*===========================================================================
+ * FUNCTION   : mm_camera_thread_get_sched
+ *
+ * DESCRIPTION: fill scheduling parameters of a thread class from properties
+ *              persist.camera.thread.rt.prio : SCHED_FIFO priority of RT
+ *                                              class, 0 keeps SCHED_OTHER
+ *              persist.camera.thread.rt.cpus : cpu mask (hex) of RT class
+ *              persist.camera.thread.bg.cpus : cpu mask (hex) of BG class
+ *
+ * PARAMETERS :
+ *   @cls     : thread class
+ *   @sched   : ptr to scheduling parameters to be filled in
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_thread_get_sched(mm_camera_thread_class_t cls,
+        mm_camera_thread_sched_t *sched)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    int prio;
+
+    memset(sched, 0, sizeof(*sched));
+    sched->cls = cls;
+    sched->policy = SCHED_OTHER;
+
+    switch (cls) {
+    case MM_CAMERA_THREAD_CLASS_RT:
+        property_get("persist.camera.thread.rt.prio", prop, "0");
+        prio = atoi(prop);
+        if ((prio >= sched_get_priority_min(SCHED_FIFO)) &&
+                (prio <= sched_get_priority_max(SCHED_FIFO)) && (prio > 0)) {
+            sched->policy = SCHED_FIFO;
+            sched->priority = prio;
+        }
+        property_get("persist.camera.thread.rt.cpus", prop, "0");
+        sched->cpu_mask = (uint32_t)strtoul(prop, NULL, 16);
+        break;
+    case MM_CAMERA_THREAD_CLASS_BG:
+        property_get("persist.camera.thread.bg.cpus", prop, "0");
+        sched->cpu_mask = (uint32_t)strtoul(prop, NULL, 16);
+        break;
+    default:
+        break;
+    }
+}
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_thread_apply_sched
  *
- * DESCRIPTION: synchorinzed call to send a command through pipe.
+ * DESCRIPTION: apply scheduling policy and cpu affinity to a thread
  *
  * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
+ *   @tid     : kernel thread id, 0 for the calling thread
+ *   @sched   : scheduling parameters
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-static int32_t mm_camera_poll_sig(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
+int32_t mm_camera_thread_apply_sched(pid_t tid,
+        const mm_camera_thread_sched_t *sched)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
+    int32_t rc = 0;
+    struct sched_param param;
+    cpu_set_t cpus;
+    uint32_t cpu;
 
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-    /* send cmd to worker */
-
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if(len < 1) {
-        CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
-                (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
+    if (MM_CAMERA_THREAD_CLASS_DEFAULT == sched->cls) {
         return 0;
     }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    /* wait till worker task gives positive signal */
-    if (FALSE == poll_cb->status) {
-        CDBG("%s: wait", __func__);
-        pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = (SCHED_FIFO == sched->policy) ? sched->priority : 0;
+    if (sched_setscheduler(tid, sched->policy, &param) != 0) {
+        CDBG_ERROR("%s: tid %d policy %d prio %d failed (%s)", __func__,
+                tid, sched->policy, sched->priority, strerror(errno));
+        rc = -1;
     }
-    /* done */
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
-    return 0;
+
+    if (0 != sched->cpu_mask) {
+        CPU_ZERO(&cpus);
+        for (cpu = 0; cpu < 32; cpu++) {
+            if (sched->cpu_mask & (1U << cpu)) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        if (sched_setaffinity(tid, sizeof(cpus), &cpus) != 0) {
+            CDBG_ERROR("%s: tid %d cpu mask 0x%x failed (%s)", __func__,
+                    tid, sched->cpu_mask, strerror(errno));
+            rc = -1;
+        }
+    }
+    return rc;
 }
 
+/* epoll user data of the control eventfd; entries use (gen << 32) | idx */
+#define MM_CAMERA_POLL_EVT_FD_TAG  ((uint64_t)-1)
+#define MM_CAMERA_POLL_MAX_EVENTS  (MAX_STREAM_NUM_IN_BUNDLE + 1)
+/* entries of a global data poll thread, serving every channel of a camera */
+#define MM_CAMERA_POLL_GLOBAL_ENTRIES \
+        (MAX_STREAM_NUM_IN_BUNDLE * MM_CAMERA_CHANNEL_MAX)
+
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_poll_get_idx
  *
- * DESCRIPTION: signal the status of done
+ * DESCRIPTION: map a handler to its poll entry index. Must be called with
+ *              poll_cb->mutex held.
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
+ *   @handler : stream handle if data polling thread,
+ *              0 if event polling thread
+ *   @alloc   : for a global data poll thread, take a free entry if the
+ *              handler has none yet
  *
- * RETURN     : none
+ * RETURN     : entry index, poll_cb->num_entries if not found
  *==========================================================================*/
-static void mm_camera_poll_sig_done(mm_camera_poll_thread_t *poll_cb)
+static uint32_t mm_camera_poll_get_idx(mm_camera_poll_thread_t *poll_cb,
+                                       uint32_t handler,
+                                       uint8_t alloc)
 {
-    pthread_mutex_lock(&poll_cb->mutex);
-    poll_cb->status = TRUE;
-    pthread_cond_signal(&poll_cb->cond_v);
-    CDBG("%s: done, in mutex", __func__);
-    pthread_mutex_unlock(&poll_cb->mutex);
+    uint32_t i, free_idx = poll_cb->num_entries;
+
+    switch (poll_cb->poll_type) {
+    case MM_CAMERA_POLL_TYPE_DATA:
+        /* get stream idx from handler if CH type */
+        return mm_camera_util_get_index_by_handler(handler);
+    case MM_CAMERA_POLL_TYPE_DATA_GLOBAL:
+        /* stream handles of different channels share index bits */
+        for (i = 0; i < poll_cb->num_entries; i++) {
+            if ((poll_cb->poll_entries[i].fd >= 0) &&
+                    (poll_cb->poll_entries[i].handler == handler)) {
+                return i;
+            }
+            if ((poll_cb->poll_entries[i].fd < 0) &&
+                    (free_idx == poll_cb->num_entries)) {
+                free_idx = i;
+            }
+        }
+        return alloc ? free_idx : poll_cb->num_entries;
+    default:
+        /* for EVT type, only idx=0 is valid */
+        return 0;
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_set_state
+ * FUNCTION   : mm_camera_poll_wait_idle
  *
- * DESCRIPTION: set a polling state
+ * DESCRIPTION: wait until the poll thread is no longer dispatching the given
+ *              entry. Must be called with poll_cb->mutex held. A no-op on the
+ *              poll thread itself, where the dispatch is the caller.
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
- *   @state   : polling state (stopped/polling)
+ *   @idx     : entry index, or -1 to wait for any dispatch to finish
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_set_state(mm_camera_poll_thread_t *poll_cb,
-                                     mm_camera_poll_task_state_type_t state)
+static void mm_camera_poll_wait_idle(mm_camera_poll_thread_t *poll_cb,
+                                     int32_t idx)
 {
-    poll_cb->state = state;
+    if (pthread_equal(pthread_self(), poll_cb->pid)) {
+        return;
+    }
+    while ((poll_cb->active_idx >= 0) &&
+           ((idx < 0) || (poll_cb->active_idx == idx))) {
+        pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_proc_pipe
+ * FUNCTION   : mm_camera_poll_dispatch
  *
- * DESCRIPTION: polling thread routine to process pipe
+ * DESCRIPTION: run the notify callback of a ready entry. The entry is
+ *              re-validated under the mutex so an event queued before a
+ *              del/add of the same slot is dropped. Error or hangup
+ *              alone does not notify, one of the events the entry
+ *              registered must be ready.
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
+ *   @ev      : ready event returned by epoll_wait
  *
- * RETURN     : none
+ * RETURN     : TRUE if the notify callback ran
  *==========================================================================*/
-static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
+static uint8_t mm_camera_poll_dispatch(mm_camera_poll_thread_t *poll_cb,
+                                       struct epoll_event *ev)
 {
-    ssize_t read_len;
-    int i;
-    mm_camera_sig_evt_t cmd_evt;
-    read_len = read(poll_cb->pfds[0], &cmd_evt, sizeof(cmd_evt));
-    CDBG("%s: read_fd = %d, read_len = %d, expect_len = %d cmd = %d",
-         __func__, poll_cb->pfds[0], (int)read_len, (int)sizeof(cmd_evt), cmd_evt.cmd);
-    switch (cmd_evt.cmd) {
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED:
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC:
-        /* we always have index 0 for pipe read */
-        poll_cb->num_fds = 0;
-        poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->pfds[0];
-        poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-        poll_cb->num_fds++;
-
-        if (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type &&
-                poll_cb->num_fds < MAX_STREAM_NUM_IN_BUNDLE) {
-            if (poll_cb->poll_entries[0].fd >= 0) {
-                /* fd is valid, we update poll_fds */
-                poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[0].fd;
-                poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                poll_cb->num_fds++;
-            }
-        } else if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type &&
-                poll_cb->num_fds <= MAX_STREAM_NUM_IN_BUNDLE) {
-            for(i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
-                if(poll_cb->poll_entries[i].fd >= 0) {
-                    /* fd is valid, we update poll_fds to this fd */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[i].fd;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                    poll_cb->num_fds++;
-                } else {
-                    /* fd is invalid, we set the entry to -1 to prevent polling.
-                     * According to spec, polling will not poll on entry with fd=-1.
-                     * If this is not the case, we need to skip these invalid fds
-                     * when updating this array.
-                     * We still keep fd=-1 in this array because this makes easier to
-                     * map cb associated with this fd once incoming data avail by directly
-                     * using the index-1(0 is reserved for pipe read, so need to reduce index by 1) */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = -1;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = 0;
-                    poll_cb->num_fds++;
-                }
-            }
-        }
-        if (cmd_evt.cmd != MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC)
-            mm_camera_poll_sig_done(poll_cb);
-        break;
+    uint32_t idx = (uint32_t)(ev->data.u64 & 0xFFFFFFFF);
+    uint32_t gen = (uint32_t)(ev->data.u64 >> 32);
+    mm_camera_poll_notify_t notify_cb = NULL;
+    void *user_data = NULL;
 
-    case MM_CAMERA_PIPE_CMD_COMMIT:
-        mm_camera_poll_sig_done(poll_cb);
-        break;
-    case MM_CAMERA_PIPE_CMD_EXIT:
-    default:
-        mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
-        mm_camera_poll_sig_done(poll_cb);
-        break;
+    if (idx >= poll_cb->num_entries) {
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&poll_cb->mutex);
+    if ((poll_cb->poll_entries[idx].gen == gen) &&
+        (poll_cb->poll_entries[idx].fd >= 0) &&
+        (ev->events & poll_cb->poll_entries[idx].events)) {
+        notify_cb = poll_cb->poll_entries[idx].notify_cb;
+        user_data = poll_cb->poll_entries[idx].user_data;
     }
+    if (NULL == notify_cb) {
+        pthread_mutex_unlock(&poll_cb->mutex);
+        if (ev->events & (EPOLLERR | EPOLLHUP)) {
+            CDBG("%s: entry %d not ready, events 0x%x\n",
+                 __func__, idx, ev->events);
+        }
+        return FALSE;
+    }
+    poll_cb->active_idx = (int32_t)idx;
+    pthread_mutex_unlock(&poll_cb->mutex);
+
+    CDBG("%s: notify entry %d events 0x%x\n", __func__, idx, ev->events);
+    notify_cb(user_data);
+
+    pthread_mutex_lock(&poll_cb->mutex);
+    poll_cb->active_idx = -1;
+    pthread_cond_broadcast(&poll_cb->cond_v);
+    pthread_mutex_unlock(&poll_cb->mutex);
+    return TRUE;
 }
 
 /*===========================================================================
@@ -282,53 +340,53 @@ static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
  *==========================================================================*/
 static void *mm_camera_poll_fn(mm_camera_poll_thread_t *poll_cb)
 {
-    int rc = 0, i;
+    struct epoll_event events[MM_CAMERA_POLL_MAX_EVENTS];
+    uint64_t val;
+    int rc, i;
+    uint8_t notified;
 
     if (NULL == poll_cb) {
         CDBG_ERROR("%s: poll_cb is NULL!\n", __func__);
         return NULL;
     }
-    CDBG("%s: poll type = %d, num_fd = %d poll_cb = %p\n",
-         __func__, poll_cb->poll_type, poll_cb->num_fds,poll_cb);
+    CDBG("%s: poll type = %d, epoll fd = %d poll_cb = %p\n",
+         __func__, poll_cb->poll_type, poll_cb->epoll_fd, poll_cb);
     do {
-         for(i = 0; i < poll_cb->num_fds; i++) {
-            poll_cb->poll_fds[i].events = POLLIN|POLLRDNORM|POLLPRI;
-         }
-
-         rc = poll(poll_cb->poll_fds, poll_cb->num_fds, poll_cb->timeoutms);
-         if(rc > 0) {
-            if ((poll_cb->poll_fds[0].revents & POLLIN) &&
-                (poll_cb->poll_fds[0].revents & POLLRDNORM)) {
-                /* if we have data on pipe, we only process pipe in this iteration */
-                CDBG("%s: cmd received on pipe\n", __func__);
-                mm_camera_poll_proc_pipe(poll_cb);
-            } else {
-                for(i=1; i<poll_cb->num_fds; i++) {
-                    /* Checking for ctrl events */
-                    if ((poll_cb->poll_type == MM_CAMERA_POLL_TYPE_EVT) &&
-                        (poll_cb->poll_fds[i].revents & POLLPRI)) {
-                        CDBG("%s: mm_camera_evt_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-
-                    if ((MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) &&
-                        (poll_cb->poll_fds[i].revents & POLLIN) &&
-                        (poll_cb->poll_fds[i].revents & POLLRDNORM)) {
-                        CDBG("%s: mm_stream_data_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
+        rc = epoll_wait(poll_cb->epoll_fd, events,
+                MM_CAMERA_POLL_MAX_EVENTS, poll_cb->timeoutms);
+        if (rc < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            CDBG_ERROR("%s: epoll_wait failed (%s), poll thread exits",
+                       __func__, strerror(errno));
+            mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
+            break;
+        }
+
+        notified = FALSE;
+        for (i = 0; i < rc; i++) {
+            if (MM_CAMERA_POLL_EVT_FD_TAG == events[i].data.u64) {
+                /* only exit is signalled on the eventfd */
+                if (read(poll_cb->evt_fd, &val, sizeof(val)) != sizeof(val)) {
+                    CDBG_ERROR("%s: eventfd read failed (%s)",
+                               __func__, strerror(errno));
                 }
+                CDBG("%s: exit received on eventfd\n", __func__);
+                mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
+                notified = TRUE;
+                break;
             }
-        } else {
-            /* in error case sleep 10 us and then continue. hard coded here */
+            if (mm_camera_poll_dispatch(poll_cb, &events[i])) {
+                notified = TRUE;
+            }
+        }
+        if ((rc > 0) && !notified) {
+            /* level triggered error/hangup, e.g. a video node with no
+             * buffer queued, don't spin on it. hard coded here */
             usleep(10);
-            continue;
         }
-    } while ((poll_cb != NULL) && (poll_cb->state == MM_CAMERA_POLL_TASK_STATE_POLL));
+    } while (poll_cb->state == MM_CAMERA_POLL_TASK_STATE_POLL);
     return NULL;
 }
 
@@ -347,35 +405,25 @@ static void *mm_camera_poll_thread(void *data)
     mm_camera_poll_thread_t *poll_cb = (mm_camera_poll_thread_t *)data;
 
     mm_camera_cmd_thread_name(poll_cb->threadName);
-    /* add pipe read fd into poll first */
-    poll_cb->poll_fds[poll_cb->num_fds++].fd = poll_cb->pfds[0];
+    mm_camera_thread_apply_sched(0, &poll_cb->sched);
 
-    mm_camera_poll_sig_done(poll_cb);
+    pthread_mutex_lock(&poll_cb->mutex);
+    poll_cb->tid = (pid_t)syscall(__NR_gettid);
     mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_POLL);
-    return mm_camera_poll_fn(poll_cb);
-}
+    poll_cb->status = TRUE;
+    pthread_cond_signal(&poll_cb->cond_v);
+    pthread_mutex_unlock(&poll_cb->mutex);
 
-/*===========================================================================
- * FUNCTION   : mm_camera_poll_thread
- *
- * DESCRIPTION: notify the polling thread that entries for polling fd have
- *              been updated
- *
- * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
- *
- * RETURN     : none
- *==========================================================================*/
-int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * poll_cb)
-{
-    /* send poll entries updated signal to poll thread */
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
+    return mm_camera_poll_fn(poll_cb);
 }
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_thread_commit_updates
  *
- * DESCRIPTION: sync with all previously pending async updates
+ * DESCRIPTION: sync with all previously pending async updates. Updates are
+ *              applied to the epoll set immediately, so this only has to
+ *              wait for a notify callback that may still be running against
+ *              an entry removed asynchronously.
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
@@ -386,7 +434,10 @@ int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * p
  *==========================================================================*/
 int32_t mm_camera_poll_thread_commit_updates(mm_camera_poll_thread_t * poll_cb)
 {
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_COMMIT);
+    pthread_mutex_lock(&poll_cb->mutex);
+    mm_camera_poll_wait_idle(poll_cb, -1);
+    pthread_mutex_unlock(&poll_cb->mutex);
+    return 0;
 }
 
 /*===========================================================================
@@ -403,7 +454,9 @@ int32_t mm_camera_poll_thread_commit_updates(mm_camera_poll_thread_t * poll_cb)
  *   @userdata  : user data ptr
  *   @call_type : Whether its Synchronous or Asynchronous call
  *
- * RETURN     : none
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
  *==========================================================================*/
 int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
                                           uint32_t handler,
@@ -412,32 +465,60 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
                                           void* userdata,
                                           mm_camera_call_type_t call_type)
 {
-    int32_t rc = -1;
-    uint8_t idx = 0;
+    int32_t rc = 0;
+    uint32_t idx;
+    mm_camera_poll_entry_t *entry;
+    struct epoll_event ev;
+    int op = EPOLL_CTL_ADD;
 
-    if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
-        /* get stream idx from handler if CH type */
-        idx = mm_camera_util_get_index_by_handler(handler);
-    } else {
-        /* for EVT type, only idx=0 is valid */
-        idx = 0;
+    if (NULL == poll_cb->poll_entries) {
+        CDBG_ERROR("%s: poll thread not launched", __func__);
+        return -1;
     }
 
-    if (MAX_STREAM_NUM_IN_BUNDLE > idx) {
-        poll_cb->poll_entries[idx].fd = fd;
-        poll_cb->poll_entries[idx].handler = handler;
-        poll_cb->poll_entries[idx].notify_cb = notify_cb;
-        poll_cb->poll_entries[idx].user_data = userdata;
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
-        } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
-        }
-    } else {
+    pthread_mutex_lock(&poll_cb->mutex);
+    idx = mm_camera_poll_get_idx(poll_cb, handler, TRUE);
+    if (poll_cb->num_entries <= idx) {
+        pthread_mutex_unlock(&poll_cb->mutex);
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
+        return -1;
+    }
+    entry = &poll_cb->poll_entries[idx];
+    if (entry->fd >= 0) {
+        if (entry->fd == fd) {
+            op = EPOLL_CTL_MOD;
+        } else {
+            epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL);
+        }
+    }
+    if (call_type == mm_camera_sync_call) {
+        /* replacing the entry must not race a running callback */
+        mm_camera_poll_wait_idle(poll_cb, (int32_t)idx);
+    }
+
+    entry->gen++;
+    entry->fd = fd;
+    entry->handler = handler;
+    entry->notify_cb = notify_cb;
+    entry->user_data = userdata;
+    entry->events = (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type) ?
+            EPOLLPRI : EPOLLIN;
+
+    memset(&ev, 0, sizeof(ev));
+    /* level triggered: each notify_cb consumes one buffer/event only */
+    ev.events = entry->events;
+    ev.data.u64 = ((uint64_t)entry->gen << 32) | idx;
+    if (epoll_ctl(poll_cb->epoll_fd, op, fd, &ev) < 0) {
+        CDBG_ERROR("%s: epoll_ctl(%d) fd %d failed (%s)",
+                   __func__, op, fd, strerror(errno));
+        entry->fd = -1;
+        entry->handler = 0;
+        entry->notify_cb = NULL;
+        entry->events = 0;
+        rc = -1;
     }
+    pthread_mutex_unlock(&poll_cb->mutex);
     return rc;
 }
 
@@ -450,6 +531,8 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
  *   @poll_cb   : ptr to poll thread object
  *   @handler   : stream handle if channel data polling thread,
  *                0 if event polling thread
+ *   @call_type : sync call also waits for a running callback of this
+ *                entry to return
  *
  * RETURN     : int32_t type of status
  *              0  -- success
@@ -459,36 +542,68 @@ int32_t mm_camera_poll_thread_del_poll_fd(mm_camera_poll_thread_t * poll_cb,
                                           uint32_t handler,
                                           mm_camera_call_type_t call_type)
 {
-    int32_t rc = -1;
-    uint8_t idx = 0;
+    uint32_t idx;
+    mm_camera_poll_entry_t *entry;
 
-    if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
-        /* get stream idx from handler if CH type */
-        idx = mm_camera_util_get_index_by_handler(handler);
-    } else {
-        /* for EVT type, only idx=0 is valid */
-        idx = 0;
+    if (NULL == poll_cb->poll_entries) {
+        CDBG_ERROR("%s: poll thread not launched", __func__);
+        return -1;
     }
 
-    if ((MAX_STREAM_NUM_IN_BUNDLE > idx) &&
-        (handler == poll_cb->poll_entries[idx].handler)) {
-        /* reset poll entry */
-        poll_cb->poll_entries[idx].fd = -1; /* set fd to invalid */
-        poll_cb->poll_entries[idx].handler = 0;
-        poll_cb->poll_entries[idx].notify_cb = NULL;
-
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
-        } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
-        }
-    } else {
+    pthread_mutex_lock(&poll_cb->mutex);
+    idx = mm_camera_poll_get_idx(poll_cb, handler, FALSE);
+    entry = (idx < poll_cb->num_entries) ? &poll_cb->poll_entries[idx] : NULL;
+    if ((NULL == entry) || (handler != entry->handler) || (entry->fd < 0)) {
+        pthread_mutex_unlock(&poll_cb->mutex);
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
         return -1;
     }
 
+    if (epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL) < 0) {
+        CDBG_ERROR("%s: epoll_ctl del fd %d failed (%s)",
+                   __func__, entry->fd, strerror(errno));
+    }
+    /* reset poll entry */
+    entry->gen++;
+    entry->fd = -1; /* set fd to invalid */
+    entry->handler = 0;
+    entry->notify_cb = NULL;
+    entry->events = 0;
+
+    if (call_type == mm_camera_sync_call) {
+        mm_camera_poll_wait_idle(poll_cb, (int32_t)idx);
+    }
+    pthread_mutex_unlock(&poll_cb->mutex);
+
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_poll_thread_set_sched
+ *
+ * DESCRIPTION: change scheduling of a running poll thread, e.g. when a
+ *              latency critical stream joins a shared poll thread
+ *
+ * PARAMETERS :
+ *   @poll_cb : ptr to poll thread object
+ *   @sched   : new scheduling parameters
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_poll_thread_set_sched(mm_camera_poll_thread_t * poll_cb,
+        const mm_camera_thread_sched_t *sched)
+{
+    int32_t rc = -1;
+
+    pthread_mutex_lock(&poll_cb->mutex);
+    if (MM_CAMERA_POLL_TASK_STATE_POLL == poll_cb->state) {
+        poll_cb->sched = *sched;
+        rc = mm_camera_thread_apply_sched(poll_cb->tid, sched);
+    }
+    pthread_mutex_unlock(&poll_cb->mutex);
     return rc;
 }
 
@@ -497,32 +612,57 @@ int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
 {
     int32_t rc = 0;
     size_t i = 0, cnt = 0;
+    struct epoll_event ev;
     poll_cb->poll_type = poll_type;
+    poll_cb->active_idx = -1;
 
-    //Initialize poll_fds
-    cnt = sizeof(poll_cb->poll_fds) / sizeof(poll_cb->poll_fds[0]);
-    for (i = 0; i < cnt; i++) {
-        poll_cb->poll_fds[i].fd = -1;
-    }
     //Initialize poll_entries
-    cnt = sizeof(poll_cb->poll_entries) / sizeof(poll_cb->poll_entries[0]);
+    switch (poll_type) {
+    case MM_CAMERA_POLL_TYPE_EVT:
+        cnt = 1;
+        break;
+    case MM_CAMERA_POLL_TYPE_DATA_GLOBAL:
+        cnt = MM_CAMERA_POLL_GLOBAL_ENTRIES;
+        break;
+    default:
+        cnt = MAX_STREAM_NUM_IN_BUNDLE;
+        break;
+    }
+    poll_cb->poll_entries =
+            (mm_camera_poll_entry_t *)calloc(cnt, sizeof(mm_camera_poll_entry_t));
+    if (NULL == poll_cb->poll_entries) {
+        CDBG_ERROR("%s: No memory for %zu poll entries", __func__, cnt);
+        return -1;
+    }
+    poll_cb->num_entries = (uint32_t)cnt;
     for (i = 0; i < cnt; i++) {
         poll_cb->poll_entries[i].fd = -1;
     }
-    //Initialize pipe fds
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
-    rc = pipe(poll_cb->pfds);
-    if(rc < 0) {
-        CDBG_ERROR("%s: pipe open rc=%d\n", __func__, rc);
-        return -1;
+
+    poll_cb->evt_fd = -1;
+    poll_cb->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poll_cb->epoll_fd < 0) {
+        CDBG_ERROR("%s: epoll_create1 failed (%s)\n", __func__, strerror(errno));
+        goto on_error;
+    }
+    poll_cb->evt_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (poll_cb->evt_fd < 0) {
+        CDBG_ERROR("%s: eventfd failed (%s)\n", __func__, strerror(errno));
+        goto on_error;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = MM_CAMERA_POLL_EVT_FD_TAG;
+    if (epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_ADD, poll_cb->evt_fd, &ev) < 0) {
+        CDBG_ERROR("%s: epoll_ctl eventfd failed (%s)\n", __func__, strerror(errno));
+        goto on_error;
     }
 
     poll_cb->timeoutms = -1;  /* Infinite seconds */
 
-    CDBG("%s: poll_type = %d, read fd = %d, write fd = %d timeout = %d",
+    CDBG("%s: poll_type = %d, epoll fd = %d, event fd = %d timeout = %d",
         __func__, poll_cb->poll_type,
-        poll_cb->pfds[0], poll_cb->pfds[1],poll_cb->timeoutms);
+        poll_cb->epoll_fd, poll_cb->evt_fd, poll_cb->timeoutms);
 
     pthread_mutex_init(&poll_cb->mutex, NULL);
     pthread_cond_init(&poll_cb->cond_v, NULL);
@@ -531,43 +671,63 @@ int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
     pthread_mutex_lock(&poll_cb->mutex);
     poll_cb->status = 0;
     pthread_create(&poll_cb->pid, NULL, mm_camera_poll_thread, (void *)poll_cb);
-    if(!poll_cb->status) {
+    while (!poll_cb->status) {
         pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
     }
 
     pthread_mutex_unlock(&poll_cb->mutex);
     CDBG("%s: End",__func__);
     return rc;
+
+on_error:
+    if (poll_cb->evt_fd >= 0) {
+        close(poll_cb->evt_fd);
+    }
+    if (poll_cb->epoll_fd >= 0) {
+        close(poll_cb->epoll_fd);
+    }
+    poll_cb->evt_fd = -1;
+    poll_cb->epoll_fd = -1;
+    free(poll_cb->poll_entries);
+    poll_cb->poll_entries = NULL;
+    poll_cb->num_entries = 0;
+    return -1;
 }
 
 int32_t mm_camera_poll_thread_release(mm_camera_poll_thread_t *poll_cb)
 {
     int32_t rc = 0;
-    if(MM_CAMERA_POLL_TASK_STATE_STOPPED == poll_cb->state) {
-        CDBG_ERROR("%s: err, poll thread is not running.\n", __func__);
+    uint64_t val = 1;
+
+    if (NULL == poll_cb->poll_entries) {
+        CDBG_ERROR("%s: err, poll thread is not launched.\n", __func__);
         return rc;
     }
 
-    /* send exit signal to poll thread */
-    mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_EXIT);
+    /* the thread may already have exited on an epoll error, the exit
+     * signal is harmless then and it still has to be joined and torn
+     * down */
+    if (write(poll_cb->evt_fd, &val, sizeof(val)) != sizeof(val)) {
+        CDBG_ERROR("%s: eventfd write failed (%s)", __func__, strerror(errno));
+    }
     /* wait until poll thread exits */
     if (pthread_join(poll_cb->pid, NULL) != 0) {
         CDBG_ERROR("%s: pthread dead already\n", __func__);
     }
 
-    /* close pipe */
-    if(poll_cb->pfds[0] >= 0) {
-        close(poll_cb->pfds[0]);
+    if (poll_cb->evt_fd >= 0) {
+        close(poll_cb->evt_fd);
     }
-    if(poll_cb->pfds[1] >= 0) {
-        close(poll_cb->pfds[1]);
+    if (poll_cb->epoll_fd >= 0) {
+        close(poll_cb->epoll_fd);
     }
 
     pthread_mutex_destroy(&poll_cb->mutex);
     pthread_cond_destroy(&poll_cb->cond_v);
+    free(poll_cb->poll_entries);
     memset(poll_cb, 0, sizeof(mm_camera_poll_thread_t));
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
+    poll_cb->epoll_fd = -1;
+    poll_cb->evt_fd = -1;
     return rc;
 }
 
@@ -580,6 +740,7 @@ static void *mm_camera_cmd_thread(void *data)
     mm_camera_cmdcb_t* node = NULL;
 
     mm_camera_cmd_thread_name(cmd_thread->threadName);
+    mm_camera_thread_apply_sched(0, &cmd_thread->sched);
     do {
         do {
             ret = cam_sem_wait(&cmd_thread->cmd_sem);
@@ -627,7 +788,7 @@ int32_t mm_camera_cmd_thread_launch(mm_camera_cmd_thread_t * cmd_thread,
 
     cam_sem_init(&cmd_thread->cmd_sem, 0);
     cam_sem_init(&cmd_thread->sync_sem, 0);
-    cam_queue_init(&cmd_thread->cmd_queue);
+    cam_queue_init_slab(&cmd_thread->cmd_queue, MM_CAMERA_CMD_QUEUE_SLAB_SIZE);
     cmd_thread->cb = cb;
     cmd_thread->user_data = user_data;
     cmd_thread->is_active = TRUE;
@@ -675,6 +836,13 @@ int32_t mm_camera_cmd_thread_stop(mm_camera_cmd_thread_t * cmd_thread)
 int32_t mm_camera_cmd_thread_destroy(mm_camera_cmd_thread_t * cmd_thread)
 {
     int32_t rc = 0;
+    cam_queue_stats_t stats;
+
+    cam_queue_get_stats(&cmd_thread->cmd_queue, &stats);
+    CDBG_HIGH("%s: %s queue: slab %u, allocs %u, mallocs %u, overflow %u, hwm %u",
+            __func__, cmd_thread->threadName, stats.slab_cnt,
+            stats.node_allocs, stats.node_mallocs, stats.overflow_cnt,
+            stats.high_water);
     cam_queue_deinit(&cmd_thread->cmd_queue);
     cam_sem_destroy(&cmd_thread->cmd_sem);
     cam_sem_destroy(&cmd_thread->sync_sem);
@@ -0,0 +1,315 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cutils/properties.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_trace.h"
+
+typedef struct {
+    int64_t ts_ns;
+    int64_t value;
+    uint32_t frame_idx;
+    char phase;
+    char name[MM_CAMERA_TRACE_NAME_LEN];
+} mm_camera_trace_event_t;
+
+typedef struct {
+    pid_t tid;
+    uint8_t in_use;      /* owned by a live thread */
+    uint32_t head;       /* total events written, only the owner writes */
+    mm_camera_trace_event_t events[MM_CAMERA_TRACE_RING_SIZE];
+} mm_camera_trace_ring_t;
+
+volatile uint32_t gMmCameraTraceLevel = 0;
+
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_trace_key;
+static mm_camera_trace_ring_t *g_trace_rings[MM_CAMERA_TRACE_MAX_THREADS];
+static uint32_t g_trace_num_rings = 0;
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_thread_exit
+ *
+ * DESCRIPTION: thread exit hook, the ring may be recycled once all rings
+ *              are taken. Events stay dumpable until then.
+ *
+ * PARAMETERS :
+ *   @data    : ring of the exiting thread
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_trace_thread_exit(void *data)
+{
+    mm_camera_trace_ring_t *ring = (mm_camera_trace_ring_t *)data;
+    pthread_mutex_lock(&g_trace_lock);
+    ring->in_use = 0;
+    pthread_mutex_unlock(&g_trace_lock);
+}
+
+static void mm_camera_trace_key_init(void)
+{
+    pthread_key_create(&g_trace_key, mm_camera_trace_thread_exit);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_get_ring
+ *
+ * DESCRIPTION: get the ring of the calling thread, assigning one on first
+ *              use. Only this slow path takes the lock.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : ptr to ring, NULL if no ring is available
+ *==========================================================================*/
+static mm_camera_trace_ring_t *mm_camera_trace_get_ring(void)
+{
+    mm_camera_trace_ring_t *ring = NULL;
+    uint32_t i;
+
+    pthread_once(&g_trace_once, mm_camera_trace_key_init);
+    ring = (mm_camera_trace_ring_t *)pthread_getspecific(g_trace_key);
+    if (NULL != ring) {
+        return ring;
+    }
+
+    pthread_mutex_lock(&g_trace_lock);
+    if (g_trace_num_rings < MM_CAMERA_TRACE_MAX_THREADS) {
+        ring = (mm_camera_trace_ring_t *)calloc(1, sizeof(mm_camera_trace_ring_t));
+        if (NULL != ring) {
+            g_trace_rings[g_trace_num_rings++] = ring;
+        }
+    } else {
+        /* out of rings, recycle the one of an exited thread */
+        for (i = 0; i < g_trace_num_rings; i++) {
+            if (!g_trace_rings[i]->in_use) {
+                ring = g_trace_rings[i];
+                break;
+            }
+        }
+    }
+    if (NULL != ring) {
+        ring->in_use = 1;
+        ring->tid = (pid_t)syscall(__NR_gettid);
+        __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_trace_lock);
+
+    if (NULL != ring) {
+        pthread_setspecific(g_trace_key, ring);
+    }
+    return ring;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_update_level
+ *
+ * DESCRIPTION: read the recorder level from persist.camera.trace.rec
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_trace_update_level(void)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    int val;
+
+    property_get("persist.camera.trace.rec", prop, "0");
+    val = atoi(prop);
+    gMmCameraTraceLevel = (val > 0) ? (uint32_t)val : 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_event
+ *
+ * DESCRIPTION: record one event into the calling thread's ring. Oldest
+ *              events are overwritten once the ring is full.
+ *
+ * PARAMETERS :
+ *   @phase     : chrome trace phase, MM_CAMERA_TRACE_PH_*
+ *   @name      : event name, truncated to MM_CAMERA_TRACE_NAME_LEN - 1
+ *   @frame_idx : frame index, or id for async events
+ *   @value     : counter value or extra argument
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_trace_event(char phase, const char *name,
+        uint32_t frame_idx, int64_t value)
+{
+    mm_camera_trace_ring_t *ring = mm_camera_trace_get_ring();
+    mm_camera_trace_event_t *ev = NULL;
+    struct timespec ts;
+    uint32_t head;
+
+    if (NULL == ring) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    head = ring->head;
+    ev = &ring->events[head & (MM_CAMERA_TRACE_RING_SIZE - 1)];
+    ev->ts_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    ev->value = value;
+    ev->frame_idx = frame_idx;
+    ev->phase = phase;
+    if (NULL != name) {
+        strncpy(ev->name, name, MM_CAMERA_TRACE_NAME_LEN - 1);
+        ev->name[MM_CAMERA_TRACE_NAME_LEN - 1] = '\0';
+    } else {
+        ev->name[0] = '\0';
+    }
+    /* publish after the event is complete, dump reads head first */
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_dump_ring
+ *
+ * DESCRIPTION: write the events of one ring as chrome trace JSON objects.
+ *              Events are copied out first; whatever the owner overwrote
+ *              while copying is dropped.
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *   @ring    : ring to dump
+ *   @pid     : process id to report
+ *   @first   : in/out, no comma before the first object in the file
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_trace_dump_ring(int fd, mm_camera_trace_ring_t *ring,
+        pid_t pid, uint8_t *first)
+{
+    mm_camera_trace_event_t *copy = NULL;
+    uint32_t start, end, end_after, i;
+    char name[MM_CAMERA_TRACE_NAME_LEN];
+
+    copy = (mm_camera_trace_event_t *)malloc(sizeof(ring->events));
+    if (NULL == copy) {
+        CDBG_ERROR("%s: No memory to dump trace ring", __func__);
+        return;
+    }
+
+    end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    start = (end > MM_CAMERA_TRACE_RING_SIZE) ?
+            (end - MM_CAMERA_TRACE_RING_SIZE) : 0;
+    memcpy(copy, ring->events, sizeof(ring->events));
+    end_after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if ((end_after >= MM_CAMERA_TRACE_RING_SIZE) &&
+            (start < end_after - MM_CAMERA_TRACE_RING_SIZE + 1)) {
+        start = end_after - MM_CAMERA_TRACE_RING_SIZE + 1;
+    }
+
+    for (i = start; i < end; i++) {
+        mm_camera_trace_event_t *ev =
+                &copy[i & (MM_CAMERA_TRACE_RING_SIZE - 1)];
+        size_t j;
+
+        /* names come from code, still keep the JSON well formed */
+        for (j = 0; (j < sizeof(name) - 1) && (ev->name[j] != '\0'); j++) {
+            name[j] = ((ev->name[j] == '"') || (ev->name[j] == '\\')) ?
+                    '_' : ev->name[j];
+        }
+        name[j] = '\0';
+
+        dprintf(fd, "%s\n{\"name\":\"%s\",\"cat\":\"camera\",\"ph\":\"%c\","
+                "\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d",
+                *first ? "" : ",", name, ev->phase,
+                (long long)(ev->ts_ns / 1000), (long long)(ev->ts_ns % 1000),
+                pid, ring->tid);
+        *first = 0;
+
+        switch (ev->phase) {
+        case MM_CAMERA_TRACE_PH_ASYNC_BEGIN:
+        case MM_CAMERA_TRACE_PH_ASYNC_END:
+            dprintf(fd, ",\"id\":%u}", ev->frame_idx);
+            break;
+        case MM_CAMERA_TRACE_PH_COUNTER:
+            dprintf(fd, ",\"args\":{\"%s\":%lld}}", name,
+                    (long long)ev->value);
+            break;
+        case MM_CAMERA_TRACE_PH_INSTANT:
+            dprintf(fd, ",\"s\":\"p\",\"args\":{\"frame\":%u,\"val\":%lld}}",
+                    ev->frame_idx, (long long)ev->value);
+            break;
+        default:
+            dprintf(fd, "}");
+            break;
+        }
+    }
+
+    free(copy);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_dump
+ *
+ * DESCRIPTION: write all recorded events as a chrome trace JSON document
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_trace_dump(int fd)
+{
+    uint32_t i, num_rings;
+    mm_camera_trace_ring_t *rings[MM_CAMERA_TRACE_MAX_THREADS];
+    uint8_t first = 1;
+    pid_t pid = getpid();
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* rings are never freed, so they can be walked without the lock */
+    pthread_mutex_lock(&g_trace_lock);
+    num_rings = g_trace_num_rings;
+    memcpy(rings, g_trace_rings, num_rings * sizeof(rings[0]));
+    pthread_mutex_unlock(&g_trace_lock);
+
+    dprintf(fd, "{\"traceEvents\":[");
+    for (i = 0; i < num_rings; i++) {
+        mm_camera_trace_dump_ring(fd, rings[i], pid, &first);
+    }
+    dprintf(fd, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return 0;
+}
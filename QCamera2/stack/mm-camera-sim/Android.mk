@@ -0,0 +1,57 @@
+OLD_LOCAL_PATH := $(LOCAL_PATH)
+LOCAL_PATH := $(call my-dir)
+
+# Simulated camera driver, daemon and ion: libmmcamera_sim. Preload it into
+# the camera process to run the stack without the msm camera driver.
+include $(LOCAL_PATH)/../../../common.mk
+include $(CLEAR_VARS)
+
+MM_CAM_SIM_FILES := \
+        src/mm_camera_sim.c \
+        src/mm_camera_sim_video.c \
+        src/mm_camera_sim_server.c \
+        src/mm_camera_sim_sensor.c
+
+LOCAL_CFLAGS += -D_ANDROID_ -D_GNU_SOURCE
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/inc \
+    $(LOCAL_PATH)/../common
+
+LOCAL_C_INCLUDES+= $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+LOCAL_CLANG := false
+
+LOCAL_SRC_FILES := $(MM_CAM_SIM_FILES)
+
+LOCAL_MODULE           := libmmcamera_sim
+LOCAL_PRELINK_MODULE   := false
+LOCAL_SHARED_LIBRARIES := libdl libcutils liblog
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+include $(BUILD_SHARED_LIBRARY)
+
+# Runner streaming preview through the camera HAL on the simulator and
+# reporting frame rate and latency: mm-camera-sim-runner
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS += -D_ANDROID_ -D_GNU_SOURCE
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/inc
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+LOCAL_CLANG := false
+
+LOCAL_SRC_FILES := src/mm_camera_sim_runner.c
+
+LOCAL_MODULE           := mm-camera-sim-runner
+LOCAL_SHARED_LIBRARIES := libhardware libcamera_metadata liblog
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+include $(BUILD_EXECUTABLE)
+
+LOCAL_PATH := $(OLD_LOCAL_PATH)
@@ -0,0 +1,248 @@
+/* Copyright (c) 2012-2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __MM_CAMERA_SIM_H__
+#define __MM_CAMERA_SIM_H__
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <linux/videodev2.h>
+#include <media/msmb_camera.h>
+
+#include "cam_intf.h"
+
+/* The simulator stands in for everything below mm_camera_open(): the media
+ * and video nodes of the msm camera driver, the sensor_init subdev, the
+ * daemon end of the domain socket and /dev/ion. It is preloaded into the
+ * camera process with LD_PRELOAD and catches
+ * open/close/ioctl/epoll_ctl/epoll_wait/connect on those nodes, so
+ * mm-camera-interface and the HALs above it run unmodified on a device or
+ * emulator without the msm camera driver. It is built for the target only,
+ * it needs the msm kernel headers. mm-camera-sim-runner streams preview
+ * through the HALs on it, mm-qcamera-app streams on it below the HALs.
+ * gralloc in the same process allocates from the simulated ion as well.
+ *
+ * Every node opened is backed by an eventfd with EFD_SEMAPHORE. The eventfd
+ * counts what can be dequeued from the node: events on the session fd and
+ * filled buffers on a stream fd. The stack polls it like the real node.
+ *
+ * It is configured from the environment of the process it is preloaded
+ * into:
+ *   MM_CAMERA_SIM_CAMERAS   number of cameras, 1 to 4 (2)
+ *   MM_CAMERA_SIM_FPS       sensor frame rate (30), set_parms may lower it
+ *   MM_CAMERA_SIM_SENSOR    sensor size as WxH (4000x3000)
+ *   MM_CAMERA_SIM_FILL      draw synthetic frames, 0 to skip (1)
+ *   MM_CAMERA_SIM_MAP_US    daemon cost per socket packet in usec (0)
+ *   MM_CAMERA_SIM_LOG       log level, see mm_camera_sim_dbg.h (1) */
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define MM_CAMERA_SIM_MAX_CAMERAS     4
+#define MM_CAMERA_SIM_MAX_FDS         4096
+#define MM_CAMERA_SIM_MAX_STREAMS     16
+#define MM_CAMERA_SIM_MAX_EVENTS      64
+#define MM_CAMERA_SIM_MAX_MAPS        512
+#define MM_CAMERA_SIM_MAX_ION_HANDLES 64
+#define MM_CAMERA_SIM_MAX_FRAME_NUMS  64
+
+/* /dev/videoN of camera 0, further cameras follow */
+#define MM_CAMERA_SIM_VNODE_BASE      1
+#define MM_CAMERA_SIM_SINIT_NAME      "v4l-subdev0"
+
+typedef enum {
+    MM_CAMERA_SIM_NODE_MEDIA,       /* /dev/mediaN */
+    MM_CAMERA_SIM_NODE_SENSOR_INIT, /* sensor_init subdev */
+    MM_CAMERA_SIM_NODE_VIDEO,       /* /dev/videoN of a camera session */
+    MM_CAMERA_SIM_NODE_ION,         /* /dev/ion */
+} mm_camera_sim_node_t;
+
+typedef struct {
+    uint32_t num_cameras;
+    uint32_t fps;
+    cam_dimension_t sensor_dim;
+    uint8_t fill;
+    uint32_t map_us;
+} mm_camera_sim_cfg_t;
+
+/* a buffer mapped to the daemon through the domain socket */
+typedef struct {
+    cam_mapping_buf_type type;
+    uint32_t stream_id;
+    uint32_t frame_idx;
+    int32_t plane_idx;
+    void *vaddr;
+    size_t size;
+} mm_camera_sim_map_t;
+
+typedef enum {
+    MM_CAMERA_SIM_BUF_CLIENT,  /* owned by the stack */
+    MM_CAMERA_SIM_BUF_QUEUED,  /* queued, waiting for a frame */
+    MM_CAMERA_SIM_BUF_FILLING, /* frame drawn outside the session lock */
+    MM_CAMERA_SIM_BUF_DONE,    /* filled, waiting for DQBUF */
+} mm_camera_sim_buf_state_t;
+
+typedef struct {
+    mm_camera_sim_buf_state_t state;
+    uint32_t num_planes;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    uint8_t *plane_vaddr[VIDEO_MAX_PLANES]; /* resolved at QBUF */
+    size_t plane_len[VIDEO_MAX_PLANES];
+    uint32_t sequence;
+    struct timeval timestamp;
+    uint64_t dq_ns;            /* when the stack dequeued it */
+} mm_camera_sim_buf_t;
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t frames;           /* frames delivered */
+    uint64_t drops;            /* sensor frames without a queued buffer */
+    uint64_t returned;         /* buffers queued back after a frame */
+    uint64_t hold_ns;          /* time buffers spent in the stack */
+    uint64_t hold_max_ns;
+} mm_camera_sim_stats_t;
+
+typedef struct {
+    uint32_t id;               /* server stream id */
+    int fd;                    /* eventfd of the stream file */
+    struct msm_v4l2_format_data fmt;
+    cam_stream_type_t type;    /* from the stream info at STREAMON */
+    cam_streaming_mode_t mode;
+    cam_frame_len_offset_t plane_info;
+    uint32_t num_bufs;
+    mm_camera_sim_buf_t bufs[CAM_MAX_NUM_BUFS_PER_STREAM];
+    uint32_t queued[CAM_MAX_NUM_BUFS_PER_STREAM];
+    uint32_t queued_head;
+    uint32_t queued_cnt;
+    uint32_t done[CAM_MAX_NUM_BUFS_PER_STREAM];
+    uint32_t done_head;
+    uint32_t done_cnt;
+    uint8_t streaming;
+    uint32_t burst_left;       /* frames left of a burst stream */
+    uint32_t busy;             /* buffers being filled */
+    mm_camera_sim_stats_t stats;
+} mm_camera_sim_stream_t;
+
+typedef struct {
+    int fd;                    /* memfd */
+    size_t size;
+} mm_camera_sim_ion_buf_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    mm_camera_sim_ion_buf_t bufs[MM_CAMERA_SIM_MAX_ION_HANDLES];
+} mm_camera_sim_ion_t;
+
+typedef struct {
+    uint32_t cam_idx;
+    uint32_t refcnt;           /* video files open on the node */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* session fd subscribed to MSM_CAMERA_MSM_NOTIFY, -1 if none. Events
+     * posted meanwhile are kept until someone subscribes */
+    int evt_fd;
+    struct msm_v4l2_event_data events[MM_CAMERA_SIM_MAX_EVENTS];
+    uint32_t evt_head;
+    uint32_t evt_cnt;
+
+    mm_camera_sim_map_t maps[MM_CAMERA_SIM_MAX_MAPS];
+    uint32_t num_maps;
+    mm_camera_sim_stream_t *streams[MM_CAMERA_SIM_MAX_STREAMS];
+    uint32_t next_stream_id;
+
+    /* daemon end of the domain socket */
+    int sock_fd;
+    int sock_stop_fd;
+    pthread_t sock_tid;
+
+    /* sensor */
+    pthread_t frame_tid;
+    uint8_t frame_running;
+    uint8_t frame_exit;
+    uint32_t frame_id;
+    uint32_t fps;
+    uint32_t frame_nums[MM_CAMERA_SIM_MAX_FRAME_NUMS]; /* hal3 requests */
+    uint32_t frame_num_head;
+    uint32_t frame_num_cnt;
+    uint8_t af_pending;
+    uint8_t prep_snapshot_pending;
+} mm_camera_sim_session_t;
+
+typedef struct {
+    mm_camera_sim_node_t node;
+    int fd;
+    uint32_t idx;                       /* media node or camera index */
+    mm_camera_sim_session_t *session;   /* video */
+    mm_camera_sim_stream_t *stream;     /* video, once S_PARM made it a stream */
+    mm_camera_sim_ion_t *ion;           /* ion */
+} mm_camera_sim_file_t;
+
+/* mm_camera_sim.c */
+extern mm_camera_sim_cfg_t g_sim_cfg;
+uint64_t mm_camera_sim_now_ns(void);
+void mm_camera_sim_signal(int fd);
+int mm_camera_sim_consume(int fd);
+int mm_camera_sim_real_close(int fd);
+
+/* mm_camera_sim_video.c */
+int32_t mm_camera_sim_video_open(mm_camera_sim_file_t *file);
+void mm_camera_sim_video_close(mm_camera_sim_file_t *file);
+int mm_camera_sim_video_ioctl(mm_camera_sim_file_t *file,
+        unsigned long req, void *arg);
+
+/* mm_camera_sim_server.c */
+int32_t mm_camera_sim_server_start(mm_camera_sim_session_t *session);
+void mm_camera_sim_server_stop(mm_camera_sim_session_t *session);
+void mm_camera_sim_server_addr(uint32_t vnode, struct sockaddr_un *addr,
+        socklen_t *len);
+mm_camera_sim_map_t *mm_camera_sim_find_map(mm_camera_sim_session_t *session,
+        cam_mapping_buf_type type, uint32_t stream_id, uint32_t frame_idx,
+        int32_t plane_idx);
+void mm_camera_sim_post_event(mm_camera_sim_session_t *session,
+        uint32_t command, uint32_t status);
+
+/* mm_camera_sim_sensor.c */
+void mm_camera_sim_fill_capability(mm_camera_sim_session_t *session,
+        cam_capability_t *cap);
+void mm_camera_sim_set_parms(mm_camera_sim_session_t *session,
+        parm_buffer_t *parm);
+void mm_camera_sim_do_reprocess(mm_camera_sim_session_t *session,
+        mm_camera_sim_stream_t *stream);
+int32_t mm_camera_sim_sensor_start(mm_camera_sim_session_t *session);
+void mm_camera_sim_sensor_stop(mm_camera_sim_session_t *session);
+
+#endif /* __MM_CAMERA_SIM_H__ */
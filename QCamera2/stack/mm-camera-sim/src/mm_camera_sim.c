@@ -0,0 +1,817 @@
+/* Copyright (c) 2012-2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/media.h>
+#include <linux/msm_ion.h>
+#include <media/msm_cam_sensor.h>
+
+#include "mm_camera_sim.h"
+#include "mm_camera_sim_dbg.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+volatile uint32_t gMmCameraSimLogLevel = 1;
+mm_camera_sim_cfg_t g_sim_cfg;
+
+#ifdef __BIONIC__
+typedef int mm_camera_sim_ioctl_req_t;
+#else
+typedef unsigned long mm_camera_sim_ioctl_req_t;
+#endif
+
+/* libc entry points the simulator sits in front of */
+static struct {
+    int (*open)(const char *path, int flags, ...);
+    int (*close)(int fd);
+    int (*ioctl)(int fd, mm_camera_sim_ioctl_req_t req, ...);
+    int (*epoll_ctl)(int epfd, int op, int fd, struct epoll_event *ev);
+    int (*epoll_wait)(int epfd, struct epoll_event *events, int maxevents,
+            int timeout);
+    int (*connect)(int fd, const struct sockaddr *addr, socklen_t len);
+} g_sim_real;
+
+static pthread_once_t g_sim_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_sim_files_lock = PTHREAD_MUTEX_INITIALIZER;
+static mm_camera_sim_file_t *g_sim_files[MM_CAMERA_SIM_MAX_FDS];
+
+/* EPOLLPRI registrations of simulated nodes, by fd. The eventfd behind a
+ * node only reports EPOLLIN, so the node is registered for EPOLLIN with a
+ * tagged data word naming the fd. epoll_wait hands back the caller's data
+ * and EPOLLPRI for tagged events. A node can be in one epoll set only */
+#define MM_CAMERA_SIM_PRI_TAG 0x53494d50U /* "SIMP" in the upper word */
+static struct {
+    int epfd;       /* epoll set + 1, 0 if not registered */
+    uint64_t data;  /* data word the caller registered */
+} g_sim_pri_regs[MM_CAMERA_SIM_MAX_FDS];
+static uint32_t g_sim_pri_cnt; /* registrations, 0 skips the epoll_wait scan */
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_getenv
+ *
+ * DESCRIPTION: read an unsigned config value from the environment
+ *
+ * PARAMETERS :
+ *   @name    : variable name
+ *   @def     : value if not set
+ *
+ * RETURN     : value
+ *==========================================================================*/
+static uint32_t mm_camera_sim_getenv(const char *name, uint32_t def)
+{
+    const char *val = getenv(name);
+    return (NULL != val) ? (uint32_t)strtoul(val, NULL, 0) : def;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_init
+ *
+ * DESCRIPTION: resolve the libc functions behind the simulator and read
+ *              its config, once per process
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_init(void)
+{
+    const char *sensor;
+    unsigned int w, h;
+
+    g_sim_real.open = dlsym(RTLD_NEXT, "open");
+    g_sim_real.close = dlsym(RTLD_NEXT, "close");
+    g_sim_real.ioctl = dlsym(RTLD_NEXT, "ioctl");
+    g_sim_real.epoll_ctl = dlsym(RTLD_NEXT, "epoll_ctl");
+    g_sim_real.epoll_wait = dlsym(RTLD_NEXT, "epoll_wait");
+    g_sim_real.connect = dlsym(RTLD_NEXT, "connect");
+
+    gMmCameraSimLogLevel = mm_camera_sim_getenv("MM_CAMERA_SIM_LOG", 1);
+    g_sim_cfg.num_cameras = mm_camera_sim_getenv("MM_CAMERA_SIM_CAMERAS", 2);
+    if ((g_sim_cfg.num_cameras < 1) ||
+            (g_sim_cfg.num_cameras > MM_CAMERA_SIM_MAX_CAMERAS)) {
+        g_sim_cfg.num_cameras = 2;
+    }
+    g_sim_cfg.fps = mm_camera_sim_getenv("MM_CAMERA_SIM_FPS", 30);
+    if (g_sim_cfg.fps < 1) {
+        g_sim_cfg.fps = 30;
+    }
+    g_sim_cfg.sensor_dim.width = 4000;
+    g_sim_cfg.sensor_dim.height = 3000;
+    sensor = getenv("MM_CAMERA_SIM_SENSOR");
+    if ((NULL != sensor) && (2 == sscanf(sensor, "%ux%u", &w, &h)) &&
+            (w >= 640) && (h >= 480)) {
+        g_sim_cfg.sensor_dim.width = (int32_t)(w & ~31U);
+        g_sim_cfg.sensor_dim.height = (int32_t)(h & ~31U);
+    }
+    g_sim_cfg.fill = (uint8_t)(mm_camera_sim_getenv("MM_CAMERA_SIM_FILL", 1) != 0);
+    g_sim_cfg.map_us = mm_camera_sim_getenv("MM_CAMERA_SIM_MAP_US", 0);
+
+    CDBG_HIGH("%s: %u cameras, sensor %dx%d at %u fps", __func__,
+            g_sim_cfg.num_cameras, g_sim_cfg.sensor_dim.width,
+            g_sim_cfg.sensor_dim.height, g_sim_cfg.fps);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_now_ns
+ *
+ * DESCRIPTION: monotonic time
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : time in nsec
+ *==========================================================================*/
+uint64_t mm_camera_sim_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_signal
+ *
+ * DESCRIPTION: make one more item dequeueable from a node
+ *
+ * PARAMETERS :
+ *   @fd      : eventfd of the node
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_signal(int fd)
+{
+    uint64_t val = 1;
+    if (write(fd, &val, sizeof(val)) != sizeof(val)) {
+        CDBG_ERROR("%s: eventfd %d write failed: %s", __func__, fd,
+                strerror(errno));
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_consume
+ *
+ * DESCRIPTION: take one item off the count of a node, pairs with
+ *              mm_camera_sim_signal
+ *
+ * PARAMETERS :
+ *   @fd      : eventfd of the node
+ *
+ * RETURN     : 0 on success, -1 if nothing was pending
+ *==========================================================================*/
+int mm_camera_sim_consume(int fd)
+{
+    uint64_t val;
+    return (read(fd, &val, sizeof(val)) == sizeof(val)) ? 0 : -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_real_close
+ *
+ * DESCRIPTION: close a fd the simulator owns, bypassing the fd table
+ *
+ * PARAMETERS :
+ *   @fd      : fd to close
+ *
+ * RETURN     : result of close
+ *==========================================================================*/
+int mm_camera_sim_real_close(int fd)
+{
+    pthread_once(&g_sim_once, mm_camera_sim_init);
+    return g_sim_real.close(fd);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_get_file
+ *
+ * DESCRIPTION: look up the simulated node behind a fd
+ *
+ * PARAMETERS :
+ *   @fd      : fd
+ *
+ * RETURN     : file or NULL if fd is not a simulated node
+ *==========================================================================*/
+static mm_camera_sim_file_t *mm_camera_sim_get_file(int fd)
+{
+    if ((fd < 0) || (fd >= MM_CAMERA_SIM_MAX_FDS)) {
+        return NULL;
+    }
+    return __atomic_load_n(&g_sim_files[fd], __ATOMIC_ACQUIRE);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_match
+ *
+ * DESCRIPTION: find which simulated node a path names
+ *
+ * PARAMETERS :
+ *   @path    : path passed to open
+ *   @node    : node type, filled on match
+ *   @idx     : media node or camera index, filled on match
+ *
+ * RETURN     : TRUE if the path is a simulated node
+ *==========================================================================*/
+static uint8_t mm_camera_sim_match(const char *path, mm_camera_sim_node_t *node,
+        uint32_t *idx)
+{
+    unsigned int n;
+    int end = 0;
+
+    if (NULL == path) {
+        return FALSE;
+    }
+    if ((1 == sscanf(path, "/dev/media%u%n", &n, &end)) &&
+            (path[end] == '\0') && (n <= g_sim_cfg.num_cameras)) {
+        *node = MM_CAMERA_SIM_NODE_MEDIA;
+        *idx = n;
+        return TRUE;
+    }
+    if ((1 == sscanf(path, "/dev/video%u%n", &n, &end)) &&
+            (path[end] == '\0') && (n >= MM_CAMERA_SIM_VNODE_BASE) &&
+            (n < MM_CAMERA_SIM_VNODE_BASE + g_sim_cfg.num_cameras)) {
+        *node = MM_CAMERA_SIM_NODE_VIDEO;
+        *idx = n - MM_CAMERA_SIM_VNODE_BASE;
+        return TRUE;
+    }
+    if (0 == strcmp(path, "/dev/"MM_CAMERA_SIM_SINIT_NAME)) {
+        *node = MM_CAMERA_SIM_NODE_SENSOR_INIT;
+        *idx = 0;
+        return TRUE;
+    }
+    if (0 == strcmp(path, "/dev/ion")) {
+        *node = MM_CAMERA_SIM_NODE_ION;
+        *idx = 0;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_open_node
+ *
+ * DESCRIPTION: open a simulated node, backed by a new eventfd
+ *
+ * PARAMETERS :
+ *   @node    : node type
+ *   @idx     : media node or camera index
+ *
+ * RETURN     : fd, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_open_node(mm_camera_sim_node_t node, uint32_t idx)
+{
+    mm_camera_sim_file_t *file;
+    int fd, err;
+
+    file = (mm_camera_sim_file_t *)calloc(1, sizeof(mm_camera_sim_file_t));
+    if (NULL == file) {
+        errno = ENOMEM;
+        return -1;
+    }
+    fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+    if (fd < 0) {
+        free(file);
+        return -1;
+    }
+    if (fd >= MM_CAMERA_SIM_MAX_FDS) {
+        g_sim_real.close(fd);
+        free(file);
+        errno = EMFILE;
+        return -1;
+    }
+    file->node = node;
+    file->fd = fd;
+    file->idx = idx;
+
+    if (MM_CAMERA_SIM_NODE_VIDEO == node) {
+        if (0 != mm_camera_sim_video_open(file)) {
+            err = errno;
+            g_sim_real.close(fd);
+            free(file);
+            errno = err;
+            return -1;
+        }
+    } else if (MM_CAMERA_SIM_NODE_ION == node) {
+        file->ion = (mm_camera_sim_ion_t *)calloc(1, sizeof(mm_camera_sim_ion_t));
+        if (NULL == file->ion) {
+            g_sim_real.close(fd);
+            free(file);
+            errno = ENOMEM;
+            return -1;
+        }
+        pthread_mutex_init(&file->ion->lock, NULL);
+    }
+
+    pthread_mutex_lock(&g_sim_files_lock);
+    __atomic_store_n(&g_sim_files[fd], file, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_sim_files_lock);
+    CDBG("%s: node %d idx %u fd %d", __func__, node, idx, fd);
+    return fd;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_media_ioctl
+ *
+ * DESCRIPTION: media controller ioctls. media0 is the msm_config node with
+ *              the sensor_init and sensor subdevs, mediaN is the msm_camera
+ *              node of camera N-1.
+ *
+ * PARAMETERS :
+ *   @file    : media file
+ *   @req     : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_media_ioctl(mm_camera_sim_file_t *file,
+        unsigned long req, void *arg)
+{
+    if (MEDIA_IOC_DEVICE_INFO == req) {
+        struct media_device_info *info = (struct media_device_info *)arg;
+        memset(info, 0, sizeof(*info));
+        strncpy(info->driver, "mm-camera-sim", sizeof(info->driver) - 1);
+        strncpy(info->model, (0 == file->idx) ?
+                MSM_CONFIGURATION_NAME : MSM_CAMERA_NAME,
+                sizeof(info->model) - 1);
+        snprintf(info->serial, sizeof(info->serial), "%u", file->idx);
+        strncpy(info->bus_info, "platform:mm-camera-sim",
+                sizeof(info->bus_info) - 1);
+        return 0;
+    }
+
+    if (MEDIA_IOC_ENUM_ENTITIES == req) {
+        struct media_entity_desc *entity = (struct media_entity_desc *)arg;
+        uint32_t id = entity->id;
+
+        memset(entity, 0, sizeof(*entity));
+        entity->id = id;
+        if (0 != file->idx) {
+            if (1 != id) {
+                errno = EINVAL;
+                return -1;
+            }
+            entity->type = MEDIA_ENT_T_DEVNODE_V4L;
+            entity->group_id = QCAMERA_VNODE_GROUP_ID;
+            snprintf(entity->name, sizeof(entity->name), "video%u",
+                    file->idx - 1 + MM_CAMERA_SIM_VNODE_BASE);
+            return 0;
+        }
+        if (1 == id) {
+            entity->type = MEDIA_ENT_T_V4L2_SUBDEV;
+            entity->group_id = MSM_CAMERA_SUBDEV_SENSOR_INIT;
+            strncpy(entity->name, MM_CAMERA_SIM_SINIT_NAME,
+                    sizeof(entity->name) - 1);
+            return 0;
+        }
+        if ((id >= 2) && (id < 2 + g_sim_cfg.num_cameras)) {
+            /* flags carry mount angle / 90 and facing, camera 1 faces front */
+            uint32_t facing = (3 == id) ? 1 : 0;
+            uint32_t angle = facing ? 3 : 1;
+            entity->type = MEDIA_ENT_T_V4L2_SUBDEV;
+            entity->group_id = MSM_CAMERA_SUBDEV_SENSOR;
+            entity->flags = ((facing << 8) | angle) << 8;
+            snprintf(entity->name, sizeof(entity->name), "sim_sensor%u", id - 2);
+            return 0;
+        }
+        errno = EINVAL;
+        return -1;
+    }
+
+    errno = ENOTTY;
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_ion_slot
+ *
+ * DESCRIPTION: ion handles are slot index + 1, so 0 stays invalid
+ *
+ * PARAMETERS :
+ *   @ion     : ion client
+ *   @handle  : ion handle
+ *
+ * RETURN     : buffer of the handle or NULL. Called with ion lock held
+ *==========================================================================*/
+static mm_camera_sim_ion_buf_t *mm_camera_sim_ion_slot(mm_camera_sim_ion_t *ion,
+        ion_user_handle_t handle)
+{
+    uintptr_t slot = (uintptr_t)handle;
+    if ((slot < 1) || (slot > MM_CAMERA_SIM_MAX_ION_HANDLES) ||
+            (0 == ion->bufs[slot - 1].size)) {
+        return NULL;
+    }
+    return &ion->bufs[slot - 1];
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_ion_add
+ *
+ * DESCRIPTION: store a memfd under a new ion handle
+ *
+ * PARAMETERS :
+ *   @ion     : ion client
+ *   @fd      : memfd, owned by the handle on success
+ *   @size    : buffer size
+ *   @handle  : new handle
+ *
+ * RETURN     : 0 on success, -1 if out of handles. Called with ion lock held
+ *==========================================================================*/
+static int mm_camera_sim_ion_add(mm_camera_sim_ion_t *ion, int fd, size_t size,
+        ion_user_handle_t *handle)
+{
+    uintptr_t i;
+    for (i = 0; i < MM_CAMERA_SIM_MAX_ION_HANDLES; i++) {
+        if (0 == ion->bufs[i].size) {
+            ion->bufs[i].fd = fd;
+            ion->bufs[i].size = size;
+            *handle = (ion_user_handle_t)(i + 1);
+            return 0;
+        }
+    }
+    errno = ENOMEM;
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_ion_ioctl
+ *
+ * DESCRIPTION: ion ioctls on memfd backed buffers. CPU memory is coherent,
+ *              so cache maintenance is a no-op.
+ *
+ * PARAMETERS :
+ *   @file    : ion file
+ *   @req     : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_ion_ioctl(mm_camera_sim_file_t *file,
+        unsigned long req, void *arg)
+{
+    mm_camera_sim_ion_t *ion = file->ion;
+    mm_camera_sim_ion_buf_t *buf;
+    int rc = 0, fd;
+
+    if (ION_IOC_CUSTOM == req) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ion->lock);
+    if (ION_IOC_ALLOC == req) {
+        struct ion_allocation_data *alloc = (struct ion_allocation_data *)arg;
+        fd = (int)syscall(__NR_memfd_create, "mm-camera-sim", MFD_CLOEXEC);
+        if ((fd < 0) || (ftruncate(fd, (off_t)alloc->len) < 0)) {
+            CDBG_ERROR("%s: memfd of %zu bytes failed: %s", __func__,
+                    (size_t)alloc->len, strerror(errno));
+            if (fd >= 0) {
+                g_sim_real.close(fd);
+            }
+            rc = -1;
+        } else if (0 != mm_camera_sim_ion_add(ion, fd, alloc->len,
+                &alloc->handle)) {
+            g_sim_real.close(fd);
+            rc = -1;
+        }
+    } else if ((ION_IOC_SHARE == req) || (ION_IOC_MAP == req)) {
+        struct ion_fd_data *data = (struct ion_fd_data *)arg;
+        buf = mm_camera_sim_ion_slot(ion, data->handle);
+        if (NULL == buf) {
+            errno = EINVAL;
+            rc = -1;
+        } else {
+            data->fd = fcntl(buf->fd, F_DUPFD_CLOEXEC, 0);
+            rc = (data->fd < 0) ? -1 : 0;
+        }
+    } else if (ION_IOC_IMPORT == req) {
+        struct ion_fd_data *data = (struct ion_fd_data *)arg;
+        struct stat st;
+        fd = fcntl(data->fd, F_DUPFD_CLOEXEC, 0);
+        if ((fd < 0) || (fstat(fd, &st) < 0) || (st.st_size <= 0)) {
+            if (fd >= 0) {
+                g_sim_real.close(fd);
+            }
+            errno = EINVAL;
+            rc = -1;
+        } else if (0 != mm_camera_sim_ion_add(ion, fd, (size_t)st.st_size,
+                &data->handle)) {
+            g_sim_real.close(fd);
+            rc = -1;
+        }
+    } else if (ION_IOC_FREE == req) {
+        struct ion_handle_data *data = (struct ion_handle_data *)arg;
+        buf = mm_camera_sim_ion_slot(ion, data->handle);
+        if (NULL == buf) {
+            errno = EINVAL;
+            rc = -1;
+        } else {
+            g_sim_real.close(buf->fd);
+            buf->size = 0;
+        }
+    } else {
+        errno = ENOTTY;
+        rc = -1;
+    }
+    pthread_mutex_unlock(&ion->lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_ioctl
+ *
+ * DESCRIPTION: dispatch an ioctl on a simulated node
+ *
+ * PARAMETERS :
+ *   @file    : file of the node
+ *   @req     : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_ioctl(mm_camera_sim_file_t *file, unsigned long req,
+        void *arg)
+{
+    switch (file->node) {
+    case MM_CAMERA_SIM_NODE_MEDIA:
+        return mm_camera_sim_media_ioctl(file, req, arg);
+    case MM_CAMERA_SIM_NODE_SENSOR_INIT:
+        /* sensors are probed as soon as they exist */
+        if (VIDIOC_MSM_SENSOR_INIT_CFG == req) {
+            return 0;
+        }
+        break;
+    case MM_CAMERA_SIM_NODE_VIDEO:
+        return mm_camera_sim_video_ioctl(file, req, arg);
+    case MM_CAMERA_SIM_NODE_ION:
+        return mm_camera_sim_ion_ioctl(file, req, arg);
+    default:
+        break;
+    }
+    errno = ENOTTY;
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_release
+ *
+ * DESCRIPTION: tear down a simulated node on its last close
+ *
+ * PARAMETERS :
+ *   @file    : file of the node, freed
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_release(mm_camera_sim_file_t *file)
+{
+    uint32_t i;
+
+    if (MM_CAMERA_SIM_NODE_VIDEO == file->node) {
+        mm_camera_sim_video_close(file);
+    } else if (MM_CAMERA_SIM_NODE_ION == file->node) {
+        /* like the ion driver, closing the client frees its handles */
+        for (i = 0; i < MM_CAMERA_SIM_MAX_ION_HANDLES; i++) {
+            if (0 != file->ion->bufs[i].size) {
+                g_sim_real.close(file->ion->bufs[i].fd);
+            }
+        }
+        pthread_mutex_destroy(&file->ion->lock);
+        free(file->ion);
+    }
+    free(file);
+}
+
+/* interposed libc entry points */
+
+int open(const char *path, int flags, ...)
+{
+    mm_camera_sim_node_t node;
+    uint32_t idx;
+    mode_t mode = 0;
+    va_list ap;
+
+    pthread_once(&g_sim_once, mm_camera_sim_init);
+    if (mm_camera_sim_match(path, &node, &idx)) {
+        return mm_camera_sim_open_node(node, idx);
+    }
+    if (flags & O_CREAT) {
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, int);
+        va_end(ap);
+    }
+    return g_sim_real.open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    va_list ap;
+
+    if (flags & O_CREAT) {
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, int);
+        va_end(ap);
+    }
+    return open(path, flags | O_LARGEFILE, mode);
+}
+
+/* fortified open from _FORTIFY_SOURCE builds */
+int __open_2(const char *path, int flags)
+{
+    return open(path, flags);
+}
+
+int __open64_2(const char *path, int flags)
+{
+    return open(path, flags | O_LARGEFILE);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_set_pri_reg
+ *
+ * DESCRIPTION: record or drop the EPOLLPRI registration of a simulated node
+ *
+ * PARAMETERS :
+ *   @fd      : node fd
+ *   @epfd    : epoll set, -1 to drop the registration
+ *   @data    : data word the caller registered
+ *
+ * RETURN     : 0 on success, -1 with errno set to EBUSY if the node is
+ *              registered in another epoll set
+ *==========================================================================*/
+static int mm_camera_sim_set_pri_reg(int fd, int epfd, uint64_t data)
+{
+    int cur = __atomic_load_n(&g_sim_pri_regs[fd].epfd, __ATOMIC_ACQUIRE);
+
+    if ((epfd >= 0) && (0 != cur) && (cur != epfd + 1)) {
+        CDBG_ERROR("%s: fd %d is already in epoll set %d, can not add it to %d",
+                __func__, fd, cur - 1, epfd);
+        errno = EBUSY;
+        return -1;
+    }
+    if (epfd >= 0) {
+        __atomic_store_n(&g_sim_pri_regs[fd].data, data, __ATOMIC_RELAXED);
+        cur = __atomic_exchange_n(&g_sim_pri_regs[fd].epfd, epfd + 1,
+                __ATOMIC_RELEASE);
+        if (0 == cur) {
+            __atomic_add_fetch(&g_sim_pri_cnt, 1, __ATOMIC_RELAXED);
+        }
+    } else if (0 != __atomic_exchange_n(&g_sim_pri_regs[fd].epfd, 0,
+            __ATOMIC_RELEASE)) {
+        __atomic_sub_fetch(&g_sim_pri_cnt, 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+int close(int fd)
+{
+    mm_camera_sim_file_t *file;
+
+    pthread_once(&g_sim_once, mm_camera_sim_init);
+    file = mm_camera_sim_get_file(fd);
+    if (NULL != file) {
+        pthread_mutex_lock(&g_sim_files_lock);
+        __atomic_store_n(&g_sim_files[fd], NULL, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&g_sim_files_lock);
+        mm_camera_sim_set_pri_reg(fd, -1, 0);
+        mm_camera_sim_release(file);
+    }
+    return g_sim_real.close(fd);
+}
+
+int ioctl(int fd, mm_camera_sim_ioctl_req_t req, ...)
+{
+    mm_camera_sim_file_t *file;
+    void *arg;
+    va_list ap;
+
+    pthread_once(&g_sim_once, mm_camera_sim_init);
+    va_start(ap, req);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    file = mm_camera_sim_get_file(fd);
+    if (NULL != file) {
+        return mm_camera_sim_ioctl(file, (unsigned long)(unsigned int)req, arg);
+    }
+    return g_sim_real.ioctl(fd, req, arg);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+    struct epoll_event sim_ev;
+    int rc;
+
+    pthread_once(&g_sim_once, mm_camera_sim_init);
+    if (NULL == mm_camera_sim_get_file(fd)) {
+        return g_sim_real.epoll_ctl(epfd, op, fd, ev);
+    }
+    /* the eventfd behind a node only ever reports EPOLLIN */
+    if ((EPOLL_CTL_DEL != op) && (NULL != ev) && (ev->events & EPOLLPRI)) {
+        if (0 != mm_camera_sim_set_pri_reg(fd, epfd, ev->data.u64)) {
+            return -1;
+        }
+        sim_ev.events = (ev->events & ~(uint32_t)EPOLLPRI) | EPOLLIN;
+        sim_ev.data.u64 = ((uint64_t)MM_CAMERA_SIM_PRI_TAG << 32) |
+                (uint32_t)fd;
+        rc = g_sim_real.epoll_ctl(epfd, op, fd, &sim_ev);
+        if ((0 != rc) && (EPOLL_CTL_ADD == op)) {
+            mm_camera_sim_set_pri_reg(fd, -1, 0);
+        }
+        return rc;
+    }
+    if (__atomic_load_n(&g_sim_pri_regs[fd].epfd, __ATOMIC_RELAXED) ==
+            epfd + 1) {
+        mm_camera_sim_set_pri_reg(fd, -1, 0);
+    }
+    return g_sim_real.epoll_ctl(epfd, op, fd, ev);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+        int timeout)
+{
+    uint32_t fd;
+    int rc, i;
+
+    pthread_once(&g_sim_once, mm_camera_sim_init);
+    rc = g_sim_real.epoll_wait(epfd, events, maxevents, timeout);
+    if ((rc <= 0) ||
+            (0 == __atomic_load_n(&g_sim_pri_cnt, __ATOMIC_RELAXED))) {
+        return rc;
+    }
+    for (i = 0; i < rc; i++) {
+        if ((uint32_t)(events[i].data.u64 >> 32) != MM_CAMERA_SIM_PRI_TAG) {
+            continue;
+        }
+        fd = (uint32_t)events[i].data.u64;
+        if ((fd >= MM_CAMERA_SIM_MAX_FDS) ||
+                (__atomic_load_n(&g_sim_pri_regs[fd].epfd, __ATOMIC_ACQUIRE) !=
+                 epfd + 1)) {
+            continue;
+        }
+        events[i].data.u64 =
+                __atomic_load_n(&g_sim_pri_regs[fd].data, __ATOMIC_RELAXED);
+        if (events[i].events & EPOLLIN) {
+            events[i].events =
+                    (events[i].events & ~(uint32_t)EPOLLIN) | EPOLLPRI;
+        }
+    }
+    return rc;
+}
+
+int connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    const struct sockaddr_un *un = (const struct sockaddr_un *)addr;
+    struct sockaddr_un sim_addr;
+    socklen_t sim_len;
+    unsigned int vnode;
+    int end = 0;
+
+    pthread_once(&g_sim_once, mm_camera_sim_init);
+    /* the daemon socket of a simulated camera is served in this process */
+    if ((NULL != addr) && (AF_UNIX == addr->sa_family) &&
+            (1 == sscanf(un->sun_path, QCAMERA_DUMP_FRM_LOCATION"cam_socket%u%n",
+                    &vnode, &end)) && (un->sun_path[end] == '\0') &&
+            (vnode >= MM_CAMERA_SIM_VNODE_BASE) &&
+            (vnode < MM_CAMERA_SIM_VNODE_BASE + g_sim_cfg.num_cameras)) {
+        mm_camera_sim_server_addr(vnode, &sim_addr, &sim_len);
+        return g_sim_real.connect(fd, (struct sockaddr *)&sim_addr, sim_len);
+    }
+    return g_sim_real.connect(fd, addr, len);
+}
@@ -0,0 +1,1188 @@
+/* Copyright (c) 2012-2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* mm-camera-sim-runner: streams the camera HAL on libmmcamera_sim.
+ *
+ * The runner re-executes itself with the simulator preloaded, loads the
+ * camera HAL module and walks every camera it reports through open,
+ * capability query, preview streaming and close:
+ *   HAL1: set_callbacks, get/set_parameters, set_preview_window with a
+ *         window backed by gralloc, start_preview, stop_preview, release
+ *   HAL3: initialize, construct_default_request_settings for every
+ *         template, configure_streams with one preview stream, repeating
+ *         preview requests on gralloc buffers, flush
+ * gralloc allocates through the simulated ion, so no display or camera
+ * driver is needed. For every camera the runner reports preview frames,
+ * frame rate and the latency from sensor timestamp to the buffer coming
+ * back to the window (HAL1) or to the result callback (HAL3).
+ *
+ * usage: mm-camera-sim-runner [-1] [-p libmmcamera_sim.so] [-t seconds]
+ *                             [-w WxH]
+ *   -1   open every camera as HAL1 through open_legacy
+ *   -p   simulator library to preload
+ *   -t   seconds to stream preview for, 0 only sets the session up
+ *   -w   preview size, 640x480 by default */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <hardware/hardware.h>
+#include <hardware/gralloc.h>
+#include <hardware/camera_common.h>
+#include <hardware/camera.h>
+#include <hardware/camera3.h>
+
+#include "mm_camera_sim_dbg.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define MM_CAMERA_SIM_RUNNER_LIB "libmmcamera_sim.so"
+#define MM_CAMERA_SIM_RUNNER_REEXEC "MM_CAMERA_SIM_RUNNER"
+#define MM_CAMERA_SIM_RUNNER_SECONDS 3
+#define MM_CAMERA_SIM_RUNNER_MAX_BUFS 32
+#define MM_CAMERA_SIM_RUNNER_MAX_SAMPLES 8192
+#define MM_CAMERA_SIM_RUNNER_MAX_INFLIGHT 64 /* power of 2 */
+#define MM_CAMERA_SIM_RUNNER_DRAIN_MS 2000
+
+volatile uint32_t gMmCameraSimLogLevel = 1;
+
+/* what main asked for, shared by every camera */
+static struct {
+    int seconds;
+    int width;
+    int height;
+    alloc_device_t *alloc;
+} g_runner_cfg = {
+    MM_CAMERA_SIM_RUNNER_SECONDS, 640, 480, NULL,
+};
+
+/* preview frames seen by the app side and their latency */
+typedef struct {
+    pthread_mutex_t lock;
+    int64_t first_ns;
+    int64_t last_ns;
+    uint32_t frames;
+    uint32_t num_lat;
+    int64_t lat_ns[MM_CAMERA_SIM_RUNNER_MAX_SAMPLES];
+} mm_camera_sim_runner_stats_t;
+
+/* preview window handed to HAL1. Buffers are allocated from gralloc the
+ * first time they are dequeued, up to the count the HAL set. The last
+ * enqueued buffer stays on "display" until the next one is enqueued */
+typedef struct {
+    preview_stream_ops_t ops; /* must be first */
+    pthread_mutex_t lock;
+    int width;
+    int height;
+    int format;
+    int usage;
+    int count;
+    int num_bufs;
+    buffer_handle_t bufs[MM_CAMERA_SIM_RUNNER_MAX_BUFS];
+    uint8_t queued[MM_CAMERA_SIM_RUNNER_MAX_BUFS]; /* held by the window */
+    int displayed;
+    int64_t timestamp;
+    mm_camera_sim_runner_stats_t stats;
+} mm_camera_sim_runner_window_t;
+
+/* HAL3 session: preview buffers and the requests in flight */
+typedef struct {
+    camera3_callback_ops_t ops; /* must be first */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    camera3_stream_t stream;
+    int num_bufs;
+    buffer_handle_t bufs[MM_CAMERA_SIM_RUNNER_MAX_BUFS];
+    uint8_t free[MM_CAMERA_SIM_RUNNER_MAX_BUFS]; /* not with the HAL */
+    int num_free;
+    int64_t shutter_ns[MM_CAMERA_SIM_RUNNER_MAX_INFLIGHT];
+    uint32_t errors;
+    mm_camera_sim_runner_stats_t stats;
+} mm_camera_sim_runner_session3_t;
+
+/* camera_memory_t handed to HAL1, malloc or mmap of the fd backed */
+typedef struct {
+    camera_memory_t mem;
+    size_t len;
+    uint8_t mapped;
+} mm_camera_sim_runner_mem_t;
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_mem_release
+ *
+ * DESCRIPTION: release memory got from mm_camera_sim_runner_get_memory
+ *
+ * PARAMETERS :
+ *   @mem     : memory to be released
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_mem_release(camera_memory_t *mem)
+{
+    mm_camera_sim_runner_mem_t *rmem = (mm_camera_sim_runner_mem_t *)mem;
+
+    if (NULL == rmem) {
+        return;
+    }
+    if (rmem->mapped) {
+        munmap(rmem->mem.data, rmem->len);
+    } else {
+        free(rmem->mem.data);
+    }
+    free(rmem);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_get_memory
+ *
+ * DESCRIPTION: camera_request_memory for HAL1, stands in for the memory
+ *              camera service hands out
+ *
+ * PARAMETERS :
+ *   @fd       : fd to be mapped, -1 to allocate
+ *   @buf_size : size of one buffer
+ *   @num_bufs : number of buffers
+ *   @user     : not used
+ *
+ * RETURN     : memory, NULL on failure
+ *==========================================================================*/
+static camera_memory_t *mm_camera_sim_runner_get_memory(int fd,
+        size_t buf_size, unsigned int num_bufs, void *user)
+{
+    mm_camera_sim_runner_mem_t *rmem;
+    size_t len = buf_size * num_bufs;
+
+    (void)user;
+    rmem = (mm_camera_sim_runner_mem_t *)calloc(1, sizeof(*rmem));
+    if (NULL == rmem) {
+        return NULL;
+    }
+    if (fd >= 0) {
+        rmem->mem.data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+        if (MAP_FAILED == rmem->mem.data) {
+            CDBG_ERROR("%s: mmap of fd %d failed", __func__, fd);
+            free(rmem);
+            return NULL;
+        }
+        rmem->mapped = TRUE;
+    } else {
+        rmem->mem.data = calloc(1, len);
+        if (NULL == rmem->mem.data) {
+            free(rmem);
+            return NULL;
+        }
+    }
+    rmem->len = len;
+    rmem->mem.size = len;
+    rmem->mem.handle = rmem;
+    rmem->mem.release = mm_camera_sim_runner_mem_release;
+    return &rmem->mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_now
+ *
+ * DESCRIPTION: monotonic time, the clock the simulator stamps frames with
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : time in ns
+ *==========================================================================*/
+static int64_t mm_camera_sim_runner_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_stats_frame
+ *
+ * DESCRIPTION: account one preview frame handed back to the app side
+ *
+ * PARAMETERS :
+ *   @stats   : statistics of the camera
+ *   @ts_ns   : sensor timestamp of the frame, 0 if not known
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_stats_frame(
+        mm_camera_sim_runner_stats_t *stats, int64_t ts_ns)
+{
+    int64_t now = mm_camera_sim_runner_now();
+
+    pthread_mutex_lock(&stats->lock);
+    if (0 == stats->frames) {
+        stats->first_ns = now;
+    }
+    stats->last_ns = now;
+    stats->frames++;
+    if ((ts_ns > 0) && (now >= ts_ns) &&
+            (stats->num_lat < MM_CAMERA_SIM_RUNNER_MAX_SAMPLES)) {
+        stats->lat_ns[stats->num_lat++] = now - ts_ns;
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
+
+static int mm_camera_sim_runner_cmp_ns(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_stats_report
+ *
+ * DESCRIPTION: print frames, frame rate and latency percentiles. Called
+ *              once streaming stopped
+ *
+ * PARAMETERS :
+ *   @stats   : statistics of the camera
+ *   @id      : camera id
+ *   @hal     : HAL name for the report
+ *
+ * RETURN     : 0 if frames came through, -1 otherwise
+ *==========================================================================*/
+static int mm_camera_sim_runner_stats_report(
+        mm_camera_sim_runner_stats_t *stats, int id, const char *hal)
+{
+    double fps = 0.0;
+    uint32_t n = stats->num_lat;
+
+    if (stats->frames > 1) {
+        fps = (double)(stats->frames - 1) * 1e9 /
+                (double)(stats->last_ns - stats->first_ns);
+    }
+    printf("camera %d: %s preview %u frames, %.1f fps", id, hal,
+            stats->frames, fps);
+    if (n > 0) {
+        qsort(stats->lat_ns, n, sizeof(stats->lat_ns[0]),
+                mm_camera_sim_runner_cmp_ns);
+        printf(", latency p50 %.2f ms p99 %.2f ms max %.2f ms",
+                (double)stats->lat_ns[(n - 1) * 50 / 100] / 1e6,
+                (double)stats->lat_ns[(n - 1) * 99 / 100] / 1e6,
+                (double)stats->lat_ns[n - 1] / 1e6);
+    }
+    printf("\n");
+    return (stats->frames > 0) ? 0 : -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_alloc
+ *
+ * DESCRIPTION: allocate one gralloc buffer
+ *
+ * PARAMETERS :
+ *   @width   : width in pixels
+ *   @height  : height in lines
+ *   @format  : HAL pixel format
+ *   @usage   : gralloc usage
+ *
+ * RETURN     : buffer handle, NULL on failure
+ *==========================================================================*/
+static buffer_handle_t mm_camera_sim_runner_alloc(int width, int height,
+        int format, int usage)
+{
+    alloc_device_t *alloc = g_runner_cfg.alloc;
+    buffer_handle_t handle = NULL;
+    int stride = 0;
+    int rc;
+
+    rc = alloc->alloc(alloc, width, height, format, usage, &handle, &stride);
+    if ((0 != rc) || (NULL == handle)) {
+        CDBG_ERROR("%s: %dx%d format 0x%x usage 0x%x failed %d", __func__,
+                width, height, format, usage, rc);
+        return NULL;
+    }
+    return handle;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_win_idx
+ *
+ * DESCRIPTION: find the window buffer behind a handle pointer, lock held
+ *
+ * PARAMETERS :
+ *   @win     : preview window
+ *   @buffer  : handle pointer the HAL got from dequeue_buffer
+ *
+ * RETURN     : buffer index, -1 if the buffer is not the window's
+ *==========================================================================*/
+static int mm_camera_sim_runner_win_idx(mm_camera_sim_runner_window_t *win,
+        buffer_handle_t *buffer)
+{
+    int idx = (int)(buffer - win->bufs);
+
+    if ((idx < 0) || (idx >= win->num_bufs) || (win->queued[idx])) {
+        CDBG_ERROR("%s: %p is not dequeued from the window", __func__,
+                buffer);
+        return -1;
+    }
+    return idx;
+}
+
+static int mm_camera_sim_runner_win_dequeue(struct preview_stream_ops *w,
+        buffer_handle_t **buffer, int *stride)
+{
+    mm_camera_sim_runner_window_t *win = (mm_camera_sim_runner_window_t *)w;
+    int i, rc = -EBUSY;
+
+    pthread_mutex_lock(&win->lock);
+    for (i = 0; i < win->num_bufs; i++) {
+        if (win->queued[i]) {
+            break;
+        }
+    }
+    if ((i == win->num_bufs) && (win->num_bufs < win->count)) {
+        win->bufs[i] = mm_camera_sim_runner_alloc(win->width, win->height,
+                win->format, win->usage);
+        if (NULL != win->bufs[i]) {
+            win->queued[i] = TRUE;
+            win->num_bufs++;
+        } else {
+            rc = -ENOMEM;
+        }
+    }
+    if (i < win->num_bufs) {
+        win->queued[i] = FALSE;
+        *buffer = &win->bufs[i];
+        *stride = win->width;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&win->lock);
+    return rc;
+}
+
+static int mm_camera_sim_runner_win_enqueue(struct preview_stream_ops *w,
+        buffer_handle_t *buffer)
+{
+    mm_camera_sim_runner_window_t *win = (mm_camera_sim_runner_window_t *)w;
+    int64_t ts;
+    int idx;
+
+    pthread_mutex_lock(&win->lock);
+    idx = mm_camera_sim_runner_win_idx(win, buffer);
+    if (idx < 0) {
+        pthread_mutex_unlock(&win->lock);
+        return -EINVAL;
+    }
+    /* the new frame replaces the one on display */
+    if (win->displayed >= 0) {
+        win->queued[win->displayed] = TRUE;
+    }
+    win->displayed = idx;
+    ts = win->timestamp;
+    win->timestamp = 0;
+    pthread_mutex_unlock(&win->lock);
+
+    mm_camera_sim_runner_stats_frame(&win->stats, ts);
+    return 0;
+}
+
+static int mm_camera_sim_runner_win_cancel(struct preview_stream_ops *w,
+        buffer_handle_t *buffer)
+{
+    mm_camera_sim_runner_window_t *win = (mm_camera_sim_runner_window_t *)w;
+    int idx;
+
+    pthread_mutex_lock(&win->lock);
+    idx = mm_camera_sim_runner_win_idx(win, buffer);
+    if (idx >= 0) {
+        win->queued[idx] = TRUE;
+    }
+    pthread_mutex_unlock(&win->lock);
+    return (idx >= 0) ? 0 : -EINVAL;
+}
+
+static int mm_camera_sim_runner_win_set_count(struct preview_stream_ops *w,
+        int count)
+{
+    mm_camera_sim_runner_window_t *win = (mm_camera_sim_runner_window_t *)w;
+    int rc = 0;
+
+    pthread_mutex_lock(&win->lock);
+    if ((count < win->num_bufs) || (count > MM_CAMERA_SIM_RUNNER_MAX_BUFS)) {
+        CDBG_ERROR("%s: %d buffers not supported", __func__, count);
+        rc = -EINVAL;
+    } else {
+        win->count = count;
+    }
+    pthread_mutex_unlock(&win->lock);
+    return rc;
+}
+
+static int mm_camera_sim_runner_win_set_geometry(struct preview_stream_ops *w,
+        int width, int height, int format)
+{
+    mm_camera_sim_runner_window_t *win = (mm_camera_sim_runner_window_t *)w;
+    int rc = 0;
+
+    pthread_mutex_lock(&win->lock);
+    if (win->num_bufs > 0) {
+        /* not needed by the runner, buffers are only freed at the end */
+        CDBG_ERROR("%s: geometry change with buffers allocated", __func__);
+        rc = -EBUSY;
+    } else {
+        win->width = width;
+        win->height = height;
+        win->format = format;
+    }
+    pthread_mutex_unlock(&win->lock);
+    return rc;
+}
+
+static int mm_camera_sim_runner_win_set_crop(struct preview_stream_ops *w,
+        int left, int top, int right, int bottom)
+{
+    (void)w;
+    (void)left;
+    (void)top;
+    (void)right;
+    (void)bottom;
+    return 0;
+}
+
+static int mm_camera_sim_runner_win_set_usage(struct preview_stream_ops *w,
+        int usage)
+{
+    mm_camera_sim_runner_window_t *win = (mm_camera_sim_runner_window_t *)w;
+
+    pthread_mutex_lock(&win->lock);
+    win->usage = usage | GRALLOC_USAGE_HW_TEXTURE;
+    pthread_mutex_unlock(&win->lock);
+    return 0;
+}
+
+static int mm_camera_sim_runner_win_set_swap_interval(
+        struct preview_stream_ops *w, int interval)
+{
+    (void)w;
+    (void)interval;
+    return 0;
+}
+
+static int mm_camera_sim_runner_win_get_min_undequeued(
+        const struct preview_stream_ops *w, int *count)
+{
+    (void)w;
+    /* the buffer on display */
+    *count = 1;
+    return 0;
+}
+
+static int mm_camera_sim_runner_win_lock(struct preview_stream_ops *w,
+        buffer_handle_t *buffer)
+{
+    (void)w;
+    (void)buffer;
+    return 0;
+}
+
+static int mm_camera_sim_runner_win_set_timestamp(
+        struct preview_stream_ops *w, int64_t timestamp)
+{
+    mm_camera_sim_runner_window_t *win = (mm_camera_sim_runner_window_t *)w;
+
+    pthread_mutex_lock(&win->lock);
+    win->timestamp = timestamp;
+    pthread_mutex_unlock(&win->lock);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_win_create
+ *
+ * DESCRIPTION: create a preview window for HAL1
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : window, NULL if out of memory
+ *==========================================================================*/
+static mm_camera_sim_runner_window_t *mm_camera_sim_runner_win_create(void)
+{
+    mm_camera_sim_runner_window_t *win;
+
+    win = (mm_camera_sim_runner_window_t *)calloc(1, sizeof(*win));
+    if (NULL == win) {
+        return NULL;
+    }
+    win->ops.dequeue_buffer = mm_camera_sim_runner_win_dequeue;
+    win->ops.enqueue_buffer = mm_camera_sim_runner_win_enqueue;
+    win->ops.cancel_buffer = mm_camera_sim_runner_win_cancel;
+    win->ops.set_buffer_count = mm_camera_sim_runner_win_set_count;
+    win->ops.set_buffers_geometry = mm_camera_sim_runner_win_set_geometry;
+    win->ops.set_crop = mm_camera_sim_runner_win_set_crop;
+    win->ops.set_usage = mm_camera_sim_runner_win_set_usage;
+    win->ops.set_swap_interval = mm_camera_sim_runner_win_set_swap_interval;
+    win->ops.get_min_undequeued_buffer_count =
+            mm_camera_sim_runner_win_get_min_undequeued;
+    win->ops.lock_buffer = mm_camera_sim_runner_win_lock;
+    win->ops.set_timestamp = mm_camera_sim_runner_win_set_timestamp;
+    pthread_mutex_init(&win->lock, NULL);
+    pthread_mutex_init(&win->stats.lock, NULL);
+    win->displayed = -1;
+    return win;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_win_destroy
+ *
+ * DESCRIPTION: free a preview window and its buffers. The HAL must have
+ *              given every buffer back
+ *
+ * PARAMETERS :
+ *   @win     : preview window
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_win_destroy(mm_camera_sim_runner_window_t *win)
+{
+    int i;
+
+    for (i = 0; i < win->num_bufs; i++) {
+        if (!win->queued[i] && (i != win->displayed)) {
+            CDBG_ERROR("%s: buffer %d still dequeued", __func__, i);
+        }
+        g_runner_cfg.alloc->free(g_runner_cfg.alloc, win->bufs[i]);
+    }
+    pthread_mutex_destroy(&win->stats.lock);
+    pthread_mutex_destroy(&win->lock);
+    free(win);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_set_param
+ *
+ * DESCRIPTION: set one key of a flattened HAL1 parameter string
+ *
+ * PARAMETERS :
+ *   @params  : key=value pairs separated by ';'
+ *   @key     : key to set
+ *   @value   : new value
+ *
+ * RETURN     : new parameter string to be freed by the caller, NULL if
+ *              out of memory
+ *==========================================================================*/
+static char *mm_camera_sim_runner_set_param(const char *params,
+        const char *key, const char *value)
+{
+    size_t key_len = strlen(key);
+    size_t len = strlen(params) + key_len + strlen(value) + 3;
+    const char *p = params;
+    char *out = (char *)malloc(len);
+    char *o = out;
+
+    if (NULL == out) {
+        return NULL;
+    }
+    /* copy every pair but the one being set, then append it */
+    while ('\0' != *p) {
+        const char *end = strchr(p, ';');
+        size_t pair_len = (NULL != end) ? (size_t)(end - p) : strlen(p);
+        if ((pair_len <= key_len) || (0 != strncmp(p, key, key_len)) ||
+                ('=' != p[key_len])) {
+            memcpy(o, p, pair_len);
+            o += pair_len;
+            *o++ = ';';
+        }
+        p += pair_len;
+        if (';' == *p) {
+            p++;
+        }
+    }
+    snprintf(o, len - (size_t)(o - out), "%s=%s", key, value);
+    return out;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_notify1
+ *
+ * DESCRIPTION: HAL1 notify callback
+ *
+ * PARAMETERS : see camera_notify_callback
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_notify1(int32_t msg_type, int32_t ext1,
+        int32_t ext2, void *user)
+{
+    CDBG_HIGH("camera %ld: notify 0x%x %d %d", (long)user, msg_type, ext1,
+            ext2);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_data1
+ *
+ * DESCRIPTION: HAL1 data callback
+ *
+ * PARAMETERS : see camera_data_callback
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_data1(int32_t msg_type,
+        const camera_memory_t *data, unsigned int index,
+        camera_frame_metadata_t *metadata, void *user)
+{
+    (void)metadata;
+    CDBG_HIGH("camera %ld: data 0x%x %zu bytes index %u", (long)user,
+            msg_type, (NULL != data) ? data->size : 0, index);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_data_ts1
+ *
+ * DESCRIPTION: HAL1 timestamped data callback, not expected as nothing
+ *              is recorded
+ *
+ * PARAMETERS : see camera_data_timestamp_callback
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_data_ts1(int64_t timestamp, int32_t msg_type,
+        const camera_memory_t *data, unsigned int index, void *user)
+{
+    (void)timestamp;
+    (void)data;
+    CDBG_HIGH("camera %ld: data_ts 0x%x index %u", (long)user, msg_type,
+            index);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_hal1
+ *
+ * DESCRIPTION: bring up one camera as HAL1
+ *
+ * PARAMETERS :
+ *   @module  : camera module
+ *   @id      : camera id
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+static int mm_camera_sim_runner_hal1(camera_module_t *module, int id)
+{
+    hw_device_t *hw_dev = NULL;
+    camera_device_t *dev;
+    mm_camera_sim_runner_window_t *win = NULL;
+    char name[8];
+    char size[24];
+    char *params;
+    char *new_params = NULL;
+    int rc;
+
+    snprintf(name, sizeof(name), "%d", id);
+    if (NULL != module->open_legacy) {
+        rc = module->open_legacy(&module->common, name,
+                CAMERA_DEVICE_API_VERSION_1_0, &hw_dev);
+    } else {
+        rc = module->common.methods->open(&module->common, name, &hw_dev);
+    }
+    if ((0 != rc) || (NULL == hw_dev)) {
+        CDBG_ERROR("camera %d: HAL1 open failed %d", id, rc);
+        return -1;
+    }
+    dev = (camera_device_t *)hw_dev;
+
+    dev->ops->set_callbacks(dev, mm_camera_sim_runner_notify1,
+            mm_camera_sim_runner_data1, mm_camera_sim_runner_data_ts1,
+            mm_camera_sim_runner_get_memory, (void *)(long)id);
+
+    params = dev->ops->get_parameters(dev);
+    if (NULL == params) {
+        CDBG_ERROR("camera %d: get_parameters failed", id);
+        rc = -1;
+    } else {
+        printf("camera %d: HAL1 parameters %zu bytes\n", id, strlen(params));
+        snprintf(size, sizeof(size), "%dx%d", g_runner_cfg.width,
+                g_runner_cfg.height);
+        new_params = mm_camera_sim_runner_set_param(params, "preview-size",
+                size);
+        rc = (NULL != new_params) ? dev->ops->set_parameters(dev, new_params)
+                : -1;
+        if (0 != rc) {
+            CDBG_ERROR("camera %d: set_parameters with preview %s failed %d",
+                    id, size, rc);
+        }
+        free(new_params);
+        if (NULL != dev->ops->put_parameters) {
+            dev->ops->put_parameters(dev, params);
+        }
+    }
+
+    if ((0 == rc) && (g_runner_cfg.seconds > 0)) {
+        win = mm_camera_sim_runner_win_create();
+        rc = (NULL != win) ? dev->ops->set_preview_window(dev, &win->ops) : -1;
+        if (0 != rc) {
+            CDBG_ERROR("camera %d: set_preview_window failed %d", id, rc);
+        }
+    }
+
+    if (0 == rc) {
+        /* without a window the preview is prepared and left waiting */
+        rc = dev->ops->start_preview(dev);
+        if (0 != rc) {
+            CDBG_ERROR("camera %d: start_preview failed %d", id, rc);
+        } else {
+            sleep((unsigned int)g_runner_cfg.seconds);
+            dev->ops->stop_preview(dev);
+        }
+    }
+    if ((0 == rc) && (NULL != win)) {
+        rc = mm_camera_sim_runner_stats_report(&win->stats, id, "HAL1");
+    }
+
+    dev->ops->release(dev);
+    dev->common.close(&dev->common);
+    if (NULL != win) {
+        mm_camera_sim_runner_win_destroy(win);
+    }
+    printf("camera %d: HAL1 %s\n", id, (0 == rc) ? "ok" : "failed");
+    return (0 == rc) ? 0 : -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_result3
+ *
+ * DESCRIPTION: HAL3 capture result callback, takes the preview buffers
+ *              back
+ *
+ * PARAMETERS : see camera3_callback_ops_t
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_result3(
+        const struct camera3_callback_ops *ops,
+        const camera3_capture_result_t *result)
+{
+    mm_camera_sim_runner_session3_t *session =
+            (mm_camera_sim_runner_session3_t *)ops;
+    uint32_t slot = result->frame_number &
+            (MM_CAMERA_SIM_RUNNER_MAX_INFLIGHT - 1);
+    uint32_t i;
+
+    CDBG("capture result %u, %u buffers", result->frame_number,
+            result->num_output_buffers);
+    for (i = 0; i < result->num_output_buffers; i++) {
+        const camera3_stream_buffer_t *buf = &result->output_buffers[i];
+        int idx = (int)(buf->buffer - session->bufs);
+        int64_t ts;
+
+        if (buf->release_fence >= 0) {
+            close(buf->release_fence);
+        }
+        pthread_mutex_lock(&session->lock);
+        ts = session->shutter_ns[slot];
+        if ((idx < 0) || (idx >= session->num_bufs) || session->free[idx]) {
+            CDBG_ERROR("%s: frame %u returned unknown buffer %p", __func__,
+                    result->frame_number, buf->buffer);
+            session->errors++;
+        } else {
+            session->free[idx] = TRUE;
+            session->num_free++;
+            if (CAMERA3_BUFFER_STATUS_OK != buf->status) {
+                session->errors++;
+            }
+        }
+        pthread_cond_signal(&session->cond);
+        pthread_mutex_unlock(&session->lock);
+        if (CAMERA3_BUFFER_STATUS_OK == buf->status) {
+            mm_camera_sim_runner_stats_frame(&session->stats, ts);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_notify3
+ *
+ * DESCRIPTION: HAL3 notify callback, records shutter timestamps
+ *
+ * PARAMETERS : see camera3_callback_ops_t
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_runner_notify3(
+        const struct camera3_callback_ops *ops,
+        const camera3_notify_msg_t *msg)
+{
+    mm_camera_sim_runner_session3_t *session =
+            (mm_camera_sim_runner_session3_t *)ops;
+
+    if (CAMERA3_MSG_SHUTTER == msg->type) {
+        pthread_mutex_lock(&session->lock);
+        session->shutter_ns[msg->message.shutter.frame_number &
+                (MM_CAMERA_SIM_RUNNER_MAX_INFLIGHT - 1)] =
+                (int64_t)msg->message.shutter.timestamp;
+        pthread_mutex_unlock(&session->lock);
+    } else {
+        CDBG_HIGH("notify %d", msg->type);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_stream3
+ *
+ * DESCRIPTION: allocate the preview buffers of a HAL3 session and send
+ *              preview requests until the run time is over, then flush
+ *              and wait for every buffer to come back
+ *
+ * PARAMETERS :
+ *   @dev     : camera device
+ *   @session : session with the configured preview stream
+ *   @id      : camera id
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+static int mm_camera_sim_runner_stream3(camera3_device_t *dev,
+        mm_camera_sim_runner_session3_t *session, int id)
+{
+    camera3_stream_t *stream = &session->stream;
+    camera3_capture_request_t request;
+    camera3_stream_buffer_t out;
+    struct timespec deadline;
+    int64_t end_ns;
+    int i, rc = 0;
+
+    session->num_bufs = (int)stream->max_buffers;
+    if ((session->num_bufs <= 0) ||
+            (session->num_bufs > MM_CAMERA_SIM_RUNNER_MAX_BUFS)) {
+        CDBG_ERROR("camera %d: %d preview buffers not supported", id,
+                session->num_bufs);
+        session->num_bufs = 0;
+        return -1;
+    }
+    for (i = 0; i < session->num_bufs; i++) {
+        session->bufs[i] = mm_camera_sim_runner_alloc((int)stream->width,
+                (int)stream->height, stream->format, (int)stream->usage);
+        if (NULL == session->bufs[i]) {
+            session->num_bufs = i;
+            return -1;
+        }
+        session->free[i] = TRUE;
+    }
+    session->num_free = session->num_bufs;
+
+    memset(&request, 0, sizeof(request));
+    request.num_output_buffers = 1;
+    request.output_buffers = &out;
+    /* the first request carries the settings, later ones repeat them */
+    request.settings = dev->ops->construct_default_request_settings(dev,
+            CAMERA3_TEMPLATE_PREVIEW);
+    end_ns = mm_camera_sim_runner_now() +
+            (int64_t)g_runner_cfg.seconds * 1000000000LL;
+    while ((0 == rc) && (mm_camera_sim_runner_now() < end_ns)) {
+        pthread_mutex_lock(&session->lock);
+        while (0 == session->num_free) {
+            pthread_cond_wait(&session->cond, &session->lock);
+        }
+        for (i = 0; !session->free[i]; i++) {
+        }
+        session->free[i] = FALSE;
+        session->num_free--;
+        pthread_mutex_unlock(&session->lock);
+
+        memset(&out, 0, sizeof(out));
+        out.stream = stream;
+        out.buffer = &session->bufs[i];
+        out.status = CAMERA3_BUFFER_STATUS_OK;
+        out.acquire_fence = -1;
+        out.release_fence = -1;
+        rc = dev->ops->process_capture_request(dev, &request);
+        if (0 != rc) {
+            CDBG_ERROR("camera %d: request %u failed %d", id,
+                    request.frame_number, rc);
+            pthread_mutex_lock(&session->lock);
+            session->free[i] = TRUE;
+            session->num_free++;
+            pthread_mutex_unlock(&session->lock);
+        }
+        request.frame_number++;
+        request.settings = NULL;
+    }
+
+    if (0 != dev->ops->flush(dev)) {
+        CDBG_ERROR("camera %d: flush failed", id);
+        rc = -1;
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += MM_CAMERA_SIM_RUNNER_DRAIN_MS / 1000;
+    pthread_mutex_lock(&session->lock);
+    while (session->num_free < session->num_bufs) {
+        if (ETIMEDOUT == pthread_cond_timedwait(&session->cond,
+                &session->lock, &deadline)) {
+            CDBG_ERROR("camera %d: %d preview buffers not returned", id,
+                    session->num_bufs - session->num_free);
+            rc = -1;
+            break;
+        }
+    }
+    if (0 != session->errors) {
+        /* flush returns what it cancels in error */
+        CDBG_HIGH("camera %d: %u preview buffers returned in error", id,
+                session->errors);
+    }
+    pthread_mutex_unlock(&session->lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_hal3
+ *
+ * DESCRIPTION: bring up one camera as HAL3
+ *
+ * PARAMETERS :
+ *   @module  : camera module
+ *   @id      : camera id
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+static int mm_camera_sim_runner_hal3(camera_module_t *module, int id)
+{
+    hw_device_t *hw_dev = NULL;
+    camera3_device_t *dev;
+    mm_camera_sim_runner_session3_t *session;
+    camera3_stream_t *streams[1];
+    camera3_stream_configuration_t config;
+    char name[8];
+    int rc, type, i;
+
+    session = (mm_camera_sim_runner_session3_t *)calloc(1, sizeof(*session));
+    if (NULL == session) {
+        return -1;
+    }
+    session->ops.process_capture_result = mm_camera_sim_runner_result3;
+    session->ops.notify = mm_camera_sim_runner_notify3;
+    pthread_mutex_init(&session->lock, NULL);
+    pthread_cond_init(&session->cond, NULL);
+    pthread_mutex_init(&session->stats.lock, NULL);
+
+    snprintf(name, sizeof(name), "%d", id);
+    rc = module->common.methods->open(&module->common, name, &hw_dev);
+    if ((0 != rc) || (NULL == hw_dev)) {
+        CDBG_ERROR("camera %d: HAL3 open failed %d", id, rc);
+        rc = -1;
+        goto free_session;
+    }
+    dev = (camera3_device_t *)hw_dev;
+
+    rc = dev->ops->initialize(dev, &session->ops);
+    if (0 != rc) {
+        CDBG_ERROR("camera %d: initialize failed %d", id, rc);
+    }
+
+    for (type = CAMERA3_TEMPLATE_PREVIEW; (0 == rc) &&
+            (type < CAMERA3_TEMPLATE_COUNT); type++) {
+        const camera_metadata_t *settings =
+                dev->ops->construct_default_request_settings(dev, type);
+        if (NULL == settings) {
+            /* only the manual template is optional */
+            if (type <= CAMERA3_TEMPLATE_ZERO_SHUTTER_LAG) {
+                CDBG_ERROR("camera %d: no settings for template %d", id,
+                        type);
+                rc = -1;
+            }
+            continue;
+        }
+        printf("camera %d: template %d %zu entries\n", id, type,
+                get_camera_metadata_entry_count(settings));
+    }
+
+    if (0 == rc) {
+        session->stream.stream_type = CAMERA3_STREAM_OUTPUT;
+        session->stream.width = (uint32_t)g_runner_cfg.width;
+        session->stream.height = (uint32_t)g_runner_cfg.height;
+        session->stream.format = HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED;
+        /* consumer usage, the HAL adds its own */
+        session->stream.usage = GRALLOC_USAGE_HW_TEXTURE;
+        streams[0] = &session->stream;
+        memset(&config, 0, sizeof(config));
+        config.num_streams = 1;
+        config.streams = streams;
+        rc = dev->ops->configure_streams(dev, &config);
+        if (0 != rc) {
+            CDBG_ERROR("camera %d: configure_streams failed %d", id, rc);
+        } else {
+            printf("camera %d: preview stream usage 0x%x max buffers %u\n",
+                    id, session->stream.usage, session->stream.max_buffers);
+        }
+    }
+
+    if ((0 == rc) && (g_runner_cfg.seconds > 0)) {
+        rc = mm_camera_sim_runner_stream3(dev, session, id);
+        if (0 == rc) {
+            rc = mm_camera_sim_runner_stats_report(&session->stats, id,
+                    "HAL3");
+        }
+    }
+
+    dev->common.close(&dev->common);
+    printf("camera %d: HAL3 %s\n", id, (0 == rc) ? "ok" : "failed");
+
+free_session:
+    /* close returned whatever a failed drain left with the HAL */
+    for (i = 0; i < session->num_bufs; i++) {
+        g_runner_cfg.alloc->free(g_runner_cfg.alloc, session->bufs[i]);
+    }
+    pthread_mutex_destroy(&session->stats.lock);
+    pthread_cond_destroy(&session->cond);
+    pthread_mutex_destroy(&session->lock);
+    free(session);
+    return (0 == rc) ? 0 : -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_runner_preload
+ *
+ * DESCRIPTION: make sure the simulator is preloaded, re-executing the
+ *              runner with LD_PRELOAD set if it is not
+ *
+ * PARAMETERS :
+ *   @argv    : arguments of the runner
+ *   @lib     : simulator library
+ *
+ * RETURN     : 0 if preloaded, -1 on failure. Does not return on re-exec
+ *==========================================================================*/
+static int mm_camera_sim_runner_preload(char *argv[], const char *lib)
+{
+    char preload[256];
+    const char *cur = getenv("LD_PRELOAD");
+
+    if (NULL != getenv(MM_CAMERA_SIM_RUNNER_REEXEC)) {
+        return 0;
+    }
+    if ((NULL != cur) && ('\0' != cur[0])) {
+        snprintf(preload, sizeof(preload), "%s:%s", lib, cur);
+    } else {
+        snprintf(preload, sizeof(preload), "%s", lib);
+    }
+    setenv("LD_PRELOAD", preload, 1);
+    setenv(MM_CAMERA_SIM_RUNNER_REEXEC, "1", 1);
+    execv("/proc/self/exe", argv);
+    CDBG_ERROR("%s: re-exec with %s preloaded failed", __func__, lib);
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *lib = MM_CAMERA_SIM_RUNNER_LIB;
+    const hw_module_t *hw_module = NULL;
+    camera_module_t *module;
+    int force_hal1 = FALSE;
+    int num_cameras, id, c;
+    int failed = 0;
+
+    while ((c = getopt(argc, argv, "1p:t:w:")) != -1) {
+        switch (c) {
+        case '1':
+            force_hal1 = TRUE;
+            break;
+        case 'p':
+            lib = optarg;
+            break;
+        case 't':
+            g_runner_cfg.seconds = atoi(optarg);
+            break;
+        case 'w':
+            if ((2 != sscanf(optarg, "%dx%d", &g_runner_cfg.width,
+                    &g_runner_cfg.height)) || (g_runner_cfg.width <= 0) ||
+                    (g_runner_cfg.height <= 0)) {
+                fprintf(stderr, "%s: bad preview size %s\n", argv[0],
+                        optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-1] [-p libmmcamera_sim.so] "
+                    "[-t seconds] [-w WxH]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (0 != mm_camera_sim_runner_preload(argv, lib)) {
+        return 1;
+    }
+
+    if (g_runner_cfg.seconds > 0) {
+        /* loaded with the simulator in place, so it allocates from the
+         * simulated ion */
+        if ((0 != hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &hw_module)) ||
+                (0 != gralloc_open(hw_module, &g_runner_cfg.alloc))) {
+            CDBG_ERROR("%s: no gralloc to allocate preview buffers",
+                    __func__);
+            return 1;
+        }
+        hw_module = NULL;
+    }
+
+    if ((0 != hw_get_module(CAMERA_HARDWARE_MODULE_ID, &hw_module)) ||
+            (NULL == hw_module)) {
+        CDBG_ERROR("%s: no camera HAL module", __func__);
+        return 1;
+    }
+    module = (camera_module_t *)hw_module;
+
+    num_cameras = module->get_number_of_cameras();
+    printf("%s: %d cameras\n", hw_module->name, num_cameras);
+    for (id = 0; id < num_cameras; id++) {
+        struct camera_info info;
+        memset(&info, 0, sizeof(info));
+        if (0 != module->get_camera_info(id, &info)) {
+            CDBG_ERROR("camera %d: get_camera_info failed", id);
+            failed++;
+            continue;
+        }
+        printf("camera %d: facing %d orientation %d device version 0x%x\n",
+                id, info.facing, info.orientation, info.device_version);
+        if (force_hal1 ||
+                (info.device_version < CAMERA_DEVICE_API_VERSION_3_0)) {
+            failed += (0 != mm_camera_sim_runner_hal1(module, id));
+        } else {
+            failed += (0 != mm_camera_sim_runner_hal3(module, id));
+        }
+    }
+
+    if (NULL != g_runner_cfg.alloc) {
+        gralloc_close(g_runner_cfg.alloc);
+    }
+    printf("%d of %d cameras failed\n", failed, num_cameras);
+    return (0 == failed) ? 0 : 1;
+}
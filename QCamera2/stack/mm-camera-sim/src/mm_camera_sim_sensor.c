@@ -0,0 +1,740 @@
+/* Copyright (c) 2012-2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm_camera_sim.h"
+#include "mm_camera_sim_dbg.h"
+
+/* output sizes offered below the full sensor size, largest first */
+static const cam_dimension_t mm_camera_sim_sizes[] = {
+    {3840, 2160}, {2592, 1944}, {1920, 1080}, {1280, 960}, {1280, 720},
+    {800, 600}, {640, 480}, {320, 240},
+};
+
+#define MM_CAMERA_SIM_NUM_SIZES \
+    (sizeof(mm_camera_sim_sizes) / sizeof(mm_camera_sim_sizes[0]))
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_fill_sizes
+ *
+ * DESCRIPTION: fill a size table with the sensor size and the standard
+ *              sizes that fit below a limit
+ *
+ * PARAMETERS :
+ *   @tbl     : table to fill
+ *   @max_w   : largest width
+ *   @max_h   : largest height
+ *
+ * RETURN     : number of entries
+ *==========================================================================*/
+static size_t mm_camera_sim_fill_sizes(cam_dimension_t *tbl, int32_t max_w,
+        int32_t max_h)
+{
+    size_t cnt = 0, i;
+
+    if ((g_sim_cfg.sensor_dim.width <= max_w) &&
+            (g_sim_cfg.sensor_dim.height <= max_h)) {
+        tbl[cnt++] = g_sim_cfg.sensor_dim;
+    }
+    for (i = 0; (i < MM_CAMERA_SIM_NUM_SIZES) && (cnt < MAX_SIZES_CNT); i++) {
+        if ((mm_camera_sim_sizes[i].width <= max_w) &&
+                (mm_camera_sim_sizes[i].height <= max_h) &&
+                (mm_camera_sim_sizes[i].width < g_sim_cfg.sensor_dim.width) &&
+                (mm_camera_sim_sizes[i].height <= g_sim_cfg.sensor_dim.height)) {
+            tbl[cnt++] = mm_camera_sim_sizes[i];
+        }
+    }
+    return cnt;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_fill_capability
+ *
+ * DESCRIPTION: fill the capability of a camera the way the daemon does on
+ *              QUERYCAP. Enough for both HALs to build their parameters
+ *              and static metadata. Called with session lock held.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @cap     : mapped capability buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_fill_capability(mm_camera_sim_session_t *session,
+        cam_capability_t *cap)
+{
+    int64_t frame_ns = 1000000000LL / g_sim_cfg.fps;
+    int32_t w = g_sim_cfg.sensor_dim.width;
+    int32_t h = g_sim_cfg.sensor_dim.height;
+    uint8_t front = (1 == session->cam_idx);
+    size_t i;
+
+    memset(cap, 0, sizeof(*cap));
+    cap->position = front ? CAM_POSITION_FRONT : CAM_POSITION_BACK;
+    cap->sensor_mount_angle = front ? 270 : 90;
+    cap->modes_supported = CAM_MODE_2D;
+    cap->sensor_type.sens_type = CAM_SENSOR_RAW;
+    cap->sensor_type.native_format = CAM_FORMAT_BAYER_MIPI_RAW_10BPP_RGGB;
+
+    /* sizes, all at sensor rate */
+    cap->picture_sizes_tbl_cnt = mm_camera_sim_fill_sizes(cap->picture_sizes_tbl,
+            w, h);
+    cap->preview_sizes_tbl_cnt = mm_camera_sim_fill_sizes(cap->preview_sizes_tbl,
+            1920, 1080);
+    cap->video_sizes_tbl_cnt = mm_camera_sim_fill_sizes(cap->video_sizes_tbl,
+            3840, 2160);
+    cap->livesnapshot_sizes_tbl_cnt = mm_camera_sim_fill_sizes(
+            cap->livesnapshot_sizes_tbl, w, h);
+    cap->vhdr_livesnapshot_sizes_tbl_cnt = mm_camera_sim_fill_sizes(
+            cap->vhdr_livesnapshot_sizes_tbl, w, h);
+    for (i = 0; i < cap->picture_sizes_tbl_cnt; i++) {
+        cap->picture_min_duration[i] = frame_ns;
+        cap->stall_durations[i] = frame_ns;
+        cap->jpeg_stall_durations[i] = frame_ns;
+    }
+    cap->supported_raw_dim_cnt = 1;
+    cap->raw_dim[0] = g_sim_cfg.sensor_dim;
+    cap->raw_min_duration[0] = frame_ns;
+    cap->raw16_stall_durations[0] = frame_ns;
+    cap->supported_raw_fmt_cnt = 1;
+    cap->supported_raw_fmts[0] = CAM_FORMAT_BAYER_MIPI_RAW_10BPP_RGGB;
+    cap->rdi_mode_stream_fmt = CAM_FORMAT_BAYER_MIPI_RAW_10BPP_RGGB;
+    cap->supported_preview_fmt_cnt = 2;
+    cap->supported_preview_fmts[0] = CAM_FORMAT_YUV_420_NV21;
+    cap->supported_preview_fmts[1] = CAM_FORMAT_YUV_420_YV12;
+    cap->supported_picture_fmt_cnt = 2;
+    cap->supported_picture_fmts[0] = CAM_FORMAT_JPEG;
+    cap->supported_picture_fmts[1] = CAM_FORMAT_YUV_420_NV21;
+    cap->supported_scalar_format_cnt = 2;
+    cap->supported_scalar_fmts[0] = CAM_FORMAT_YUV_420_NV21;
+    cap->supported_scalar_fmts[1] = CAM_FORMAT_JPEG;
+    cap->max_downscale_factor = 16;
+    cap->max_viewfinder_size.width = 1920;
+    cap->max_viewfinder_size.height = 1080;
+    cap->analysis_max_res.width = 640;
+    cap->analysis_max_res.height = 480;
+    cap->analysis_recommended_res = cap->analysis_max_res;
+    cap->analysis_recommended_format = CAM_FORMAT_YUV_420_NV21;
+
+    cap->fps_ranges_tbl_cnt = 2;
+    cap->fps_ranges_tbl[0].min_fps = 15.0f;
+    cap->fps_ranges_tbl[0].max_fps = (float)g_sim_cfg.fps;
+    cap->fps_ranges_tbl[1].min_fps = (float)g_sim_cfg.fps;
+    cap->fps_ranges_tbl[1].max_fps = (float)g_sim_cfg.fps;
+    for (i = 0; i < cap->fps_ranges_tbl_cnt; i++) {
+        cap->fps_ranges_tbl[i].video_min_fps = cap->fps_ranges_tbl[i].min_fps;
+        cap->fps_ranges_tbl[i].video_max_fps = cap->fps_ranges_tbl[i].max_fps;
+    }
+
+    /* padding as on the ISP */
+    cap->padding_info.width_padding = CAM_PAD_TO_32;
+    cap->padding_info.height_padding = CAM_PAD_TO_32;
+    cap->padding_info.plane_padding = CAM_PAD_TO_4K;
+    cap->padding_info.min_stride = 64;
+    cap->padding_info.min_scanline = 32;
+    cap->analysis_padding_info = cap->padding_info;
+    cap->buf_alignment = CAM_PAD_TO_4K;
+    cap->min_stride = 64;
+    cap->min_scanline = 32;
+    cap->min_num_pp_bufs = 1;
+    cap->max_batch_bufs_supported = 1;
+
+    /* 3A and modes */
+    cap->zoom_supported = 1;
+    cap->zoom_ratio_tbl_cnt = 13;
+    for (i = 0; i < cap->zoom_ratio_tbl_cnt; i++) {
+        cap->zoom_ratio_tbl[i] = (uint32_t)(100 + i * 25);
+    }
+    cap->max_zoom_step = (uint8_t)(cap->zoom_ratio_tbl_cnt - 1);
+    cap->supported_iso_modes_cnt = 2;
+    cap->supported_iso_modes[0] = CAM_ISO_MODE_AUTO;
+    cap->supported_iso_modes[1] = CAM_ISO_MODE_100;
+    cap->supported_flash_modes_cnt = 1;
+    cap->supported_flash_modes[0] = CAM_FLASH_MODE_OFF;
+    cap->supported_effects_cnt = 1;
+    cap->supported_effects[0] = CAM_EFFECT_MODE_OFF;
+    cap->supported_scene_modes_cnt = 1;
+    cap->supported_scene_modes[0] = CAM_SCENE_MODE_OFF;
+    cap->supported_aec_modes_cnt = 1;
+    cap->supported_aec_modes[0] = CAM_AEC_MODE_FRAME_AVERAGE;
+    cap->supported_ae_modes_cnt = 2;
+    cap->supported_ae_modes[0] = CAM_AE_MODE_OFF;
+    cap->supported_ae_modes[1] = CAM_AE_MODE_ON;
+    cap->supported_antibandings_cnt = 2;
+    cap->supported_antibandings[0] = CAM_ANTIBANDING_MODE_OFF;
+    cap->supported_antibandings[1] = CAM_ANTIBANDING_MODE_AUTO;
+    cap->supported_white_balances_cnt = 2;
+    cap->supported_white_balances[0] = CAM_WB_MODE_AUTO;
+    cap->supported_white_balances[1] = CAM_WB_MODE_OFF;
+    cap->min_wb_cct = 2000;
+    cap->max_wb_cct = 8000;
+    cap->min_wb_gain = 1.0f;
+    cap->max_wb_gain = 4.0f;
+    if (front) {
+        cap->supported_focus_modes_cnt = 1;
+        cap->supported_focus_modes[0] = CAM_FOCUS_MODE_FIXED;
+    } else {
+        cap->supported_focus_modes_cnt = 4;
+        cap->supported_focus_modes[0] = CAM_FOCUS_MODE_AUTO;
+        cap->supported_focus_modes[1] = CAM_FOCUS_MODE_CONTINOUS_PICTURE;
+        cap->supported_focus_modes[2] = CAM_FOCUS_MODE_CONTINOUS_VIDEO;
+        cap->supported_focus_modes[3] = CAM_FOCUS_MODE_OFF;
+        cap->min_focus_distance = 10.0f;
+        cap->hyper_focal_distance = 0.5f;
+        cap->max_num_focus_areas = 1;
+    }
+    cap->supported_focus_algos_cnt = 1;
+    cap->supported_focus_algos[0] = CAM_FOCUS_ALGO_AUTO;
+    cap->exposure_compensation_min = -12;
+    cap->exposure_compensation_max = 12;
+    cap->exposure_compensation_default = 0;
+    cap->exposure_compensation_step = 1.0f / 6.0f;
+    cap->exp_compensation_step.numerator = 1;
+    cap->exp_compensation_step.denominator = 6;
+    cap->auto_wb_lock_supported = 1;
+    cap->auto_exposure_lock_supported = 1;
+    cap->video_snapshot_supported = 1;
+    cap->max_num_metering_areas = 1;
+    cap->brightness_ctrl.min_value = 0;
+    cap->brightness_ctrl.max_value = 6;
+    cap->brightness_ctrl.def_value = 3;
+    cap->brightness_ctrl.step = 1;
+    cap->sharpness_ctrl.min_value = 0;
+    cap->sharpness_ctrl.max_value = 36;
+    cap->sharpness_ctrl.def_value = 12;
+    cap->sharpness_ctrl.step = 6;
+    cap->contrast_ctrl.min_value = 0;
+    cap->contrast_ctrl.max_value = 10;
+    cap->contrast_ctrl.def_value = 5;
+    cap->contrast_ctrl.step = 1;
+    cap->saturation_ctrl = cap->contrast_ctrl;
+    cap->sce_ctrl.min_value = -100;
+    cap->sce_ctrl.max_value = 100;
+    cap->sce_ctrl.step = 10;
+    cap->qcom_supported_feature_mask = CAM_QCOM_FEATURE_NONE;
+
+    /* lens and sensor */
+    cap->focal_length = 4.0f;
+    cap->hor_view_angle = 63.0f;
+    cap->ver_view_angle = 49.0f;
+    cap->focal_lengths[0] = cap->focal_length;
+    cap->focal_lengths_count = 1;
+    cap->apertures[0] = 2.0f;
+    cap->apertures_count = 1;
+    cap->filter_densities_count = 0;
+    cap->optical_stab_modes[0] = CAM_OPT_STAB_OFF;
+    cap->optical_stab_modes_count = 1;
+    cap->lens_shading_map_size.width = CAM_MAX_MAP_WIDTH;
+    cap->lens_shading_map_size.height = CAM_MAX_MAP_HEIGHT;
+    cap->exposure_time_range[0] = 100000LL;
+    cap->exposure_time_range[1] = frame_ns;
+    cap->max_frame_duration = 1000000000LL / 15;
+    cap->color_arrangement = CAM_FILTER_ARRANGEMENT_RGGB;
+    cap->num_color_channels = 4;
+    cap->sensor_physical_size[0] = 4.6f;
+    cap->sensor_physical_size[1] = 3.5f;
+    cap->pixel_array_size = g_sim_cfg.sensor_dim;
+    cap->active_array_size.width = w;
+    cap->active_array_size.height = h;
+    cap->white_level = 1023;
+    for (i = 0; i < BLACK_LEVEL_PATTERN_CNT; i++) {
+        cap->black_level_pattern[i] = 64;
+    }
+    cap->sensitivity_range.min_sensitivity = 100;
+    cap->sensitivity_range.max_sensitivity = 1600;
+    cap->max_analog_sensitivity = 800;
+    cap->base_gain_factor.numerator = 1;
+    cap->base_gain_factor.denominator = 1;
+    cap->max_tone_map_curve_points = 64;
+    cap->max_face_detection_count = 0;
+    cap->histogram_size = 256;
+    cap->max_histogram_count = 50000;
+    cap->sharpness_map_size.width = 64;
+    cap->sharpness_map_size.height = 48;
+    cap->max_sharpness_map_value = 255;
+    cap->reference_illuminant1 = CAM_AWB_D50;
+    cap->reference_illuminant2 = CAM_AWB_D65;
+    cap->supported_test_pattern_modes_cnt = 1;
+    cap->supported_test_pattern_modes[0] = CAM_TEST_PATTERN_OFF;
+    cap->aberration_modes_count = 1;
+    cap->aberration_modes[0] = CAM_COLOR_CORRECTION_ABERRATION_OFF;
+    cap->isTimestampCalibrated = 0;
+    cap->supported_is_types_cnt = 1;
+    cap->supported_is_types[0] = IS_TYPE_NONE;
+    for (i = 0; i < 3; i++) {
+        cap->forward_matrix[i][i].numerator = 1;
+        cap->forward_matrix[i][i].denominator = 1;
+        cap->color_transform[i][i] = cap->forward_matrix[i][i];
+        cap->forward_matrix1[i][i] = cap->forward_matrix[i][i];
+        cap->forward_matrix2[i][i] = cap->forward_matrix[i][i];
+        cap->color_transform1[i][i] = cap->forward_matrix[i][i];
+        cap->color_transform2[i][i] = cap->forward_matrix[i][i];
+        cap->calibration_transform1[i][i] = cap->forward_matrix[i][i];
+        cap->calibration_transform2[i][i] = cap->forward_matrix[i][i];
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_set_parms
+ *
+ * DESCRIPTION: apply the session parameters the sensor acts on. Called with
+ *              session lock held.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @parm    : mapped parameter buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_set_parms(mm_camera_sim_session_t *session,
+        parm_buffer_t *parm)
+{
+    IF_META_AVAILABLE(cam_fps_range_t, fps_range, CAM_INTF_PARM_FPS_RANGE,
+            parm) {
+        uint32_t fps = (uint32_t)fps_range->max_fps;
+        if (fps < 1) {
+            fps = 1;
+        } else if (fps > g_sim_cfg.fps) {
+            fps = g_sim_cfg.fps;
+        }
+        if (fps != session->fps) {
+            CDBG_HIGH("%s: camera %u at %u fps", __func__, session->cam_idx,
+                    fps);
+            session->fps = fps;
+            pthread_cond_broadcast(&session->cond);
+        }
+    }
+    /* hal3 requests: the next sensor frame carries this frame number */
+    IF_META_AVAILABLE(uint32_t, frame_number, CAM_INTF_META_FRAME_NUMBER,
+            parm) {
+        if (session->frame_num_cnt < MM_CAMERA_SIM_MAX_FRAME_NUMS) {
+            session->frame_nums[(session->frame_num_head +
+                    session->frame_num_cnt) % MM_CAMERA_SIM_MAX_FRAME_NUMS] =
+                    *frame_number;
+            session->frame_num_cnt++;
+        } else {
+            CDBG_ERROR("%s: frame number %u dropped", __func__, *frame_number);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_fill_image
+ *
+ * DESCRIPTION: draw a synthetic frame. Luma and raw planes get horizontal
+ *              bands that move with the frame id, chroma planes are grey.
+ *              Each row is one memset, so the cost tracks a real DMA write
+ *              of the frame.
+ *
+ * PARAMETERS :
+ *   @stream  : stream
+ *   @buf     : buffer to draw into
+ *   @frame_id : sensor frame id
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_fill_image(mm_camera_sim_stream_t *stream,
+        mm_camera_sim_buf_t *buf, uint32_t frame_id)
+{
+    cam_mp_len_offset_t *mp;
+    size_t stride, rows, off, r;
+    uint32_t i;
+    uint8_t *p;
+
+    for (i = 0; i < buf->num_planes; i++) {
+        if (NULL == buf->plane_vaddr[i]) {
+            continue;
+        }
+        if ((i >= stream->plane_info.num_planes) || (i >= VIDEO_MAX_PLANES)) {
+            memset(buf->plane_vaddr[i], 0x80, buf->plane_len[i]);
+            continue;
+        }
+        mp = &stream->plane_info.mp[i];
+        stride = (size_t)((mp->stride_in_bytes > 0) ?
+                mp->stride_in_bytes : mp->stride);
+        rows = (size_t)mp->scanline;
+        off = mp->offset;
+        if ((0 == stride) || (0 == rows) || (off >= buf->plane_len[i])) {
+            memset(buf->plane_vaddr[i], 0x80, buf->plane_len[i]);
+            continue;
+        }
+        if (rows > (buf->plane_len[i] - off) / stride) {
+            rows = (buf->plane_len[i] - off) / stride;
+        }
+        p = buf->plane_vaddr[i] + off;
+        if (i > 0) {
+            memset(p, 0x80, rows * stride);
+            continue;
+        }
+        for (r = 0; r < rows; r++) {
+            memset(p + r * stride,
+                    (((r + frame_id * 8) >> 6) & 1) ? 0xd0 : 0x30, stride);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_fill_meta
+ *
+ * DESCRIPTION: write the metadata of a sensor frame. Called with session
+ *              lock held.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @buf     : metadata buffer
+ *   @ts_ns   : sensor timestamp
+ *   @frame_number : hal3 frame number
+ *   @frame_number_valid : whether a request came with this frame
+ *   @af_done : an auto focus request completes with this frame
+ *   @prep_done : a prepare snapshot request completes with this frame
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_fill_meta(mm_camera_sim_session_t *session,
+        mm_camera_sim_buf_t *buf, int64_t ts_ns, uint32_t frame_number,
+        int32_t frame_number_valid, uint8_t af_done, uint8_t prep_done)
+{
+    metadata_buffer_t *meta = (metadata_buffer_t *)buf->plane_vaddr[0];
+    cam_fps_range_t fps_range;
+
+    if ((NULL == meta) || (buf->plane_len[0] < sizeof(metadata_buffer_t))) {
+        return;
+    }
+    clear_metadata_buffer(meta);
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_FRAME_NUMBER_VALID,
+            frame_number_valid);
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_FRAME_NUMBER,
+            frame_number);
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_URGENT_FRAME_NUMBER_VALID,
+            frame_number_valid);
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_URGENT_FRAME_NUMBER,
+            frame_number);
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_SENSOR_TIMESTAMP, ts_ns);
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_AEC_STATE,
+            (uint32_t)CAM_AE_STATE_CONVERGED);
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_AWB_STATE,
+            (uint32_t)CAM_AWB_STATE_CONVERGED);
+    if (af_done) {
+        ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_AF_STATE,
+                (uint32_t)CAM_AF_STATE_FOCUSED_LOCKED);
+        ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_AF_STATE_TRANSITION,
+                (uint8_t)1);
+    } else {
+        ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_AF_STATE,
+                (uint32_t)CAM_AF_STATE_INACTIVE);
+    }
+    if (prep_done) {
+        ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_META_PREP_SNAPSHOT_DONE,
+                (int32_t)DO_NOT_NEED_FUTURE_FRAME);
+    }
+    memset(&fps_range, 0, sizeof(fps_range));
+    fps_range.min_fps = fps_range.max_fps = (float)session->fps;
+    fps_range.video_min_fps = fps_range.video_max_fps = (float)session->fps;
+    ADD_SET_PARAM_ENTRY_TO_BATCH(meta, CAM_INTF_PARM_FPS_RANGE, fps_range);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_deliver
+ *
+ * DESCRIPTION: make a filled buffer dequeueable. Called with session lock
+ *              held.
+ *
+ * PARAMETERS :
+ *   @stream  : stream
+ *   @idx     : buffer index
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_deliver(mm_camera_sim_stream_t *stream, uint32_t idx)
+{
+    stream->bufs[idx].state = MM_CAMERA_SIM_BUF_DONE;
+    stream->done[(stream->done_head + stream->done_cnt) %
+            CAM_MAX_NUM_BUFS_PER_STREAM] = idx;
+    stream->done_cnt++;
+    stream->stats.frames++;
+    mm_camera_sim_signal(stream->fd);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_take_buf
+ *
+ * DESCRIPTION: take the oldest queued buffer of a stream for a frame.
+ *              Called with session lock held.
+ *
+ * PARAMETERS :
+ *   @stream  : stream
+ *   @frame_id : sensor frame id
+ *   @ts      : sensor timestamp
+ *
+ * RETURN     : buffer index, -1 if none is queued
+ *==========================================================================*/
+static int32_t mm_camera_sim_take_buf(mm_camera_sim_stream_t *stream,
+        uint32_t frame_id, const struct timespec *ts)
+{
+    mm_camera_sim_buf_t *buf;
+    uint32_t idx;
+
+    if (0 == stream->queued_cnt) {
+        stream->stats.drops++;
+        return -1;
+    }
+    idx = stream->queued[stream->queued_head];
+    stream->queued_head = (stream->queued_head + 1) % CAM_MAX_NUM_BUFS_PER_STREAM;
+    stream->queued_cnt--;
+    buf = &stream->bufs[idx];
+    buf->state = MM_CAMERA_SIM_BUF_FILLING;
+    buf->sequence = frame_id;
+    buf->timestamp.tv_sec = ts->tv_sec;
+    buf->timestamp.tv_usec = ts->tv_nsec / 1000;
+    return (int32_t)idx;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_do_reprocess
+ *
+ * DESCRIPTION: run a reprocess request on an offline stream: the oldest
+ *              queued output buffer comes back drawn right away
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @stream  : offline stream
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_do_reprocess(mm_camera_sim_session_t *session,
+        mm_camera_sim_stream_t *stream)
+{
+    struct timespec ts;
+    uint32_t frame_id;
+    int32_t idx;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pthread_mutex_lock(&session->lock);
+    frame_id = session->frame_id;
+    idx = mm_camera_sim_take_buf(stream, frame_id, &ts);
+    if (idx < 0) {
+        pthread_mutex_unlock(&session->lock);
+        CDBG_ERROR("%s: no output buffer queued on stream %u", __func__,
+                stream->id);
+        return;
+    }
+    stream->busy++;
+    pthread_mutex_unlock(&session->lock);
+
+    if (g_sim_cfg.fill) {
+        mm_camera_sim_fill_image(stream, &stream->bufs[idx], frame_id);
+    }
+
+    pthread_mutex_lock(&session->lock);
+    mm_camera_sim_deliver(stream, (uint32_t)idx);
+    stream->busy--;
+    pthread_cond_broadcast(&session->cond);
+    pthread_mutex_unlock(&session->lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_frame
+ *
+ * DESCRIPTION: produce one sensor frame on every running stream. Buffers
+ *              are taken and metadata written under the session lock,
+ *              images are drawn outside of it.
+ *
+ * PARAMETERS :
+ *   @session : camera session, locked on entry and return
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_frame(mm_camera_sim_session_t *session)
+{
+    mm_camera_sim_stream_t *filling[MM_CAMERA_SIM_MAX_STREAMS];
+    int32_t filling_idx[MM_CAMERA_SIM_MAX_STREAMS];
+    mm_camera_sim_stream_t *stream;
+    uint32_t num_filling = 0, frame_number = 0, frame_id, i;
+    int32_t frame_number_valid = 0, idx;
+    uint8_t af_done, prep_done;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    frame_id = ++session->frame_id;
+    if (session->frame_num_cnt > 0) {
+        frame_number = session->frame_nums[session->frame_num_head];
+        session->frame_num_head = (session->frame_num_head + 1) %
+                MM_CAMERA_SIM_MAX_FRAME_NUMS;
+        session->frame_num_cnt--;
+        frame_number_valid = 1;
+    }
+    af_done = __atomic_exchange_n(&session->af_pending, 0, __ATOMIC_ACQ_REL);
+    prep_done = __atomic_exchange_n(&session->prep_snapshot_pending, 0,
+            __ATOMIC_ACQ_REL);
+
+    for (i = 0; i < MM_CAMERA_SIM_MAX_STREAMS; i++) {
+        stream = session->streams[i];
+        if ((NULL == stream) || !stream->streaming ||
+                (CAM_STREAM_TYPE_OFFLINE_PROC == stream->type)) {
+            continue;
+        }
+        if (CAM_STREAMING_MODE_BURST == stream->mode) {
+            if (0 == stream->burst_left) {
+                continue;
+            }
+        }
+        idx = mm_camera_sim_take_buf(stream, frame_id, &ts);
+        if (idx < 0) {
+            continue;
+        }
+        if (CAM_STREAMING_MODE_BURST == stream->mode) {
+            stream->burst_left--;
+        }
+        if (CAM_STREAM_TYPE_METADATA == stream->type) {
+            mm_camera_sim_fill_meta(session, &stream->bufs[idx],
+                    (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec,
+                    frame_number, frame_number_valid, af_done, prep_done);
+            mm_camera_sim_deliver(stream, (uint32_t)idx);
+            continue;
+        }
+        stream->busy++;
+        filling[num_filling] = stream;
+        filling_idx[num_filling] = idx;
+        num_filling++;
+    }
+    if (0 == num_filling) {
+        return;
+    }
+
+    pthread_mutex_unlock(&session->lock);
+    if (g_sim_cfg.fill) {
+        for (i = 0; i < num_filling; i++) {
+            mm_camera_sim_fill_image(filling[i],
+                    &filling[i]->bufs[filling_idx[i]], frame_id);
+        }
+    }
+    pthread_mutex_lock(&session->lock);
+
+    for (i = 0; i < num_filling; i++) {
+        mm_camera_sim_deliver(filling[i], (uint32_t)filling_idx[i]);
+        filling[i]->busy--;
+    }
+    pthread_cond_broadcast(&session->cond);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_sensor_thread
+ *
+ * DESCRIPTION: sensor of a session, runs at the session frame rate on an
+ *              absolute schedule so frame intervals do not drift
+ *
+ * PARAMETERS :
+ *   @data    : camera session
+ *
+ * RETURN     : NULL
+ *==========================================================================*/
+static void *mm_camera_sim_sensor_thread(void *data)
+{
+    mm_camera_sim_session_t *session = (mm_camera_sim_session_t *)data;
+    struct timespec next;
+    uint64_t period;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    pthread_mutex_lock(&session->lock);
+    while (!session->frame_exit) {
+        period = 1000000000ULL / session->fps;
+        next.tv_nsec += (long)period;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        while (!session->frame_exit &&
+                (ETIMEDOUT != pthread_cond_timedwait(&session->cond,
+                        &session->lock, &next))) {
+        }
+        if (session->frame_exit) {
+            break;
+        }
+        mm_camera_sim_frame(session);
+    }
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_sensor_start
+ *
+ * DESCRIPTION: start the sensor of a session if it is not running yet
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+int32_t mm_camera_sim_sensor_start(mm_camera_sim_session_t *session)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&session->lock);
+    if (!session->frame_running) {
+        session->frame_exit = 0;
+        rc = pthread_create(&session->frame_tid, NULL,
+                mm_camera_sim_sensor_thread, session);
+        session->frame_running = (0 == rc);
+    }
+    pthread_mutex_unlock(&session->lock);
+    if (0 != rc) {
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_sensor_stop
+ *
+ * DESCRIPTION: stop the sensor of a session
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_sensor_stop(mm_camera_sim_session_t *session)
+{
+    uint8_t running;
+
+    pthread_mutex_lock(&session->lock);
+    running = session->frame_running;
+    session->frame_exit = 1;
+    session->frame_running = 0;
+    pthread_cond_broadcast(&session->cond);
+    pthread_mutex_unlock(&session->lock);
+    if (running) {
+        pthread_join(session->frame_tid, NULL);
+    }
+}
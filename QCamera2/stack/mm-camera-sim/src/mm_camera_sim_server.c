@@ -0,0 +1,521 @@
+/* Copyright (c) 2012-2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mm_camera_sim.h"
+#include "mm_camera_sim_dbg.h"
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_server_addr
+ *
+ * DESCRIPTION: address the daemon socket of a camera is served on. It is
+ *              abstract and per process, so concurrent runs do not collide
+ *              and no directory needs to exist.
+ *
+ * PARAMETERS :
+ *   @vnode   : video node number of the camera
+ *   @addr    : filled with the address
+ *   @len     : filled with the address length
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_server_addr(uint32_t vnode, struct sockaddr_un *addr,
+        socklen_t *len)
+{
+    int n;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+            "mm-camera-sim.%d.cam_socket%u", (int)getpid(), vnode);
+    *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + (size_t)n);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_per_buf
+ *
+ * DESCRIPTION: whether a mapping type has one map per buffer or plane,
+ *              rather than one per session or stream
+ *
+ * PARAMETERS :
+ *   @type    : mapping type
+ *
+ * RETURN     : TRUE if maps are per buffer
+ *==========================================================================*/
+static uint8_t mm_camera_sim_per_buf(cam_mapping_buf_type type)
+{
+    return (CAM_MAPPING_BUF_TYPE_STREAM_BUF == type) ||
+            (CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF == type) ||
+            (CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF == type);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_find_map
+ *
+ * DESCRIPTION: look up a mapped buffer. Called with session lock held.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @type    : mapping type
+ *   @stream_id : server stream id, 0 for session buffers
+ *   @frame_idx : buffer index, only for per buffer types
+ *   @plane_idx : plane index or -1, only for per buffer types
+ *
+ * RETURN     : map or NULL
+ *==========================================================================*/
+mm_camera_sim_map_t *mm_camera_sim_find_map(mm_camera_sim_session_t *session,
+        cam_mapping_buf_type type, uint32_t stream_id, uint32_t frame_idx,
+        int32_t plane_idx)
+{
+    mm_camera_sim_map_t *map;
+    uint8_t per_buf = mm_camera_sim_per_buf(type);
+    uint32_t i;
+
+    for (i = 0; i < session->num_maps; i++) {
+        map = &session->maps[i];
+        if ((map->type == type) && (map->stream_id == stream_id) &&
+                (!per_buf || ((map->frame_idx == frame_idx) &&
+                (map->plane_idx == plane_idx)))) {
+            return map;
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_unmap
+ *
+ * DESCRIPTION: drop a mapped buffer. Called with session lock held.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @map     : map to drop
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_unmap(mm_camera_sim_session_t *session,
+        mm_camera_sim_map_t *map)
+{
+    munmap(map->vaddr, map->size);
+    *map = session->maps[--session->num_maps];
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_map
+ *
+ * DESCRIPTION: map a buffer received from the stack, like the daemon does
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @type    : mapping type
+ *   @stream_id : server stream id
+ *   @frame_idx : buffer index
+ *   @plane_idx : plane index or -1
+ *   @fd      : fd received with the packet, closed on return
+ *   @size    : size given by the stack, 0 to use the fd size
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+static int32_t mm_camera_sim_map(mm_camera_sim_session_t *session,
+        cam_mapping_buf_type type, uint32_t stream_id, uint32_t frame_idx,
+        int32_t plane_idx, int fd, size_t size)
+{
+    mm_camera_sim_map_t *map;
+    struct stat st;
+    void *vaddr;
+
+    if ((fd < 0) || (fstat(fd, &st) < 0)) {
+        CDBG_ERROR("%s: bad fd %d for type %d", __func__, fd, type);
+        return -1;
+    }
+    if ((0 == size) || (size > (size_t)st.st_size)) {
+        size = (size_t)st.st_size;
+    }
+    vaddr = (size > 0) ?
+            mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) :
+            MAP_FAILED;
+    mm_camera_sim_real_close(fd);
+    if (MAP_FAILED == vaddr) {
+        CDBG_ERROR("%s: mmap of %zu bytes for type %d failed: %s", __func__,
+                size, type, strerror(errno));
+        return -1;
+    }
+
+    pthread_mutex_lock(&session->lock);
+    map = mm_camera_sim_find_map(session, type, stream_id, frame_idx,
+            plane_idx);
+    if (NULL != map) {
+        munmap(map->vaddr, map->size);
+    } else if (session->num_maps < MM_CAMERA_SIM_MAX_MAPS) {
+        map = &session->maps[session->num_maps++];
+    }
+    if (NULL == map) {
+        pthread_mutex_unlock(&session->lock);
+        munmap(vaddr, size);
+        CDBG_ERROR("%s: out of maps", __func__);
+        return -1;
+    }
+    map->type = type;
+    map->stream_id = stream_id;
+    map->frame_idx = frame_idx;
+    map->plane_idx = plane_idx;
+    map->vaddr = vaddr;
+    map->size = size;
+    pthread_mutex_unlock(&session->lock);
+    CDBG("%s: type %d stream %u frame %u plane %d size %zu", __func__, type,
+            stream_id, frame_idx, plane_idx, size);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_unmap_one
+ *
+ * DESCRIPTION: handle one unmap request
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @unmap   : unmap request
+ *
+ * RETURN     : 0 on success, -1 if nothing was mapped there
+ *==========================================================================*/
+static int32_t mm_camera_sim_unmap_one(mm_camera_sim_session_t *session,
+        cam_buf_unmap_type *unmap)
+{
+    mm_camera_sim_map_t *map;
+
+    pthread_mutex_lock(&session->lock);
+    map = mm_camera_sim_find_map(session, unmap->type, unmap->stream_id,
+            unmap->frame_idx, unmap->plane_idx);
+    if (NULL != map) {
+        mm_camera_sim_unmap(session, map);
+    }
+    pthread_mutex_unlock(&session->lock);
+    if (NULL == map) {
+        CDBG_ERROR("%s: type %d stream %u frame %u plane %d not mapped",
+                __func__, unmap->type, unmap->stream_id, unmap->frame_idx,
+                unmap->plane_idx);
+        return -1;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_handle_pkt
+ *
+ * DESCRIPTION: handle one socket packet. Every fd is consumed.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @pkt     : packet
+ *   @fds     : fds received with it, in entry order
+ *   @numfds  : number of fds
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+static int32_t mm_camera_sim_handle_pkt(mm_camera_sim_session_t *session,
+        cam_sock_packet_t *pkt, int *fds, int numfds)
+{
+    cam_buf_map_type *map;
+    int32_t rc = 0;
+    int used = 0;
+    uint32_t i, n;
+
+    switch (pkt->msg_type) {
+    case CAM_MAPPING_TYPE_FD_MAPPING:
+        map = &pkt->payload.buf_map;
+        if (numfds >= 1) {
+            rc = mm_camera_sim_map(session, map->type, map->stream_id,
+                    map->frame_idx, map->plane_idx, fds[0], map->size);
+            used = 1;
+        } else {
+            rc = -1;
+        }
+        break;
+    case CAM_MAPPING_TYPE_FD_UNMAPPING:
+        rc = mm_camera_sim_unmap_one(session, &pkt->payload.buf_unmap);
+        break;
+    case CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING:
+        n = pkt->payload.buf_map_list.length;
+        if ((n > CAM_MAX_NUM_BUFS_PER_STREAM) || ((int)n != numfds)) {
+            rc = -1;
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            map = &pkt->payload.buf_map_list.buf_maps[i];
+            if (0 != mm_camera_sim_map(session, map->type, map->stream_id,
+                    map->frame_idx, map->plane_idx, fds[i], map->size)) {
+                rc = -1;
+            }
+        }
+        used = (int)n;
+        break;
+    case CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING:
+        n = pkt->payload.buf_unmap_list.length;
+        if (n > CAM_MAX_NUM_BUFS_PER_STREAM) {
+            rc = -1;
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (0 != mm_camera_sim_unmap_one(session,
+                    &pkt->payload.buf_unmap_list.buf_unmaps[i])) {
+                rc = -1;
+            }
+        }
+        break;
+    default:
+        rc = -1;
+        break;
+    }
+
+    for (; used < numfds; used++) {
+        mm_camera_sim_real_close(fds[used]);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_spin
+ *
+ * DESCRIPTION: burn the configured daemon cost of a packet. Busy waits, a
+ *              sleep would add scheduler wakeup latency to it.
+ *
+ * PARAMETERS :
+ *   @usec    : cost in usec
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_spin(uint32_t usec)
+{
+    uint64_t end;
+
+    if (0 == usec) {
+        return;
+    }
+    end = mm_camera_sim_now_ns() + (uint64_t)usec * 1000ULL;
+    while (mm_camera_sim_now_ns() < end) {
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_server_thread
+ *
+ * DESCRIPTION: daemon end of the domain socket. Every packet is acked with
+ *              a MAP_UNMAP_DONE event, in order, as the daemon does.
+ *
+ * PARAMETERS :
+ *   @data    : camera session
+ *
+ * RETURN     : NULL
+ *==========================================================================*/
+static void *mm_camera_sim_server_thread(void *data)
+{
+    mm_camera_sim_session_t *session = (mm_camera_sim_session_t *)data;
+    char cmsgbuf[CMSG_SPACE(sizeof(int) * CAM_MAX_NUM_BUFS_PER_STREAM)];
+    int fds[CAM_MAX_NUM_BUFS_PER_STREAM];
+    cam_sock_packet_t pkt;
+    struct pollfd pfds[2];
+    int32_t rc;
+
+    pfds[0].fd = session->sock_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = session->sock_stop_fd;
+    pfds[1].events = POLLIN;
+
+    for (;;) {
+        struct msghdr msgh;
+        struct iovec iov[1];
+        struct cmsghdr *cmsghp;
+        int numfds = 0, n, i;
+        ssize_t len;
+
+        if (poll(pfds, 2, -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            CDBG_ERROR("%s: poll failed: %s", __func__, strerror(errno));
+            break;
+        }
+        if (pfds[1].revents) {
+            break;
+        }
+
+        memset(&msgh, 0, sizeof(msgh));
+        iov[0].iov_base = &pkt;
+        iov[0].iov_len = sizeof(pkt);
+        msgh.msg_iov = iov;
+        msgh.msg_iovlen = 1;
+        msgh.msg_control = cmsgbuf;
+        msgh.msg_controllen = sizeof(cmsgbuf);
+        len = recvmsg(session->sock_fd, &msgh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (len < 0) {
+            continue;
+        }
+
+        for (cmsghp = CMSG_FIRSTHDR(&msgh); cmsghp != NULL;
+                cmsghp = CMSG_NXTHDR(&msgh, cmsghp)) {
+            if ((SOL_SOCKET == cmsghp->cmsg_level) &&
+                    (SCM_RIGHTS == cmsghp->cmsg_type)) {
+                n = (int)((cmsghp->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                for (i = 0; (i < n) &&
+                        (numfds < CAM_MAX_NUM_BUFS_PER_STREAM); i++) {
+                    fds[numfds++] = ((int *)CMSG_DATA(cmsghp))[i];
+                }
+            }
+        }
+
+        mm_camera_sim_spin(g_sim_cfg.map_us);
+        if ((len != (ssize_t)sizeof(pkt)) ||
+                (msgh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+            CDBG_ERROR("%s: bad packet of %zd bytes", __func__, len);
+            for (i = 0; i < numfds; i++) {
+                mm_camera_sim_real_close(fds[i]);
+            }
+            rc = -1;
+        } else {
+            rc = mm_camera_sim_handle_pkt(session, &pkt, fds, numfds);
+        }
+        mm_camera_sim_post_event(session, CAM_EVENT_TYPE_MAP_UNMAP_DONE,
+                (0 == rc) ? MSM_CAMERA_STATUS_SUCCESS : MSM_CAMERA_ERR_MAPPING);
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_server_start
+ *
+ * DESCRIPTION: bind the daemon socket of a session and start serving it
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+int32_t mm_camera_sim_server_start(mm_camera_sim_session_t *session)
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+
+    session->sock_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (session->sock_fd < 0) {
+        CDBG_ERROR("%s: socket failed: %s", __func__, strerror(errno));
+        return -1;
+    }
+    mm_camera_sim_server_addr(session->cam_idx + MM_CAMERA_SIM_VNODE_BASE,
+            &addr, &len);
+    if (bind(session->sock_fd, (struct sockaddr *)&addr, len) < 0) {
+        CDBG_ERROR("%s: bind failed: %s", __func__, strerror(errno));
+        mm_camera_sim_real_close(session->sock_fd);
+        return -1;
+    }
+    session->sock_stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (session->sock_stop_fd < 0) {
+        mm_camera_sim_real_close(session->sock_fd);
+        return -1;
+    }
+    if (0 != pthread_create(&session->sock_tid, NULL,
+            mm_camera_sim_server_thread, session)) {
+        mm_camera_sim_real_close(session->sock_stop_fd);
+        mm_camera_sim_real_close(session->sock_fd);
+        return -1;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_server_stop
+ *
+ * DESCRIPTION: stop serving the daemon socket and drop all maps left
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_server_stop(mm_camera_sim_session_t *session)
+{
+    mm_camera_sim_signal(session->sock_stop_fd);
+    pthread_join(session->sock_tid, NULL);
+    mm_camera_sim_real_close(session->sock_stop_fd);
+    mm_camera_sim_real_close(session->sock_fd);
+
+    pthread_mutex_lock(&session->lock);
+    if (session->num_maps > 0) {
+        CDBG_HIGH("%s: %u buffers still mapped", __func__, session->num_maps);
+    }
+    while (session->num_maps > 0) {
+        mm_camera_sim_unmap(session, &session->maps[0]);
+    }
+    pthread_mutex_unlock(&session->lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_post_event
+ *
+ * DESCRIPTION: queue a MSM_CAMERA_MSM_NOTIFY event on the session node
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @command : event command, a cam_event_type_t
+ *   @status  : event status
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_post_event(mm_camera_sim_session_t *session,
+        uint32_t command, uint32_t status)
+{
+    struct msm_v4l2_event_data *evt;
+
+    pthread_mutex_lock(&session->lock);
+    if (session->evt_cnt >= MM_CAMERA_SIM_MAX_EVENTS) {
+        pthread_mutex_unlock(&session->lock);
+        CDBG_ERROR("%s: event queue full, command %u dropped", __func__,
+                command);
+        return;
+    }
+    evt = &session->events[(session->evt_head + session->evt_cnt) %
+            MM_CAMERA_SIM_MAX_EVENTS];
+    memset(evt, 0, sizeof(*evt));
+    evt->command = command;
+    evt->status = status;
+    evt->session_id = session->cam_idx + 1;
+    session->evt_cnt++;
+    if (session->evt_fd >= 0) {
+        mm_camera_sim_signal(session->evt_fd);
+    }
+    pthread_mutex_unlock(&session->lock);
+}
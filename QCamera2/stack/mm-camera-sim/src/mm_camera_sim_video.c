@@ -0,0 +1,659 @@
+/* Copyright (c) 2012-2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm_camera_sim.h"
+#include "mm_camera_sim_dbg.h"
+
+static pthread_mutex_t g_sim_sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+static mm_camera_sim_session_t *g_sim_sessions[MM_CAMERA_SIM_MAX_CAMERAS];
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_session_create
+ *
+ * DESCRIPTION: create the session of a camera and start its daemon socket.
+ *              Called with sessions lock held.
+ *
+ * PARAMETERS :
+ *   @cam_idx : camera index
+ *
+ * RETURN     : session or NULL
+ *==========================================================================*/
+static mm_camera_sim_session_t *mm_camera_sim_session_create(uint32_t cam_idx)
+{
+    mm_camera_sim_session_t *session;
+    pthread_condattr_t attr;
+
+    session = (mm_camera_sim_session_t *)calloc(1,
+            sizeof(mm_camera_sim_session_t));
+    if (NULL == session) {
+        return NULL;
+    }
+    session->cam_idx = cam_idx;
+    session->evt_fd = -1;
+    session->next_stream_id = 1;
+    session->fps = g_sim_cfg.fps;
+    pthread_mutex_init(&session->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&session->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (0 != mm_camera_sim_server_start(session)) {
+        pthread_cond_destroy(&session->cond);
+        pthread_mutex_destroy(&session->lock);
+        free(session);
+        return NULL;
+    }
+    CDBG_HIGH("%s: camera %u opened", __func__, cam_idx);
+    return session;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_session_destroy
+ *
+ * DESCRIPTION: stop the sensor and daemon socket of a session and free it
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_session_destroy(mm_camera_sim_session_t *session)
+{
+    mm_camera_sim_sensor_stop(session);
+    mm_camera_sim_server_stop(session);
+    pthread_cond_destroy(&session->cond);
+    pthread_mutex_destroy(&session->lock);
+    CDBG_HIGH("%s: camera %u closed", __func__, session->cam_idx);
+    free(session);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_video_open
+ *
+ * DESCRIPTION: open a video node. The first open of a camera creates its
+ *              session, further opens are its streams.
+ *
+ * PARAMETERS :
+ *   @file    : new file
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+int32_t mm_camera_sim_video_open(mm_camera_sim_file_t *file)
+{
+    mm_camera_sim_session_t *session;
+
+    pthread_mutex_lock(&g_sim_sessions_lock);
+    session = g_sim_sessions[file->idx];
+    if (NULL == session) {
+        session = mm_camera_sim_session_create(file->idx);
+        if (NULL == session) {
+            pthread_mutex_unlock(&g_sim_sessions_lock);
+            errno = EIO;
+            return -1;
+        }
+        g_sim_sessions[file->idx] = session;
+    }
+    session->refcnt++;
+    file->session = session;
+    pthread_mutex_unlock(&g_sim_sessions_lock);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_stream_reset
+ *
+ * DESCRIPTION: stop a stream and hand every buffer back to the stack.
+ *              Called with session lock held.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @stream  : stream
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_sim_stream_reset(mm_camera_sim_session_t *session,
+        mm_camera_sim_stream_t *stream)
+{
+    mm_camera_sim_stats_t *stats = &stream->stats;
+    uint64_t secs;
+    uint32_t i;
+
+    stream->streaming = 0;
+    /* frames being drawn outside the lock must land first */
+    while (stream->busy > 0) {
+        pthread_cond_wait(&session->cond, &session->lock);
+    }
+    for (i = 0; i < stream->done_cnt; i++) {
+        mm_camera_sim_consume(stream->fd);
+    }
+    for (i = 0; i < CAM_MAX_NUM_BUFS_PER_STREAM; i++) {
+        stream->bufs[i].state = MM_CAMERA_SIM_BUF_CLIENT;
+        stream->bufs[i].dq_ns = 0;
+    }
+    stream->queued_cnt = 0;
+    stream->done_cnt = 0;
+
+    if (stats->frames > 0) {
+        secs = (mm_camera_sim_now_ns() - stats->start_ns) / 1000000ULL;
+        CDBG_HIGH("%s: stream %u type %d: %llu frames in %llu ms, %llu drops, "
+                "buffer hold avg %llu us max %llu us", __func__, stream->id,
+                stream->type, (unsigned long long)stats->frames,
+                (unsigned long long)secs, (unsigned long long)stats->drops,
+                (unsigned long long)((stats->returned > 0) ?
+                        stats->hold_ns / stats->returned / 1000ULL : 0),
+                (unsigned long long)(stats->hold_max_ns / 1000ULL));
+    }
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_video_close
+ *
+ * DESCRIPTION: close a video node. The last close of a camera destroys its
+ *              session.
+ *
+ * PARAMETERS :
+ *   @file    : file to close
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_sim_video_close(mm_camera_sim_file_t *file)
+{
+    mm_camera_sim_session_t *session = file->session;
+    mm_camera_sim_stream_t *stream = file->stream;
+    uint32_t i;
+
+    pthread_mutex_lock(&session->lock);
+    if (NULL != stream) {
+        mm_camera_sim_stream_reset(session, stream);
+        for (i = 0; i < MM_CAMERA_SIM_MAX_STREAMS; i++) {
+            if (session->streams[i] == stream) {
+                session->streams[i] = NULL;
+            }
+        }
+        free(stream);
+    }
+    if (session->evt_fd == file->fd) {
+        session->evt_fd = -1;
+    }
+    pthread_mutex_unlock(&session->lock);
+
+    pthread_mutex_lock(&g_sim_sessions_lock);
+    if (0 == --session->refcnt) {
+        g_sim_sessions[session->cam_idx] = NULL;
+        mm_camera_sim_session_destroy(session);
+    }
+    pthread_mutex_unlock(&g_sim_sessions_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_new_stream
+ *
+ * DESCRIPTION: make a video file a stream, like S_PARM does on the driver
+ *
+ * PARAMETERS :
+ *   @file    : video file
+ *   @parm    : streamparm, returns the server stream id in extendedmode
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_new_stream(mm_camera_sim_file_t *file,
+        struct v4l2_streamparm *parm)
+{
+    mm_camera_sim_session_t *session = file->session;
+    mm_camera_sim_stream_t *stream;
+    uint32_t i;
+
+    if (NULL != file->stream) {
+        parm->parm.capture.extendedmode = file->stream->id;
+        return 0;
+    }
+    stream = (mm_camera_sim_stream_t *)calloc(1, sizeof(mm_camera_sim_stream_t));
+    if (NULL == stream) {
+        errno = ENOMEM;
+        return -1;
+    }
+    stream->fd = file->fd;
+
+    pthread_mutex_lock(&session->lock);
+    for (i = 0; i < MM_CAMERA_SIM_MAX_STREAMS; i++) {
+        if (NULL == session->streams[i]) {
+            break;
+        }
+    }
+    if (MM_CAMERA_SIM_MAX_STREAMS == i) {
+        pthread_mutex_unlock(&session->lock);
+        free(stream);
+        errno = EBUSY;
+        return -1;
+    }
+    stream->id = session->next_stream_id++;
+    session->streams[i] = stream;
+    file->stream = stream;
+    pthread_mutex_unlock(&session->lock);
+
+    parm->parm.capture.extendedmode = stream->id;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_stream_info
+ *
+ * DESCRIPTION: stream info the stack mapped for a stream. Called with
+ *              session lock held.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @stream  : stream
+ *
+ * RETURN     : stream info or NULL if not mapped
+ *==========================================================================*/
+static cam_stream_info_t *mm_camera_sim_stream_info(
+        mm_camera_sim_session_t *session, mm_camera_sim_stream_t *stream)
+{
+    mm_camera_sim_map_t *map;
+
+    map = mm_camera_sim_find_map(session, CAM_MAPPING_BUF_TYPE_STREAM_INFO,
+            stream->id, 0, 0);
+    if ((NULL == map) || (map->size < sizeof(cam_stream_info_t))) {
+        return NULL;
+    }
+    return (cam_stream_info_t *)map->vaddr;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_qbuf
+ *
+ * DESCRIPTION: queue a buffer. Plane addresses are resolved here from the
+ *              maps, either one fd for all planes at reserved[0] offsets or
+ *              one fd per plane.
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @stream  : stream
+ *   @vb      : v4l2 buffer
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_qbuf(mm_camera_sim_session_t *session,
+        mm_camera_sim_stream_t *stream, struct v4l2_buffer *vb)
+{
+    mm_camera_sim_buf_t *buf;
+    mm_camera_sim_map_t *whole, *map;
+    uint64_t hold;
+    size_t off;
+    uint32_t i;
+
+    if ((vb->index >= CAM_MAX_NUM_BUFS_PER_STREAM) || (NULL == vb->m.planes)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&session->lock);
+    buf = &stream->bufs[vb->index];
+    if (MM_CAMERA_SIM_BUF_CLIENT != buf->state) {
+        pthread_mutex_unlock(&session->lock);
+        CDBG_ERROR("%s: stream %u buf %u queued twice", __func__, stream->id,
+                vb->index);
+        errno = EINVAL;
+        return -1;
+    }
+
+    buf->num_planes = (vb->length < VIDEO_MAX_PLANES) ?
+            vb->length : VIDEO_MAX_PLANES;
+    memcpy(buf->planes, vb->m.planes,
+            sizeof(struct v4l2_plane) * buf->num_planes);
+    whole = mm_camera_sim_find_map(session, CAM_MAPPING_BUF_TYPE_STREAM_BUF,
+            stream->id, vb->index, -1);
+    for (i = 0; i < buf->num_planes; i++) {
+        buf->plane_vaddr[i] = NULL;
+        buf->plane_len[i] = 0;
+        if (NULL != whole) {
+            map = whole;
+            off = buf->planes[i].reserved[0];
+        } else {
+            map = mm_camera_sim_find_map(session,
+                    CAM_MAPPING_BUF_TYPE_STREAM_BUF, stream->id, vb->index,
+                    (int32_t)i);
+            off = 0;
+        }
+        if ((NULL != map) && (off < map->size)) {
+            buf->plane_vaddr[i] = (uint8_t *)map->vaddr + off;
+            buf->plane_len[i] = map->size - off;
+            if (buf->planes[i].length < buf->plane_len[i]) {
+                buf->plane_len[i] = buf->planes[i].length;
+            }
+        }
+    }
+
+    if (0 != buf->dq_ns) {
+        hold = mm_camera_sim_now_ns() - buf->dq_ns;
+        stream->stats.returned++;
+        stream->stats.hold_ns += hold;
+        if (hold > stream->stats.hold_max_ns) {
+            stream->stats.hold_max_ns = hold;
+        }
+        buf->dq_ns = 0;
+    }
+    buf->state = MM_CAMERA_SIM_BUF_QUEUED;
+    stream->queued[(stream->queued_head + stream->queued_cnt) %
+            CAM_MAX_NUM_BUFS_PER_STREAM] = vb->index;
+    stream->queued_cnt++;
+    pthread_mutex_unlock(&session->lock);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_dqbuf
+ *
+ * DESCRIPTION: dequeue a filled buffer
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @stream  : stream
+ *   @vb      : v4l2 buffer, filled
+ *
+ * RETURN     : 0 on success, -1 with errno EAGAIN if nothing is filled
+ *==========================================================================*/
+static int mm_camera_sim_dqbuf(mm_camera_sim_session_t *session,
+        mm_camera_sim_stream_t *stream, struct v4l2_buffer *vb)
+{
+    mm_camera_sim_buf_t *buf;
+    uint32_t idx, i;
+
+    pthread_mutex_lock(&session->lock);
+    if ((0 == stream->done_cnt) || (0 != mm_camera_sim_consume(stream->fd))) {
+        pthread_mutex_unlock(&session->lock);
+        errno = EAGAIN;
+        return -1;
+    }
+    idx = stream->done[stream->done_head];
+    stream->done_head = (stream->done_head + 1) % CAM_MAX_NUM_BUFS_PER_STREAM;
+    stream->done_cnt--;
+    buf = &stream->bufs[idx];
+    buf->state = MM_CAMERA_SIM_BUF_CLIENT;
+    buf->dq_ns = mm_camera_sim_now_ns();
+
+    vb->index = idx;
+    vb->sequence = buf->sequence;
+    vb->timestamp = buf->timestamp;
+    vb->reserved = 0;
+    if (NULL != vb->m.planes) {
+        for (i = 0; (i < vb->length) && (i < buf->num_planes); i++) {
+            vb->m.planes[i] = buf->planes[i];
+            vb->m.planes[i].bytesused = buf->planes[i].length;
+        }
+    }
+    pthread_mutex_unlock(&session->lock);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_streamon
+ *
+ * DESCRIPTION: start a stream and the sensor behind it
+ *
+ * PARAMETERS :
+ *   @session : camera session
+ *   @stream  : stream
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_streamon(mm_camera_sim_session_t *session,
+        mm_camera_sim_stream_t *stream)
+{
+    cam_stream_info_t *info;
+
+    pthread_mutex_lock(&session->lock);
+    info = mm_camera_sim_stream_info(session, stream);
+    if (NULL == info) {
+        pthread_mutex_unlock(&session->lock);
+        CDBG_ERROR("%s: stream %u has no stream info", __func__, stream->id);
+        errno = EINVAL;
+        return -1;
+    }
+    stream->type = info->stream_type;
+    stream->mode = info->streaming_mode;
+    stream->plane_info = info->buf_planes.plane_info;
+    stream->burst_left = info->num_of_burst;
+    stream->streaming = 1;
+    memset(&stream->stats, 0, sizeof(stream->stats));
+    stream->stats.start_ns = mm_camera_sim_now_ns();
+    pthread_mutex_unlock(&session->lock);
+    CDBG_HIGH("%s: stream %u type %d mode %d %ux%u", __func__, stream->id,
+            stream->type, stream->mode, stream->fmt.width, stream->fmt.height);
+
+    if (CAM_STREAM_TYPE_OFFLINE_PROC == stream->type) {
+        return 0;
+    }
+    return (0 == mm_camera_sim_sensor_start(session)) ? 0 : -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_s_ctrl
+ *
+ * DESCRIPTION: private controls. Parameters are read from the buffers the
+ *              stack mapped before sending the control.
+ *
+ * PARAMETERS :
+ *   @file    : video file
+ *   @ctrl    : control
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_camera_sim_s_ctrl(mm_camera_sim_file_t *file,
+        struct v4l2_control *ctrl)
+{
+    mm_camera_sim_session_t *session = file->session;
+    mm_camera_sim_map_t *map;
+    cam_stream_info_t *info;
+    uint8_t reprocess = FALSE;
+
+    switch (ctrl->id) {
+    case CAM_PRIV_PARM:
+        pthread_mutex_lock(&session->lock);
+        map = mm_camera_sim_find_map(session, CAM_MAPPING_BUF_TYPE_PARM_BUF,
+                0, 0, 0);
+        if ((NULL != map) && (map->size >= sizeof(parm_buffer_t))) {
+            mm_camera_sim_set_parms(session, (parm_buffer_t *)map->vaddr);
+        }
+        pthread_mutex_unlock(&session->lock);
+        break;
+    case CAM_PRIV_DO_AUTO_FOCUS:
+        __atomic_store_n(&session->af_pending, 1, __ATOMIC_RELEASE);
+        break;
+    case CAM_PRIV_CANCEL_AUTO_FOCUS:
+        __atomic_store_n(&session->af_pending, 0, __ATOMIC_RELEASE);
+        break;
+    case CAM_PRIV_PREPARE_SNAPSHOT:
+        __atomic_store_n(&session->prep_snapshot_pending, 1, __ATOMIC_RELEASE);
+        break;
+    case CAM_PRIV_STREAM_PARM:
+        if (NULL == file->stream) {
+            break;
+        }
+        pthread_mutex_lock(&session->lock);
+        info = mm_camera_sim_stream_info(session, file->stream);
+        reprocess = (NULL != info) &&
+                (CAM_STREAM_PARAM_TYPE_DO_REPROCESS == info->parm_buf.type);
+        pthread_mutex_unlock(&session->lock);
+        if (reprocess) {
+            mm_camera_sim_do_reprocess(session, file->stream);
+        }
+        break;
+    default:
+        /* stream info sync, zsl, related sensors and flush need no action
+         * from a sensor that never holds frames back */
+        break;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_sim_video_ioctl
+ *
+ * DESCRIPTION: v4l2 ioctls of a video node
+ *
+ * PARAMETERS :
+ *   @file    : video file
+ *   @req     : ioctl request
+ *   @arg     : ioctl argument
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+int mm_camera_sim_video_ioctl(mm_camera_sim_file_t *file,
+        unsigned long req, void *arg)
+{
+    mm_camera_sim_session_t *session = file->session;
+    mm_camera_sim_stream_t *stream = file->stream;
+    mm_camera_sim_map_t *map;
+    uint32_t i;
+
+    switch (req) {
+    case VIDIOC_QUERYCAP: {
+        /* the daemon answers by filling the mapped capability buffer */
+        struct v4l2_capability *cap = (struct v4l2_capability *)arg;
+        int rc = 0;
+        memset(cap, 0, sizeof(*cap));
+        strncpy((char *)cap->driver, "mm-camera-sim", sizeof(cap->driver) - 1);
+        cap->capabilities = V4L2_CAP_VIDEO_CAPTURE_MPLANE | V4L2_CAP_STREAMING;
+        pthread_mutex_lock(&session->lock);
+        map = mm_camera_sim_find_map(session, CAM_MAPPING_BUF_TYPE_CAPABILITY,
+                0, 0, 0);
+        if ((NULL != map) && (map->size >= sizeof(cam_capability_t))) {
+            mm_camera_sim_fill_capability(session,
+                    (cam_capability_t *)map->vaddr);
+        } else {
+            errno = EINVAL;
+            rc = -1;
+        }
+        pthread_mutex_unlock(&session->lock);
+        return rc;
+    }
+    case VIDIOC_SUBSCRIBE_EVENT:
+        pthread_mutex_lock(&session->lock);
+        session->evt_fd = file->fd;
+        for (i = 0; i < session->evt_cnt; i++) {
+            mm_camera_sim_signal(session->evt_fd);
+        }
+        pthread_mutex_unlock(&session->lock);
+        return 0;
+    case VIDIOC_UNSUBSCRIBE_EVENT:
+        pthread_mutex_lock(&session->lock);
+        if (session->evt_fd == file->fd) {
+            for (i = 0; i < session->evt_cnt; i++) {
+                mm_camera_sim_consume(file->fd);
+            }
+            session->evt_fd = -1;
+        }
+        pthread_mutex_unlock(&session->lock);
+        return 0;
+    case VIDIOC_DQEVENT: {
+        struct v4l2_event *ev = (struct v4l2_event *)arg;
+        pthread_mutex_lock(&session->lock);
+        if ((session->evt_fd != file->fd) || (0 == session->evt_cnt) ||
+                (0 != mm_camera_sim_consume(file->fd))) {
+            pthread_mutex_unlock(&session->lock);
+            errno = ENOENT;
+            return -1;
+        }
+        memset(ev, 0, sizeof(*ev));
+        ev->type = MSM_CAMERA_V4L2_EVENT_TYPE;
+        ev->id = MSM_CAMERA_MSM_NOTIFY;
+        memcpy(ev->u.data, &session->events[session->evt_head],
+                sizeof(struct msm_v4l2_event_data));
+        session->evt_head = (session->evt_head + 1) % MM_CAMERA_SIM_MAX_EVENTS;
+        session->evt_cnt--;
+        ev->pending = session->evt_cnt;
+        pthread_mutex_unlock(&session->lock);
+        return 0;
+    }
+    case VIDIOC_S_CTRL:
+        return mm_camera_sim_s_ctrl(file, (struct v4l2_control *)arg);
+    case VIDIOC_G_CTRL: {
+        struct v4l2_control *ctrl = (struct v4l2_control *)arg;
+        if (MSM_CAMERA_PRIV_G_SESSION_ID == ctrl->id) {
+            ctrl->value = (int32_t)(session->cam_idx + 1);
+        }
+        return 0;
+    }
+    case VIDIOC_S_PARM:
+        return mm_camera_sim_new_stream(file, (struct v4l2_streamparm *)arg);
+    default:
+        break;
+    }
+
+    /* the rest is per stream */
+    if (NULL == stream) {
+        errno = ENOTTY;
+        return -1;
+    }
+    switch (req) {
+    case VIDIOC_S_FMT: {
+        struct v4l2_format *fmt = (struct v4l2_format *)arg;
+        pthread_mutex_lock(&session->lock);
+        memcpy(&stream->fmt, fmt->fmt.raw_data, sizeof(stream->fmt));
+        pthread_mutex_unlock(&session->lock);
+        return 0;
+    }
+    case VIDIOC_REQBUFS: {
+        struct v4l2_requestbuffers *req_bufs = (struct v4l2_requestbuffers *)arg;
+        if (req_bufs->count > CAM_MAX_NUM_BUFS_PER_STREAM) {
+            req_bufs->count = CAM_MAX_NUM_BUFS_PER_STREAM;
+        }
+        pthread_mutex_lock(&session->lock);
+        if (0 == req_bufs->count) {
+            mm_camera_sim_stream_reset(session, stream);
+        }
+        stream->num_bufs = req_bufs->count;
+        pthread_mutex_unlock(&session->lock);
+        return 0;
+    }
+    case VIDIOC_QBUF:
+        return mm_camera_sim_qbuf(session, stream, (struct v4l2_buffer *)arg);
+    case VIDIOC_DQBUF:
+        return mm_camera_sim_dqbuf(session, stream, (struct v4l2_buffer *)arg);
+    case VIDIOC_STREAMON:
+        return mm_camera_sim_streamon(session, stream);
+    case VIDIOC_STREAMOFF:
+        pthread_mutex_lock(&session->lock);
+        mm_camera_sim_stream_reset(session, stream);
+        pthread_mutex_unlock(&session->lock);
+        return 0;
+    default:
+        break;
+    }
+    errno = ENOTTY;
+    return -1;
+}
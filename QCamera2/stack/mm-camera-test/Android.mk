@@ -182,3 +182,183 @@ LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
 LOCAL_CLANG := false
 LOCAL_MODULE:= libmm-qcamera
 include $(BUILD_SHARED_LIBRARY)
+
+# Build domain socket stand-in server: mm-qcamera-ds-server
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags) \
+        -D_ANDROID_
+
+LOCAL_SRC_FILES:= src/mm_qcamera_ds_server.c
+
+LOCAL_C_INCLUDES:=$(LOCAL_PATH)/inc
+LOCAL_C_INCLUDES+= $(LOCAL_PATH)/../common
+LOCAL_C_INCLUDES+= $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+
+LOCAL_SHARED_LIBRARIES:= liblog
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_CLANG := false
+
+LOCAL_MODULE:= mm-qcamera-ds-server
+
+include $(BUILD_EXECUTABLE)
+
+# Build stream buffer ownership stress test: mm-qcamera-buf-stress
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags) \
+        -D_ANDROID_
+
+ifeq ($(strip $(TARGET_USES_ION)),true)
+LOCAL_CFLAGS += -DUSE_ION
+endif
+
+ifneq (,$(filter msm8974 msm8916 msm8226 msm8610 msm8916 apq8084 msm8084 msm8994 msm8992 msm8952 msm8996,$(TARGET_BOARD_PLATFORM)))
+LOCAL_CFLAGS += -DVENUS_PRESENT
+endif
+
+ifneq (,$(filter msm8996,$(TARGET_BOARD_PLATFORM)))
+LOCAL_CFLAGS += -DUBWC_PRESENT
+endif
+
+# builds mm_camera_stream.c in, against a fake kernel queue. The rest of
+# the interface is built from source too rather than linking
+# libmmcamera_interface, which would define the stream code a second time
+LOCAL_SRC_FILES:= \
+        src/mm_qcamera_buf_stress.c \
+        ../mm-camera-interface/src/mm_camera_interface.c \
+        ../mm-camera-interface/src/mm_camera.c \
+        ../mm-camera-interface/src/mm_camera_channel.c \
+        ../mm-camera-interface/src/mm_camera_thread.c \
+        ../mm-camera-interface/src/mm_camera_sock.c \
+        ../mm-camera-interface/src/mm_camera_trace.c
+
+LOCAL_C_INCLUDES:= \
+        $(LOCAL_PATH)/../mm-camera-interface/inc \
+        $(LOCAL_PATH)/../common \
+        system/media/camera/include
+LOCAL_C_INCLUDES+= $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_C_INCLUDES += hardware/qcom/media-caf/msm8996/mm-core/inc
+
+LOCAL_CFLAGS += -DCAMERA_ION_HEAP_ID=ION_IOMMU_HEAP_ID
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+
+ifneq (1,$(filter 1,$(shell echo "$$(( $(PLATFORM_SDK_VERSION) >= 17 ))" )))
+  LOCAL_CFLAGS += -include bionic/libc/kernel/common/linux/socket.h
+  LOCAL_CFLAGS += -include bionic/libc/kernel/common/linux/un.h
+endif
+
+LOCAL_SHARED_LIBRARIES:= \
+         libcutils libdl liblog libutils
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_CLANG := false
+
+LOCAL_MODULE:= mm-qcamera-buf-stress
+
+include $(BUILD_EXECUTABLE)
+
+# Build QCameraQueue list vs ring mode benchmark: mm-qcamera-queue-bench
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags) \
+        -D_ANDROID_
+
+LOCAL_SRC_FILES:= \
+        src/mm_qcamera_queue_bench.cpp \
+        ../../util/QCameraQueue.cpp
+
+LOCAL_C_INCLUDES:= \
+        $(LOCAL_PATH)/../common \
+        $(LOCAL_PATH)/../../util
+LOCAL_C_INCLUDES+= $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+
+LOCAL_SHARED_LIBRARIES:= libcutils liblog libutils
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_CLANG := false
+
+LOCAL_MODULE:= mm-qcamera-queue-bench
+
+include $(BUILD_EXECUTABLE)
+
+# Build channel matcher out of order arrival benchmark: mm-qcamera-match-bench
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS:= \
+        $(mmcamera_debug_defines) \
+        $(mmcamera_debug_cflags) \
+        -D_ANDROID_
+
+ifeq ($(strip $(TARGET_USES_ION)),true)
+LOCAL_CFLAGS += -DUSE_ION
+endif
+
+ifneq (,$(filter msm8974 msm8916 msm8226 msm8610 msm8916 apq8084 msm8084 msm8994 msm8992 msm8952 msm8996,$(TARGET_BOARD_PLATFORM)))
+LOCAL_CFLAGS += -DVENUS_PRESENT
+endif
+
+ifneq (,$(filter msm8996,$(TARGET_BOARD_PLATFORM)))
+LOCAL_CFLAGS += -DUBWC_PRESENT
+endif
+
+# builds mm_camera_channel.c in, against a fake stream qbuf. The rest of
+# the interface is built from source as for mm-qcamera-buf-stress
+LOCAL_SRC_FILES:= \
+        src/mm_qcamera_match_bench.c \
+        ../mm-camera-interface/src/mm_camera_interface.c \
+        ../mm-camera-interface/src/mm_camera.c \
+        ../mm-camera-interface/src/mm_camera_stream.c \
+        ../mm-camera-interface/src/mm_camera_thread.c \
+        ../mm-camera-interface/src/mm_camera_sock.c \
+        ../mm-camera-interface/src/mm_camera_trace.c
+
+LOCAL_C_INCLUDES:= \
+        $(LOCAL_PATH)/../mm-camera-interface/inc \
+        $(LOCAL_PATH)/../common \
+        system/media/camera/include
+LOCAL_C_INCLUDES+= $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_C_INCLUDES += hardware/qcom/media-caf/msm8996/mm-core/inc
+
+LOCAL_CFLAGS += -DCAMERA_ION_HEAP_ID=ION_IOMMU_HEAP_ID
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+
+ifneq (1,$(filter 1,$(shell echo "$$(( $(PLATFORM_SDK_VERSION) >= 17 ))" )))
+  LOCAL_CFLAGS += -include bionic/libc/kernel/common/linux/socket.h
+  LOCAL_CFLAGS += -include bionic/libc/kernel/common/linux/un.h
+endif
+
+LOCAL_SHARED_LIBRARIES:= \
+         libcutils libdl liblog libutils
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_CLANG := false
+
+LOCAL_MODULE:= mm-qcamera-match-bench
+
+include $(BUILD_EXECUTABLE)
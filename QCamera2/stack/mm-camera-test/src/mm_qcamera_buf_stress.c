@@ -0,0 +1,590 @@
+/* Copyright (c) 2012-2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Stress test for stream buffer ownership. mm_camera_stream.c is built in
+ * against a fake V4L2 queue and a fake data poll thread:
+ *  - the fake queue counts a QBUF of a buffer it already holds and a DQBUF
+ *    of a buffer it does not hold.
+ *  - one poll thread runs mm_stream_data_notify whenever the stream fd is
+ *    in the poll set and the queue is not empty.
+ *  - consumer threads pop frames from the channel queues and call
+ *    mm_stream_buf_done. The stream is bundled and linked, so every frame
+ *    carries two references released from different threads.
+ * At the end every buffer must be back in the queue with no reference
+ * left and the stream fd must be polled. Exit status is 0 on success. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+
+#define MM_QCAMERA_STRESS_MAX_CONSUMERS 16
+#define MM_QCAMERA_STRESS_FAKE_FD       0x7fff
+#define MM_QCAMERA_STRESS_STALL_SEC     2
+
+/* fake kernel buffer queue and poll set */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t queued[CAM_MAX_NUM_BUFS_PER_STREAM];
+    uint32_t ring[CAM_MAX_NUM_BUFS_PER_STREAM];
+    uint32_t head;
+    uint32_t count;
+    uint32_t sequence;
+    /* poll set */
+    uint8_t poll_added;
+    mm_camera_poll_notify_t poll_cb;
+    void *poll_data;
+    /* errors */
+    uint64_t double_qbuf;
+    uint64_t bad_dqbuf;
+    uint64_t double_add;
+    uint64_t double_del;
+    /* counters */
+    uint64_t num_qbuf;
+    uint64_t num_dqbuf;
+} mm_qcamera_stress_kernel_t;
+
+static mm_qcamera_stress_kernel_t g_fk;
+
+static int mm_qcamera_stress_ioctl(int fd, unsigned long req, void *arg)
+{
+    struct v4l2_buffer *vb = (struct v4l2_buffer *)arg;
+    struct timeval tv;
+    uint32_t idx;
+    int rc = 0;
+
+    (void)fd;
+    if ((req != VIDIOC_QBUF) && (req != VIDIOC_DQBUF)) {
+        /* REQBUFS and friends always succeed */
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_fk.lock);
+    if (req == VIDIOC_QBUF) {
+        idx = vb->index;
+        if ((idx >= CAM_MAX_NUM_BUFS_PER_STREAM) || g_fk.queued[idx]) {
+            g_fk.double_qbuf++;
+            errno = EINVAL;
+            rc = -1;
+        } else {
+            g_fk.queued[idx] = 1;
+            g_fk.ring[(g_fk.head + g_fk.count) % CAM_MAX_NUM_BUFS_PER_STREAM] =
+                    idx;
+            g_fk.count++;
+            g_fk.num_qbuf++;
+            pthread_cond_broadcast(&g_fk.cond);
+        }
+    } else if (0 == g_fk.count) {
+        errno = EAGAIN;
+        rc = -1;
+    } else {
+        idx = g_fk.ring[g_fk.head];
+        g_fk.head = (g_fk.head + 1) % CAM_MAX_NUM_BUFS_PER_STREAM;
+        g_fk.count--;
+        if (!g_fk.queued[idx]) {
+            g_fk.bad_dqbuf++;
+        }
+        g_fk.queued[idx] = 0;
+        g_fk.num_dqbuf++;
+        gettimeofday(&tv, NULL);
+        vb->index = idx;
+        vb->sequence = ++g_fk.sequence;
+        vb->timestamp = tv;
+    }
+    pthread_mutex_unlock(&g_fk.lock);
+    return rc;
+}
+
+static int32_t mm_qcamera_stress_add_poll_fd(mm_camera_poll_thread_t *poll_cb,
+        uint32_t handler, int32_t fd, mm_camera_poll_notify_t notify_cb,
+        void *userdata, mm_camera_call_type_t call_type)
+{
+    (void)poll_cb;
+    (void)handler;
+    (void)fd;
+    (void)call_type;
+    pthread_mutex_lock(&g_fk.lock);
+    if (g_fk.poll_added) {
+        g_fk.double_add++;
+    }
+    g_fk.poll_added = 1;
+    g_fk.poll_cb = notify_cb;
+    g_fk.poll_data = userdata;
+    pthread_cond_broadcast(&g_fk.cond);
+    pthread_mutex_unlock(&g_fk.lock);
+    return 0;
+}
+
+static int32_t mm_qcamera_stress_del_poll_fd(mm_camera_poll_thread_t *poll_cb,
+        uint32_t handler, mm_camera_call_type_t call_type)
+{
+    (void)poll_cb;
+    (void)handler;
+    (void)call_type;
+    pthread_mutex_lock(&g_fk.lock);
+    if (!g_fk.poll_added) {
+        g_fk.double_del++;
+    }
+    g_fk.poll_added = 0;
+    pthread_mutex_unlock(&g_fk.lock);
+    return 0;
+}
+
+/* route the stream's kernel and poll thread calls to the fakes above */
+#define ioctl mm_qcamera_stress_ioctl
+#define mm_camera_poll_thread_add_poll_fd mm_qcamera_stress_add_poll_fd
+#define mm_camera_poll_thread_del_poll_fd mm_qcamera_stress_del_poll_fd
+#include "../../mm-camera-interface/src/mm_camera_stream.c"
+#undef ioctl
+#undef mm_camera_poll_thread_add_poll_fd
+#undef mm_camera_poll_thread_del_poll_fd
+
+typedef struct {
+    mm_stream_t *stream;
+    mm_channel_t *ch;
+    uint32_t max_delay_us;
+    unsigned int seed;
+    volatile uint8_t *exit;
+    uint64_t num_done;
+    uint64_t done_errs;
+} mm_qcamera_stress_consumer_t;
+
+typedef struct {
+    uint32_t frames;
+    uint8_t stalled;
+} mm_qcamera_stress_poll_t;
+
+static int32_t mm_qcamera_stress_cache_op(uint32_t index, void *user_data)
+{
+    (void)index;
+    (void)user_data;
+    return 0;
+}
+
+static void *mm_qcamera_stress_poll_fn(void *data)
+{
+    mm_qcamera_stress_poll_t *poll = (mm_qcamera_stress_poll_t *)data;
+    mm_camera_poll_notify_t cb;
+    void *cb_data;
+    struct timespec ts;
+
+    for (;;) {
+        pthread_mutex_lock(&g_fk.lock);
+        if (g_fk.num_dqbuf >= poll->frames) {
+            pthread_mutex_unlock(&g_fk.lock);
+            break;
+        }
+        while (!(g_fk.poll_added && (g_fk.count > 0))) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += MM_QCAMERA_STRESS_STALL_SEC;
+            if (ETIMEDOUT == pthread_cond_timedwait(&g_fk.cond, &g_fk.lock,
+                    &ts)) {
+                break;
+            }
+        }
+        if (!(g_fk.poll_added && (g_fk.count > 0))) {
+            /* nothing could be dequeued for a while */
+            CDBG_ERROR("%s: stalled, queued %u polled %d", __func__,
+                    g_fk.count, g_fk.poll_added);
+            poll->stalled = 1;
+            pthread_mutex_unlock(&g_fk.lock);
+            break;
+        }
+        cb = g_fk.poll_cb;
+        cb_data = g_fk.poll_data;
+        pthread_mutex_unlock(&g_fk.lock);
+
+        /* the poll thread is the only dequeuer, the buffer stays queued */
+        cb(cb_data);
+    }
+    return NULL;
+}
+
+static void *mm_qcamera_stress_consumer_fn(void *data)
+{
+    mm_qcamera_stress_consumer_t *c = (mm_qcamera_stress_consumer_t *)data;
+    mm_camera_cmdcb_t *node;
+    uint32_t delay;
+
+    for (;;) {
+        cam_sem_wait(&c->ch->cmd_thread.cmd_sem);
+        node = (mm_camera_cmdcb_t *)cam_queue_deq(&c->ch->cmd_thread.cmd_queue);
+        if (NULL == node) {
+            if (*c->exit) {
+                break;
+            }
+            continue;
+        }
+        if (c->max_delay_us > 0) {
+            delay = (uint32_t)rand_r(&c->seed) % (c->max_delay_us + 1);
+            if (delay > 0) {
+                usleep(delay);
+            }
+        }
+        if (mm_stream_buf_done(c->stream, node->u.buf.buf) < 0) {
+            c->done_errs++;
+        }
+        c->num_done++;
+        free(node);
+    }
+    return NULL;
+}
+
+static void mm_qcamera_stress_drain(mm_channel_t *ch)
+{
+    mm_camera_cmdcb_t *node;
+
+    while (NULL != (node = (mm_camera_cmdcb_t *)
+            cam_queue_deq(&ch->cmd_thread.cmd_queue))) {
+        free(node);
+    }
+}
+
+/* wait until the consumers returned every buffer to the fake queue */
+static int mm_qcamera_stress_wait_all_queued(uint8_t num_bufs)
+{
+    struct timespec ts;
+    int rc = 0;
+
+    pthread_mutex_lock(&g_fk.lock);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += MM_QCAMERA_STRESS_STALL_SEC;
+    while ((g_fk.count < num_bufs) && (0 == rc)) {
+        rc = pthread_cond_timedwait(&g_fk.cond, &g_fk.lock, &ts);
+    }
+    rc = (g_fk.count == num_bufs) ? 0 : -1;
+    pthread_mutex_unlock(&g_fk.lock);
+    return rc;
+}
+
+/* check that every buffer is owned by kernel with no reference left */
+static int mm_qcamera_stress_check_idle(mm_stream_t *stream)
+{
+    uint64_t full = (stream->buf_num >= 64) ? ~0ULL :
+            ((1ULL << stream->buf_num) - 1);
+    int errs = 0;
+    uint8_t i;
+
+    for (i = 0; i < stream->buf_num; i++) {
+        if (0 != stream->buf_status[i].buf_refcnt) {
+            printf("  buf %d refcnt %d\n", i, stream->buf_status[i].buf_refcnt);
+            errs++;
+        }
+        if (!g_fk.queued[i]) {
+            printf("  buf %d not in kernel queue\n", i);
+            errs++;
+        }
+    }
+    if (stream->kernel_mask != full) {
+        printf("  kernel_mask 0x%llx expected 0x%llx\n",
+                (unsigned long long)stream->kernel_mask,
+                (unsigned long long)full);
+        errs++;
+    }
+    if (stream->queued_buffer_count != stream->buf_num) {
+        printf("  queued_buffer_count %d expected %d\n",
+                stream->queued_buffer_count, stream->buf_num);
+        errs++;
+    }
+    if (!stream->poll_added || !g_fk.poll_added) {
+        printf("  stream fd not polled (stream %d fake %d)\n",
+                stream->poll_added, g_fk.poll_added);
+        errs++;
+    }
+    return errs;
+}
+
+/* an extra qbuf and a third buf_done of a two reference frame must both
+ * be refused without reaching the kernel queue */
+static int mm_qcamera_stress_check_refused(mm_stream_t *stream,
+        mm_channel_t *ch, mm_channel_t *linked)
+{
+    uint64_t double_qbuf = g_fk.double_qbuf;
+    uint32_t idx;
+    int errs = 0;
+
+    if (mm_stream_qbuf(stream, &stream->buf[0]) != -1) {
+        printf("  extra qbuf of a queued buffer accepted\n");
+        errs++;
+    }
+
+    pthread_mutex_lock(&g_fk.lock);
+    idx = g_fk.ring[g_fk.head];
+    pthread_mutex_unlock(&g_fk.lock);
+    mm_stream_data_notify(stream);
+    mm_qcamera_stress_drain(ch);
+    mm_qcamera_stress_drain(linked);
+    if (stream->buf_status[idx].buf_refcnt != 2) {
+        printf("  dequeued buf %u refcnt %d expected 2\n", idx,
+                stream->buf_status[idx].buf_refcnt);
+        return errs + 1;
+    }
+    if ((mm_stream_buf_done(stream, &stream->buf[idx]) != 0) ||
+            (mm_stream_buf_done(stream, &stream->buf[idx]) != 0)) {
+        printf("  buf_done of a held reference failed\n");
+        errs++;
+    }
+    if (mm_stream_buf_done(stream, &stream->buf[idx]) != -1) {
+        printf("  third buf_done of a two reference frame accepted\n");
+        errs++;
+    }
+    if (g_fk.double_qbuf != double_qbuf) {
+        printf("  refused request reached the kernel queue\n");
+        errs++;
+    }
+    return errs + mm_qcamera_stress_check_idle(stream);
+}
+
+static int mm_qcamera_stress_run(uint8_t num_bufs, uint32_t frames,
+        uint32_t num_consumers, uint32_t max_delay_us)
+{
+    mm_qcamera_stress_consumer_t consumers[MM_QCAMERA_STRESS_MAX_CONSUMERS];
+    pthread_t consumer_tids[MM_QCAMERA_STRESS_MAX_CONSUMERS];
+    mm_qcamera_stress_poll_t poll;
+    pthread_t poll_tid;
+    mm_stream_t *stream;
+    mm_channel_t *ch, *linked;
+    cam_stream_info_t *info;
+    mm_camera_buf_def_t *bufs;
+    volatile uint8_t exit_flag = 0;
+    uint64_t num_done = 0, done_errs = 0, num_frames;
+    struct timespec start, end;
+    double secs;
+    int errs = 0;
+    uint32_t i;
+
+    stream = (mm_stream_t *)calloc(1, sizeof(mm_stream_t));
+    ch = (mm_channel_t *)calloc(1, sizeof(mm_channel_t));
+    linked = (mm_channel_t *)calloc(1, sizeof(mm_channel_t));
+    info = (cam_stream_info_t *)calloc(1, sizeof(cam_stream_info_t));
+    bufs = (mm_camera_buf_def_t *)calloc(num_bufs, sizeof(mm_camera_buf_def_t));
+    if (!stream || !ch || !linked || !info || !bufs) {
+        CDBG_ERROR("%s: no memory", __func__);
+        free(stream);
+        free(ch);
+        free(linked);
+        free(info);
+        free(bufs);
+        return 1;
+    }
+
+    memset(&g_fk, 0, sizeof(g_fk));
+    pthread_mutex_init(&g_fk.lock, NULL);
+    pthread_cond_init(&g_fk.cond, NULL);
+
+    cam_queue_init(&ch->cmd_thread.cmd_queue);
+    cam_sem_init(&ch->cmd_thread.cmd_sem, 0);
+    cam_queue_init(&linked->cmd_thread.cmd_queue);
+    cam_sem_init(&linked->cmd_thread.cmd_sem, 0);
+
+    info->stream_type = CAM_STREAM_TYPE_PREVIEW;
+    info->streaming_mode = CAM_STREAMING_MODE_CONTINUOUS;
+    for (i = 0; i < num_bufs; i++) {
+        bufs[i].buf_idx = i;
+        bufs[i].buf_type = CAM_STREAM_BUF_TYPE_MPLANE;
+        bufs[i].stream_type = CAM_STREAM_TYPE_PREVIEW;
+        bufs[i].planes_buf.num_planes = 1;
+        stream->buf_status[i].initial_reg_flag = 1;
+    }
+    stream->my_hdl = 1;
+    stream->fd = MM_QCAMERA_STRESS_FAKE_FD;
+    stream->state = MM_STREAM_STATE_ACTIVE;
+    stream->stream_info = info;
+    stream->frame_offset.num_planes = 1;
+    stream->buf = bufs;
+    stream->buf_num = num_bufs;
+    stream->ch_obj = ch;
+    stream->is_bundled = 1;
+    stream->linked_obj = linked;
+    stream->is_linked = 1;
+    stream->mem_vtbl.invalidate_buf = mm_qcamera_stress_cache_op;
+    stream->mem_vtbl.clean_invalidate_buf = mm_qcamera_stress_cache_op;
+    pthread_mutex_init(&stream->buf_lock, NULL);
+    pthread_mutex_init(&stream->poll_lock, NULL);
+    pthread_mutex_init(&stream->stats_lock, NULL);
+    pthread_mutex_init(&stream->cb_lock, NULL);
+    pthread_mutex_init(&stream->cmd_lock, NULL);
+    pthread_cond_init(&stream->buf_cond, NULL);
+
+    if (mm_stream_reg_buf(stream) != 0) {
+        CDBG_ERROR("%s: reg_buf failed", __func__);
+        errs++;
+        goto done;
+    }
+
+    memset(consumers, 0, sizeof(consumers));
+    for (i = 0; i < num_consumers; i++) {
+        consumers[i].stream = stream;
+        consumers[i].ch = (i & 1) ? linked : ch;
+        consumers[i].max_delay_us = max_delay_us;
+        consumers[i].seed = i + 1;
+        consumers[i].exit = &exit_flag;
+        pthread_create(&consumer_tids[i], NULL,
+                mm_qcamera_stress_consumer_fn, &consumers[i]);
+    }
+    memset(&poll, 0, sizeof(poll));
+    poll.frames = frames;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&poll_tid, NULL, mm_qcamera_stress_poll_fn, &poll);
+    pthread_join(poll_tid, NULL);
+    if (mm_qcamera_stress_wait_all_queued(num_bufs) != 0) {
+        printf("  buffers leaked, %u of %d back in kernel\n", g_fk.count,
+                num_bufs);
+        errs++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    exit_flag = 1;
+    for (i = 0; i < num_consumers; i++) {
+        cam_sem_post(&consumers[i].ch->cmd_thread.cmd_sem);
+    }
+    for (i = 0; i < num_consumers; i++) {
+        pthread_join(consumer_tids[i], NULL);
+        num_done += consumers[i].num_done;
+        done_errs += consumers[i].done_errs;
+    }
+
+    if (poll.stalled) {
+        errs++;
+    }
+    if (g_fk.double_qbuf || g_fk.bad_dqbuf || g_fk.double_add ||
+            g_fk.double_del || done_errs) {
+        errs++;
+    }
+    if (num_done != 2 * g_fk.num_dqbuf) {
+        printf("  %llu buf_done for %llu frames\n",
+                (unsigned long long)num_done,
+                (unsigned long long)g_fk.num_dqbuf);
+        errs++;
+    }
+    num_frames = g_fk.num_dqbuf;
+    errs += mm_qcamera_stress_check_idle(stream);
+    if (0 == errs) {
+        errs += mm_qcamera_stress_check_refused(stream, ch, linked);
+    }
+
+    secs = (double)(end.tv_sec - start.tv_sec) +
+            (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("bufs %2d consumers %u: frames %llu in %.2fs, double qbuf %llu, "
+           "bad dqbuf %llu, poll add/del errors %llu, buf_done errors %llu: %s\n",
+           num_bufs, num_consumers, (unsigned long long)num_frames, secs,
+           (unsigned long long)g_fk.double_qbuf,
+           (unsigned long long)g_fk.bad_dqbuf,
+           (unsigned long long)(g_fk.double_add + g_fk.double_del),
+           (unsigned long long)done_errs, errs ? "FAIL" : "PASS");
+
+done:
+    mm_qcamera_stress_drain(ch);
+    mm_qcamera_stress_drain(linked);
+    cam_queue_deinit(&ch->cmd_thread.cmd_queue);
+    cam_sem_destroy(&ch->cmd_thread.cmd_sem);
+    cam_queue_deinit(&linked->cmd_thread.cmd_queue);
+    cam_sem_destroy(&linked->cmd_thread.cmd_sem);
+    pthread_mutex_destroy(&stream->buf_lock);
+    pthread_mutex_destroy(&stream->poll_lock);
+    pthread_mutex_destroy(&stream->stats_lock);
+    pthread_mutex_destroy(&stream->cb_lock);
+    pthread_mutex_destroy(&stream->cmd_lock);
+    pthread_cond_destroy(&stream->buf_cond);
+    pthread_mutex_destroy(&g_fk.lock);
+    pthread_cond_destroy(&g_fk.cond);
+    free(stream);
+    free(ch);
+    free(linked);
+    free(info);
+    free(bufs);
+    return errs;
+}
+
+static void mm_qcamera_stress_usage(const char *name)
+{
+    printf("usage: %s [-b num_bufs] [-f frames] [-c consumers] [-d usec]\n"
+           "  -b  buffers per stream, 1..%d. Default runs 2, 4, 8, 16 and 64\n"
+           "  -f  frames per run, default 100000\n"
+           "  -c  consumer threads, 2..%d, default 4\n"
+           "  -d  max random consumer delay per frame in usec, default 0\n",
+           name, CAM_MAX_NUM_BUFS_PER_STREAM, MM_QCAMERA_STRESS_MAX_CONSUMERS);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint8_t default_bufs[] = { 2, 4, 8, 16, 64 };
+    uint32_t frames = 100000, consumers = 4, max_delay_us = 0;
+    int num_bufs = 0, failed = 0, opt;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "b:f:c:d:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            num_bufs = atoi(optarg);
+            break;
+        case 'f':
+            frames = (uint32_t)atol(optarg);
+            break;
+        case 'c':
+            consumers = (uint32_t)atoi(optarg);
+            break;
+        case 'd':
+            max_delay_us = (uint32_t)atoi(optarg);
+            break;
+        default:
+            mm_qcamera_stress_usage(argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    if ((num_bufs < 0) || (num_bufs > CAM_MAX_NUM_BUFS_PER_STREAM) ||
+            (consumers < 2) || (consumers > MM_QCAMERA_STRESS_MAX_CONSUMERS) ||
+            (0 == frames)) {
+        mm_qcamera_stress_usage(argv[0]);
+        return 1;
+    }
+
+    if (num_bufs > 0) {
+        failed = mm_qcamera_stress_run((uint8_t)num_bufs, frames, consumers,
+                max_delay_us);
+    } else {
+        for (i = 0; i < sizeof(default_bufs) / sizeof(default_bufs[0]); i++) {
+            failed += mm_qcamera_stress_run(default_bufs[i], frames, consumers,
+                    max_delay_us);
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,283 @@
+/* Copyright (c) 2012-2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Stand-in for the daemon end of the mm-camera-interface domain socket.
+ * It receives map/unmap packets with their fds the way the daemon does,
+ * optionally burns a fixed cost per packet and per fd, and can ack every
+ * packet on a second socket so the client side can be benchmarked without
+ * the camera daemon. On a device acks come as CAM_EVENT_TYPE_MAP_UNMAP_DONE
+ * V4L2 events instead.
+ *
+ * Ack datagram: mm_qcamera_ds_ack_t, sent to "<socket path>_ack". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cam_types.h"
+#include "mm_qcamera_dbg.h"
+
+#define MM_QCAMERA_DS_PATH_MAX 108
+
+typedef struct {
+    uint32_t seq;       /* packets received before this one */
+    uint32_t status;    /* 0 on success */
+} mm_qcamera_ds_ack_t;
+
+typedef struct {
+    uint64_t num_pkts;
+    uint64_t num_maps;
+    uint64_t num_unmaps;
+    uint64_t num_fds;
+    uint64_t num_errs;
+} mm_qcamera_ds_stats_t;
+
+static volatile sig_atomic_t g_ds_exit;
+
+static void mm_qcamera_ds_sig_handler(int sig)
+{
+    (void)sig;
+    g_ds_exit = 1;
+}
+
+/* busy wait, sleeping would add scheduler wakeup latency to the cost */
+static void mm_qcamera_ds_spin(long usec)
+{
+    struct timespec start, now;
+
+    if (usec <= 0) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000L +
+            (now.tv_nsec - start.tv_nsec) / 1000L < usec);
+}
+
+static int mm_qcamera_ds_bind(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        CDBG_ERROR("%s: socket failed: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        CDBG_ERROR("%s: bind %s failed: %s\n", __func__, path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* validate packet against the fds it came with. Returns 0 if sane */
+static int mm_qcamera_ds_handle_pkt(cam_sock_packet_t *pkt, ssize_t len,
+        int numfds, mm_qcamera_ds_stats_t *stats)
+{
+    uint32_t n;
+
+    if (len != (ssize_t)sizeof(cam_sock_packet_t)) {
+        return -1;
+    }
+    switch (pkt->msg_type) {
+    case CAM_MAPPING_TYPE_FD_MAPPING:
+        stats->num_maps++;
+        return (1 == numfds) ? 0 : -1;
+    case CAM_MAPPING_TYPE_FD_UNMAPPING:
+        stats->num_unmaps++;
+        return (0 == numfds) ? 0 : -1;
+    case CAM_MAPPING_TYPE_FD_BUNDLED_MAPPING:
+        n = pkt->payload.buf_map_list.length;
+        if ((n == 0) || (n > CAM_MAX_NUM_BUFS_PER_STREAM)) {
+            return -1;
+        }
+        stats->num_maps += n;
+        return ((int)n == numfds) ? 0 : -1;
+    case CAM_MAPPING_TYPE_FD_BUNDLED_UNMAPPING:
+        n = pkt->payload.buf_unmap_list.length;
+        if ((n == 0) || (n > CAM_MAX_NUM_BUFS_PER_STREAM)) {
+            return -1;
+        }
+        stats->num_unmaps += n;
+        return (0 == numfds) ? 0 : -1;
+    default:
+        return -1;
+    }
+}
+
+static void mm_qcamera_ds_usage(const char *name)
+{
+    printf("usage: %s [-c cam_id] [-s path] [-p usec] [-f usec] [-a]\n"
+           "  -c  camera id used in the default socket path\n"
+           "  -s  socket path, default %scam_socket<cam_id>\n"
+           "  -p  cost per packet in usec\n"
+           "  -f  cost per fd in usec\n"
+           "  -a  ack every packet to <path>_ack\n",
+           name, QCAMERA_DUMP_FRM_LOCATION);
+}
+
+int main(int argc, char **argv)
+{
+    char path[MM_QCAMERA_DS_PATH_MAX];
+    struct sockaddr_un ack_addr;
+    mm_qcamera_ds_stats_t stats;
+    cam_sock_packet_t pkt;
+    char cmsgbuf[CMSG_SPACE(sizeof(int) * CAM_MAX_NUM_BUFS_PER_STREAM)];
+    struct sigaction sa;
+    long pkt_cost = 0, fd_cost = 0;
+    int cam_id = 0, ack = 0, opt, fd, i;
+
+    path[0] = '\0';
+    while ((opt = getopt(argc, argv, "c:s:p:f:ah")) != -1) {
+        switch (opt) {
+        case 'c':
+            cam_id = atoi(optarg);
+            break;
+        case 's':
+            snprintf(path, sizeof(path), "%s", optarg);
+            break;
+        case 'p':
+            pkt_cost = atol(optarg);
+            break;
+        case 'f':
+            fd_cost = atol(optarg);
+            break;
+        case 'a':
+            ack = 1;
+            break;
+        default:
+            mm_qcamera_ds_usage(argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    if (path[0] == '\0') {
+        snprintf(path, sizeof(path), QCAMERA_DUMP_FRM_LOCATION"cam_socket%d",
+                cam_id);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = mm_qcamera_ds_sig_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    fd = mm_qcamera_ds_bind(path);
+    if (fd < 0) {
+        return 1;
+    }
+    memset(&ack_addr, 0, sizeof(ack_addr));
+    ack_addr.sun_family = AF_UNIX;
+    snprintf(ack_addr.sun_path, sizeof(ack_addr.sun_path), "%s_ack", path);
+    memset(&stats, 0, sizeof(stats));
+    printf("%s: listening on %s\n", argv[0], path);
+    fflush(stdout);
+
+    while (!g_ds_exit) {
+        struct msghdr msgh;
+        struct iovec iov[1];
+        struct cmsghdr *cmsghp;
+        mm_qcamera_ds_ack_t ack_msg;
+        int numfds = 0;
+        ssize_t len;
+
+        memset(&msgh, 0, sizeof(msgh));
+        iov[0].iov_base = &pkt;
+        iov[0].iov_len = sizeof(pkt);
+        msgh.msg_iov = iov;
+        msgh.msg_iovlen = 1;
+        msgh.msg_control = cmsgbuf;
+        msgh.msg_controllen = sizeof(cmsgbuf);
+
+        len = recvmsg(fd, &msgh, 0);
+        if (len < 0) {
+            if (errno != EINTR) {
+                CDBG_ERROR("%s: recvmsg failed: %s\n", __func__,
+                        strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        /* fds were installed in this process, so close them even when the
+         * packet turns out to be malformed */
+        for (cmsghp = CMSG_FIRSTHDR(&msgh); cmsghp != NULL;
+                cmsghp = CMSG_NXTHDR(&msgh, cmsghp)) {
+            if ((cmsghp->cmsg_level == SOL_SOCKET) &&
+                    (cmsghp->cmsg_type == SCM_RIGHTS)) {
+                int n = (int)((cmsghp->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                int *fds = (int *)CMSG_DATA(cmsghp);
+                for (i = 0; i < n; i++) {
+                    close(fds[i]);
+                }
+                numfds += n;
+            }
+        }
+
+        mm_qcamera_ds_spin(pkt_cost + fd_cost * numfds);
+        ack_msg.seq = (uint32_t)stats.num_pkts;
+        ack_msg.status = 0;
+        if (mm_qcamera_ds_handle_pkt(&pkt, len, numfds, &stats) != 0 ||
+                (msgh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+            CDBG_ERROR("%s: bad packet %u type %d len %zd fds %d\n", __func__,
+                    ack_msg.seq, pkt.msg_type, len, numfds);
+            ack_msg.status = 1;
+            stats.num_errs++;
+        }
+        stats.num_pkts++;
+        stats.num_fds += (uint64_t)numfds;
+
+        if (ack && sendto(fd, &ack_msg, sizeof(ack_msg), 0,
+                (struct sockaddr *)&ack_addr, sizeof(ack_addr)) < 0) {
+            CDBG_ERROR("%s: ack %u failed: %s\n", __func__, ack_msg.seq,
+                    strerror(errno));
+        }
+    }
+
+    printf("pkts %llu maps %llu unmaps %llu fds %llu errors %llu\n",
+           (unsigned long long)stats.num_pkts,
+           (unsigned long long)stats.num_maps,
+           (unsigned long long)stats.num_unmaps,
+           (unsigned long long)stats.num_fds,
+           (unsigned long long)stats.num_errs);
+    close(fd);
+    unlink(path);
+    return 0;
+}
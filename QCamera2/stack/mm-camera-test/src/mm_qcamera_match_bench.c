@@ -0,0 +1,404 @@
+/* Copyright (c) 2012-2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Synthetic benchmark of the channel superbuf matcher with out of order
+ * arrivals. mm_camera_channel.c is built in and fed directly with
+ * mm_channel_superbuf_comp_and_enqueue; buffers the matcher gives back go
+ * through a fake stream qbuf.
+ *
+ * Every stream delivers frames 1..N in order, with its own lag behind
+ * stream 0 plus random jitter, and drops a share of its frames, so the
+ * streams interleave out of frame order. Matched superbufs are dispatched
+ * right away, or held up to a lookback depth as in ZSL burst mode. Each
+ * run checks that:
+ *  - every dispatched superbuf holds one buffer per stream, all with the
+ *    superbuf frame_idx, and frame_idx increases between dispatches.
+ *  - every buffer is given back exactly once, by dispatch, qbuf or the
+ *    final flush.
+ * Cost is reported per fed buffer, including the dispatch of matched
+ * superbufs. Exit status is 0 when every run passes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+
+/* buffers per stream, more than the matcher can ever hold */
+#define MM_QCAMERA_MBENCH_POOL_SIZE 256
+/* arrival times are in 1/16 of a frame interval */
+#define MM_QCAMERA_MBENCH_TICKS     16
+
+typedef struct {
+    uint32_t arrival;
+    uint32_t frame_idx;
+    uint8_t stream;
+} mm_qcamera_mbench_event_t;
+
+typedef struct {
+    uint32_t num_streams;
+    uint32_t depth;      /* max_unmatched_frames */
+    uint32_t lag;        /* frames each stream lags the previous one */
+    uint32_t jitter;     /* max random extra delay in frames */
+    uint32_t drop_pct;   /* frames dropped per stream, percent */
+    uint32_t lookback;   /* matched superbufs held, 0 dispatches at once */
+} mm_qcamera_mbench_cfg_t;
+
+typedef struct {
+    mm_camera_buf_def_t bufs[MAX_STREAM_NUM_IN_BUNDLE][MM_QCAMERA_MBENCH_POOL_SIZE];
+    uint8_t held[MAX_STREAM_NUM_IN_BUNDLE][MM_QCAMERA_MBENCH_POOL_SIZE];
+    uint64_t released;
+    uint64_t double_release;
+    uint64_t reuse_held;
+} mm_qcamera_mbench_pool_t;
+
+static mm_qcamera_mbench_pool_t g_pool;
+
+/* give a buffer back to its stream pool */
+static void mm_qcamera_mbench_release(mm_camera_buf_def_t *buf)
+{
+    uint32_t s = buf->stream_id - 1;
+
+    if ((s >= MAX_STREAM_NUM_IN_BUNDLE) ||
+            (buf->buf_idx >= MM_QCAMERA_MBENCH_POOL_SIZE) ||
+            !g_pool.held[s][buf->buf_idx]) {
+        g_pool.double_release++;
+        return;
+    }
+    g_pool.held[s][buf->buf_idx] = 0;
+    g_pool.released++;
+}
+
+static int32_t mm_qcamera_mbench_stream_fsm_fn(mm_stream_t *my_obj,
+        mm_stream_evt_type_t evt, void *in_val, void *out_val)
+{
+    (void)my_obj;
+    (void)out_val;
+    if (MM_STREAM_EVT_QBUF == evt) {
+        mm_qcamera_mbench_release((mm_camera_buf_def_t *)in_val);
+    }
+    return 0;
+}
+
+/* route buffers the matcher gives back to the pool above */
+#define mm_stream_fsm_fn mm_qcamera_mbench_stream_fsm_fn
+#include "../../mm-camera-interface/src/mm_camera_channel.c"
+#undef mm_stream_fsm_fn
+
+typedef struct {
+    uint64_t dispatched;
+    uint64_t bad_superbuf;
+    uint64_t out_of_order;
+    uint32_t last_frame_idx;
+} mm_qcamera_mbench_result_t;
+
+static int mm_qcamera_mbench_event_cmp(const void *a, const void *b)
+{
+    const mm_qcamera_mbench_event_t *x = (const mm_qcamera_mbench_event_t *)a;
+    const mm_qcamera_mbench_event_t *y = (const mm_qcamera_mbench_event_t *)b;
+
+    if (x->arrival != y->arrival) {
+        return (x->arrival < y->arrival) ? -1 : 1;
+    }
+    if (x->frame_idx != y->frame_idx) {
+        return (x->frame_idx < y->frame_idx) ? -1 : 1;
+    }
+    return (int)x->stream - (int)y->stream;
+}
+
+/* build the arrival order of all buffers of all streams */
+static uint32_t mm_qcamera_mbench_gen(const mm_qcamera_mbench_cfg_t *cfg,
+        uint32_t frames, mm_qcamera_mbench_event_t *events)
+{
+    uint32_t last[MAX_STREAM_NUM_IN_BUNDLE];
+    unsigned int seed = 1;
+    uint32_t f, s, t, n = 0;
+
+    memset(last, 0, sizeof(last));
+    for (f = 1; f <= frames; f++) {
+        for (s = 0; s < cfg->num_streams; s++) {
+            if ((uint32_t)(rand_r(&seed) % 100) < cfg->drop_pct) {
+                continue;
+            }
+            t = (f + s * cfg->lag) * MM_QCAMERA_MBENCH_TICKS +
+                    (uint32_t)rand_r(&seed) %
+                    (cfg->jitter * MM_QCAMERA_MBENCH_TICKS + 1);
+            /* a stream dequeues its own frames in order */
+            if (t <= last[s]) {
+                t = last[s] + 1;
+            }
+            last[s] = t;
+            events[n].frame_idx = f;
+            events[n].stream = (uint8_t)s;
+            events[n].arrival = t;
+            n++;
+        }
+    }
+    qsort(events, n, sizeof(*events), mm_qcamera_mbench_event_cmp);
+    return n;
+}
+
+static void mm_qcamera_mbench_dispatch(mm_channel_queue_t *queue,
+        mm_channel_queue_node_t *super_buf, mm_qcamera_mbench_result_t *res)
+{
+    uint8_t i, bad = 0;
+
+    if (super_buf->num_of_bufs != queue->num_streams) {
+        bad = 1;
+    }
+    for (i = 0; i < super_buf->num_of_bufs; i++) {
+        if ((NULL == super_buf->super_buf[i].buf) ||
+                (super_buf->super_buf[i].frame_idx != super_buf->frame_idx) ||
+                (super_buf->super_buf[i].stream_id !=
+                 queue->bundled_streams[i])) {
+            bad = 1;
+            continue;
+        }
+        mm_qcamera_mbench_release(super_buf->super_buf[i].buf);
+    }
+    if (bad) {
+        res->bad_superbuf++;
+    }
+    if ((0 != res->last_frame_idx) &&
+            (super_buf->frame_idx <= res->last_frame_idx)) {
+        res->out_of_order++;
+    }
+    res->last_frame_idx = super_buf->frame_idx;
+    res->dispatched++;
+    free(super_buf);
+}
+
+static int mm_qcamera_mbench_run(const mm_qcamera_mbench_cfg_t *cfg,
+        uint32_t frames)
+{
+    mm_qcamera_mbench_event_t *events;
+    mm_qcamera_mbench_result_t res;
+    mm_channel_queue_node_t *super_buf;
+    mm_channel_queue_t *queue;
+    mm_channel_t *ch;
+    cam_stream_info_t infos[MAX_STREAM_NUM_IN_BUNDLE];
+    mm_camera_buf_info_t buf_info;
+    mm_camera_buf_def_t *buf;
+    struct timespec start, end;
+    uint32_t num_events, i, s, slot;
+    uint64_t elapsed;
+    int errs = 0;
+
+    events = (mm_qcamera_mbench_event_t *)malloc(
+            sizeof(mm_qcamera_mbench_event_t) * frames * cfg->num_streams);
+    ch = (mm_channel_t *)calloc(1, sizeof(mm_channel_t));
+    if ((NULL == events) || (NULL == ch)) {
+        CDBG_ERROR("%s: no memory", __func__);
+        free(events);
+        free(ch);
+        return 1;
+    }
+    num_events = mm_qcamera_mbench_gen(cfg, frames, events);
+
+    memset(&g_pool, 0, sizeof(g_pool));
+    memset(&res, 0, sizeof(res));
+    memset(infos, 0, sizeof(infos));
+    queue = &ch->bundle.superbuf_queue;
+    for (s = 0; s < cfg->num_streams; s++) {
+        /* no metadata stream, the matcher must not parse buffer content */
+        infos[s].stream_type = (0 == s) ? CAM_STREAM_TYPE_PREVIEW :
+                CAM_STREAM_TYPE_SNAPSHOT;
+        ch->streams[s].state = MM_STREAM_STATE_ACTIVE;
+        ch->streams[s].my_hdl = s + 1;
+        ch->streams[s].ch_obj = ch;
+        ch->streams[s].stream_info = &infos[s];
+        queue->bundled_streams[s] = s + 1;
+        for (i = 0; i < MM_QCAMERA_MBENCH_POOL_SIZE; i++) {
+            g_pool.bufs[s][i].stream_id = s + 1;
+            g_pool.bufs[s][i].buf_idx = i;
+            g_pool.bufs[s][i].stream_type = infos[s].stream_type;
+        }
+    }
+    queue->num_streams = cfg->num_streams;
+    queue->attr.max_unmatched_frames = cfg->depth;
+    queue->attr.priority = MM_CAMERA_SUPER_BUF_PRIORITY_NORMAL;
+    queue->attr.notify_mode = (cfg->lookback > 0) ?
+            MM_CAMERA_SUPER_BUF_NOTIFY_BURST :
+            MM_CAMERA_SUPER_BUF_NOTIFY_CONTINUOUS;
+    queue->attr.water_mark = cfg->lookback;
+    mm_channel_superbuf_queue_init(queue);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_events; i++) {
+        s = events[i].stream;
+        slot = events[i].frame_idx % MM_QCAMERA_MBENCH_POOL_SIZE;
+        buf = &g_pool.bufs[s][slot];
+        if (g_pool.held[s][slot]) {
+            g_pool.reuse_held++;
+        }
+        g_pool.held[s][slot] = 1;
+        buf->frame_idx = events[i].frame_idx;
+
+        memset(&buf_info, 0, sizeof(buf_info));
+        buf_info.buf = buf;
+        buf_info.frame_idx = events[i].frame_idx;
+        buf_info.stream_id = s + 1;
+        mm_channel_superbuf_comp_and_enqueue(ch, queue, &buf_info);
+
+        if (0 == cfg->lookback) {
+            while (NULL != (super_buf = mm_channel_superbuf_dequeue(queue, ch))) {
+                mm_qcamera_mbench_dispatch(queue, super_buf, &res);
+            }
+        } else {
+            /* drops the oldest matched ones beyond the lookback depth */
+            mm_channel_superbuf_bufdone_overflow(ch, queue);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+            (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+
+    /* a burst capture takes what the lookback holds */
+    while (NULL != (super_buf = mm_channel_superbuf_dequeue(queue, ch))) {
+        mm_qcamera_mbench_dispatch(queue, super_buf, &res);
+    }
+    mm_channel_superbuf_flush(ch, queue, CAM_STREAM_TYPE_DEFAULT);
+
+    if (res.bad_superbuf || res.out_of_order || g_pool.double_release ||
+            g_pool.reuse_held) {
+        errs++;
+    }
+    for (s = 0; s < cfg->num_streams; s++) {
+        for (i = 0; i < MM_QCAMERA_MBENCH_POOL_SIZE; i++) {
+            if (g_pool.held[s][i]) {
+                errs++;
+            }
+        }
+    }
+    if (g_pool.released != num_events) {
+        printf("  %llu of %u buffers given back\n",
+                (unsigned long long)g_pool.released, num_events);
+        errs++;
+    }
+
+    printf("%u streams, depth %u, lag %u, jitter %u, drop %u%%, lookback %u: "
+           "%.1f ns/buf, dispatched %llu of %u frames, unindexed %u, "
+           "bad %llu, reordered %llu, double release %llu: %s\n",
+           cfg->num_streams, cfg->depth, cfg->lag, cfg->jitter, cfg->drop_pct,
+           cfg->lookback, (double)elapsed / num_events,
+           (unsigned long long)res.dispatched, frames, queue->unindexed_cnt,
+           (unsigned long long)res.bad_superbuf,
+           (unsigned long long)res.out_of_order,
+           (unsigned long long)g_pool.double_release, errs ? "FAIL" : "PASS");
+
+    mm_channel_superbuf_queue_deinit(queue);
+    free(events);
+    free(ch);
+    return errs;
+}
+
+static void mm_qcamera_mbench_usage(const char *name)
+{
+    printf("usage: %s [-n frames] [-s streams] [-d depth] [-l lag] [-j jitter]"
+           " [-p drop] [-z lookback]\n"
+           "  -n  frames per stream, default 200000\n"
+           "  -s  bundled streams, 2..%d\n"
+           "  -d  max unmatched frames\n"
+           "  -l  frames each stream lags the previous one\n"
+           "  -j  max random extra delay in frames\n"
+           "  -p  frames dropped per stream in percent, default 2\n"
+           "  -z  matched superbufs held as in ZSL, default 0\n"
+           "Without -s a preset of 3 streams 24 deep, 4 streams 68 deep and\n"
+           "4 streams 128 deep is run, once dispatching and once with lookback\n",
+           name, MAX_STREAM_NUM_IN_BUNDLE);
+}
+
+int main(int argc, char **argv)
+{
+    static const mm_qcamera_mbench_cfg_t presets[] = {
+        { 3, 24, 2, 4, 2, 0 },
+        { 4, 68, 6, 8, 2, 0 },
+        { 4, 128, 12, 16, 2, 0 },
+        { 3, 24, 2, 4, 2, 8 },
+        { 4, 68, 6, 8, 2, 8 },
+        { 4, 128, 12, 16, 2, 8 },
+    };
+    mm_qcamera_mbench_cfg_t cfg = { 0, 24, 2, 4, 2, 0 };
+    uint32_t frames = 200000;
+    int failed = 0, opt;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "n:s:d:l:j:p:z:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = (uint32_t)atol(optarg);
+            break;
+        case 's':
+            cfg.num_streams = (uint32_t)atoi(optarg);
+            break;
+        case 'd':
+            cfg.depth = (uint32_t)atoi(optarg);
+            break;
+        case 'l':
+            cfg.lag = (uint32_t)atoi(optarg);
+            break;
+        case 'j':
+            cfg.jitter = (uint32_t)atoi(optarg);
+            break;
+        case 'p':
+            cfg.drop_pct = (uint32_t)atoi(optarg);
+            break;
+        case 'z':
+            cfg.lookback = (uint32_t)atoi(optarg);
+            break;
+        default:
+            mm_qcamera_mbench_usage(argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    if ((0 == frames) || (cfg.drop_pct >= 100) ||
+            ((0 != cfg.num_streams) && ((cfg.num_streams < 2) ||
+            (cfg.num_streams > MAX_STREAM_NUM_IN_BUNDLE))) ||
+            /* a buffer is held for at most this many frames */
+            (cfg.depth + cfg.lookback + (cfg.num_streams * cfg.lag) +
+             cfg.jitter >= MM_QCAMERA_MBENCH_POOL_SIZE)) {
+        mm_qcamera_mbench_usage(argv[0]);
+        return 1;
+    }
+
+    if (0 != cfg.num_streams) {
+        failed = mm_qcamera_mbench_run(&cfg, frames);
+    } else {
+        for (i = 0; i < sizeof(presets) / sizeof(presets[0]); i++) {
+            failed += mm_qcamera_mbench_run(&presets[i], frames);
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+/* Copyright (c) 2012-2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Microbenchmark of QCameraQueue in list mode against ring mode, shaped
+ * like a stream data queue: a producer thread paced at the frame rate
+ * enqueues a burst of entries per frame and wakes a consumer thread that
+ * drains the queue. The time spent in enqueue and dequeue is sampled per
+ * call and reported as median, 99th percentile and max.
+ *
+ * Frame rate 0 runs unpaced and also reports throughput. Allocator noise
+ * threads keep malloc/free busy on other cores, which is where list mode
+ * pays for its per-node allocation. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <cam_semaphore.h>
+
+#include "QCameraQueue.h"
+
+using namespace qcamera;
+
+#define MM_QCAMERA_QBENCH_MAX_NOISE 8
+
+typedef struct {
+    QCameraQueue *queue;
+    cam_semaphore_t sem;
+    uint32_t fps;
+    uint32_t frames;
+    uint32_t burst;
+    /* per call samples in nsec */
+    int64_t *enq_ns;
+    int64_t *deq_ns;
+    uint32_t num_enq;
+    uint32_t num_deq;
+    volatile bool done;
+} mm_qcamera_qbench_t;
+
+typedef struct {
+    volatile bool *stop;
+    uint32_t seed;
+} mm_qcamera_qbench_noise_t;
+
+static inline int64_t mm_qcamera_qbench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *mm_qcamera_qbench_producer(void *data)
+{
+    mm_qcamera_qbench_t *b = (mm_qcamera_qbench_t *)data;
+    int64_t period = (b->fps > 0) ? (1000000000LL / b->fps) : 0;
+    int64_t next = mm_qcamera_qbench_now();
+    struct timespec ts;
+    int64_t t0;
+    uint32_t f, i;
+
+    for (f = 0; f < b->frames; f++) {
+        if (period > 0) {
+            next += period;
+            ts.tv_sec = (time_t)(next / 1000000000LL);
+            ts.tv_nsec = (long)(next % 1000000000LL);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+        for (i = 0; i < b->burst; i++) {
+            t0 = mm_qcamera_qbench_now();
+            b->queue->enqueue((void *)(uintptr_t)(f * b->burst + i + 1));
+            b->enq_ns[b->num_enq++] = mm_qcamera_qbench_now() - t0;
+        }
+        cam_sem_post(&b->sem);
+    }
+    b->done = true;
+    cam_sem_post(&b->sem);
+    return NULL;
+}
+
+static void *mm_qcamera_qbench_consumer(void *data)
+{
+    mm_qcamera_qbench_t *b = (mm_qcamera_qbench_t *)data;
+    uint32_t total = b->frames * b->burst;
+    int64_t t0, t1;
+    void *entry;
+
+    while (b->num_deq < total) {
+        cam_sem_wait(&b->sem);
+        for (;;) {
+            t0 = mm_qcamera_qbench_now();
+            entry = b->queue->dequeue();
+            t1 = mm_qcamera_qbench_now();
+            if (NULL == entry) {
+                break;
+            }
+            b->deq_ns[b->num_deq++] = t1 - t0;
+        }
+        if (b->done && b->queue->isEmpty()) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* keep the allocator busy with mixed size churn */
+static void *mm_qcamera_qbench_noise(void *data)
+{
+    mm_qcamera_qbench_noise_t *n = (mm_qcamera_qbench_noise_t *)data;
+    void *slots[64];
+    uint32_t i;
+
+    memset(slots, 0, sizeof(slots));
+    while (!*n->stop) {
+        n->seed = n->seed * 1103515245 + 12345;
+        i = (n->seed >> 16) & 63;
+        free(slots[i]);
+        slots[i] = malloc(16 + ((n->seed >> 8) & 255));
+    }
+    for (i = 0; i < 64; i++) {
+        free(slots[i]);
+    }
+    return NULL;
+}
+
+static int mm_qcamera_qbench_cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static void mm_qcamera_qbench_report(const char *name, int64_t *ns,
+        uint32_t num)
+{
+    if (0 == num) {
+        printf("  %s: no samples\n", name);
+        return;
+    }
+    qsort(ns, num, sizeof(int64_t), mm_qcamera_qbench_cmp);
+    printf("  %s: p50 %lld ns, p99 %lld ns, max %lld ns\n", name,
+           (long long)ns[num / 2],
+           (long long)ns[(uint32_t)((uint64_t)num * 99 / 100)],
+           (long long)ns[num - 1]);
+}
+
+static int mm_qcamera_qbench_run(bool ring, uint32_t ringSize, uint32_t fps,
+        uint32_t frames, uint32_t burst)
+{
+    mm_qcamera_qbench_t b;
+    pthread_t prod, cons;
+    int64_t start, elapsed;
+    uint32_t total = frames * burst;
+
+    memset(&b, 0, sizeof(b));
+    b.queue = ring ? new QCameraQueue(NULL, NULL, ringSize) :
+            new QCameraQueue();
+    b.fps = fps;
+    b.frames = frames;
+    b.burst = burst;
+    b.enq_ns = (int64_t *)malloc(sizeof(int64_t) * total);
+    b.deq_ns = (int64_t *)malloc(sizeof(int64_t) * total);
+    if ((NULL == b.queue) || (NULL == b.enq_ns) || (NULL == b.deq_ns)) {
+        printf("no memory\n");
+        delete b.queue;
+        free(b.enq_ns);
+        free(b.deq_ns);
+        return -1;
+    }
+    cam_sem_init(&b.sem, 0);
+
+    start = mm_qcamera_qbench_now();
+    pthread_create(&cons, NULL, mm_qcamera_qbench_consumer, &b);
+    pthread_create(&prod, NULL, mm_qcamera_qbench_producer, &b);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    elapsed = mm_qcamera_qbench_now() - start;
+
+    if (fps > 0) {
+        printf("%s mode, %u fps, %u frames x %u entries:\n",
+               ring ? "ring" : "list", fps, frames, burst);
+    } else {
+        printf("%s mode, unpaced, %u frames x %u entries: %.0f entries/s\n",
+               ring ? "ring" : "list", frames, burst,
+               (double)b.num_deq * 1e9 / (double)elapsed);
+    }
+    mm_qcamera_qbench_report("enqueue", b.enq_ns, b.num_enq);
+    mm_qcamera_qbench_report("dequeue", b.deq_ns, b.num_deq);
+    if (b.num_deq != total) {
+        printf("  lost entries: %u of %u dequeued\n", b.num_deq, total);
+    }
+
+    cam_sem_destroy(&b.sem);
+    delete b.queue;
+    free(b.enq_ns);
+    free(b.deq_ns);
+    return (b.num_deq == total) ? 0 : -1;
+}
+
+static void mm_qcamera_qbench_usage(const char *name)
+{
+    printf("usage: %s [-f fps] [-n frames] [-b entries] [-r slots] [-a threads]\n"
+           "  -f  frame rate, 0 runs unpaced. Default runs 30, 60 and 240\n"
+           "  -n  frames per run, default 300\n"
+           "  -b  entries enqueued per frame, default 4\n"
+           "  -r  ring mode slot count, default %d\n"
+           "  -a  allocator noise threads, 0..%d, default 0\n",
+           name, QCAMERA_QUEUE_RING_SIZE, MM_QCAMERA_QBENCH_MAX_NOISE);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t default_fps[] = { 30, 60, 240 };
+    mm_qcamera_qbench_noise_t noise[MM_QCAMERA_QBENCH_MAX_NOISE];
+    pthread_t noise_tids[MM_QCAMERA_QBENCH_MAX_NOISE];
+    volatile bool stop = false;
+    uint32_t frames = 300, burst = 4, ringSize = QCAMERA_QUEUE_RING_SIZE;
+    uint32_t num_noise = 0, i;
+    int fps = -1, failed = 0, opt;
+
+    while ((opt = getopt(argc, argv, "f:n:b:r:a:h")) != -1) {
+        switch (opt) {
+        case 'f':
+            fps = atoi(optarg);
+            break;
+        case 'n':
+            frames = (uint32_t)atoi(optarg);
+            break;
+        case 'b':
+            burst = (uint32_t)atoi(optarg);
+            break;
+        case 'r':
+            ringSize = (uint32_t)atoi(optarg);
+            break;
+        case 'a':
+            num_noise = (uint32_t)atoi(optarg);
+            break;
+        default:
+            mm_qcamera_qbench_usage(argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    if ((fps < -1) || (0 == frames) || (0 == burst) || (0 == ringSize) ||
+            (num_noise > MM_QCAMERA_QBENCH_MAX_NOISE)) {
+        mm_qcamera_qbench_usage(argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < num_noise; i++) {
+        noise[i].stop = &stop;
+        noise[i].seed = i + 1;
+        pthread_create(&noise_tids[i], NULL, mm_qcamera_qbench_noise,
+                &noise[i]);
+    }
+
+    if (fps >= 0) {
+        failed |= mm_qcamera_qbench_run(false, ringSize, (uint32_t)fps,
+                frames, burst);
+        failed |= mm_qcamera_qbench_run(true, ringSize, (uint32_t)fps,
+                frames, burst);
+    } else {
+        for (i = 0; i < sizeof(default_fps) / sizeof(default_fps[0]); i++) {
+            failed |= mm_qcamera_qbench_run(false, ringSize, default_fps[i],
+                    frames, burst);
+            failed |= mm_qcamera_qbench_run(true, ringSize, default_fps[i],
+                    frames, burst);
+        }
+    }
+
+    stop = true;
+    for (i = 0; i < num_noise; i++) {
+        pthread_join(noise_tids[i], NULL);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,783 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define LOG_TAG "QCameraBufferAllocator"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <cutils/properties.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include "QCameraBufferAllocator.h"
+#include "QCameraMemBudget.h"
+#include "cam_types.h"
+
+using namespace android;
+
+namespace qcamera {
+
+#define QCAMERA_PAGE_SIZE       4096U
+#define QCAMERA_HUGEPAGE_SIZE   (2U * 1024U * 1024U)
+#define QCAMERA_SECURE_ALIGN    1048576U
+#define QCAMERA_ALIGN(x, a)     (((x) + ((a) - 1)) & ~((size_t)(a) - 1))
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC             0x0001U
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB             0x0004U
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE           14
+#endif
+
+/* dma-heap and dma-buf uapi, not in every kernel header set we build with */
+struct qcamera_dma_heap_alloc_data {
+    uint64_t len;
+    uint32_t fd;
+    uint32_t fd_flags;
+    uint64_t heap_flags;
+};
+#define QCAMERA_DMA_HEAP_IOCTL_ALLOC \
+        _IOWR('H', 0x0, struct qcamera_dma_heap_alloc_data)
+
+struct qcamera_dma_buf_sync {
+    uint64_t flags;
+};
+#define QCAMERA_DMA_BUF_SYNC_READ   (1 << 0)
+#define QCAMERA_DMA_BUF_SYNC_WRITE  (2 << 0)
+#define QCAMERA_DMA_BUF_SYNC_RW     (QCAMERA_DMA_BUF_SYNC_READ | \
+        QCAMERA_DMA_BUF_SYNC_WRITE)
+#define QCAMERA_DMA_BUF_SYNC_START  (0 << 2)
+#define QCAMERA_DMA_BUF_SYNC_END    (1 << 2)
+#define QCAMERA_DMA_BUF_IOCTL_SYNC  _IOW('b', 0, struct qcamera_dma_buf_sync)
+
+/*===========================================================================
+ * FUNCTION   : getInstance
+ *
+ * DESCRIPTION: get the HAL wide allocator, the backend is chosen on first use
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : allocator
+ *==========================================================================*/
+QCameraBufferAllocator& QCameraBufferAllocator::getInstance()
+{
+    static QCameraBufferAllocator *instance = create();
+    return *instance;
+}
+
+/*===========================================================================
+ * FUNCTION   : create
+ *
+ * DESCRIPTION: pick the backend from persist.camera.mem.backend. "auto"
+ *              takes ion, then dma-heap, then memfd, whichever the kernel
+ *              offers first.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : allocator of the chosen backend
+ *==========================================================================*/
+QCameraBufferAllocator *QCameraBufferAllocator::create()
+{
+    char backend[PROPERTY_VALUE_MAX];
+    char prop[PROPERTY_VALUE_MAX];
+    char heapPath[PATH_MAX];
+    QCameraBufferAllocator *allocator = NULL;
+    bool hugePages;
+    int heapFd = -1;
+
+    property_get("persist.camera.mem.backend", backend, "auto");
+    property_get("persist.camera.mem.hugepage", prop, "0");
+    hugePages = (atoi(prop) > 0);
+    property_get("persist.camera.mem.dmaheap", prop, "system");
+    snprintf(heapPath, sizeof(heapPath), "/dev/dma_heap/%s", prop);
+
+    if (!strcmp(backend, "ion") ||
+            (!strcmp(backend, "auto") && (0 == access("/dev/ion", R_OK)))) {
+        allocator = new QCameraIonAllocator(hugePages);
+    } else if (strcmp(backend, "memfd")) {
+        heapFd = open(heapPath, O_RDONLY | O_CLOEXEC);
+        if (heapFd >= 0) {
+            allocator = new QCameraDmaHeapAllocator(heapFd, hugePages);
+        } else if (!strcmp(backend, "dmaheap")) {
+            ALOGE("%s: Cannot open %s: %s, falling back to memfd", __func__,
+                    heapPath, strerror(errno));
+        }
+    }
+    if (NULL == allocator) {
+        allocator = new QCameraMemfdAllocator(hugePages);
+    }
+
+    ALOGI("%s: Camera buffers from %s%s", __func__, allocator->getName(),
+            hugePages ? ", huge pages" : "");
+    return allocator;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraBufferAllocator
+ *
+ * DESCRIPTION: constructor of QCameraBufferAllocator
+ *
+ * PARAMETERS :
+ *   @backend   : backend type
+ *   @hugePages : whether large buffers should use huge pages
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraBufferAllocator::QCameraBufferAllocator(qcamera_alloc_backend_t backend,
+        bool hugePages) :
+    mBackend(backend),
+    mHugePages(hugePages)
+{
+    memset(&mCacheStats, 0, sizeof(mCacheStats));
+}
+
+/*===========================================================================
+ * FUNCTION   : initBuf
+ *
+ * DESCRIPTION: mark a buffer as not allocated
+ *
+ * PARAMETERS :
+ *   @buf     : buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::initBuf(qcamera_alloc_buf_t &buf)
+{
+    buf.fd = -1;
+    buf.main_ion_fd = -1;
+    buf.handle = 0;
+    buf.size = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocate
+ *
+ * DESCRIPTION: allocate one buffer from the backend and charge it to the
+ *              camera memory budget. The budget gets a chance to reclaim
+ *              idle buffers first, and once more if the backend runs out.
+ *
+ * PARAMETERS :
+ *   @size        : length of the buffer
+ *   @heap_id     : ion heap mask, ignored by the other backends
+ *   @cached      : whether the buffer should be cached
+ *   @secure_mode : SECURE for content protected buffers
+ *   @buf         : [output] allocated buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraBufferAllocator::allocate(size_t size, unsigned int heap_id,
+        bool cached, uint32_t secure_mode, qcamera_alloc_buf_t &buf)
+{
+    QCameraMemBudget &budget = QCameraMemBudget::getInstance();
+
+    budget.admit(size);
+    int32_t rc = allocateBuf(size, heap_id, cached, secure_mode, buf);
+    if ((rc != OK) && (budget.reclaim(size) > 0)) {
+        rc = allocateBuf(size, heap_id, cached, secure_mode, buf);
+    }
+    if (rc == OK) {
+        budget.charge(QCAMERA_MEM_CLASS_BUF, buf.size);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : release
+ *
+ * DESCRIPTION: free a buffer returned by allocate. Works on buffers of any
+ *              backend.
+ *
+ * PARAMETERS :
+ *   @buf     : buffer, reset on return
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::release(qcamera_alloc_buf_t &buf)
+{
+    struct ion_handle_data handle_data;
+
+    if (buf.fd >= 0) {
+        close(buf.fd);
+        QCameraMemBudget::getInstance().uncharge(QCAMERA_MEM_CLASS_BUF,
+                buf.size);
+    }
+    if (buf.main_ion_fd >= 0) {
+        memset(&handle_data, 0, sizeof(handle_data));
+        handle_data.handle = buf.handle;
+        ioctl(buf.main_ion_fd, ION_IOC_FREE, &handle_data);
+        close(buf.main_ion_fd);
+    }
+    initBuf(buf);
+}
+
+/*===========================================================================
+ * FUNCTION   : cacheOps
+ *
+ * DESCRIPTION: cache maintenance on a buffer or a byte range of it. Buffers
+ *              with an ion client go through ion whatever the backend is,
+ *              gralloc buffers are always ion. dma-buf sync has no range,
+ *              other backends always work on the whole buffer.
+ *
+ * PARAMETERS :
+ *   @buf     : buffer
+ *   @vaddr   : HAL mapping of the buffer
+ *   @cmd     : ION_IOC_CLEAN_CACHES, ION_IOC_INV_CACHES or
+ *              ION_IOC_CLEAN_INV_CACHES
+ *   @offset  : start of the range
+ *   @len     : length of the range, 0 for the rest of the buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraBufferAllocator::cacheOps(const qcamera_alloc_buf_t &buf,
+        void *vaddr, unsigned int cmd, size_t offset, size_t len)
+{
+    struct ion_flush_data cache_inv_data;
+    struct ion_custom_data custom_data;
+    int ret;
+
+    if (offset >= buf.size) {
+        return NO_ERROR;
+    }
+    if ((len == 0) || (len > buf.size - offset)) {
+        len = buf.size - offset;
+    }
+
+    if (buf.main_ion_fd < 0) {
+        if (QCAMERA_ALLOC_BACKEND_MEMFD != mBackend) {
+            __atomic_add_fetch(&mCacheStats.calls, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&mCacheStats.bytes, (uint64_t)buf.size,
+                    __ATOMIC_RELAXED);
+        }
+        return syncCache(buf, cmd);
+    }
+
+    // msm ion walks [vaddr, vaddr + length) and checks offset + length
+    // against the buffer size
+    memset(&cache_inv_data, 0, sizeof(cache_inv_data));
+    memset(&custom_data, 0, sizeof(custom_data));
+    cache_inv_data.vaddr = (uint8_t *)vaddr + offset;
+    cache_inv_data.fd = buf.fd;
+    cache_inv_data.handle = buf.handle;
+    cache_inv_data.offset = (unsigned int)offset;
+    cache_inv_data.length =
+            ( /* FIXME: Should remove this after ION interface changes */ unsigned int)
+            len;
+    custom_data.cmd = cmd;
+    custom_data.arg = (unsigned long)&cache_inv_data;
+
+    ALOGV("%s: addr = %p, fd = %d, handle = %lx offset = %d length = %d, ION Fd = %d",
+         __func__, cache_inv_data.vaddr, cache_inv_data.fd,
+         (unsigned long)cache_inv_data.handle, cache_inv_data.offset,
+         cache_inv_data.length, buf.main_ion_fd);
+    ret = ioctl(buf.main_ion_fd, ION_IOC_CUSTOM, &custom_data);
+    if (ret < 0) {
+        ALOGE("%s: Cache Invalidate failed: %s\n", __func__, strerror(errno));
+    }
+    __atomic_add_fetch(&mCacheStats.calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mCacheStats.bytes, (uint64_t)len, __ATOMIC_RELAXED);
+    return ret;
+}
+
+/*===========================================================================
+ * FUNCTION   : noteCacheSkipped
+ *
+ * DESCRIPTION: account a cache maintenance call that was not needed
+ *
+ * PARAMETERS :
+ *   @bytes   : bytes the call would have covered
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::noteCacheSkipped(size_t bytes)
+{
+    __atomic_add_fetch(&mCacheStats.skipped, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mCacheStats.bytesSkipped, (uint64_t)bytes,
+            __ATOMIC_RELAXED);
+}
+
+/*===========================================================================
+ * FUNCTION   : noteCacheNarrowed
+ *
+ * DESCRIPTION: account a cache maintenance call shrunk to a smaller range
+ *
+ * PARAMETERS :
+ *   @bytes   : bytes cut from the call
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::noteCacheNarrowed(size_t bytes)
+{
+    __atomic_add_fetch(&mCacheStats.narrowed, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mCacheStats.bytesNarrowed, (uint64_t)bytes,
+            __ATOMIC_RELAXED);
+}
+
+/*===========================================================================
+ * FUNCTION   : noteCacheDeferred
+ *
+ * DESCRIPTION: account a dequeue invalidate left to the buffer consumer
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::noteCacheDeferred()
+{
+    __atomic_add_fetch(&mCacheStats.deferred, 1, __ATOMIC_RELAXED);
+}
+
+/*===========================================================================
+ * FUNCTION   : noteCacheMerged
+ *
+ * DESCRIPTION: account a cache maintenance call folded into another one
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::noteCacheMerged()
+{
+    __atomic_add_fetch(&mCacheStats.merged, 1, __ATOMIC_RELAXED);
+}
+
+/*===========================================================================
+ * FUNCTION   : getCacheStats
+ *
+ * DESCRIPTION: snapshot of the cache maintenance counters
+ *
+ * PARAMETERS :
+ *   @stats   : [output] counters
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::getCacheStats(qcamera_cache_stats_t &stats)
+{
+    stats.calls = __atomic_load_n(&mCacheStats.calls, __ATOMIC_RELAXED);
+    stats.bytes = __atomic_load_n(&mCacheStats.bytes, __ATOMIC_RELAXED);
+    stats.skipped = __atomic_load_n(&mCacheStats.skipped, __ATOMIC_RELAXED);
+    stats.bytesSkipped =
+            __atomic_load_n(&mCacheStats.bytesSkipped, __ATOMIC_RELAXED);
+    stats.narrowed = __atomic_load_n(&mCacheStats.narrowed, __ATOMIC_RELAXED);
+    stats.bytesNarrowed =
+            __atomic_load_n(&mCacheStats.bytesNarrowed, __ATOMIC_RELAXED);
+    stats.deferred = __atomic_load_n(&mCacheStats.deferred, __ATOMIC_RELAXED);
+    stats.merged = __atomic_load_n(&mCacheStats.merged, __ATOMIC_RELAXED);
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpCacheStats
+ *
+ * DESCRIPTION: print the cache maintenance counters into a dumpsys fd
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::dumpCacheStats(int fd)
+{
+    qcamera_cache_stats_t stats;
+    getCacheStats(stats);
+
+    dprintf(fd, "\n Cache maintenance (%s):\n", getName());
+    dprintf(fd, "  calls %u (%llu bytes)\n", stats.calls,
+            (unsigned long long)stats.bytes);
+    dprintf(fd, "  saved: skipped %u (%llu bytes), narrowed %u (%llu bytes), "
+            "deferred %u, merged %u\n", stats.skipped,
+            (unsigned long long)stats.bytesSkipped, stats.narrowed,
+            (unsigned long long)stats.bytesNarrowed, stats.deferred,
+            stats.merged);
+}
+
+/*===========================================================================
+ * FUNCTION   : adviseMapping
+ *
+ * DESCRIPTION: ask for transparent huge pages on a fresh HAL mapping of a
+ *              large memfd buffer. Other backends map driver pages, where
+ *              the advice has no effect.
+ *
+ * PARAMETERS :
+ *   @vaddr   : mapping
+ *   @size    : mapping length
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufferAllocator::adviseMapping(void *vaddr, size_t size)
+{
+    if (mHugePages && (QCAMERA_ALLOC_BACKEND_MEMFD == mBackend) &&
+            (size >= QCAMERA_HUGEPAGE_SIZE)) {
+        madvise(vaddr, size, MADV_HUGEPAGE);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraIonAllocator
+ *
+ * DESCRIPTION: constructor of QCameraIonAllocator
+ *
+ * PARAMETERS :
+ *   @hugePages : unused, ion heaps pick their own page sizes
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraIonAllocator::QCameraIonAllocator(bool hugePages) :
+    QCameraBufferAllocator(QCAMERA_ALLOC_BACKEND_ION, hugePages)
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : allocateBuf
+ *
+ * DESCRIPTION: allocate one ion buffer and share it as a fd
+ *
+ * PARAMETERS :
+ *   @size        : length of the buffer, rounded up to pages
+ *   @heap_id     : ion heap mask
+ *   @cached      : whether the buffer should be cached
+ *   @secure_mode : SECURE to allocate from the content protection heap
+ *   @buf         : [output] allocated buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraIonAllocator::allocateBuf(size_t size, unsigned int heap_id,
+        bool cached, uint32_t secure_mode, qcamera_alloc_buf_t &buf)
+{
+    int rc = OK;
+    struct ion_handle_data handle_data;
+    struct ion_allocation_data alloc;
+    struct ion_fd_data ion_info_fd;
+    int main_ion_fd = -1;
+
+    main_ion_fd = open("/dev/ion", O_RDONLY);
+    if (main_ion_fd < 0) {
+        ALOGE("Ion dev open failed: %s\n", strerror(errno));
+        goto ION_OPEN_FAILED;
+    }
+
+    memset(&alloc, 0, sizeof(alloc));
+    /* to make it page size aligned */
+    alloc.len = QCAMERA_ALIGN(size, QCAMERA_PAGE_SIZE);
+    alloc.align = QCAMERA_PAGE_SIZE;
+    if (cached) {
+        alloc.flags = ION_FLAG_CACHED;
+    }
+    alloc.heap_id_mask = heap_id;
+    if (secure_mode == SECURE) {
+        ALOGD("%s: Allocate secure buffer\n", __func__);
+        alloc.flags = ION_SECURE;
+        alloc.heap_id_mask = ION_HEAP(ION_CP_MM_HEAP_ID);
+        alloc.align = QCAMERA_SECURE_ALIGN; // to be able to protect later
+        alloc.len = QCAMERA_ALIGN(alloc.len, QCAMERA_SECURE_ALIGN);
+    }
+
+    rc = ioctl(main_ion_fd, ION_IOC_ALLOC, &alloc);
+    if (rc < 0) {
+        ALOGE("ION allocation for len %zu failed: %s\n", (size_t)alloc.len,
+                strerror(errno));
+        goto ION_ALLOC_FAILED;
+    }
+
+    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
+    ion_info_fd.handle = alloc.handle;
+    rc = ioctl(main_ion_fd, ION_IOC_SHARE, &ion_info_fd);
+    if (rc < 0) {
+        ALOGE("ION map failed %s\n", strerror(errno));
+        goto ION_MAP_FAILED;
+    }
+
+    buf.main_ion_fd = main_ion_fd;
+    buf.fd = ion_info_fd.fd;
+    buf.handle = ion_info_fd.handle;
+    buf.size = alloc.len;
+
+    ALOGV("%s : ION buffer %lx with size %zu allocated",
+            __func__, (unsigned long)buf.handle, buf.size);
+    return OK;
+
+ION_MAP_FAILED:
+    memset(&handle_data, 0, sizeof(handle_data));
+    handle_data.handle = alloc.handle;
+    ioctl(main_ion_fd, ION_IOC_FREE, &handle_data);
+ION_ALLOC_FAILED:
+    close(main_ion_fd);
+ION_OPEN_FAILED:
+    return NO_MEMORY;
+}
+
+/*===========================================================================
+ * FUNCTION   : syncCache
+ *
+ * DESCRIPTION: every ion buffer has an ion client, so nothing gets here
+ *
+ * PARAMETERS :
+ *   @buf     : buffer
+ *   @cmd     : ion cache command
+ *
+ * RETURN     : NO_ERROR
+ *==========================================================================*/
+int32_t QCameraIonAllocator::syncCache(const qcamera_alloc_buf_t &/*buf*/,
+        unsigned int /*cmd*/)
+{
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraDmaHeapAllocator
+ *
+ * DESCRIPTION: constructor of QCameraDmaHeapAllocator
+ *
+ * PARAMETERS :
+ *   @heapFd    : open dma-heap node, owned by the allocator
+ *   @hugePages : unused, the system heap already uses high order pages
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDmaHeapAllocator::QCameraDmaHeapAllocator(int heapFd, bool hugePages) :
+    QCameraBufferAllocator(QCAMERA_ALLOC_BACKEND_DMA_HEAP, hugePages),
+    mHeapFd(heapFd)
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraDmaHeapAllocator
+ *
+ * DESCRIPTION: deconstructor of QCameraDmaHeapAllocator
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDmaHeapAllocator::~QCameraDmaHeapAllocator()
+{
+    if (mHeapFd >= 0) {
+        close(mHeapFd);
+        mHeapFd = -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : allocateBuf
+ *
+ * DESCRIPTION: allocate one dma-buf from the heap
+ *
+ * PARAMETERS :
+ *   @size        : length of the buffer, rounded up to pages
+ *   @heap_id     : unused, the heap is chosen by property
+ *   @cached      : unused, cached heaps are synced in syncCache
+ *   @secure_mode : secure buffers are not supported
+ *   @buf         : [output] allocated buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraDmaHeapAllocator::allocateBuf(size_t size,
+        unsigned int /*heap_id*/, bool /*cached*/, uint32_t secure_mode,
+        qcamera_alloc_buf_t &buf)
+{
+    struct qcamera_dma_heap_alloc_data alloc;
+
+    if (secure_mode == SECURE) {
+        ALOGE("%s: Secure buffers need ion", __func__);
+        return NO_MEMORY;
+    }
+
+    memset(&alloc, 0, sizeof(alloc));
+    alloc.len = QCAMERA_ALIGN(size, QCAMERA_PAGE_SIZE);
+    alloc.fd_flags = O_RDWR | O_CLOEXEC;
+    if (ioctl(mHeapFd, QCAMERA_DMA_HEAP_IOCTL_ALLOC, &alloc) < 0) {
+        ALOGE("%s: dma-heap allocation for len %zu failed: %s", __func__,
+                (size_t)alloc.len, strerror(errno));
+        return NO_MEMORY;
+    }
+
+    buf.fd = (int)alloc.fd;
+    buf.main_ion_fd = -1;
+    buf.handle = 0;
+    buf.size = (size_t)alloc.len;
+    return OK;
+}
+
+/*===========================================================================
+ * FUNCTION   : syncCache
+ *
+ * DESCRIPTION: map an ion cache command to dma-buf cpu access syncs. Clean
+ *              ends a cpu write, invalidate starts a cpu read.
+ *
+ * PARAMETERS :
+ *   @buf     : buffer
+ *   @cmd     : ion cache command
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraDmaHeapAllocator::syncCache(const qcamera_alloc_buf_t &buf,
+        unsigned int cmd)
+{
+    struct qcamera_dma_buf_sync sync;
+    int ret = 0;
+
+    memset(&sync, 0, sizeof(sync));
+    if (ION_IOC_CLEAN_CACHES == cmd) {
+        sync.flags = QCAMERA_DMA_BUF_SYNC_END | QCAMERA_DMA_BUF_SYNC_WRITE;
+        ret = ioctl(buf.fd, QCAMERA_DMA_BUF_IOCTL_SYNC, &sync);
+    } else if (ION_IOC_INV_CACHES == cmd) {
+        sync.flags = QCAMERA_DMA_BUF_SYNC_START | QCAMERA_DMA_BUF_SYNC_READ;
+        ret = ioctl(buf.fd, QCAMERA_DMA_BUF_IOCTL_SYNC, &sync);
+    } else {
+        sync.flags = QCAMERA_DMA_BUF_SYNC_END | QCAMERA_DMA_BUF_SYNC_RW;
+        ret = ioctl(buf.fd, QCAMERA_DMA_BUF_IOCTL_SYNC, &sync);
+        if (ret >= 0) {
+            sync.flags = QCAMERA_DMA_BUF_SYNC_START | QCAMERA_DMA_BUF_SYNC_RW;
+            ret = ioctl(buf.fd, QCAMERA_DMA_BUF_IOCTL_SYNC, &sync);
+        }
+    }
+    if (ret < 0) {
+        ALOGE("%s: dma-buf sync %u on fd %d failed: %s", __func__, cmd,
+                buf.fd, strerror(errno));
+    }
+    return ret;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraMemfdAllocator
+ *
+ * DESCRIPTION: constructor of QCameraMemfdAllocator
+ *
+ * PARAMETERS :
+ *   @hugePages : whether large buffers should use huge pages
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraMemfdAllocator::QCameraMemfdAllocator(bool hugePages) :
+    QCameraBufferAllocator(QCAMERA_ALLOC_BACKEND_MEMFD, hugePages)
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : allocateBuf
+ *
+ * DESCRIPTION: allocate one memfd buffer. With huge pages on, buffers of
+ *              2MB and more are first tried on hugetlbfs, rounded up to
+ *              whole huge pages.
+ *
+ * PARAMETERS :
+ *   @size        : length of the buffer, rounded up to pages
+ *   @heap_id     : unused
+ *   @cached      : unused, memfd buffers are always coherent
+ *   @secure_mode : secure buffers are not supported
+ *   @buf         : [output] allocated buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraMemfdAllocator::allocateBuf(size_t size, unsigned int /*heap_id*/,
+        bool /*cached*/, uint32_t secure_mode, qcamera_alloc_buf_t &buf)
+{
+    size_t len = QCAMERA_ALIGN(size, QCAMERA_PAGE_SIZE);
+    int fd = -1;
+
+    if (secure_mode == SECURE) {
+        ALOGE("%s: Secure buffers need ion", __func__);
+        return NO_MEMORY;
+    }
+
+    if (mHugePages && (len >= QCAMERA_HUGEPAGE_SIZE)) {
+        size_t hugeLen = QCAMERA_ALIGN(len, QCAMERA_HUGEPAGE_SIZE);
+        fd = (int)syscall(__NR_memfd_create, "qcamera",
+                MFD_CLOEXEC | MFD_HUGETLB);
+        if ((fd >= 0) && (ftruncate(fd, (off_t)hugeLen) < 0)) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd >= 0) {
+            len = hugeLen;
+        } else {
+            ALOGV("%s: No hugetlb pages for %zu bytes, using shmem", __func__,
+                    hugeLen);
+        }
+    }
+
+    if (fd < 0) {
+        fd = (int)syscall(__NR_memfd_create, "qcamera", MFD_CLOEXEC);
+        if ((fd >= 0) && (ftruncate(fd, (off_t)len) < 0)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        ALOGE("%s: memfd of %zu bytes failed: %s", __func__, len,
+                strerror(errno));
+        return NO_MEMORY;
+    }
+
+    buf.fd = fd;
+    buf.main_ion_fd = -1;
+    buf.handle = 0;
+    buf.size = len;
+    return OK;
+}
+
+/*===========================================================================
+ * FUNCTION   : syncCache
+ *
+ * DESCRIPTION: memfd buffers are plain cached memory shared by cpu users
+ *              only, there is nothing to maintain
+ *
+ * PARAMETERS :
+ *   @buf     : buffer
+ *   @cmd     : ion cache command
+ *
+ * RETURN     : NO_ERROR
+ *==========================================================================*/
+int32_t QCameraMemfdAllocator::syncCache(const qcamera_alloc_buf_t &/*buf*/,
+        unsigned int /*cmd*/)
+{
+    return NO_ERROR;
+}
+
+}; // namespace qcamera
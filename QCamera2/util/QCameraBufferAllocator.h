@@ -0,0 +1,159 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_BUFFER_ALLOCATOR_H__
+#define __QCAMERA_BUFFER_ALLOCATOR_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+extern "C" {
+#include <linux/msm_ion.h>
+}
+
+namespace qcamera {
+
+/* One allocated buffer. fd is what gets mapped by the HAL and shared with
+ * the server; main_ion_fd and handle are only valid for ion buffers and
+ * stay -1/0 for the other backends. */
+typedef struct {
+    int fd;
+    int main_ion_fd;
+    ion_user_handle_t handle;
+    size_t size;
+} qcamera_alloc_buf_t;
+
+/* cache maintenance counters, HAL wide */
+typedef struct {
+    uint32_t calls;           // cache maintenance calls sent to the kernel
+    uint64_t bytes;           // bytes covered by them
+    uint32_t skipped;         // calls dropped, the CPU never touched the buffer
+    uint64_t bytesSkipped;
+    uint32_t narrowed;        // calls shrunk to the CPU written range
+    uint64_t bytesNarrowed;   // bytes cut from them
+    uint32_t deferred;        // dequeue invalidates left to the consumer
+    uint32_t merged;          // calls folded into another call of a batch
+} qcamera_cache_stats_t;
+
+typedef enum {
+    QCAMERA_ALLOC_BACKEND_ION,
+    QCAMERA_ALLOC_BACKEND_DMA_HEAP,
+    QCAMERA_ALLOC_BACKEND_MEMFD,
+} qcamera_alloc_backend_t;
+
+/* HAL wide source of camera buffers. The backend is picked once per
+ * process from persist.camera.mem.backend (ion, dmaheap, memfd); by default
+ * the first of them the kernel offers is used. Cache ops take the ion cache
+ * commands (ION_IOC_CLEAN_CACHES...) whatever the backend is and can be
+ * limited to a byte range of the buffer. Every buffer is charged to
+ * QCameraMemBudget. */
+class QCameraBufferAllocator {
+public:
+    static QCameraBufferAllocator& getInstance();
+
+    int32_t allocate(size_t size, unsigned int heap_id, bool cached,
+            uint32_t secure_mode, qcamera_alloc_buf_t &buf);
+    void release(qcamera_alloc_buf_t &buf);
+    int32_t cacheOps(const qcamera_alloc_buf_t &buf, void *vaddr,
+            unsigned int cmd, size_t offset = 0, size_t len = 0);
+    void noteCacheSkipped(size_t bytes);
+    void noteCacheNarrowed(size_t bytes);
+    void noteCacheDeferred();
+    void noteCacheMerged();
+    void getCacheStats(qcamera_cache_stats_t &stats);
+    void dumpCacheStats(int fd);
+    void adviseMapping(void *vaddr, size_t size);
+    qcamera_alloc_backend_t getBackend() const {return mBackend;}
+    virtual const char *getName() const = 0;
+
+    static void initBuf(qcamera_alloc_buf_t &buf);
+
+protected:
+    QCameraBufferAllocator(qcamera_alloc_backend_t backend, bool hugePages);
+    virtual ~QCameraBufferAllocator() {}
+    virtual int32_t allocateBuf(size_t size, unsigned int heap_id,
+            bool cached, uint32_t secure_mode, qcamera_alloc_buf_t &buf) = 0;
+    /* cache ops on buffers without an ion client */
+    virtual int32_t syncCache(const qcamera_alloc_buf_t &buf,
+            unsigned int cmd) = 0;
+
+    qcamera_alloc_backend_t mBackend;
+    bool mHugePages;   // back large buffers by huge pages where possible
+    qcamera_cache_stats_t mCacheStats; // updated with atomics
+
+private:
+    static QCameraBufferAllocator *create();
+    QCameraBufferAllocator(const QCameraBufferAllocator&);
+    QCameraBufferAllocator& operator=(const QCameraBufferAllocator&);
+};
+
+/* /dev/ion, the only backend that can allocate secure buffers */
+class QCameraIonAllocator : public QCameraBufferAllocator {
+public:
+    QCameraIonAllocator(bool hugePages);
+    virtual const char *getName() const {return "ion";}
+protected:
+    virtual int32_t allocateBuf(size_t size, unsigned int heap_id,
+            bool cached, uint32_t secure_mode, qcamera_alloc_buf_t &buf);
+    virtual int32_t syncCache(const qcamera_alloc_buf_t &buf,
+            unsigned int cmd);
+};
+
+/* /dev/dma_heap/<persist.camera.mem.dmaheap>, system by default. Cached
+ * heaps are kept coherent with DMA_BUF_IOCTL_SYNC. */
+class QCameraDmaHeapAllocator : public QCameraBufferAllocator {
+public:
+    QCameraDmaHeapAllocator(int heapFd, bool hugePages);
+    virtual ~QCameraDmaHeapAllocator();
+    virtual const char *getName() const {return "dmaheap";}
+protected:
+    virtual int32_t allocateBuf(size_t size, unsigned int heap_id,
+            bool cached, uint32_t secure_mode, qcamera_alloc_buf_t &buf);
+    virtual int32_t syncCache(const qcamera_alloc_buf_t &buf,
+            unsigned int cmd);
+private:
+    int mHeapFd;
+};
+
+/* memfd_create. Only the CPU touches these buffers, so cache ops are
+ * no-ops. Large buffers try hugetlbfs first and fall back to shmem THP. */
+class QCameraMemfdAllocator : public QCameraBufferAllocator {
+public:
+    QCameraMemfdAllocator(bool hugePages);
+    virtual const char *getName() const {return "memfd";}
+protected:
+    virtual int32_t allocateBuf(size_t size, unsigned int heap_id,
+            bool cached, uint32_t secure_mode, qcamera_alloc_buf_t &buf);
+    virtual int32_t syncCache(const qcamera_alloc_buf_t &buf,
+            unsigned int cmd);
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_BUFFER_ALLOCATOR_H__ */
@@ -46,11 +46,17 @@ namespace qcamera {
  * RETURN     : None
  *==========================================================================*/
 QCameraCmdThread::QCameraCmdThread() :
-    cmd_queue()
+    cmd_queue(NULL, NULL, QCAMERA_QUEUE_RING_SIZE),
+    cmd_sem(0),
+    sync_sem(0),
+    mBatchLeft(0),
+    mBatchPostTime(0),
+    mWakeCnt(0),
+    mWakeCmdCnt(0),
+    mWakeLatencySum(0),
+    mWakeLatencyMax(0)
 {
     cmd_pid = 0;
-    cam_sem_init(&sync_sem, 0);
-    cam_sem_init(&cmd_sem, 0);
 }
 
 /*===========================================================================
@@ -64,8 +70,6 @@ QCameraCmdThread::QCameraCmdThread() :
  *==========================================================================*/
 QCameraCmdThread::~QCameraCmdThread()
 {
-    cam_sem_destroy(&sync_sem);
-    cam_sem_destroy(&cmd_sem);
 }
 
 /*===========================================================================
@@ -148,15 +152,84 @@ int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8
             node = NULL;
         }
     }
-    cam_sem_post(&cmd_sem);
+
+    /* only the first post after the cmd thread took the last stamp sets
+     * it, the cmd thread measures its wakeup latency against it. Posters
+     * race on it, so it is only touched atomically; a 64-bit plain store
+     * can tear on 32-bit targets */
+    nsecs_t unstamped = 0;
+    __atomic_compare_exchange_n(&mBatchPostTime, &unstamped, systemTime(),
+            false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    cmd_sem.post();
 
     /* if is a sync call, need to wait until it returns */
     if (sync_cmd) {
-        cam_sem_wait(&sync_sem);
+        sync_sem.wait();
     }
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : waitCmd
+ *
+ * DESCRIPTION: wait for a new cmd in the cmd queue. Called from the cmd
+ *              thread only. One wakeup takes all cmds posted so far, the
+ *              following calls return without blocking until the batch is
+ *              drained.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : 0 -- a cmd is available; -1 -- wait failed, errno is set
+ *==========================================================================*/
+int QCameraCmdThread::waitCmd()
+{
+    if (mBatchLeft > 0) {
+        mBatchLeft--;
+        return 0;
+    }
+
+    int32_t cnt = cmd_sem.waitAll();
+    if (cnt <= 0) {
+        return -1;
+    }
+
+    /* the semaphore post orders the stamp before the count we took */
+    nsecs_t postTime = __atomic_exchange_n(&mBatchPostTime, 0,
+            __ATOMIC_RELAXED);
+    nsecs_t latency = systemTime() - postTime;
+    mWakeCnt++;
+    mWakeCmdCnt += (uint32_t)cnt;
+    if ((postTime > 0) && (latency > 0)) {
+        mWakeLatencySum += latency;
+        if (latency > mWakeLatencyMax) {
+            mWakeLatencyMax = latency;
+        }
+    }
+
+    mBatchLeft = cnt - 1;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpWakeStats
+ *
+ * DESCRIPTION: log wakeup count, cmds per wakeup and post-to-run latency
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraCmdThread::dumpWakeStats()
+{
+    if (0 == mWakeCnt) {
+        return;
+    }
+    ALOGD("%s: thread %lu: %u wakeups, %u cmds, avg wake latency %lld us, "
+            "max %lld us", __func__, (unsigned long)cmd_pid, mWakeCnt,
+            mWakeCmdCnt, (long long)(mWakeLatencySum / mWakeCnt / 1000),
+            (long long)(mWakeLatencyMax / 1000));
+}
+
 /*===========================================================================
  * FUNCTION   : getCmd
  *
@@ -209,6 +282,7 @@ int32_t QCameraCmdThread::exit()
     if (pthread_join(cmd_pid, NULL) != 0) {
         ALOGD("%s: pthread dead already\n", __func__);
     }
+    dumpWakeStats();
     cmd_pid = 0;
     return rc;
 }
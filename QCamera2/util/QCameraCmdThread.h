@@ -32,9 +32,11 @@
 
 #include <pthread.h>
 #include <cam_semaphore.h>
+#include <utils/Timers.h>
 
 #include "cam_types.h"
 #include "QCameraQueue.h"
+#include "QCameraSemaphore.h"
 
 namespace qcamera {
 
@@ -61,12 +63,23 @@ public:
     int32_t setName(const char* name);
     int32_t exit();
     int32_t sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority);
+    int waitCmd();
     camera_cmd_type_t getCmd();
+    void dumpWakeStats();
 
     QCameraQueue cmd_queue;      /* cmd queue */
     pthread_t cmd_pid;           /* cmd thread ID */
-    cam_semaphore_t cmd_sem;               /* semaphore for cmd thread */
-    cam_semaphore_t sync_sem;              /* semaphore for synchronized call signal */
+    QCameraSemaphore cmd_sem;    /* semaphore for cmd thread */
+    QCameraSemaphore sync_sem;   /* semaphore for synchronized call signal */
+
+private:
+    int32_t mBatchLeft;          /* cmds left from the last wakeup, cmd thread only */
+    nsecs_t mBatchPostTime;      /* time the first cmd of a batch was posted,
+                                  * 0 once taken, atomic access only */
+    uint32_t mWakeCnt;           /* number of wakeups of the cmd thread */
+    uint32_t mWakeCmdCnt;        /* cmds drained by those wakeups */
+    nsecs_t mWakeLatencySum;     /* sum of post-to-run latencies */
+    nsecs_t mWakeLatencyMax;     /* worst post-to-run latency */
 };
 
 }; // namespace qcamera
@@ -0,0 +1,535 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include "QCameraExecutor.h"
+
+using namespace android;
+
+namespace qcamera {
+
+#define QCAMERA_TASK_RING_INIT_SIZE 16
+
+/*===========================================================================
+ * FUNCTION   : QCameraTaskRing
+ *
+ * DESCRIPTION: constructor of QCameraTaskRing
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraTaskRing::QCameraTaskRing() :
+    mRing(NULL),
+    mSize(0),
+    mHead(0),
+    mCount(0)
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraTaskRing
+ *
+ * DESCRIPTION: deconstructor of QCameraTaskRing
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraTaskRing::~QCameraTaskRing()
+{
+    if (NULL != mRing) {
+        free(mRing);
+        mRing = NULL;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : pushBack
+ *
+ * DESCRIPTION: append a task, growing the ring if it is full
+ *
+ * PARAMETERS :
+ *   @task    : task to be queued
+ *
+ * RETURN     : true -- success; false -- no memory
+ *==========================================================================*/
+bool QCameraTaskRing::pushBack(qcamera_task_t &task)
+{
+    if (mCount == mSize) {
+        uint32_t newSize = (0 == mSize) ? QCAMERA_TASK_RING_INIT_SIZE :
+                (mSize << 1);
+        qcamera_task_t *ring =
+                (qcamera_task_t *)malloc(newSize * sizeof(qcamera_task_t));
+        if (NULL == ring) {
+            ALOGE("%s: No memory for %u tasks", __func__, newSize);
+            return false;
+        }
+        for (uint32_t i = 0; i < mCount; i++) {
+            ring[i] = mRing[(mHead + i) & (mSize - 1)];
+        }
+        if (NULL != mRing) {
+            free(mRing);
+        }
+        mRing = ring;
+        mSize = newSize;
+        mHead = 0;
+    }
+
+    mRing[(mHead + mCount) & (mSize - 1)] = task;
+    mCount++;
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : popFront
+ *
+ * DESCRIPTION: take the oldest task
+ *
+ * PARAMETERS :
+ *   @task    : returned task
+ *
+ * RETURN     : true -- task returned; false -- ring is empty
+ *==========================================================================*/
+bool QCameraTaskRing::popFront(qcamera_task_t &task)
+{
+    if (0 == mCount) {
+        return false;
+    }
+    task = mRing[mHead];
+    mHead = (mHead + 1) & (mSize - 1);
+    mCount--;
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : popBack
+ *
+ * DESCRIPTION: take the newest task
+ *
+ * PARAMETERS :
+ *   @task    : returned task
+ *
+ * RETURN     : true -- task returned; false -- ring is empty
+ *==========================================================================*/
+bool QCameraTaskRing::popBack(qcamera_task_t &task)
+{
+    if (0 == mCount) {
+        return false;
+    }
+    mCount--;
+    task = mRing[(mHead + mCount) & (mSize - 1)];
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : getInstance
+ *
+ * DESCRIPTION: get the HAL wide executor for tasks that do not block,
+ *              workers are started on first use
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : reference to the executor
+ *==========================================================================*/
+QCameraExecutor& QCameraExecutor::getInstance()
+{
+    static QCameraExecutor instance("CAM_Exec", QCAMERA_EXEC_MIN_WORKERS,
+            QCAMERA_EXEC_MAX_WORKERS);
+    return instance;
+}
+
+/*===========================================================================
+ * FUNCTION   : getBlockingInstance
+ *
+ * DESCRIPTION: get the HAL wide executor for tasks that may block, workers
+ *              are started on first use
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : reference to the executor
+ *==========================================================================*/
+QCameraExecutor& QCameraExecutor::getBlockingInstance()
+{
+    static QCameraExecutor instance("CAM_Blk", QCAMERA_EXEC_BLOCKING_WORKERS,
+            QCAMERA_EXEC_BLOCKING_WORKERS);
+    return instance;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraExecutor
+ *
+ * DESCRIPTION: constructor of QCameraExecutor. Starts one worker per core,
+ *              within minWorkers..maxWorkers.
+ *
+ * PARAMETERS :
+ *   @name       : worker thread name prefix
+ *   @minWorkers : least number of workers
+ *   @maxWorkers : most number of workers, up to QCAMERA_EXEC_MAX_WORKERS
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraExecutor::QCameraExecutor(const char *name, uint32_t minWorkers,
+        uint32_t maxWorkers) :
+    mNumWorkers(0),
+    mNextWorker(0),
+    mPending(0),
+    mName(name),
+    mPushSeq(0),
+    mPushWaiters(0)
+{
+    long cores = sysconf(_SC_NPROCESSORS_CONF);
+    uint32_t num = (cores < (long)minWorkers) ? minWorkers : (uint32_t)cores;
+    if (maxWorkers > QCAMERA_EXEC_MAX_WORKERS) {
+        maxWorkers = QCAMERA_EXEC_MAX_WORKERS;
+    }
+    if (num > maxWorkers) {
+        num = maxWorkers;
+    }
+
+    pthread_mutex_init(&mPushLock, NULL);
+    pthread_cond_init(&mPushCond, NULL);
+    pthread_key_create(&mWorkerKey, NULL);
+    for (uint32_t i = 0; i < num; i++) {
+        worker_t *worker = &mWorkers[i];
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->idx = i;
+        worker->exec = this;
+    }
+    /* deques must exist before any worker can try to steal */
+    for (uint32_t i = 0; i < num; i++) {
+        if (pthread_create(&mWorkers[i].pid, NULL, workerRoutine,
+                &mWorkers[i]) != 0) {
+            ALOGE("%s: Failed to start worker %u", __func__, i);
+            break;
+        }
+        mNumWorkers++;
+    }
+    ALOGD("%s: %s %u workers", __func__, mName, mNumWorkers);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraExecutor
+ *
+ * DESCRIPTION: deconstructor of QCameraExecutor. The executor lives as long
+ *              as the HAL library, workers are left to process exit.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraExecutor::~QCameraExecutor()
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : submit
+ *
+ * DESCRIPTION: queue a task to run on any worker
+ *
+ * PARAMETERS :
+ *   @fn      : task function
+ *   @data    : argument passed to fn
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraExecutor::submit(qcamera_task_fn fn, void *data)
+{
+    qcamera_task_t task;
+    worker_t *worker = NULL;
+    bool rc;
+
+    if ((NULL == fn) || (0 == mNumWorkers)) {
+        return BAD_VALUE;
+    }
+
+    task.fn = fn;
+    task.data = data;
+
+    worker = (worker_t *)pthread_getspecific(mWorkerKey);
+    if (NULL == worker) {
+        uint32_t idx = __atomic_fetch_add(&mNextWorker, 1, __ATOMIC_RELAXED);
+        worker = &mWorkers[idx % mNumWorkers];
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    rc = worker->tasks.pushBack(task);
+    pthread_mutex_unlock(&worker->lock);
+    if (!rc) {
+        return NO_MEMORY;
+    }
+
+    __atomic_add_fetch(&mPushSeq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&mPushWaiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&mPushLock);
+        pthread_cond_broadcast(&mPushCond);
+        pthread_mutex_unlock(&mPushLock);
+    }
+    mPending.post();
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : getTask
+ *
+ * DESCRIPTION: take a task from the worker's own deque, or steal one from
+ *              the back of another worker's deque
+ *
+ * PARAMETERS :
+ *   @idx     : index of the calling worker
+ *   @task    : returned task
+ *
+ * RETURN     : true -- task returned; false -- all deques are empty
+ *==========================================================================*/
+bool QCameraExecutor::getTask(uint32_t idx, qcamera_task_t &task)
+{
+    bool found;
+    worker_t *own = &mWorkers[idx];
+
+    pthread_mutex_lock(&own->lock);
+    found = own->tasks.popFront(task);
+    pthread_mutex_unlock(&own->lock);
+
+    for (uint32_t i = 1; !found && (i < mNumWorkers); i++) {
+        worker_t *victim = &mWorkers[(idx + i) % mNumWorkers];
+        pthread_mutex_lock(&victim->lock);
+        found = victim->tasks.popBack(task);
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return found;
+}
+
+/*===========================================================================
+ * FUNCTION   : workerRoutine
+ *
+ * DESCRIPTION: worker thread main loop
+ *
+ * PARAMETERS :
+ *   @data    : ptr to the worker_t of this thread
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCameraExecutor::workerRoutine(void *data)
+{
+    worker_t *worker = (worker_t *)data;
+    QCameraExecutor *pme = worker->exec;
+    qcamera_task_t task;
+    uint32_t seq;
+    char name[16];
+
+    snprintf(name, sizeof(name), "%s%u", pme->mName, worker->idx);
+    prctl(PR_SET_NAME, (unsigned long)name, 0, 0, 0);
+    pthread_setspecific(pme->mWorkerKey, worker);
+
+    while (true) {
+        if (pme->mPending.wait() != 0) {
+            ALOGE("%s: wait error (%s)", __func__, strerror(errno));
+            continue;
+        }
+        /* every count taken stands for a queued task. A scan can miss it
+         * only if another worker took the task it was heading for while
+         * a new one went into a deque already scanned, so rescan once a
+         * submit happened since the scan started */
+        seq = __atomic_load_n(&pme->mPushSeq, __ATOMIC_SEQ_CST);
+        while (!pme->getTask(worker->idx, task)) {
+            pthread_mutex_lock(&pme->mPushLock);
+            __atomic_add_fetch(&pme->mPushWaiters, 1, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&pme->mPushSeq, __ATOMIC_SEQ_CST) == seq) {
+                pthread_cond_wait(&pme->mPushCond, &pme->mPushLock);
+            }
+            __atomic_sub_fetch(&pme->mPushWaiters, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&pme->mPushLock);
+            seq = __atomic_load_n(&pme->mPushSeq, __ATOMIC_SEQ_CST);
+        }
+        task.fn(task.data);
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraStrand
+ *
+ * DESCRIPTION: constructor of QCameraStrand
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraStrand::QCameraStrand() :
+    mScheduled(false),
+    mExec(&QCameraExecutor::getInstance())
+{
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mIdleCond, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraStrand
+ *
+ * DESCRIPTION: deconstructor of QCameraStrand, waits for pending tasks
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraStrand::~QCameraStrand()
+{
+    drain();
+    pthread_cond_destroy(&mIdleCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : setExecutor
+ *
+ * DESCRIPTION: run the strand's tasks on another executor, e.g. the
+ *              blocking pool for tasks that may sleep. Waits for tasks
+ *              already posted; nothing may be posted meanwhile.
+ *
+ * PARAMETERS :
+ *   @exec    : executor to run the tasks on
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStrand::setExecutor(QCameraExecutor &exec)
+{
+    drain();
+    pthread_mutex_lock(&mLock);
+    mExec = &exec;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : post
+ *
+ * DESCRIPTION: queue a task on the strand
+ *
+ * PARAMETERS :
+ *   @fn      : task function
+ *   @data    : argument passed to fn
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraStrand::post(qcamera_task_fn fn, void *data)
+{
+    int32_t rc = NO_ERROR;
+    bool schedule = false;
+    qcamera_task_t task;
+
+    task.fn = fn;
+    task.data = data;
+
+    pthread_mutex_lock(&mLock);
+    if (!mTasks.pushBack(task)) {
+        pthread_mutex_unlock(&mLock);
+        return NO_MEMORY;
+    }
+    if (!mScheduled) {
+        mScheduled = true;
+        schedule = true;
+    }
+    QCameraExecutor *exec = mExec;
+    pthread_mutex_unlock(&mLock);
+
+    if (schedule) {
+        rc = exec->submit(runTasks, this);
+        if (NO_ERROR != rc) {
+            ALOGE("%s: Failed to schedule strand, running inline", __func__);
+            runTasks(this);
+            rc = NO_ERROR;
+        }
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : drain
+ *
+ * DESCRIPTION: block until all tasks posted so far have completed
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStrand::drain()
+{
+    pthread_mutex_lock(&mLock);
+    while (mScheduled) {
+        pthread_cond_wait(&mIdleCond, &mLock);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : runTasks
+ *
+ * DESCRIPTION: executor job that runs up to QCAMERA_STRAND_BATCH tasks of
+ *              a strand, then requeues itself if more are pending so other
+ *              strands get a turn on the worker
+ *
+ * PARAMETERS :
+ *   @data    : ptr to the strand
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraStrand::runTasks(void *data)
+{
+    QCameraStrand *pme = (QCameraStrand *)data;
+    qcamera_task_t task;
+
+    for (uint32_t i = 0; i < QCAMERA_STRAND_BATCH; i++) {
+        pthread_mutex_lock(&pme->mLock);
+        if (!pme->mTasks.popFront(task)) {
+            pme->mScheduled = false;
+            pthread_cond_broadcast(&pme->mIdleCond);
+            pthread_mutex_unlock(&pme->mLock);
+            return;
+        }
+        pthread_mutex_unlock(&pme->mLock);
+
+        task.fn(task.data);
+    }
+
+    if (NO_ERROR != pme->mExec->submit(runTasks, pme)) {
+        /* keep the strand alive on this worker */
+        runTasks(pme);
+    }
+}
+
+}; // namespace qcamera
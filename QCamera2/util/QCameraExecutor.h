@@ -0,0 +1,139 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_EXECUTOR_H__
+#define __QCAMERA_EXECUTOR_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include "QCameraSemaphore.h"
+
+namespace qcamera {
+
+#define QCAMERA_EXEC_MAX_WORKERS 8
+#define QCAMERA_EXEC_MIN_WORKERS 2
+/* workers of the pool for tasks that block, see getBlockingInstance */
+#define QCAMERA_EXEC_BLOCKING_WORKERS 4
+/* max tasks a strand runs before yielding its worker to other strands */
+#define QCAMERA_STRAND_BATCH 8
+
+typedef void (*qcamera_task_fn)(void *data);
+
+typedef struct {
+    qcamera_task_fn fn;
+    void *data;
+} qcamera_task_t;
+
+/* Growable FIFO of tasks. Not thread safe, callers hold their own lock */
+class QCameraTaskRing {
+public:
+    QCameraTaskRing();
+    ~QCameraTaskRing();
+    bool pushBack(qcamera_task_t &task);
+    bool popFront(qcamera_task_t &task);
+    bool popBack(qcamera_task_t &task);
+    uint32_t getSize() {return mCount;}
+private:
+    qcamera_task_t *mRing;
+    uint32_t mSize;    // slot count, power of 2
+    uint32_t mHead;
+    uint32_t mCount;
+};
+
+/* HAL wide pool of worker threads. Every worker owns a task deque; tasks
+ * submitted from a worker go to its own deque, others are spread round
+ * robin. Idle workers steal from the back of the other deques.
+ * getInstance() runs stream data callbacks and must only get tasks that
+ * do not block. Tasks that may sleep for long, like ion allocations or
+ * native window calls, go to getBlockingInstance() so they never hold up
+ * frame delivery. */
+class QCameraExecutor {
+public:
+    static QCameraExecutor& getInstance();
+    static QCameraExecutor& getBlockingInstance();
+    int32_t submit(qcamera_task_fn fn, void *data);
+
+private:
+    QCameraExecutor(const char *name, uint32_t minWorkers,
+            uint32_t maxWorkers);
+    virtual ~QCameraExecutor();
+    QCameraExecutor(const QCameraExecutor&);
+    QCameraExecutor& operator=(const QCameraExecutor&);
+
+    static void *workerRoutine(void *data);
+    bool getTask(uint32_t idx, qcamera_task_t &task);
+
+    typedef struct {
+        pthread_mutex_t lock;
+        QCameraTaskRing tasks;
+        pthread_t pid;
+        uint32_t idx;
+        QCameraExecutor *exec;
+    } worker_t;
+
+    worker_t mWorkers[QCAMERA_EXEC_MAX_WORKERS];
+    uint32_t mNumWorkers;
+    uint32_t mNextWorker;       // round robin target for external submits
+    QCameraSemaphore mPending;  // one count per queued task
+    pthread_key_t mWorkerKey;   // worker_t of the calling thread, if any
+    const char *mName;          // worker thread name prefix
+    /* bumped on every submit. A worker holding a count that missed its
+     * task in a scan sleeps on mPushCond until the next submit */
+    uint32_t mPushSeq;
+    uint32_t mPushWaiters;
+    pthread_mutex_t mPushLock;
+    pthread_cond_t mPushCond;
+};
+
+/* Serial queue on top of QCameraExecutor. Tasks posted to one strand run
+ * one at a time in posting order, on whichever worker is free. */
+class QCameraStrand {
+public:
+    QCameraStrand();
+    ~QCameraStrand();
+    /* run the tasks on another pool. Only while nothing is posted */
+    void setExecutor(QCameraExecutor &exec);
+    int32_t post(qcamera_task_fn fn, void *data);
+    /* wait until every posted task has run. Must not be called from a
+     * task running on this strand */
+    void drain();
+
+private:
+    static void runTasks(void *data);
+
+    pthread_mutex_t mLock;
+    pthread_cond_t mIdleCond;
+    QCameraTaskRing mTasks;
+    bool mScheduled;            // a runTasks job is queued or running
+    QCameraExecutor *mExec;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_EXECUTOR_H__ */
@@ -0,0 +1,423 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define LOG_TAG "QCameraMemBudget"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/properties.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include "QCameraMemBudget.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : getInstance
+ *
+ * DESCRIPTION: get the HAL wide memory budget
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : memory budget
+ *==========================================================================*/
+QCameraMemBudget& QCameraMemBudget::getInstance()
+{
+    static QCameraMemBudget instance;
+    return instance;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraMemBudget
+ *
+ * DESCRIPTION: constructor, reads the limits
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraMemBudget::QCameraMemBudget() :
+    mTotal(0),
+    mPeak(0),
+    mReclaims(0),
+    mReclaimedBytes(0),
+    mDegrades(0),
+    mNumSessions(0)
+{
+    char prop[PROPERTY_VALUE_MAX];
+
+    property_get("persist.camera.mem.budget", prop, "0");
+    mLimit = (size_t)atoi(prop) << 20;
+    if (mLimit == 0) {
+        mLimit = readMemInfo("MemTotal:") / 3;
+        if (mLimit == 0) {
+            mLimit = (size_t)1024 << 20;
+        }
+    }
+    property_get("persist.camera.mem.budget.soft", prop, "85");
+    int pct = atoi(prop);
+    if ((pct <= 0) || (pct > 100)) {
+        pct = 85;
+    }
+    mSoftLimit = mLimit / 100 * (size_t)pct;
+    property_get("persist.camera.mem.minfree", prop, "256");
+    mMinFree = (size_t)atoi(prop) << 20;
+
+    memset(mUsed, 0, sizeof(mUsed));
+    memset(mSessions, 0, sizeof(mSessions));
+    pthread_mutex_init(&mLock, NULL);
+    pthread_mutex_init(&mReclaimLock, NULL);
+
+    ALOGI("%s: limit %zu soft %zu minfree %zu", __func__,
+            mLimit, mSoftLimit, mMinFree);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraMemBudget
+ *
+ * DESCRIPTION: destructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraMemBudget::~QCameraMemBudget()
+{
+    pthread_mutex_destroy(&mReclaimLock);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : readMemInfo
+ *
+ * DESCRIPTION: read one entry of /proc/meminfo
+ *
+ * PARAMETERS :
+ *   @key     : entry name including the colon, e.g. "MemAvailable:"
+ *
+ * RETURN     : value in bytes, 0 if not available
+ *==========================================================================*/
+size_t QCameraMemBudget::readMemInfo(const char *key)
+{
+    char line[128];
+    size_t keyLen = strlen(key);
+    size_t value = 0;
+
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (!strncmp(line, key, keyLen)) {
+            value = (size_t)strtoull(line + keyLen, NULL, 10) << 10;
+            break;
+        }
+    }
+    fclose(fp);
+
+    return value;
+}
+
+/*===========================================================================
+ * FUNCTION   : charge
+ *
+ * DESCRIPTION: account memory held by the HAL
+ *
+ * PARAMETERS :
+ *   @cls     : kind of memory
+ *   @bytes   : amount
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraMemBudget::charge(qcamera_mem_class_t cls, size_t bytes)
+{
+    pthread_mutex_lock(&mLock);
+    mUsed[cls] += bytes;
+    mTotal += bytes;
+    if (mTotal > mPeak) {
+        mPeak = mTotal;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : uncharge
+ *
+ * DESCRIPTION: account memory given back by the HAL
+ *
+ * PARAMETERS :
+ *   @cls     : kind of memory
+ *   @bytes   : amount
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraMemBudget::uncharge(qcamera_mem_class_t cls, size_t bytes)
+{
+    pthread_mutex_lock(&mLock);
+    if (bytes > mUsed[cls]) {
+        ALOGE("%s: class %d uncharging %zu but only %zu charged", __func__,
+                cls, bytes, mUsed[cls]);
+        bytes = mUsed[cls];
+    }
+    mUsed[cls] -= bytes;
+    mTotal -= bytes;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : admit
+ *
+ * DESCRIPTION: called before an allocation. If it would take the HAL over
+ *              the soft limit, idle memory of the sessions is reclaimed
+ *              first.
+ *
+ * PARAMETERS :
+ *   @bytes   : size of the coming allocation
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraMemBudget::admit(size_t bytes)
+{
+    size_t excess = 0;
+
+    pthread_mutex_lock(&mLock);
+    if (mTotal + bytes > mSoftLimit) {
+        excess = mTotal + bytes - mSoftLimit;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (excess > 0) {
+        reclaim(excess);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : reclaim
+ *
+ * DESCRIPTION: ask the sessions to free idle memory until at least bytes
+ *              are freed or every session was asked
+ *
+ * PARAMETERS :
+ *   @bytes   : amount wanted
+ *
+ * RETURN     : bytes freed
+ *==========================================================================*/
+size_t QCameraMemBudget::reclaim(size_t bytes)
+{
+    session_t sessions[QCAMERA_MEM_MAX_SESSIONS];
+    uint32_t numSessions;
+    size_t freed = 0;
+
+    pthread_mutex_lock(&mReclaimLock);
+
+    pthread_mutex_lock(&mLock);
+    numSessions = mNumSessions;
+    memcpy(sessions, mSessions, sizeof(sessions));
+    pthread_mutex_unlock(&mLock);
+
+    for (uint32_t i = 0; (i < numSessions) && (freed < bytes); i++) {
+        if (sessions[i].fn != NULL) {
+            freed += sessions[i].fn(sessions[i].data);
+        }
+    }
+
+    pthread_mutex_unlock(&mReclaimLock);
+
+    pthread_mutex_lock(&mLock);
+    mReclaims++;
+    mReclaimedBytes += freed;
+    pthread_mutex_unlock(&mLock);
+
+    ALOGI("%s: wanted %zu, freed %zu", __func__, bytes, freed);
+    return freed;
+}
+
+/*===========================================================================
+ * FUNCTION   : getPressure
+ *
+ * DESCRIPTION: current memory pressure, from the HAL usage against the
+ *              budget and from the memory left in the system
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : pressure level
+ *==========================================================================*/
+qcamera_mem_pressure_t QCameraMemBudget::getPressure()
+{
+    size_t avail = readMemInfo("MemAvailable:");
+
+    pthread_mutex_lock(&mLock);
+    size_t total = mTotal;
+    pthread_mutex_unlock(&mLock);
+
+    // no MemAvailable means an old kernel, judge by the budget only
+    if ((total >= mLimit / 10 * 9) || ((avail > 0) && (avail < mMinFree))) {
+        return QCAMERA_MEM_PRESSURE_CRITICAL;
+    }
+    if ((total >= mSoftLimit) || ((avail > 0) && (avail < 2 * mMinFree))) {
+        return QCAMERA_MEM_PRESSURE_MODERATE;
+    }
+    return QCAMERA_MEM_PRESSURE_NORMAL;
+}
+
+/*===========================================================================
+ * FUNCTION   : adjustBufferCount
+ *
+ * DESCRIPTION: admission control for a new buffer set. The set gets as many
+ *              buffers as fit in the calling session's share of the
+ *              remaining budget, never less than minCount. Under critical
+ *              pressure it gets minCount.
+ *
+ * PARAMETERS :
+ *   @bufSize  : size of one buffer
+ *   @count    : buffers wanted
+ *   @minCount : buffers the stream can not run without
+ *
+ * RETURN     : buffer count to use
+ *==========================================================================*/
+uint8_t QCameraMemBudget::adjustBufferCount(size_t bufSize, uint8_t count,
+        uint8_t minCount)
+{
+    if ((count <= minCount) || (bufSize == 0)) {
+        return count;
+    }
+
+    qcamera_mem_pressure_t pressure = getPressure();
+
+    pthread_mutex_lock(&mLock);
+    size_t headroom = (mLimit > mTotal) ? (mLimit - mTotal) : 0;
+    if (mNumSessions > 1) {
+        headroom /= mNumSessions;
+    }
+
+    size_t fit = headroom / bufSize;
+    uint8_t adjusted = count;
+    if (pressure == QCAMERA_MEM_PRESSURE_CRITICAL) {
+        adjusted = minCount;
+    } else if (fit < count) {
+        adjusted = (fit > minCount) ? (uint8_t)fit : minCount;
+    }
+    if (adjusted < count) {
+        mDegrades++;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (adjusted < count) {
+        ALOGI("%s: %d buffers of %zu bytes lowered to %d, pressure %d",
+                __func__, count, bufSize, adjusted, pressure);
+    }
+    return adjusted;
+}
+
+/*===========================================================================
+ * FUNCTION   : addSession
+ *
+ * DESCRIPTION: register an open camera session
+ *
+ * PARAMETERS :
+ *   @fn      : reclaim callback of the session, may be NULL
+ *   @data    : session, passed to fn
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraMemBudget::addSession(qcamera_mem_reclaim_fn fn, void *data)
+{
+    int32_t rc = NO_ERROR;
+
+    pthread_mutex_lock(&mLock);
+    if (mNumSessions < QCAMERA_MEM_MAX_SESSIONS) {
+        mSessions[mNumSessions].fn = fn;
+        mSessions[mNumSessions].data = data;
+        mNumSessions++;
+    } else {
+        ALOGE("%s: too many sessions", __func__);
+        rc = NO_MEMORY;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : removeSession
+ *
+ * DESCRIPTION: unregister a camera session. Waits for a reclaim that may
+ *              be using it.
+ *
+ * PARAMETERS :
+ *   @data    : session given to addSession
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraMemBudget::removeSession(void *data)
+{
+    pthread_mutex_lock(&mReclaimLock);
+    pthread_mutex_lock(&mLock);
+    for (uint32_t i = 0; i < mNumSessions; i++) {
+        if (mSessions[i].data == data) {
+            mSessions[i] = mSessions[mNumSessions - 1];
+            mNumSessions--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    pthread_mutex_unlock(&mReclaimLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print budget usage
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraMemBudget::dump(int fd)
+{
+    qcamera_mem_pressure_t pressure = getPressure();
+
+    pthread_mutex_lock(&mLock);
+    dprintf(fd, "\n Memory budget: used %zu (buffers %zu, jpeg work %zu) "
+            "peak %zu limit %zu soft %zu",
+            mTotal, mUsed[QCAMERA_MEM_CLASS_BUF],
+            mUsed[QCAMERA_MEM_CLASS_JPEG_WORK], mPeak, mLimit, mSoftLimit);
+    dprintf(fd, "\n   sessions %u pressure %d reclaims %u (%zu bytes) "
+            "degraded sets %u\n",
+            mNumSessions, pressure, mReclaims, mReclaimedBytes, mDegrades);
+    pthread_mutex_unlock(&mLock);
+}
+
+}; // namespace qcamera
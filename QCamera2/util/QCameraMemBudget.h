@@ -0,0 +1,108 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_MEM_BUDGET_H__
+#define __QCAMERA_MEM_BUDGET_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace qcamera {
+
+#define QCAMERA_MEM_MAX_SESSIONS 8
+
+typedef enum {
+    QCAMERA_MEM_CLASS_BUF,          // buffers of QCameraBufferAllocator
+    QCAMERA_MEM_CLASS_JPEG_WORK,    // jpeg encoder work buffers, estimated
+    QCAMERA_MEM_CLASS_MAX
+} qcamera_mem_class_t;
+
+typedef enum {
+    QCAMERA_MEM_PRESSURE_NORMAL,
+    QCAMERA_MEM_PRESSURE_MODERATE,  // optional extra buffers are dropped
+    QCAMERA_MEM_PRESSURE_CRITICAL,  // queues run at their minimum depth
+} qcamera_mem_pressure_t;
+
+/* frees idle memory (pools, caches) of one session, returns bytes freed.
+ * Runs on the thread of the allocation that needs the memory. */
+typedef size_t (*qcamera_mem_reclaim_fn)(void *data);
+
+/* HAL wide account of camera memory across streams, sessions and cameras.
+ * The limit comes from persist.camera.mem.budget (MB); by default it is a
+ * third of MemTotal. Going over the soft limit first reclaims idle buffers
+ * of the open sessions. Buffer counts are then degraded through the
+ * pressure level, which also follows MemAvailable so the HAL backs off
+ * before lowmemorykiller steps in. Nothing here fails an allocation. */
+class QCameraMemBudget {
+public:
+    static QCameraMemBudget& getInstance();
+
+    void charge(qcamera_mem_class_t cls, size_t bytes);
+    void uncharge(qcamera_mem_class_t cls, size_t bytes);
+    void admit(size_t bytes);
+    size_t reclaim(size_t bytes);
+    qcamera_mem_pressure_t getPressure();
+    uint8_t adjustBufferCount(size_t bufSize, uint8_t count, uint8_t minCount);
+
+    int32_t addSession(qcamera_mem_reclaim_fn fn, void *data);
+    void removeSession(void *data);
+    void dump(int fd);
+
+private:
+    QCameraMemBudget();
+    virtual ~QCameraMemBudget();
+    QCameraMemBudget(const QCameraMemBudget&);
+    QCameraMemBudget& operator=(const QCameraMemBudget&);
+
+    static size_t readMemInfo(const char *key);
+
+    typedef struct {
+        qcamera_mem_reclaim_fn fn;
+        void *data;
+    } session_t;
+
+    size_t mLimit;
+    size_t mSoftLimit;          // reclaim idle memory above this
+    size_t mMinFree;            // MemAvailable under which pressure is critical
+    size_t mUsed[QCAMERA_MEM_CLASS_MAX];
+    size_t mTotal;
+    size_t mPeak;
+    uint32_t mReclaims;
+    size_t mReclaimedBytes;
+    uint32_t mDegrades;         // buffer counts lowered by adjustBufferCount
+    session_t mSessions[QCAMERA_MEM_MAX_SESSIONS];
+    uint32_t mNumSessions;
+    pthread_mutex_t mLock;
+    pthread_mutex_t mReclaimLock; // keeps sessions alive while reclaiming
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_MEM_BUDGET_H__ */
@@ -27,10 +27,16 @@
 *
 */
 
+#include <stdlib.h>
+#include <string.h>
 #include <utils/Errors.h>
 #include <utils/Log.h>
 #include "QCameraQueue.h"
 
+/* slot array is aligned so that the ring does not share cache lines
+ * with unrelated heap data touched by other threads */
+#define QCAMERA_QUEUE_CACHE_LINE 64
+
 namespace qcamera {
 
 /*===========================================================================
@@ -50,6 +56,7 @@ QCameraQueue::QCameraQueue()
     m_dataFn = NULL;
     m_userData = NULL;
     m_active = true;
+    initRing(0);
 }
 
 /*===========================================================================
@@ -71,6 +78,33 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
     m_dataFn = data_rel_fn;
     m_userData = user_data;
     m_active = true;
+    initRing(0);
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraQueue
+ *
+ * DESCRIPTION: constructor of QCameraQueue running in ring mode. Nodes are
+ *              kept in a preallocated slot array, so enqueue/dequeue do not
+ *              go to the heap allocator.
+ *
+ * PARAMETERS :
+ *   @data_rel_fn : function ptr to release node data internal resource
+ *   @user_data   : user data ptr
+ *   @ringSize    : initial number of slots. 0 falls back to list mode.
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data,
+        uint32_t ringSize)
+{
+    pthread_mutex_init(&m_lock, NULL);
+    cam_list_init(&m_head.list);
+    m_size = 0;
+    m_dataFn = data_rel_fn;
+    m_userData = user_data;
+    m_active = true;
+    initRing(ringSize);
 }
 
 /*===========================================================================
@@ -85,9 +119,113 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
 QCameraQueue::~QCameraQueue()
 {
     flush();
+    if (NULL != m_ring) {
+        free(m_ring);
+        m_ring = NULL;
+    }
     pthread_mutex_destroy(&m_lock);
 }
 
+/*===========================================================================
+ * FUNCTION   : initRing
+ *
+ * DESCRIPTION: preallocate the slot array for ring mode
+ *
+ * PARAMETERS :
+ *   @ringSize : requested number of slots, rounded up to power of 2.
+ *               0 keeps the queue in list mode.
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::initRing(uint32_t ringSize)
+{
+    m_ringMode = false;
+    m_ring = NULL;
+    m_ringSize = 0;
+    m_ringHead = 0;
+
+    if (0 == ringSize) {
+        return;
+    }
+
+    uint32_t size = 1;
+    while (size < ringSize) {
+        size <<= 1;
+    }
+
+    void *ring = NULL;
+    if (0 != posix_memalign(&ring, QCAMERA_QUEUE_CACHE_LINE,
+            size * sizeof(void *))) {
+        ALOGE("%s: No memory for ring of %u slots, using list mode",
+                __func__, size);
+        return;
+    }
+    memset(ring, 0, size * sizeof(void *));
+    m_ring = (void **)ring;
+    m_ringSize = size;
+    m_ringMode = true;
+}
+
+/*===========================================================================
+ * FUNCTION   : growRingLocked
+ *
+ * DESCRIPTION: double the slot array when the ring is full. Elements are
+ *              repacked starting at slot 0. Caller holds m_lock.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- success; false -- no memory
+ *==========================================================================*/
+bool QCameraQueue::growRingLocked()
+{
+    uint32_t newSize = m_ringSize << 1;
+    void *ring = NULL;
+
+    if (0 != posix_memalign(&ring, QCAMERA_QUEUE_CACHE_LINE,
+            newSize * sizeof(void *))) {
+        ALOGE("%s: No memory to grow ring to %u slots", __func__, newSize);
+        return false;
+    }
+
+    void **newRing = (void **)ring;
+    for (uint32_t i = 0; i < (uint32_t)m_size; i++) {
+        newRing[i] = m_ring[ringSlot(i)];
+    }
+    free(m_ring);
+    m_ring = newRing;
+    m_ringSize = newSize;
+    m_ringHead = 0;
+
+    ALOGW("%s: ring full, grown to %u slots", __func__, newSize);
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : removeRingLocked
+ *
+ * DESCRIPTION: remove element at given position from the ring, closing the
+ *              gap towards the tail. Caller holds m_lock.
+ *
+ * PARAMETERS :
+ *   @pos     : position counted from the head, must be less than m_size
+ *
+ * RETURN     : data ptr of the removed element
+ *==========================================================================*/
+void *QCameraQueue::removeRingLocked(uint32_t pos)
+{
+    void *data = m_ring[ringSlot(pos)];
+
+    if (0 == pos) {
+        m_ringHead = ringSlot(1);
+    } else {
+        for (uint32_t i = pos; i + 1 < (uint32_t)m_size; i++) {
+            m_ring[ringSlot(i)] = m_ring[ringSlot(i + 1)];
+        }
+    }
+    m_size--;
+    return data;
+}
+
 /*===========================================================================
  * FUNCTION   : init
  *
@@ -137,6 +275,21 @@ bool QCameraQueue::isEmpty()
 bool QCameraQueue::enqueue(void *data)
 {
     bool rc;
+
+    if (m_ringMode) {
+        pthread_mutex_lock(&m_lock);
+        rc = m_active;
+        if (rc && ((uint32_t)m_size == m_ringSize)) {
+            rc = growRingLocked();
+        }
+        if (rc) {
+            m_ring[ringSlot(m_size)] = data;
+            m_size++;
+        }
+        pthread_mutex_unlock(&m_lock);
+        return rc;
+    }
+
     camera_q_node *node =
         (camera_q_node *)malloc(sizeof(camera_q_node));
     if (NULL == node) {
@@ -174,6 +327,22 @@ bool QCameraQueue::enqueue(void *data)
 bool QCameraQueue::enqueueWithPriority(void *data)
 {
     bool rc;
+
+    if (m_ringMode) {
+        pthread_mutex_lock(&m_lock);
+        rc = m_active;
+        if (rc && ((uint32_t)m_size == m_ringSize)) {
+            rc = growRingLocked();
+        }
+        if (rc) {
+            m_ringHead = (m_ringHead - 1) & (m_ringSize - 1);
+            m_ring[m_ringHead] = data;
+            m_size++;
+        }
+        pthread_mutex_unlock(&m_lock);
+        return rc;
+    }
+
     camera_q_node *node =
         (camera_q_node *)malloc(sizeof(camera_q_node));
     if (NULL == node) {
@@ -221,6 +390,13 @@ void* QCameraQueue::peek()
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        if (m_ringMode) {
+            if (m_size > 0) {
+                data = m_ring[m_ringHead];
+            }
+            pthread_mutex_unlock(&m_lock);
+            return data;
+        }
         head = &m_head.list;
         pos = head->next;
         if (pos != head) {
@@ -256,6 +432,13 @@ void* QCameraQueue::dequeue(bool bFromHead)
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        if (m_ringMode) {
+            if (m_size > 0) {
+                data = removeRingLocked(bFromHead ? 0 : (uint32_t)(m_size - 1));
+            }
+            pthread_mutex_unlock(&m_lock);
+            return data;
+        }
         head = &m_head.list;
         if (bFromHead) {
             pos = head->next;
@@ -301,6 +484,16 @@ void* QCameraQueue::dequeue(match_fn_data match, void *match_data){
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        if (m_ringMode) {
+            for (uint32_t i = 0; i < (uint32_t)m_size; i++) {
+                if (match(m_ring[ringSlot(i)], m_userData, match_data)) {
+                    data = removeRingLocked(i);
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&m_lock);
+            return data;
+        }
         head = &m_head.list;
         pos = head->next;
 
@@ -340,6 +533,18 @@ void QCameraQueue::flush(){
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        if (m_ringMode) {
+            for (uint32_t i = 0; i < (uint32_t)m_size; i++) {
+                void *data = m_ring[ringSlot(i)];
+                if (NULL != data) {
+                    if (m_dataFn) {
+                        m_dataFn(data, m_userData);
+                    }
+                    free(data);
+                }
+            }
+            m_ringHead = 0;
+        }
         head = &m_head.list;
         pos = head->next;
 
@@ -386,6 +591,25 @@ void QCameraQueue::flushNodes(match_fn match){
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        if (m_ringMode) {
+            uint32_t kept = 0;
+            for (uint32_t i = 0; i < (uint32_t)m_size; i++) {
+                void *data = m_ring[ringSlot(i)];
+                if ( match(data, m_userData) ) {
+                    if (NULL != data) {
+                        if (m_dataFn) {
+                            m_dataFn(data, m_userData);
+                        }
+                        free(data);
+                    }
+                } else {
+                    m_ring[ringSlot(kept++)] = data;
+                }
+            }
+            m_size = (int)kept;
+            pthread_mutex_unlock(&m_lock);
+            return;
+        }
         head = &m_head.list;
         pos = head->next;
 
@@ -431,6 +655,25 @@ void QCameraQueue::flushNodes(match_fn_data match, void *match_data){
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        if (m_ringMode) {
+            uint32_t kept = 0;
+            for (uint32_t i = 0; i < (uint32_t)m_size; i++) {
+                void *data = m_ring[ringSlot(i)];
+                if ( match(data, m_userData, match_data) ) {
+                    if (NULL != data) {
+                        if (m_dataFn) {
+                            m_dataFn(data, m_userData);
+                        }
+                        free(data);
+                    }
+                } else {
+                    m_ring[ringSlot(kept++)] = data;
+                }
+            }
+            m_size = (int)kept;
+            pthread_mutex_unlock(&m_lock);
+            return;
+        }
         head = &m_head.list;
         pos = head->next;
 
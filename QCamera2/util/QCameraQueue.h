@@ -31,6 +31,7 @@
 #define __QCAMERA_QUEUE_H__
 
 #include <pthread.h>
+#include <stdint.h>
 #include "cam_list.h"
 
 namespace qcamera {
@@ -39,10 +40,16 @@ typedef bool (*match_fn_data)(void *data, void *user_data, void *match_data);
 typedef void (*release_data_fn)(void* data, void *user_data);
 typedef bool (*match_fn)(void *data, void *user_data);
 
+/* Default slot count for queues running in ring mode. The ring grows on
+ * demand, this only sets the initial preallocation */
+#define QCAMERA_QUEUE_RING_SIZE 32
+
 class QCameraQueue {
 public:
     QCameraQueue();
     QCameraQueue(release_data_fn data_rel_fn, void *user_data);
+    QCameraQueue(release_data_fn data_rel_fn, void *user_data,
+            uint32_t ringSize);
     virtual ~QCameraQueue();
     void init();
     bool enqueue(void *data);
@@ -57,6 +64,7 @@ public:
     void* peek();
     bool isEmpty();
     int getCurrentSize() {return m_size;}
+    bool isRingMode() {return m_ringMode;}
 private:
     typedef struct {
         struct cam_list list;
@@ -69,6 +77,20 @@ private:
     pthread_mutex_t m_lock;
     release_data_fn m_dataFn;
     void * m_userData;
+
+    /* ring mode: nodes live in a preallocated slot array instead of
+     * being malloc'ed per enqueue */
+    void initRing(uint32_t ringSize);
+    bool growRingLocked();
+    void *removeRingLocked(uint32_t pos);
+    inline uint32_t ringSlot(uint32_t pos) {
+        return (m_ringHead + pos) & (m_ringSize - 1);
+    }
+
+    bool m_ringMode;      // set once at construction, read without m_lock
+    void **m_ring;        // slot array, NULL when running in list mode
+    uint32_t m_ringSize;  // slot count, always power of 2
+    uint32_t m_ringHead;  // slot index of the head element
 };
 
 }; // namespace qcamera
@@ -0,0 +1,130 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <string.h>
+#include "QCameraRowCopy.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define QCAMERA_ROW_COPY_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define QCAMERA_ROW_COPY_SSE2
+#endif
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : copyRow
+ *
+ * DESCRIPTION: copy one row, 64 bytes per iteration in vector registers.
+ *              Rows are a few KB at most, so this beats the setup cost
+ *              of a memcpy call per row.
+ *
+ * PARAMETERS :
+ *   @dst     : destination row
+ *   @src     : source row
+ *   @width   : bytes to copy
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static inline void copyRow(uint8_t *dst, const uint8_t *src, size_t width)
+{
+    size_t i = 0;
+#if defined(QCAMERA_ROW_COPY_NEON)
+    for (; i + 64 <= width; i += 64) {
+        uint8x16_t v0 = vld1q_u8(src + i);
+        uint8x16_t v1 = vld1q_u8(src + i + 16);
+        uint8x16_t v2 = vld1q_u8(src + i + 32);
+        uint8x16_t v3 = vld1q_u8(src + i + 48);
+        vst1q_u8(dst + i, v0);
+        vst1q_u8(dst + i + 16, v1);
+        vst1q_u8(dst + i + 32, v2);
+        vst1q_u8(dst + i + 48, v3);
+    }
+    for (; i + 16 <= width; i += 16) {
+        vst1q_u8(dst + i, vld1q_u8(src + i));
+    }
+#elif defined(QCAMERA_ROW_COPY_SSE2)
+    for (; i + 64 <= width; i += 64) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(src + i + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(src + i + 48));
+        _mm_storeu_si128((__m128i *)(dst + i), v0);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), v1);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), v2);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), v3);
+    }
+    for (; i + 16 <= width; i += 16) {
+        _mm_storeu_si128((__m128i *)(dst + i),
+                _mm_loadu_si128((const __m128i *)(src + i)));
+    }
+#endif
+    if (i < width) {
+        memcpy(dst + i, src + i, width - i);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : copyRows
+ *
+ * DESCRIPTION: copy a plane row by row between buffers of different
+ *              strides. Planes without padding go in a single memcpy.
+ *
+ * PARAMETERS :
+ *   @dst       : destination plane
+ *   @dstStride : destination stride in bytes
+ *   @src       : source plane
+ *   @srcStride : source stride in bytes
+ *   @width     : bytes to copy per row
+ *   @rows      : number of rows
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void copyRows(uint8_t *dst, size_t dstStride, const uint8_t *src,
+        size_t srcStride, size_t width, size_t rows)
+{
+    if ((dstStride == width) && (srcStride == width)) {
+        memcpy(dst, src, width * rows);
+        return;
+    }
+
+    for (size_t r = 0; r < rows; r++) {
+        if (r + 1 < rows) {
+            // the stride jump defeats the hardware prefetcher
+            __builtin_prefetch(src + srcStride);
+        }
+        copyRow(dst, src, width);
+        dst += dstStride;
+        src += srcStride;
+    }
+}
+
+}; // namespace qcamera
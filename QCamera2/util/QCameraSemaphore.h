@@ -0,0 +1,115 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_SEMAPHORE_FUTEX_H__
+#define __QCAMERA_SEMAPHORE_FUTEX_H__
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace qcamera {
+
+/* Counting semaphore on a futex word. post() and an uncontended wait()
+ * never enter the kernel, and only a post that finds a sleeping waiter
+ * issues FUTEX_WAKE. waitAll() takes every pending count in one go so
+ * that a burst of posts costs the consumer a single wakeup. */
+class QCameraSemaphore {
+public:
+    QCameraSemaphore(int32_t val = 0) : mVal(val), mWaiters(0) {}
+
+    /* returns the count before this post */
+    inline int32_t post() {
+        int32_t prev = __atomic_fetch_add(&mVal, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&mWaiters, __ATOMIC_SEQ_CST) > 0) {
+            futexWake();
+        }
+        return prev;
+    }
+
+    /* take one count, block while there is none */
+    inline int wait() {
+        while (true) {
+            int32_t val = __atomic_load_n(&mVal, __ATOMIC_SEQ_CST);
+            while (val > 0) {
+                if (__atomic_compare_exchange_n(&mVal, &val, val - 1, false,
+                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                    return 0;
+                }
+            }
+            if (futexWait() != 0) {
+                return -1;
+            }
+        }
+    }
+
+    /* take all pending counts, block while there is none.
+     * Returns the number of counts taken, or -1 on error */
+    inline int32_t waitAll() {
+        while (true) {
+            int32_t val = __atomic_exchange_n(&mVal, 0, __ATOMIC_SEQ_CST);
+            if (val > 0) {
+                return val;
+            }
+            if (futexWait() != 0) {
+                return -1;
+            }
+        }
+    }
+
+    inline int32_t getValue() {
+        return __atomic_load_n(&mVal, __ATOMIC_SEQ_CST);
+    }
+
+private:
+    inline int futexWait() {
+        int rc;
+        __atomic_fetch_add(&mWaiters, 1, __ATOMIC_SEQ_CST);
+        rc = (int)syscall(__NR_futex, &mVal, FUTEX_WAIT_PRIVATE, 0,
+                NULL, NULL, 0);
+        __atomic_fetch_sub(&mWaiters, 1, __ATOMIC_SEQ_CST);
+        if ((rc != 0) && (errno != EAGAIN) && (errno != EINTR)) {
+            return rc;
+        }
+        return 0;
+    }
+
+    inline void futexWake() {
+        syscall(__NR_futex, &mVal, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+
+    int32_t mVal;
+    int32_t mWaiters;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_SEMAPHORE_FUTEX_H__ */
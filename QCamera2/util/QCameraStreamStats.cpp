@@ -0,0 +1,79 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include "QCameraStreamStats.h"
+
+namespace qcamera {
+
+static const char *kLatStageNames[MM_CAMERA_LAT_MAX] = {
+    "sensor->dq",
+    "dq->match",
+    "dq->hal cb",
+    "dq->consume",
+    "dq->done",
+    "jitter",
+};
+
+/*===========================================================================
+ * FUNCTION   : dumpStreamStats
+ *
+ * DESCRIPTION: print latency stats of a stream in dumpsys format
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to write to
+ *   @type    : stream type
+ *   @handle  : stream handle
+ *   @stats   : stats read through get_stream_stats
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void dumpStreamStats(int fd, cam_stream_type_t type, uint32_t handle,
+        const mm_camera_stream_stats_t &stats)
+{
+    dprintf(fd, "\n Stream type %d handle 0x%x: frames %u drops %u\n",
+            type, handle, stats.frames, stats.drops);
+    dprintf(fd, " %-12s | %8s | %8s | %8s | %8s | %8s | %8s\n",
+            "stage (us)", "count", "avg", "p50", "p90", "p99", "max");
+    for (int i = 0; i < MM_CAMERA_LAT_MAX; i++) {
+        const cam_hist_t *hist = &stats.hist[i];
+        if (0 == hist->count) {
+            continue;
+        }
+        dprintf(fd, " %-12s | %8u | %8llu | %8u | %8u | %8u | %8u\n",
+                kLatStageNames[i], hist->count,
+                (unsigned long long)(hist->sum / hist->count),
+                cam_hist_percentile(hist, 500),
+                cam_hist_percentile(hist, 900),
+                cam_hist_percentile(hist, 990),
+                hist->max);
+    }
+}
+
+}; // namespace qcamera
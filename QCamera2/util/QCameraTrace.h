@@ -22,6 +22,7 @@
 
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 #include <utils/Trace.h>
+#include "mm_camera_trace.h"
 
 #undef ATRACE_CALL
 #undef ATRACE_NAME
@@ -39,23 +40,27 @@
 if (gKpiDebugLevel >= KPI_ONLY) { \
      atrace_begin(ATRACE_TAG, name); \
 }\
+MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_BEGIN, name, 0, 0); \
 })
 
 #define KPI_ATRACE_END() ({\
 if (gKpiDebugLevel >= KPI_ONLY) { \
      atrace_end(ATRACE_TAG); \
 }\
+MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_END, NULL, 0, 0); \
 })
 
 #define KPI_ATRACE_INT(name,val) ({\
 if (gKpiDebugLevel >= KPI_ONLY) { \
      atrace_int(ATRACE_TAG, name, val); \
 }\
+MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_COUNTER, name, 0, val); \
 })
 
 
 #define ATRACE_BEGIN_SNPRINTF(fmt_str, ...) \
- if (gKpiDebugLevel >= KPI_DBG) { \
+ if ((gKpiDebugLevel >= KPI_DBG) || \
+         (gMmCameraTraceLevel >= MM_CAMERA_TRACE_DBG)) { \
    char trace_tag[CAMERA_TRACE_BUF]; \
    snprintf(trace_tag, CAMERA_TRACE_BUF, fmt_str, ##__VA_ARGS__); \
    ATRACE_BEGIN(trace_tag); \
@@ -65,18 +70,21 @@ if (gKpiDebugLevel >= KPI_ONLY) { \
 if (gKpiDebugLevel >= KPI_DBG) { \
      atrace_begin(ATRACE_TAG, name); \
 }\
+MM_CAMERA_TRACE(MM_CAMERA_TRACE_DBG, MM_CAMERA_TRACE_PH_BEGIN, name, 0, 0); \
 })
 
 #define ATRACE_END_DBG() ({\
 if (gKpiDebugLevel >= KPI_DBG) { \
      atrace_end(ATRACE_TAG); \
 }\
+MM_CAMERA_TRACE(MM_CAMERA_TRACE_DBG, MM_CAMERA_TRACE_PH_END, NULL, 0, 0); \
 })
 
 #define ATRACE_INT_DBG(name,val) ({\
 if (gKpiDebugLevel >= KPI_DBG) { \
      atrace_int(ATRACE_TAG, name, val); \
 }\
+MM_CAMERA_TRACE(MM_CAMERA_TRACE_DBG, MM_CAMERA_TRACE_PH_COUNTER, name, 0, val); \
 })
 
 #define ATRACE_BEGIN ATRACE_BEGIN_DBG
@@ -97,12 +105,14 @@ public:
         if (gKpiDebugLevel >= KPI_ONLY) {
             atrace_begin(mTag,name);
         }
+        MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_BEGIN, name, 0, 0);
     }
 
     inline ~ScopedTraceKpi() {
         if (gKpiDebugLevel >= KPI_ONLY) {
             atrace_end(mTag);
         }
+        MM_CAMERA_TRACE(MM_CAMERA_TRACE_KPI, MM_CAMERA_TRACE_PH_END, NULL, 0, 0);
     }
 
     private:
@@ -116,12 +126,14 @@ public:
         if (gKpiDebugLevel >= KPI_DBG) {
             atrace_begin(mTag,name);
         }
+        MM_CAMERA_TRACE(MM_CAMERA_TRACE_DBG, MM_CAMERA_TRACE_PH_BEGIN, name, 0, 0);
     }
 
     inline ~ScopedTraceDbg() {
         if (gKpiDebugLevel >= KPI_DBG) {
             atrace_end(mTag);
         }
+        MM_CAMERA_TRACE(MM_CAMERA_TRACE_DBG, MM_CAMERA_TRACE_PH_END, NULL, 0, 0);
     }
 
     private: